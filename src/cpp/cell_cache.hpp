@@ -0,0 +1,100 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "nd_types.hpp"
+
+// CellCache: formatted cell text for one table widget. get_datum formats
+// ints, doubles, timestamps and decimals on every call, and render_table
+// used to call it for every visible cell on every frame, reformatting
+// values that don't change once a BatchResponse has landed. Here the
+// rows around the clipper's DisplayStart..DisplayEnd are formatted once
+// into a char arena, and render_table draws each cell as a span of it.
+// Scrolling within the prefetch margin costs nothing. The cache is
+// dropped when the bulk cache's result epoch, the handle or the table's
+// geometry changes, which covers a new QueryResult, eviction and more
+// chunks streaming in, or when the table's sort order changes. Rows
+// appended under an unchanged order leave the formatted rows valid, so
+// the cache just grows.
+
+struct CellCache {
+    static constexpr uint32_t prefetch_rows{ 64 };
+
+    RSHandle                handle{ 0 };
+    uint32_t                epoch{ 0 };
+    uint32_t                col_count{ 0 };
+    uint32_t                row_count{ 0 };
+    uint32_t                order{ 0 };     // TableSort::order, 0 if never sorted
+    // formatted window: rows [first_row, end_row)
+    uint32_t                first_row{ 0 };
+    uint32_t                end_row{ 0 };
+    std::vector<char>       arena;
+    // cell (row, col) is arena[offsets[i], offsets[i+1]) where
+    // i = (row - first_row) * col_count + col
+    std::vector<uint32_t>   offsets;
+    uint32_t                fill_count{ 0 };    // windows formatted, for tests and pix
+
+    bool matches(RSHandle h, uint32_t e, uint32_t cols, uint32_t rows, uint32_t ord = 0) const {
+        return handle == h && epoch == e && col_count == cols && row_count == rows && order == ord;
+    }
+
+    bool grows(RSHandle h, uint32_t e, uint32_t cols, uint32_t rows, uint32_t ord = 0) const {
+        return handle == h && epoch == e && col_count == cols && row_count < rows && order == ord;
+    }
+
+    void reset(RSHandle h, uint32_t e, uint32_t cols, uint32_t rows, uint32_t ord = 0) {
+        handle = h;
+        epoch = e;
+        col_count = cols;
+        row_count = rows;
+        order = ord;
+        first_row = end_row = 0;
+        arena.clear();
+        offsets.clear();
+    }
+
+    bool covers(uint32_t begin, uint32_t end) const {
+        return begin >= first_row && end <= end_row;
+    }
+
+    // Format rows [begin, end) plus prefetch_rows either side. get_datum
+    // leaves the text at bulk.buffer, and returns its end, or nullptr if
+    // the text is zero terminated. perm maps display rows to result rows
+    // when the table is sorted.
+    template <typename DB>
+    void fill(DB& bulk, uint32_t begin, uint32_t end, const uint32_t* perm = nullptr) {
+        first_row = begin > prefetch_rows ? begin - prefetch_rows : 0;
+        end_row = std::min(end + prefetch_rows, row_count);
+        arena.clear();
+        offsets.clear();
+        if (end_row <= first_row) {
+            end_row = first_row;
+            return;
+        }
+        size_t cell_count = static_cast<size_t>(end_row - first_row) * col_count;
+        offsets.reserve(cell_count + 1);
+        // non empty, so arena.data() is never null for TextUnformatted
+        arena.reserve(cell_count * 8 + 1);
+        for (uint32_t row_inx = first_row; row_inx < end_row; row_inx++) {
+            uint32_t data_row = perm ? perm[row_inx] : row_inx;
+            for (uint32_t col_inx = 0; col_inx < col_count; col_inx++) {
+                const char* endchar = bulk.get_datum(handle, col_inx, data_row);
+                const char* text = bulk.buffer;
+                size_t len = endchar ? endchar - text : strlen(text);
+                offsets.push_back(static_cast<uint32_t>(arena.size()));
+                arena.insert(arena.end(), text, text + len);
+            }
+        }
+        offsets.push_back(static_cast<uint32_t>(arena.size()));
+        fill_count++;
+    }
+
+    // Caller has checked covers(row, row + 1)
+    const char* cell(uint32_t row_inx, uint32_t col_inx, const char*& end) const {
+        size_t cell_inx = static_cast<size_t>(row_inx - first_row) * col_count + col_inx;
+        const char* base = arena.data();
+        end = base + offsets[cell_inx + 1];
+        return base + offsets[cell_inx];
+    }
+};
@@ -0,0 +1,181 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "simd_kernels.hpp"
+
+// ChunkArena: WebDuckDBCache's memory for the chunks batch_materializer
+// fills. get_chunk_cpp used to new a zeroed buffer per Arrow batch, so a
+// BatchRequest churned the heap, and with ALLOW_MEMORY_GROWTH a heap
+// resize could stall it. Here blocks come in quarter power of two size
+// classes, carved from an arena reserved once at startup, or from the heap
+// once the arena is used up. Either way a freed block goes onto its
+// class's free list for the next batch, and is never handed back to the
+// heap. Blocks are owned by the query_id whose result they hold, and chain
+// per class, so release splices a whole result onto the free lists with
+// one link per class it used. Blocks aren't zeroed, as the materializer
+// writes every word that's read. Chunks over the biggest class are plain
+// heap allocations, freed on release.
+
+class ChunkArena {
+public:
+    // block sizes, header included, from 1 KiB to 16 MiB in quarter
+    // power of two steps, so a chunk wastes under a fifth of its block
+    static constexpr uint32_t min_shift{ 10 };
+    static constexpr uint32_t max_shift{ 24 };
+    static constexpr uint32_t class_count{ (max_shift - min_shift) * 4 + 1 };
+    static constexpr uint32_t large_class{ class_count };
+    // keeps payloads 8 byte aligned for batch_materializer's 64 bit views
+    static constexpr uint32_t header_bytes{ 16 };
+
+    // reserved: the arena plus heap blocks, in_use: blocks that hold a
+    // chunk, free: reserved blocks waiting on a free list or not yet carved
+    uint64_t    reserved_bytes{ 0 };
+    uint64_t    in_use_bytes{ 0 };
+    uint64_t    free_bytes() const { return reserved_bytes - in_use_bytes; }
+
+    ChunkArena() = default;
+    ChunkArena(const ChunkArena&) = delete;
+    ChunkArena& operator=(const ChunkArena&) = delete;
+
+    ~ChunkArena() {
+        for (auto& owned_pair : owners)
+            free_large(owned_pair.second);
+    }
+
+    static uint32_t class_bytes(uint32_t size_class) {
+        return (4 + (size_class & 3)) << (min_shift - 2 + (size_class >> 2));
+    }
+
+    // Smallest class whose blocks hold bytes of payload, or large_class
+    static uint32_t size_class(uint64_t bytes) {
+        for (uint32_t size_class = 0; size_class < class_count; size_class++) {
+            if (bytes + header_bytes <= class_bytes(size_class))
+                return size_class;
+        }
+        return large_class;
+    }
+
+    // Once, at startup, so steady state batches don't grow the heap
+    void reserve(uint64_t bytes) {
+        if (arena || bytes == 0)
+            return;
+        arena_size = bytes & ~uint64_t(7);
+        arena.reset(new uint64_t[arena_size / 8]);
+        reserved_bytes += arena_size;
+    }
+
+    // 8 byte aligned, uninitialised storage for bytes, owned by owner
+    char* alloc(const std::string& owner, uint64_t bytes) {
+        Owned& owned{ owners[owner] };
+        uint32_t size_class = ChunkArena::size_class(bytes);
+        Block* block{ nullptr };
+        if (size_class == large_class) {
+            uint64_t block_bytes = (bytes + header_bytes + 7) & ~uint64_t(7);
+            block = reinterpret_cast<Block*>(new uint64_t[block_bytes / 8]);
+            block->size_class = large_class;
+            block->bytes = block_bytes;
+            block->next = owned.large;
+            owned.large = block;
+            reserved_bytes += block_bytes;
+            in_use_bytes += block_bytes;
+            return reinterpret_cast<char*>(block) + header_bytes;
+        }
+        uint32_t block_bytes = class_bytes(size_class);
+        if (free_lists[size_class]) {
+            block = free_lists[size_class];
+            free_lists[size_class] = block->next;
+        }
+        else if (arena_used + block_bytes <= arena_size) {
+            block = reinterpret_cast<Block*>(reinterpret_cast<char*>(arena.get()) + arena_used);
+            arena_used += block_bytes;
+        }
+        else {
+            grown.emplace_back(new uint64_t[block_bytes / 8]);
+            block = reinterpret_cast<Block*>(grown.back().get());
+            reserved_bytes += block_bytes;
+        }
+        block->size_class = size_class;
+        block->bytes = block_bytes;
+        // owned lists are appended at the tail, so release can splice
+        block->next = nullptr;
+        if (owned.tails[size_class])
+            owned.tails[size_class]->next = block;
+        else
+            owned.heads[size_class] = block;
+        owned.tails[size_class] = block;
+        owned.class_mask |= uint64_t(1) << size_class;
+        owned.bytes += block_bytes;
+        in_use_bytes += block_bytes;
+        return reinterpret_cast<char*>(block) + header_bytes;
+    }
+
+    // All of owner's blocks go back, whatever the chunk count
+    void release(const std::string& owner) {
+        auto owned_iter = owners.find(owner);
+        if (owned_iter == owners.end())
+            return;
+        Owned& owned{ owned_iter->second };
+        for (uint64_t mask = owned.class_mask; mask; mask &= mask - 1) {
+            uint32_t size_class = simd_ctz(mask);
+            owned.tails[size_class]->next = free_lists[size_class];
+            free_lists[size_class] = owned.heads[size_class];
+        }
+        in_use_bytes -= owned.bytes;
+        free_large(owned);
+        owners.erase(owned_iter);
+    }
+
+    // from's blocks pass to to, releasing what to held: a requery's
+    // chunks, built aside, replace the result they supersede
+    void transfer(const std::string& from, const std::string& to) {
+        auto owned_iter = owners.find(from);
+        if (owned_iter == owners.end() || from == to)
+            return;
+        Owned owned{ owned_iter->second };
+        owners.erase(owned_iter);
+        release(to);
+        owners[to] = owned;
+    }
+
+    uint64_t owned_bytes(const std::string& owner) const {
+        auto owned_iter = owners.find(owner);
+        return owned_iter == owners.end() ? 0 : owned_iter->second.bytes;
+    }
+
+private:
+    struct Block {
+        Block*      next{ nullptr };
+        uint32_t    size_class{ 0 };
+        uint32_t    bytes{ 0 };
+    };
+    static_assert(sizeof(Block) <= header_bytes, "Block header outgrows header_bytes");
+    static_assert(class_count <= 64, "Owned::class_mask has a bit per class");
+
+    struct Owned {
+        Block*      heads[class_count]{};
+        Block*      tails[class_count]{};
+        uint64_t    class_mask{ 0 };
+        Block*      large{ nullptr };
+        uint64_t    bytes{ 0 };     // in size classes
+    };
+
+    std::unique_ptr<uint64_t[]>         arena;
+    uint64_t                            arena_size{ 0 };
+    uint64_t                            arena_used{ 0 };    // carved so far
+    std::vector<std::unique_ptr<uint64_t[]>> grown;         // classed blocks past the arena
+    Block*                              free_lists[class_count]{};
+    std::unordered_map<std::string, Owned> owners;
+
+    void free_large(Owned& owned) {
+        while (owned.large) {
+            Block* block{ owned.large };
+            owned.large = block->next;
+            reserved_bytes -= block->bytes;
+            in_use_bytes -= block->bytes;
+            delete[] reinterpret_cast<uint64_t*>(block);
+        }
+    }
+};
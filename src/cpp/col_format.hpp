@@ -0,0 +1,369 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fmt/format.h>
+#include "nd_types.hpp"
+
+// ColFormatter: how one column's cells become text in get_datum. Both
+// bulk caches compile one per column in get_meta_data, from the column
+// type and any col_formats cspec, so the per cell work is the formatting
+// itself. get_datum used to recompute DECIMAL width, scale and pow(10)
+// then sprintf a format string and the value for every cell, and ran
+// chrono's {:%F %T} for every timestamp.
+//  DECIMAL:    exact, from the scaled integer, so 0.1 shows as 0.1 rather
+//              than the nearest double
+//  timestamp:  the "YYYY-MM-DD " prefix is cached for runs of same day
+//              rows, which is most of a tick table
+//  double:     shortest round trip unless a precision is given
+//
+// col_formats cspec: "name:spec;name:spec", with * for every column.
+// spec is printf like: ' groups thousands, .N is the precision, D shows
+// just the date of a timestamp, T just the time. So
+// "Price:'.2;Time:T" shows Price as 1,234.50 and Time as 07:00:01.250.
+
+struct ColFormatSpec {
+    int32_t     precision{ -1 };    // -1: the type's own
+    bool        thousands{ false };
+    bool        date_only{ false };
+    bool        time_only{ false };
+};
+
+// Specs for col_names from a col_formats cspec. Unnamed columns take
+// the * spec if there is one.
+inline std::vector<ColFormatSpec> parse_col_formats(const char* col_formats, const StringVec& col_names) {
+    std::vector<ColFormatSpec> specs(col_names.size());
+    if (col_formats == nullptr)
+        return specs;
+    std::string text(col_formats);
+    std::vector<bool> named(col_names.size(), false);
+    size_t begin{ 0 };
+    while (begin < text.size()) {
+        size_t end = text.find(';', begin);
+        if (end == std::string::npos)
+            end = text.size();
+        std::string entry{ text.substr(begin, end - begin) };
+        begin = end + 1;
+        size_t colon = entry.rfind(':');
+        if (colon == std::string::npos)
+            continue;
+        ColFormatSpec spec;
+        for (size_t inx = colon + 1; inx < entry.size(); inx++) {
+            switch (entry[inx]) {
+            case '\'':  spec.thousands = true; break;
+            case 'D':   spec.date_only = true; break;
+            case 'T':   spec.time_only = true; break;
+            case '.':
+                spec.precision = 0;
+                while (inx + 1 < entry.size() && entry[inx + 1] >= '0' && entry[inx + 1] <= '9')
+                    spec.precision = spec.precision * 10 + (entry[++inx] - '0');
+                break;
+            default:    break;
+            }
+        }
+        std::string name{ entry.substr(0, colon) };
+        for (size_t col = 0; col < col_names.size(); col++) {
+            if (name == col_names[col]) {
+                specs[col] = spec;
+                named[col] = true;
+            }
+            else if (name == "*" && !named[col]) {
+                specs[col] = spec;
+            }
+        }
+    }
+    return specs;
+}
+
+enum ColFormatKind : uint8_t {
+    cfkNone = 0,
+    cfkInt,
+    cfkDouble,
+    cfkDecimal,
+    cfkTimestamp,
+    cfkDate,
+    cfkBool
+};
+
+struct ColFormatter {
+    static constexpr int DIGITS_LEN{ 48 };  // 128 bit magnitudes have 39
+
+    ColFormatKind   kind{ cfkNone };
+    ColFormatSpec   spec;
+    int32_t         storage{ 0 };           // backend's physical type, eg a DECIMAL's duckdb_type
+    uint8_t         scale{ 0 };             // DECIMAL
+    int64_t         ticks_per_sec{ 1 };     // timestamp
+    int32_t         frac_digits{ 0 };       // timestamp: 0, 3, 6 or 9
+    // timestamp: last day formatted, and its "YYYY-MM-DD "
+    int64_t         cached_day{ INT64_MIN };
+    char            day_text[12]{};
+
+    ColFormatter() = default;
+
+    ColFormatter(ColFormatKind k, const ColFormatSpec& s) : kind(k), spec(s) {}
+
+    static ColFormatter decimal(uint8_t decimal_scale, const ColFormatSpec& s) {
+        ColFormatter fmtr(cfkDecimal, s);
+        fmtr.scale = decimal_scale;
+        return fmtr;
+    }
+
+    // ticks_per_second 1, 1e3, 1e6 or 1e9, which also sets the fraction
+    // digits, as chrono's %T did
+    static ColFormatter timestamp(int64_t ticks_per_second, const ColFormatSpec& s) {
+        ColFormatter fmtr(cfkTimestamp, s);
+        fmtr.ticks_per_sec = ticks_per_second;
+        for (int64_t ticks = ticks_per_second; ticks > 1; ticks /= 10)
+            fmtr.frac_digits++;
+        if (s.precision >= 0 && s.precision < fmtr.frac_digits)
+            fmtr.frac_digits = s.precision;
+        return fmtr;
+    }
+
+    // Each format_ method writes a zero terminated string at out, which
+    // has STR_BUF_LEN chars, and returns the terminator's address
+
+    char* format_int(int64_t val, char* out) const {
+        char digits[DIGITS_LEN];
+        int count = u64_digits(magnitude(val), digits);
+        return emit_fixed(val < 0, digits, count, 0, 0, out);
+    }
+
+    char* format_decimal(int64_t val, char* out) const {
+        char digits[DIGITS_LEN];
+        int count = u64_digits(magnitude(val), digits);
+        return emit_fixed(val < 0, digits, count, scale, spec.precision < 0 ? scale : spec.precision, out);
+    }
+
+    // HUGEINT DECIMALs, as two's complement halves
+    char* format_decimal(uint64_t lower, int64_t upper, char* out) const {
+        bool negative = upper < 0;
+        uint64_t hi = static_cast<uint64_t>(upper);
+        uint64_t lo = lower;
+        if (negative) {
+            lo = ~lo + 1;
+            hi = ~hi + (lo == 0 ? 1 : 0);
+        }
+        // long division by 10 over 32 bit limbs, most significant first
+        uint32_t limbs[4]{ static_cast<uint32_t>(hi >> 32), static_cast<uint32_t>(hi),
+                            static_cast<uint32_t>(lo >> 32), static_cast<uint32_t>(lo) };
+        char digits[DIGITS_LEN];
+        int count{ 0 };
+        do {
+            uint64_t rem{ 0 };
+            bool zero{ true };
+            for (uint32_t& limb : limbs) {
+                uint64_t cur = (rem << 32) | limb;
+                limb = static_cast<uint32_t>(cur / 10);
+                rem = cur % 10;
+                zero = zero && limb == 0;
+            }
+            digits[count++] = static_cast<char>('0' + rem);
+            if (zero)
+                break;
+        } while (count < DIGITS_LEN);
+        return emit_fixed(negative, digits, count, scale, spec.precision < 0 ? scale : spec.precision, out);
+    }
+
+    char* format_double(double val, char* out) const {
+        fmt::format_to_n_result<char*> result = spec.precision < 0 ?
+            fmt::format_to_n(out, STR_BUF_LEN - 1, "{}", val) :
+            fmt::format_to_n(out, STR_BUF_LEN - 1, "{:.{}f}", val, spec.precision);
+        char* end = result.out;
+        *end = 0;
+        if (spec.thousands && std::strpbrk(out, "eEn") == nullptr)
+            end = group_in_place(out, end);
+        return end;
+    }
+
+    char* format_timestamp(int64_t ticks, char* out) {
+        int64_t secs = floor_div(ticks, ticks_per_sec);
+        int64_t frac = ticks - secs * ticks_per_sec;
+        int64_t day = floor_div(secs, 86400);
+        int64_t sod = secs - day * 86400;
+        char* pos = out;
+        if (!spec.time_only) {
+            if (day != cached_day) {
+                civil_text(day, day_text);
+                day_text[10] = ' ';
+                cached_day = day;
+            }
+            memcpy(pos, day_text, 10);
+            pos += 10;
+            if (spec.date_only) {
+                *pos = 0;
+                return pos;
+            }
+            *pos++ = ' ';
+        }
+        pos = two_digits(pos, static_cast<int>(sod / 3600));
+        *pos++ = ':';
+        pos = two_digits(pos, static_cast<int>(sod / 60 % 60));
+        *pos++ = ':';
+        pos = two_digits(pos, static_cast<int>(sod % 60));
+        if (frac_digits > 0) {
+            *pos++ = '.';
+            // leading frac_digits of the full fraction, truncated
+            char frac_text[16];
+            int full_digits{ 0 };
+            for (int64_t t = ticks_per_sec; t > 1; t /= 10)
+                full_digits++;
+            for (int inx = full_digits - 1; inx >= 0; inx--) {
+                frac_text[inx] = static_cast<char>('0' + frac % 10);
+                frac /= 10;
+            }
+            memcpy(pos, frac_text, frac_digits);
+            pos += frac_digits;
+        }
+        *pos = 0;
+        return pos;
+    }
+
+    char* format_date(int32_t days, char* out) const {
+        civil_text(days, out);
+        out[10] = 0;
+        return out + 10;
+    }
+
+    char* format_bool(bool val, char* out) const {
+        const char* text = val ? "true" : "false";
+        size_t len = strlen(text);
+        memcpy(out, text, len + 1);
+        return out + len;
+    }
+
+private:
+    static uint64_t magnitude(int64_t val) {
+        return val < 0 ? ~static_cast<uint64_t>(val) + 1 : static_cast<uint64_t>(val);
+    }
+
+    // least significant first
+    static int u64_digits(uint64_t mag, char* digits) {
+        int count{ 0 };
+        do {
+            digits[count++] = static_cast<char>('0' + mag % 10);
+            mag /= 10;
+        } while (mag != 0);
+        return count;
+    }
+
+    static int64_t floor_div(int64_t num, int64_t den) {
+        int64_t quot = num / den;
+        return (num % den != 0 && (num < 0) != (den < 0)) ? quot - 1 : quot;
+    }
+
+    static char* two_digits(char* pos, int val) {
+        *pos++ = static_cast<char>('0' + val / 10);
+        *pos++ = static_cast<char>('0' + val % 10);
+        return pos;
+    }
+
+    // "YYYY-MM-DD" for days since 1970-01-01: H. Hinnant's civil_from_days
+    static void civil_text(int64_t days, char* out) {
+        days += 719468;
+        int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+        uint32_t doe = static_cast<uint32_t>(days - era * 146097);
+        uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        int64_t year = static_cast<int64_t>(yoe) + era * 400;
+        uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        uint32_t mp = (5 * doy + 2) / 153;
+        uint32_t day = doy - (153 * mp + 2) / 5 + 1;
+        uint32_t month = mp < 10 ? mp + 3 : mp - 9;
+        year += month <= 2 ? 1 : 0;
+        uint64_t y = static_cast<uint64_t>(year < 0 ? 0 : year) % 10000;
+        out[0] = static_cast<char>('0' + y / 1000);
+        out[1] = static_cast<char>('0' + y / 100 % 10);
+        out[2] = static_cast<char>('0' + y / 10 % 10);
+        out[3] = static_cast<char>('0' + y % 10);
+        out[4] = '-';
+        two_digits(out + 5, static_cast<int>(month));
+        out[7] = '-';
+        two_digits(out + 8, static_cast<int>(day));
+    }
+
+    // The value digits / 10^digit_scale, least significant digit first,
+    // printed with precision fraction digits, rounding half away from
+    // zero when precision < digit_scale
+    char* emit_fixed(bool negative, char* digits, int count, int digit_scale, int precision, char* out) const {
+        if (precision < digit_scale) {
+            int drop = digit_scale - precision;
+            bool round_up = drop <= count && digits[drop - 1] >= '5';
+            if (drop >= count) {
+                count = 1;
+                digits[0] = '0';
+            }
+            else {
+                memmove(digits, digits + drop, count - drop);
+                count -= drop;
+            }
+            for (int inx = 0; round_up && inx <= count; inx++) {
+                if (inx == count)
+                    digits[count++] = '0';
+                round_up = digits[inx] == '9';
+                digits[inx] = round_up ? '0' : static_cast<char>(digits[inx] + 1);
+            }
+            digit_scale = precision;
+        }
+        // pad so there's a digit before the point
+        while (count <= digit_scale)
+            digits[count++] = '0';
+        bool zero{ true };
+        for (int inx = 0; inx < count && zero; inx++)
+            zero = digits[inx] == '0';
+        char* pos = out;
+        if (negative && !zero)
+            *pos++ = '-';
+        for (int inx = count - 1; inx >= digit_scale; inx--) {
+            *pos++ = digits[inx];
+            int left = inx - digit_scale;
+            if (spec.thousands && left > 0 && left % 3 == 0)
+                *pos++ = ',';
+        }
+        if (precision > 0) {
+            *pos++ = '.';
+            for (int inx = digit_scale - 1; inx >= 0; inx--)
+                *pos++ = digits[inx];
+            for (int inx = digit_scale; inx < precision; inx++)
+                *pos++ = '0';
+        }
+        *pos = 0;
+        return pos;
+    }
+
+    // insert , every three digits of the integer part of the number at
+    // [begin, end), working back from the end so nothing is overwritten
+    static char* group_in_place(char* begin, char* end) {
+        char* digits = begin + (*begin == '-' ? 1 : 0);
+        char* point = static_cast<char*>(memchr(digits, '.', end - digits));
+        char* int_end = point ? point : end;
+        int int_len = static_cast<int>(int_end - digits);
+        int commas = (int_len - 1) / 3;
+        if (commas <= 0 || (end - begin) + commas >= STR_BUF_LEN)
+            return end;
+        char* new_end = end + commas;
+        *new_end = 0;
+        char* src = end - 1;
+        char* dst = new_end - 1;
+        while (src >= int_end)
+            *dst-- = *src--;
+        for (int count = 1; src >= digits; count++) {
+            *dst-- = *src--;
+            if (count % 3 == 0 && src >= digits)
+                *dst-- = ',';
+        }
+        return new_end;
+    }
+};
+
+// One result set's formatters, and the col_formats cspec they were
+// compiled for. A null col_formats, as from the summary modal and the
+// memory editor, takes whatever the table compiled.
+struct ColFormats {
+    std::string                 cspec;
+    std::vector<ColFormatter>   cols;
+
+    bool matches(const char* col_formats, size_t col_count) const {
+        return cols.size() == col_count && (col_formats == nullptr || cspec == col_formats);
+    }
+};
@@ -60,7 +60,8 @@ public:
     bool get_nested_str_map(const char* key, StringStringMap& ssmap) {
         if (JContains(config, key)) {
             StringVec svec;
-            JSON& db_config{ config[key] };
+            // const ref: emscripten::val::operator[] returns by value
+            const JSON& db_config{ config[key] };
             JKeys(db_config, svec);
             ssmap.clear();
             for (auto it = svec.begin(); it != svec.end(); ++it) {
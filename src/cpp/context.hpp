@@ -9,6 +9,9 @@
 #include "ufuncs.hpp"
 #include "widgets.hpp"
 #include "db_cache.hpp"
+#include "cell_cache.hpp"
+#include "lod_pyramid.hpp"
+#include "table_sort.hpp"
 #include "dl_cache.hpp"
 #include "logger.hpp"
 #include "ems_idb.hpp"
@@ -43,6 +46,31 @@ EM_JS(void, exec_js_action_sync, (int raw_fn_inx, emscripten::EM_VAL data_handle
 
 #endif
 
+// ImPlot getters for render_shaded_plot: user_data is an XYSeries, and
+// idx counts from its offset. The ref getter gives the fill's lower edge.
+inline ImPlotPoint xy_series_getter(int idx, void* user_data) {
+    XYSeries* series = static_cast<XYSeries*>(user_data);
+    uint32_t row = series->offset + static_cast<uint32_t>(idx);
+    return ImPlotPoint(series->x.at(row), series->y.at(row));
+}
+
+inline ImPlotPoint xy_series_ref_getter(int idx, void* user_data) {
+    XYSeries* series = static_cast<XYSeries*>(user_data);
+    uint32_t row = series->offset + static_cast<uint32_t>(idx);
+    return ImPlotPoint(series->x.at(row), series->y_ref);
+}
+
+// As above, for a run of LODPyramid points
+inline ImPlotPoint lod_getter(int idx, void* user_data) {
+    const LODPoint& pt{ static_cast<LODView*>(user_data)->points[idx] };
+    return ImPlotPoint(pt.x, pt.y);
+}
+
+inline ImPlotPoint lod_ref_getter(int idx, void* user_data) {
+    LODView* view = static_cast<LODView*>(user_data);
+    return ImPlotPoint(view->points[idx].x, view->y_ref);
+}
+
 // NDContext: stack based rendering
 // Utility funcs above if they're too specific to rendering
 // to go in nd_utils, NDContext itself below, with all inline
@@ -56,6 +84,7 @@ using CritArray = std::array<std::string, Critical::EndCritical>;
 template <typename JSON, typename DB>
 class NDContext {
 private:
+    using DBMsg = DBMessage<JSON>;
     DB&                     bulk;           // DB bulk cache
     JSON                    layout;         // layout and data are fetched by websock
     JSON                    data;
@@ -119,8 +148,23 @@ private:
         int         inx{ 0 };
         EventInx    next;
         EntityInx   query_id;
+        uint32_t    serial{ 0 };    // of the DB request we're waiting on
     };
     std::list<InFlight> in_flight_list;
+    // numbers DB requests so Cancelled|TimedOut can find their InFlight
+    uint32_t    db_serial{ 0 };
+    // query_ids of prepared Query|Command actions that have run once, so
+    // a change to a bound address reruns them with fresh params
+    std::set<uint32_t>  prepared_query_ids;
+    // Widgets with a refresh_ms cspec poll their query_id with Refresh,
+    // which fetches only the rows added since. Widgets sharing a query_id
+    // share a timer, keyed on query_id as bad_handle_map is. serial is
+    // the Refresh in flight, so a slow DB never has two queued.
+    struct RefreshTimer {
+        double      due{ 0.0 };     // ImGui::GetTime() seconds
+        uint32_t    serial{ 0 };
+    };
+    std::map<std::string, RefreshTimer> refresh_timers;
 
     EntityInx   ninx_GUI;
     EntityInx   ninx_Websock;
@@ -142,6 +186,9 @@ private:
     EventInx    einx_FunctionSync;              // CST::SubSysEvent
     EventInx    einx_FunctionAsync;             // CST::SubSysEvent
     EventInx    einx_FunctionResult;            // CST::SubSysEvent
+    EventInx    einx_Cancelled;                 // CST::DBEvent
+    EventInx    einx_TimedOut;                  // CST::DBEvent
+    EventInx    einx_Refresh;                   // CST::DBEvent
     EventInx    einx_Invalid;                   // !init->OH_FECK
 
 
@@ -194,6 +241,12 @@ private:
     EndRenderLocals     er_vars;
     SummaryTableContext smry_tbl_ctx;
     TableContext        tbl_ctx;
+    // render_table's formatted cells, one cache per table widget
+    std::unordered_map<NDWidget*, CellCache> cell_caches;
+    // render_table's client side sorts, one per table widget
+    std::unordered_map<NDWidget*, TableSort> table_sorts;
+    // render_shaded_plot's decimation pyramids, one per plot widget
+    std::unordered_map<NDWidget*, LODPyramid> lod_pyramids;
     TableMemEditContext mem_edit_ctx;
 #ifdef __EMSCRIPTEN__
     IDBFileWriter       ini_writer;
@@ -280,6 +333,10 @@ public:
     void on_dlc_init() {
         // DataLayCache on_json() has processed data and layout. Now we add
         // Entity and Event indices for our action_dispatch() impl.
+        // new layout, new table widgets
+        cell_caches.clear();
+        lod_pyramids.clear();
+        table_sorts.clear();
 
         // First EntityIDs for subsystem events from GUI or Websock
         ninx_GUI = data_lay_cache.template get_string_index<CIT::EntityID>(Static::gui_cs, CST::SubSysID);
@@ -307,6 +364,9 @@ public:
         einx_QueryResult = data_lay_cache.template get_string_index<CIT::Event>(Static::query_result_cs, CST::DBEvent);
         einx_BatchRequest = data_lay_cache.template get_string_index<CIT::Event>(Static::batch_request_cs, CST::DBEvent);
         einx_BatchResponse = data_lay_cache.template get_string_index<CIT::Event>(Static::batch_response_cs, CST::DBEvent);
+        einx_Cancelled = data_lay_cache.template get_string_index<CIT::Event>(Static::cancelled_cs, CST::DBEvent);
+        einx_TimedOut = data_lay_cache.template get_string_index<CIT::Event>(Static::timed_out_cs, CST::DBEvent);
+        einx_Refresh = data_lay_cache.template get_string_index<CIT::Event>(Static::refresh_cs, CST::DBEvent);
         // Function events, piggybacked on DB event sys
         einx_FunctionSync = data_lay_cache.template get_string_index<CIT::Event>(Static::function_sync_cs, CST::SubSysEvent);
         einx_FunctionAsync = data_lay_cache.template get_string_index<CIT::Event>(Static::function_async_cs, CST::SubSysEvent);
@@ -337,6 +397,7 @@ public:
         case dbQuery:
             return dbQueryResult;
         case dbBatchRequest:
+        case dbRefresh:
             return dbBatchResponse;
         case dbFunctionAsync:
             return dbFunctionResult;
@@ -366,6 +427,14 @@ public:
             return einx_FunctionAsync;
         case dbFunctionResult:
             return einx_FunctionResult;
+        case dbCancelled:
+            return einx_Cancelled;
+        case dbTimedOut:
+            return einx_TimedOut;
+        case dbOnline:
+            return einx_Online;
+        case dbRefresh:
+            return einx_Refresh;
         default:
             return EndDBEventTypes;
         }
@@ -430,6 +499,9 @@ public:
 
         if (render_count == 0) initialize();
 
+        // result sets fetched by get_handle this cycle are pinned
+        bulk.start_frame();
+
         // Zero the font push/pop counts before rendering. This
         // enables us to detect lopsided push/pop sequences after
         // all widgets have rendered.
@@ -527,6 +599,9 @@ public:
             changed.clear();
         }
 
+        // Rerun any prepared Query|Command bound to a changed address
+        rebind_prepared_actions();
+
         // Check the dirty_<type>_vec vectors for changes in DataRef addressables
         // that drive NDF lambda recalcs
         if (!dirty_int_ref_vec.empty()) {
@@ -549,6 +624,14 @@ public:
             dirty_str_addr_vec.clear();
             dirty_str_ref_vec.clear();
         }
+        // dbl, bool and date changes don't drive NDF lambdas,
+        // but may be bound to prepared statement params
+        dirty_dbl_addr_vec.clear();
+        dirty_dbl_ref_vec.clear();
+        dirty_bool_addr_vec.clear();
+        dirty_bool_ref_vec.clear();
+        dirty_date_addr_vec.clear();
+        dirty_date_ref_vec.clear();
 
         if (!pending_actions.empty()) {
             PendingAction pa{ pending_actions.front() };
@@ -749,36 +832,8 @@ public:
             else if (nd_type == Static::data_change_confirmed_cs) {
                 // TODO: add check that type has not mutated
             }
-            else if (nd_type == Static::function_result_cs) {
-                // see src/web/incdec.js, especially ret_val
-                int raw_fn_inx = JAsInt(resp, Static::query_id_cs);
-                const char* func_name{ data_lay_cache.get_func_name(raw_fn_inx) };
-                assert(func_name != nullptr);
-                if (JContains(resp, Static::error_cs)) {
-                    std::string errmsg{JAsString(resp, Static::error_cs)};
-                    NDLogger::cerr() << method << "FUNC_FAIL: " << func_name
-                        << ", error: " << errmsg << std::endl;
-                }
-                else {
-                    std::string addr = JAsString(resp, Static::cache_key_cs);
-                    NDLogger::cout() << method << "FuncName: " << func_name
-                        << ", addr: " << addr << std::endl;
-                    // propogate the change into DLC wasm
-                    data_lay_cache.on_data_change(addr, resp);
-                    // propogate change to server side
-                    AddrInx ainx = data_lay_cache.get_addr_inx(addr);
-                    DataRef* chngd_data_ref = data_lay_cache.get_data_ref(ainx);
-                    if (JContains(resp, Static::old_value_cs) &&
-                            JContains(resp, Static::new_value_cs)) {
-                        JSON ov = resp[Static::old_value_cs];
-                        JSON nv = resp[Static::new_value_cs];
-                        notify_server(chngd_data_ref, ov, nv);
-                    }
-                }
-            }
-            // Duck or Parquet event...
             else {
-                on_db_event(resp);
+                NDLogger::cerr() << method << "BAD_ND_TYPE: " << nd_type << std::endl;
             }
             events.pop();
         }
@@ -794,53 +849,121 @@ public:
         server_request(Static::layout_cs);
     }
 
-    void on_db_event(const JSON& db_msg) {
+    // Typed DB events from the bulk cache. Websocket messages from the
+    // server stay JSON as they carry data and layout, so they go via
+    // dispatch_events.
+    void dispatch_db_events(std::queue<DBMsg>& events) {
+        while (!events.empty()) {
+            on_db_event(events.front());
+            events.pop();
+        }
+    }
+
+    void on_db_event(DBMsg& db_msg) {
         const static char* method = "NDContext::on_db_event: ";
 
-        if (!JContains(db_msg, Static::nd_type_cs)) {
-            NDLogger::cerr() << method << "no nd_type in " << db_msg << std::endl;
-            return;
+        NDLogger::cout() << method << db_msg << std::endl;
+        // Responses to our own requests echo the interned query_id. Those
+        // the DB originates, like Online, only have the string.
+        if (!db_msg.query_id.is_valid() && !db_msg.qid.empty()) {
+            db_msg.query_id = data_lay_cache.template get_string_index<EntityID>(db_msg.qid, CST::QueryID);
         }
-        std::string nd_type = JAsString(db_msg, Static::nd_type_cs);
-        std::string qid = JAsString(db_msg, Static::query_id_cs);
-        NDLogger::cout() << method << nd_type << ", QID: " << qid << std::endl;
-
-        EntityInx ninx{data_lay_cache.template get_string_index<EntityID>(qid, CST::QueryID)};
-        EventInx einx_db{ data_lay_cache.template get_string_index<Event>(nd_type, CST::DBEvent) };
-        EventInx einx_ss{ data_lay_cache.template get_string_index<Event>(nd_type, CST::SubSysEvent) };
+        EntityInx ninx{ db_msg.query_id };
 
         // Remember, here we're invoked by pump_messages(), not by
         // ctx.Render(), so we're not on the hot path and can dispatch
         // actions directly here.
-        if (einx_db == einx_Command) {
-            db_status_color = amber;
-        }
-        else if (einx_db == einx_Query) {
+        switch (db_msg.type) {
+        case dbCommand:
+        case dbQuery:
             db_status_color = amber;
-        }
-        else if (einx_db == einx_CommandResult) {
+            break;
+        case dbCommandResult:
             db_status_color = green;
-            action_dispatch(ninx, einx_db); // qid, nd_type);
-        }
-        else if (einx_db == einx_QueryResult) {
+            action_dispatch(ninx, einx_CommandResult);
+            break;
+        case dbQueryResult:
             db_status_color = green;
             // Typically, a QueryResult is followed by dispatch
-            // of a BatchRequest. 
-            action_dispatch(ninx, einx_db); // qid, nd_type);
-        }
-        else if (einx_db == einx_BatchResponse) {
-            db_status_color = green;
-            action_dispatch(ninx, einx_db); // qid, nd_type);
-        }
-        else if (einx_ss == einx_Online) {
+            // of a BatchRequest.
+            action_dispatch(ninx, einx_QueryResult);
+            break;
+        case dbBatchResponse:
+            // Streamed BatchResponses carry done:false until the last
+            // chunk lands. The render methods already show the rows
+            // present, so only the final one resumes a continuation.
+            if (!db_msg.done) {
+                db_status_color = amber;
+            }
+            else {
+                db_status_color = green;
+                if (db_msg.truncated) {
+                    NDLogger::cerr() << method << "TRUNCATED: QID(" << db_msg.qid << ") at max_rows" << std::endl;
+                }
+                // A timer's Refresh isn't part of an action sequence, so
+                // mustn't resume one waiting on this query_id's BatchResponse
+                if (!end_refresh(db_msg)) {
+                    action_dispatch(ninx, einx_BatchResponse);
+                }
+            }
+            break;
+        case dbCancelled:
+        case dbTimedOut:
+            // A Cancelled request was superseded by a newer Query on the
+            // same query_id, which is still running, so we stay amber.
+            // The sequence waiting on the dead request will never see its
+            // result event, so drop its InFlight. Apps can still attach
+            // actions to qid.Cancelled or qid.TimedOut.
+            db_status_color = db_msg.type == dbTimedOut ? red : amber;
+            if (db_msg.serial != 0) {
+                uint32_t serial{ db_msg.serial };
+                in_flight_list.remove_if([ninx, serial](const InFlight& inf) {
+                    return inf.query_id == ninx && inf.serial == serial; });
+            }
+            end_refresh(db_msg);
+            action_dispatch(ninx, db_event_type_to_event_inx(db_msg.type));
+            break;
+        case dbFunctionResult:
+            on_func_result(db_msg);
+            break;
+        case dbOnline:
             // DB is online
             // so we can just flip status button color here
             db_status_color = amber;
             // signal DuckDB online
             action_dispatch(ninx_DuckDB, einx_Online);
+            break;
+        default:
+            NDLogger::cerr() << method << "BAD_DB_EVENT: " << db_msg << std::endl;
+            break;
         }
-        else {
-            NDLogger::cerr() << method << JPrettyPrint(db_msg) << std::endl;
+    }
+
+    void on_func_result(const DBMsg& db_msg) {
+        const static char* method = "NDContext::on_func_result: ";
+        // see src/web/incdec.js, especially ret_val
+        const JSON& resp{ db_msg.payload };
+        const char* func_name{ data_lay_cache.get_func_name(db_msg.func_inx) };
+        assert(func_name != nullptr);
+        if (db_msg.error) {
+            std::string errmsg{JAsString(resp, Static::error_cs)};
+            NDLogger::cerr() << method << "FUNC_FAIL: " << func_name
+                << ", error: " << errmsg << std::endl;
+            return;
+        }
+        std::string addr = JAsString(resp, Static::cache_key_cs);
+        NDLogger::cout() << method << "FuncName: " << func_name
+            << ", addr: " << addr << std::endl;
+        // propogate the change into DLC wasm
+        data_lay_cache.on_data_change(addr, resp);
+        // propogate change to server side
+        AddrInx ainx = data_lay_cache.get_addr_inx(addr);
+        DataRef* chngd_data_ref = data_lay_cache.get_data_ref(ainx);
+        if (JContains(resp, Static::old_value_cs) &&
+                JContains(resp, Static::new_value_cs)) {
+            JSON ov = resp[Static::old_value_cs];
+            JSON nv = resp[Static::new_value_cs];
+            notify_server(chngd_data_ref, ov, nv);
         }
     }
 
@@ -1068,12 +1191,13 @@ protected:
         // Finally, do we have a DB op to handle?
         // TODO: db_dispatch -> event_dispatch refactor
         if (db_event_is_valid(action_defn.db_action)) {
+            uint32_t serial{ 0 };
             if (action_defn.db_action == DBEventType::dbFunctionSync
                 || action_defn.db_action == DBEventType::dbFunctionAsync) {
                 func_dispatch(action_defn);
             }
             else {
-                db_dispatch(action_defn);
+                serial = db_dispatch(action_defn);
             }
             // We've dispatched a DB op from a sequence, so there's a 
             // continuation if this is not the last action.
@@ -1081,55 +1205,222 @@ protected:
                 resume.sequence = action_seq;
                 resume.inx = action_inx;
                 resume.query_id = action_defn.query_id;
+                resume.serial = serial;
                 resume.next = db_event_type_to_event_inx(next_db_event(action_defn.db_action));
             }
         }
     }
 
     void func_dispatch(const NDAction& action_defn) {
-        int raw_func_inx = data_lay_cache.get_func_inx(action_defn.query_id);
-        auto func_request = JNewObject();
-        JSet(func_request, Static::nd_type_cs, DBEventTypeToString(action_defn.db_action));
-        JSet(func_request, Static::query_id_cs, raw_func_inx);
-        JSet(func_request, Static::data_cs, data);
+        DBMsg func_request;
+        func_request.type = action_defn.db_action;
+        func_request.query_id = action_defn.query_id;
+        func_request.func_inx = data_lay_cache.get_func_inx(action_defn.query_id);
         // async slow path for funcs that await
         if (action_defn.db_action == dbFunctionAsync) {
+            func_request.payload = data;
             // ems: will invoke ems_db_dispatch to window.postMessage(func_request)
             // win32: posts into db_loop
-            bulk.db_dispatch(func_request);
+            bulk.db_dispatch(std::move(func_request));
         }
         else {  // sync fast path
 #ifdef __EMSCRIPTEN__
             // no ret val as exec_js_action_sync invokes on_db_result,
-            // so result obj will get picked up by dispatch_events
-            exec_js_action_sync(raw_func_inx, data.as_handle(),
+            // so result obj will get picked up by dispatch_db_events
+            exec_js_action_sync(func_request.func_inx, data.as_handle(),
                                             return_value.as_handle());
 #else
-            bulk.db_dispatch(func_request);
+            func_request.payload = data;
+            bulk.db_dispatch(std::move(func_request));
 #endif
         }
     }
 
-    void db_dispatch(const NDAction& action_defn) {
+    uint32_t db_dispatch(const NDAction& action_defn) {
         // const static char* method = "NDContext::db_dispatch: ";
 
-        auto db_request = JNewObject();
-        JSet(db_request, Static::nd_type_cs, DBEventTypeToString(action_defn.db_action));
+        DBMsg db_request;
+        db_request.type = action_defn.db_action;
+        db_request.query_id = action_defn.query_id;
         const char* qid = data_lay_cache.get_string_value(action_defn.query_id);
         assert(qid != nullptr);
-        JSet(db_request, Static::query_id_cs, qid);
-        // BatchRequest just needs QID, no SQL; Command and Query need SQL
-        if (action_defn.db_action != dbBatchRequest) {
+        db_request.qid = qid;
+        db_request.serial = ++db_serial;
+        db_request.timeout_ms = action_defn.timeout_ms;
+        if (!action_defn.params.empty()) {
+            db_request.prepared = true;
+            for (const ActionParam& param : action_defn.params) {
+                db_request.params.emplace_back(resolve_param(param));
+            }
+            EntityInx query_id{ action_defn.query_id };
+            prepared_query_ids.insert(query_id());
+        }
+        // BatchRequest and Refresh just need QID, no SQL; Command and
+        // Query need SQL. Refresh reruns the last Query's SQL and params.
+        if (action_defn.db_action == dbCommand || action_defn.db_action == dbQuery) {
             assert(action_defn.sql_cname.is_valid());
-            const char* sql_cname = data_lay_cache.get_addr_value(action_defn.sql_cname);
-            assert(sql_cname != nullptr);
             DataRef* data_ref = data_lay_cache.get_data_ref(action_defn.sql_cname);
             assert(data_ref != nullptr);
             const char* sql = data_lay_cache.template get_string_value<AddrInx>(data_ref->ref_inx);
             assert(sql != nullptr);
-            JSet(db_request, Static::sql_cs, sql);
+            db_request.sql_cname = action_defn.sql_cname;
+            db_request.sql = sql;
+            db_request.refresh_key = action_defn.refresh_key;
+        }
+        uint32_t serial{ db_request.serial };
+        bulk.db_dispatch(std::move(db_request));
+        return serial;
+    }
+
+    // Called by render methods with a query_id cspec. When the widget has a
+    // refresh_ms cspec, and its result set is up, post a Refresh every
+    // refresh_ms, unless the last one is still in flight. The first is a
+    // whole interval after the result set appears.
+    void refresh_tick(WidgetPtr w, const char* query_id, RSHandle handle) {
+        int refresh_ms{ 0 };
+        cspec_int(cs_refresh_ms, w->cspec_int, &refresh_ms);
+        if (refresh_ms <= 0 || handle == 0)
+            return;
+        double now = ImGui::GetTime();
+        double interval = refresh_ms / 1000.0;
+        auto [iter, inserted] = refresh_timers.try_emplace(query_id, RefreshTimer{ now + interval });
+        RefreshTimer& timer{ iter->second };
+        if (inserted || timer.serial != 0 || now < timer.due)
+            return;
+        DBMsg refresh;
+        refresh.type = dbRefresh;
+        refresh.query_id = data_lay_cache.template get_string_index<EntityID>(query_id, CST::QueryID);
+        refresh.qid = query_id;
+        refresh.serial = ++db_serial;
+        timer.serial = refresh.serial;
+        timer.due = now + interval;
+        bulk.db_dispatch(std::move(refresh));
+    }
+
+    // True if db_msg ends the Refresh a timer is waiting on
+    bool end_refresh(const DBMsg& db_msg) {
+        if (db_msg.serial == 0)
+            return false;
+        auto iter = refresh_timers.find(db_msg.qid);
+        if (iter == refresh_timers.end() || iter->second.serial != db_msg.serial)
+            return false;
+        iter->second.serial = 0;
+        return true;
+    }
+
+    // Current DLC value for a prepared statement param. Combo style params
+    // select an entry from the cname StrVec with the cindex int.
+    DBParam resolve_param(ActionParam param) {
+        const static char* method = "NDContext::resolve_param: ";
+
+        DBParam db_param;
+        DataRef* data_ref = data_lay_cache.get_data_ref(param.cname);
+        if (data_ref == nullptr) {
+            NDLogger::cerr() << method << "NO_DATA_REF(" << data_lay_cache.get_addr_value(param.cname)
+                << ") binding NULL" << std::endl;
+            return db_param;
+        }
+        if (param.cindex.is_valid()) {
+            DataRef* inx_data_ref = data_lay_cache.get_data_ref(param.cindex);
+            if (data_ref->tipe != cdStrVec || inx_data_ref == nullptr || inx_data_ref->tipe != cdInt) {
+                NDLogger::cerr() << method << "BAD_CINDEX(" << data_lay_cache.get_addr_value(param.cindex)
+                    << ") binding NULL" << std::endl;
+                return db_param;
+            }
+            int* cindex = data_lay_cache.get_int_value(IntInx(inx_data_ref->ref_inx));
+            if (cindex == nullptr || *cindex < 0 || *cindex >= static_cast<int>(data_ref->size)) {
+                NDLogger::cerr() << method << "CINDEX_OUT_OF_RANGE(" << data_lay_cache.get_addr_value(param.cindex)
+                    << ") binding NULL" << std::endl;
+                return db_param;
+            }
+            const char* val = data_lay_cache.get_string_value(StrInx(data_ref->ref_inx + *cindex));
+            if (val != nullptr) {
+                db_param.type = cdStr;
+                db_param.s = val;
+            }
+            return db_param;
+        }
+        switch (data_ref->tipe) {
+        case cdInt: {
+            int* val = data_lay_cache.get_int_value(IntInx(data_ref->ref_inx));
+            if (val != nullptr) {
+                db_param.type = cdInt;
+                db_param.i = *val;
+            }
+        } break;
+        case cdDouble: {
+            double* val = data_lay_cache.get_double_value(DoubleInx(data_ref->ref_inx));
+            if (val != nullptr) {
+                db_param.type = cdDouble;
+                db_param.d = *val;
+            }
+        } break;
+        case cdBool: {
+            bool* val = data_lay_cache.get_bool_value(BoolInx(data_ref->ref_inx));
+            if (val != nullptr) {
+                db_param.type = cdBool;
+                db_param.b = *val;
+            }
+        } break;
+        case cdStr: {
+            const char* val = data_lay_cache.get_string_value(StrInx(data_ref->ref_inx));
+            if (val != nullptr) {
+                db_param.type = cdStr;
+                db_param.s = val;
+            }
+        } break;
+        case cdIntVec:
+            // a DatePicker's [y,m,d]: NB natural contiguity for interned ints
+            if (data_ref->size == 3) {
+                int* ymd = data_lay_cache.get_int_value(IntInx(data_ref->ref_inx));
+                if (ymd != nullptr) {
+                    char date[16];
+                    snprintf(date, sizeof(date), "%04d-%02d-%02d", ymd[0], ymd[1], ymd[2]);
+                    db_param.type = cdStr;
+                    db_param.s = date;
+                }
+                break;
+            }
+            [[fallthrough]];
+        default:
+            NDLogger::cerr() << method << "BAD_PARAM_TYPE(" << data_lay_cache.get_addr_value(param.cname)
+                << ") binding NULL" << std::endl;
+        }
+        return db_param;
+    }
+
+    // A changed address may be bound to prepared Query|Command actions. Once
+    // an action has run, rerun it with the new param values, resuming its
+    // sequence as action_dispatch would, so a BatchRequest follows a Query.
+    // The DB side reuses the statement it prepared, so there's no reparse
+    // or replan, and no server round trip for new SQL.
+    void rebind_prepared_actions() {
+        const static char* method = "NDContext::rebind_prepared_actions: ";
+
+        std::set<std::pair<ActionVec*, int>> rerun;
+        const UintVec* dirty_addr_vecs[] = { &dirty_int_addr_vec, &dirty_dbl_addr_vec,
+            &dirty_str_addr_vec, &dirty_bool_addr_vec, &dirty_date_addr_vec };
+        for (const UintVec* dirty_addr_vec : dirty_addr_vecs) {
+            for (uint32_t addr_inx : *dirty_addr_vec) {
+                const std::vector<BoundAction>* bound_vec = data_lay_cache.get_bound_actions(addr_inx);
+                if (bound_vec == nullptr)
+                    continue;
+                for (const BoundAction& bound : *bound_vec) {
+                    const NDAction& action_defn{ (*bound.sequence)[bound.inx] };
+                    EntityInx query_id{ action_defn.query_id };
+                    if (prepared_query_ids.find(query_id()) != prepared_query_ids.end())
+                        rerun.emplace(bound.sequence, bound.inx);
+                }
+            }
+        }
+        for (const auto& seq_inx : rerun) {
+            NDLogger::cout() << method << "QID(" << (*seq_inx.first)[seq_inx.second].query_id
+                << ")" << std::endl;
+            InFlight resume;
+            action_execute(seq_inx.first, seq_inx.second, resume);
+            if (resume.next.is_valid())
+                in_flight_list.emplace_back(resume);
         }
-        bulk.db_dispatch(db_request);
     }
 
     // Render functions
@@ -1915,11 +2206,35 @@ protected:
                     // TODO: spinner always fails IsClippedEx on first render
                     NDLogger::cout() << method << "SPINNER_FAIL" << std::endl;
                 }
+                render_query_progress(w);
             }
             ImGui::EndPopup();
         }
     }
 
+    // A LoadingModal with a query_id shows the progress of the request
+    // executing on that query_id, so a slow scan can be told from a hung
+    // one. The bar is indeterminate until DuckDB can estimate the total.
+    void render_query_progress(WidgetPtr w) {
+        DataRef* query_data_ref = cspec_data_ref(cs_query_id, w);
+        if (query_data_ref == nullptr)
+            return;
+        const char* query_id = data_lay_cache.get_string_value(query_data_ref->addr_inx);
+        double percent{ -1.0 };
+        double rows_per_sec{ 0.0 };
+        if (query_id == nullptr || !bulk.get_progress(query_id, percent, rows_per_sec))
+            return;
+        char overlay[STR_BUF_LEN];
+        if (percent < 0.0) {
+            snprintf(overlay, sizeof(overlay), "%.0f rows/s", rows_per_sec);
+            ImGui::ProgressBar(-1.0f * static_cast<float>(ImGui::GetTime()), ImVec2(-FLT_MIN, 0.0f), overlay);
+        }
+        else {
+            snprintf(overlay, sizeof(overlay), "%.1f%%  %.0f rows/s", percent, rows_per_sec);
+            ImGui::ProgressBar(static_cast<float>(percent / 100.0), ImVec2(-FLT_MIN, 0.0f), overlay);
+        }
+    }
+
     void render_window(WidgetPtr w) {
         const static char* method = "NDContext::render_window: ";
         static int default_window_flags = ImGuiWindowFlags_None; //  AlwaysAutoResize;
@@ -1965,6 +2280,7 @@ protected:
         assert(result_set_data_ref != nullptr);
         const char* query_id = data_lay_cache.get_string_value(result_set_data_ref->addr_inx);
         RSHandle handle = bulk.get_handle(query_id);
+        refresh_tick(w, query_id, handle);
 
         DataRef* x_data_ref = cspec_data_ref(cs_xname, w);
         DataRef* y_data_ref = cspec_data_ref(cs_yname, w);
@@ -1978,39 +2294,82 @@ protected:
         StrInx yinx{ y_data_ref->ref_inx };
         const char* y_col_name = data_lay_cache.get_string_value(yinx);
 
-        // get ranges from bulk cache
-        // TODO: memoize the range in a ShadedPlotContext
-        if (!bulk.get_min_max(handle, x_col_name, sh_pl_vars.xmin_dbl, sh_pl_vars.xmax_dbl) ||
-            !bulk.get_min_max(handle, y_col_name, sh_pl_vars.ymin_dbl, sh_pl_vars.ymax_dbl))
-            return;
         // TODO: connect row_count & offset to slider widgets
         sh_pl_vars.row_count = bulk.get_row_count(handle);
         sh_pl_vars.offset = 0;
+        // get ranges from the bulk cache zone maps: O(1) for the
+        // whole result, O(chunks) for a sub range
+        if (!bulk.get_min_max(handle, x_col_name, sh_pl_vars.offset, sh_pl_vars.row_count,
+                                    sh_pl_vars.xmin_dbl, sh_pl_vars.xmax_dbl) ||
+            !bulk.get_min_max(handle, y_col_name, sh_pl_vars.offset, sh_pl_vars.row_count,
+                                    sh_pl_vars.ymin_dbl, sh_pl_vars.ymax_dbl))
+            return;
+
+        // one getter based series over every chunk in the range, with
+        // values converted per point as ImPlot asks for them
+        XYSeries& series{ sh_pl_vars.series };
+        if (!bulk.init_series(handle, x_col_name, series.x) || !bulk.init_series(handle, y_col_name, series.y)
+            || !series.x.numeric() || !series.y.numeric())
+            return;
+        series.offset = sh_pl_vars.offset;
+        series.count = sh_pl_vars.row_count - sh_pl_vars.offset;
+        if (series.count == 0)
+            return;
+        series.y_ref = series.y.at(series.offset);
+        if (std::isnan(series.y_ref))
+            series.y_ref = series.y.axis_value(sh_pl_vars.ymin_dbl);
+
+        // (re)build the decimation pyramid on first bind or a new result,
+        // and fold in any rows from BatchResponses since the last frame
+        LODPyramid& lod{ lod_pyramids[w.get()] };
+        uint32_t epoch = bulk.get_result_epoch();
+        if (!lod.matches(handle, epoch, x_col_name, y_col_name))
+            lod.reset(handle, epoch, x_col_name, y_col_name);
+        lod.extend(series, sh_pl_vars.row_count);
 
-        XYRange* range{ 0 };
         if (ImPlot::BeginPlot(title)) {
             ImPlot::SetupAxes(x_col_name, y_col_name, ImPlotAxisFlags_AutoFit, ImPlotAxisFlags_AutoFit);
-            ImPlot::SetupAxesLimits(sh_pl_vars.xmin_dbl, sh_pl_vars.xmax_dbl,
-                                        sh_pl_vars.ymin_dbl, sh_pl_vars.ymax_dbl);
+            // timestamps and dates plot on a time axis in seconds
+            if (series.x.time)
+                ImPlot::SetupAxisScale(ImAxis_X1, ImPlotScale_Time);
+            ImPlot::SetupAxesLimits(series.x.axis_value(sh_pl_vars.xmin_dbl), series.x.axis_value(sh_pl_vars.xmax_dbl),
+                                        series.y.axis_value(sh_pl_vars.ymin_dbl), series.y.axis_value(sh_pl_vars.ymax_dbl));
+            // raw rows if the visible x range fits the plot's width,
+            // otherwise the pyramid level that does
+            ImPlotRect limits = ImPlot::GetPlotLimits();
+            uint32_t row_begin{ 0 };
+            uint32_t row_end{ 0 };
+            lod.visible_rows(series.x, limits.X.Min, limits.X.Max, row_begin, row_end);
+            row_begin = std::max(row_begin, sh_pl_vars.offset);
+            row_end = std::max(row_end, row_begin);
+            int level = lod.select(row_end - row_begin, ImPlot::GetPlotSize().x);
+            ImPlotGetter getter = xy_series_getter;
+            ImPlotGetter ref_getter = xy_series_ref_getter;
+            void* getter_data = &series;
+            int count = static_cast<int>(row_end - row_begin);
+            LODView view;
+            series.offset = row_begin;
+            if (level >= 0) {
+                const LODLevel& lod_level{ lod.levels[level] };
+                uint32_t first = row_begin / lod_level.bucket_rows;
+                uint32_t last = std::min((row_end + lod_level.bucket_rows - 1) / lod_level.bucket_rows,
+                                            lod_level.bucket_count());
+                view.points = lod_level.points.data() + first * 2;
+                view.count = (last - first) * 2;
+                view.y_ref = series.y_ref;
+                getter = lod_getter;
+                ref_getter = lod_ref_getter;
+                getter_data = &view;
+                count = static_cast<int>(view.count);
+            }
             if (sh_pl_vars.show_fills) {
                 sh_pl_vars.spec.Flags = shaded_plot_flags;
                 sh_pl_vars.spec.FillAlpha = 0.25f;
-                range = bulk.init_xy_range(handle, x_col_name, y_col_name, sh_pl_vars.offset, sh_pl_vars.row_count);
-                range = bulk.next_xy_range(range);
-                while (range != nullptr) {
-                    ImPlot::PlotShaded(title, range->xdata, range->ydata, range->plot_count, range->ydata[0], sh_pl_vars.spec);
-                    range = bulk.next_xy_range(range);
-                }
+                ImPlot::PlotShadedG(title, getter, getter_data, ref_getter, getter_data, count, sh_pl_vars.spec);
             }
             // Lines on top of fills
             if (sh_pl_vars.show_lines) {
-                sh_pl_vars.spec.Flags = shaded_plot_flags;
-                range = bulk.init_xy_range(handle, x_col_name, y_col_name, sh_pl_vars.offset, sh_pl_vars.row_count);
-                range = bulk.next_xy_range(range);
-                while (range != nullptr) {
-                    ImPlot::PlotLine(title, range->xdata, range->ydata, range->plot_count);
-                    range = bulk.next_xy_range(range);
-                }
+                ImPlot::PlotLineG(title, getter, getter_data, count);
             }
             ImPlot::EndPlot();
         }
@@ -2019,11 +2378,16 @@ protected:
     void render_table(WidgetPtr w) {
         const static char* method = "NDContext::render_table: ";
 
-        static int default_table_flags = ImGuiTableFlags_BordersOuter | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollX | ImGuiTableFlags_ScrollY;
+        // Sortable sorts client side, through TableSort's permutations.
+        // SortTristate so a table can go back to the result's own order.
+        static int default_table_flags = ImGuiTableFlags_BordersOuter | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollX | ImGuiTableFlags_ScrollY
+                                            | ImGuiTableFlags_Sortable | ImGuiTableFlags_SortMulti | ImGuiTableFlags_SortTristate;
 
         const char* title = cspec_string(cs_title, w->cspec_str, method);
         int table_flags = default_table_flags;
         cspec_int(cs_table_flags, w->cspec_int, &table_flags);
+        // optional per column precision etc, see col_format.hpp
+        const char* col_formats = cspec_string(cs_col_formats, w->cspec_str, nullptr);
 
         DataRef* result_set_data_ref = cspec_data_ref(cs_query_id, w);
         assert(result_set_data_ref != nullptr);
@@ -2046,7 +2410,8 @@ protected:
                 if (!inserted) iter->second++;
                 return;
             }
-            if (!bulk.get_meta_data(tbl_ctx.handle, colm_count, row_count)) {
+            refresh_tick(w, query_id, tbl_ctx.handle);
+            if (!bulk.get_meta_data(tbl_ctx.handle, colm_count, row_count, col_formats)) {
                 NDLogger::cout() << method << "GET_META_DATA_FAIL for QID: " << query_id << std::endl;
                 return;
             }
@@ -2066,20 +2431,49 @@ protected:
                 if (tbl_ctx.menupop_data_ref != nullptr && ImGui::GetCurrentTable()->IsContextPopupOpen) {
                     render_menu_pop_item(w);
                 }
+                // header clicks sort client side: no SQL, no refetch
+                uint32_t epoch = bulk.get_result_epoch();
+                TableSort& sort{ table_sorts[w.get()] };
+                if (sort.grows(tbl_ctx.handle, epoch, row_count)) {
+                    // a Refresh appended rows: merge them into the sort
+                    sort.extend(bulk, row_count);
+                }
+                else if (!sort.matches(tbl_ctx.handle, epoch, row_count)) {
+                    sort.reset(tbl_ctx.handle, epoch, row_count);
+                }
+                ImGuiTableSortSpecs* sort_specs = ImGui::TableGetSortSpecs();
+                if (sort_specs != nullptr && sort_specs->SpecsDirty) {
+                    sort.specs.clear();
+                    for (int spec_inx = 0; spec_inx < sort_specs->SpecsCount; spec_inx++) {
+                        const ImGuiTableColumnSortSpecs& spec{ sort_specs->Specs[spec_inx] };
+                        sort.specs.push_back(SortColumnSpec{ spec.ColumnIndex,
+                                                spec.SortDirection == ImGuiSortDirection_Descending });
+                    }
+                    sort_specs->SpecsDirty = false;
+                }
+                sort.update(bulk);
+                const uint32_t* perm = sort.permutation();
+                // cells are formatted once per window, not once per frame
+                CellCache& cells{ cell_caches[w.get()] };
+                if (cells.grows(tbl_ctx.handle, epoch, colm_count, row_count, sort.order)) {
+                    cells.row_count = row_count;
+                }
+                else if (!cells.matches(tbl_ctx.handle, epoch, colm_count, row_count, sort.order)) {
+                    cells.reset(tbl_ctx.handle, epoch, colm_count, row_count, sort.order);
+                }
                 ImGuiListClipper clipper;
                 clipper.Begin((int)row_count, -1.0f);
                 while (clipper.Step()) {
+                    if (!cells.covers(clipper.DisplayStart, clipper.DisplayEnd)) {
+                        cells.fill(bulk, clipper.DisplayStart, clipper.DisplayEnd, perm);
+                    }
                     for (tbl_ctx.row_inx = clipper.DisplayStart; tbl_ctx.row_inx < clipper.DisplayEnd; tbl_ctx.row_inx++) {
                         ImGui::TableNextRow();
                         for (tbl_ctx.col_inx = 0; tbl_ctx.col_inx < colm_count; tbl_ctx.col_inx++) {
                             if (ImGui::TableSetColumnIndex(tbl_ctx.col_inx)) {
-                                const char* endchar = bulk.get_datum(tbl_ctx.handle, tbl_ctx.col_inx, tbl_ctx.row_inx);
-                                if (endchar) {
-                                    ImGui::TextUnformatted(bulk.buffer, endchar);
-                                }
-                                else {
-                                    ImGui::TextUnformatted(bulk.buffer);
-                                }
+                                const char* cell_end{ nullptr };
+                                const char* cell_begin = cells.cell(tbl_ctx.row_inx, tbl_ctx.col_inx, cell_end);
+                                ImGui::TextUnformatted(cell_begin, cell_end);
                             }
                         }
                     }
@@ -5,10 +5,20 @@
 #include <stdexcept>
 #include <chrono>
 #include <list>
+#include <memory>
 #include "nd_types.hpp"
 #include "static_strings.hpp"
 #include "json_ops.hpp"
 #include "config.hpp"
+#include "zone_map.hpp"
+#include "simd_kernels.hpp"
+#include "series.hpp"
+#include "col_format.hpp"
+#include "result_budget.hpp"
+#include "chunk_arena.hpp"
+#include "spsc_ring.hpp"
+#include "string_dict.hpp"
+#include "db_message.hpp"
 
 
 #ifndef __EMSCRIPTEN__
@@ -16,8 +26,11 @@
 #include "nlohmann.hpp"     
 #include <boost/thread.hpp>
 #include <boost/atomic.hpp>
+#include <boost/chrono.hpp>
 #ifdef NODOM_DUCK
 #include <duckdb.h>
+#include "scan_cache.hpp"
+#include "query_progress.hpp"
 #else   // sqlite
 #endif  // NODOM_DUCK
 
@@ -38,8 +51,11 @@
 //    uint32_t get_row_count(RSHandle handle);
 //    bool get_meta_data(RSHandle handle, std::uint32_t& column_count, std::uint32_t& row_count);
 //    const char* get_datum(RSHandle handle, std::uint32_t colm_index, std::uint32_t row_index);
-//    void get_db_responses(std::queue<JSON>& responses);
-//    void db_dispatch(JSON& db_request);
+//    bool init_series(RSHandle handle, const char* col_name, SeriesColumn& series);   // zero copy column view for plots and sorts
+//    uint32_t get_result_epoch();    // bumped whenever a result set is reset or evicted
+//    bool get_progress(const char* query_id, double& percent, double& rows_per_sec);    // of an executing request
+//    void get_db_responses(std::queue<DBMessage<JSON>>& responses);
+//    void db_dispatch(DBMessage<JSON>&& db_request);
 //    void set_done(bool d);
 
 static constexpr int CHUNK_SIZE = 2048;
@@ -144,151 +160,368 @@ struct XYRange {
 static constexpr int MAX_COLUMNS = 256;
 
 class BBDuckDBCache {
+public:
+    using DBMsg = DBMessage<nlohmann::json>;
 private:
-    // work Qs for talking to NDContext, and thread
-    // gubbins to do the DB work off the GUI thread
-    std::queue<nlohmann::json>          db_queries;
-    std::queue<nlohmann::json>          db_results;
-    boost::mutex                        query_mutex;
-    boost::mutex                        result_mutex;
-    boost::condition_variable           query_cond;
+    // One Query's duckdb_result. A worker allocates it, and posts it
+    // to the GUI thread on a reset entry, after which the GUI thread
+    // owns it. version orders the results of a query_id, and is what
+    // chunks and responses refer to, since a freed ResultVersion's
+    // address may be reused.
+    // lane_busy is the LaneState::busy of the lane that ran the Query,
+    // so evict can tell whether a worker may be fetching from it
+    struct ResultVersion {
+        duckdb_result       result{};
+        uint32_t            version{ 0 };
+        const boost::atomic<bool>* lane_busy{ nullptr };
+    };
+    // Chunks fetched by the workers travel to the GUI thread on the
+    // result rings, and get_db_responses adopts them into bobbin_map
+    // et al. So the maps the render methods read only change on the
+    // GUI thread, between frames. A reset entry carries a requery's
+    // new ResultVersion. A chunk with dictionary coded columns carries
+    // the entries its codes added, and which columns hold codes.
+    struct StagedChunk {
+        std::string         qid;
+        uint32_t            version{ 0 };
+        duckdb_data_chunk   chunk{ nullptr };
+        ColumnZoneVec       zones;
+        uint64_t            bytes{ 0 };
+        bool                reset{ false };
+        ResultVersion*      result{ nullptr };
+        std::vector<StringDict> dict_deltas;
+        std::vector<uint8_t>    coded;
+    };
+    // A result ring entry is a response for NDContext or a staged chunk.
+    // A lane's requests may run on any worker, so its results may come
+    // through several rings. seq numbers them per query_id, and
+    // get_db_responses releases them in that order, so a chunk is always
+    // adopted before the BatchResponse that announces it. db_loop's own
+    // results have seq 0, and go straight through. version is set on
+    // BatchResponses, and on an interrupted BatchRequest's response, so
+    // the GUI thread knows which result they report on.
+    struct DBResult {
+        DBMsg               response;
+        StagedChunk         staged;
+        uint64_t            seq{ 0 };
+        uint32_t            version{ 0 };
+        bool                is_chunk{ false };
+    };
+    // GUI thread: one slot per query_id, never erased, so its address
+    // is the handle, and a handle outlives requeries. live is the version
+    // the render methods read. building is a requery's result, whose
+    // chunks wait in staged until its first BatchResponse publishes it,
+    // so the previous version is drawn until then. staged may also hold
+    // chunks of a version whose reset entry is still on another ring.
+    // next_seq is the seq of the query_id's next result, and held those
+    // popped ahead of it from another ring.
+    struct ResultSlot {
+        ResultVersion*              live{ nullptr };
+        ResultVersion*              building{ nullptr };
+        uint32_t                    announced{ 0 };     // latest version with a BatchResponse
+        std::vector<StagedChunk>    staged;
+        uint64_t                    next_seq{ 1 };
+        std::map<uint64_t, DBResult> held;
+    };
+    // A replaced or evicted version's chunks, types and result. Views
+    // such as SeriesColumn hold chunk pointers until they see the epoch
+    // change, so these are freed by start_frame two frames on.
+    struct RetiredVersion {
+        uint32_t                            frame{ 0 };
+        ResultVersion*                      result{ nullptr };
+        Bobbin                              chunks;
+        std::vector<duckdb_logical_type>    logical_types;
+    };
+    using RequestRing = SPSCRing<DBMsg, 256>;
+    using ResultRing = SPSCRing<DBResult, 1024>;
+    // Where a worker posts: its own ring, stamping each result with the
+    // next seq of the lane it's running. busy is that lane's, for the
+    // ResultVersions it makes.
+    struct ResultPort {
+        ResultRing&         ring;
+        uint64_t&           seq;
+        const boost::atomic<bool>& busy;
+    };
+    // Lock free handoff with NDContext: the GUI thread is the only
+    // producer on request_ring and db_loop the only consumer, sleeping
+    // on request_bell when there's nothing to do. Result rings are one
+    // per producer: db_loop's at 0, then one per worker. The GUI thread
+    // polls them every frame without taking a lock.
+    RequestRing                         request_ring;
+    Doorbell                            request_bell;
+    std::vector<std::unique_ptr<ResultRing>> result_rings;
+    boost::atomic<uint32_t>             result_ring_count{ 0 };
     boost::thread                       db_thread;
-    bool                                done{ false };
-    // DuckDB connection state
+    boost::atomic<bool>                 done{ false };
+    // Worker pool: db_loop sorts requests into one lane per query_id.
+    // A lane's requests run in order, one at a time, so Query always
+    // precedes its BatchRequest. Lanes for different query_ids run
+    // concurrently on pool_size workers, each request on whichever
+    // worker is free, so a quick query_id never waits behind a slow one.
+    boost::thread_group                 db_workers;
+    boost::mutex                        lane_mutex;
+    boost::condition_variable           lane_cond;
+    std::unordered_map<std::string, std::queue<DBMsg>> lanes;
+    std::deque<std::string>             ready_lanes;    // queued work, not executing
+    uint32_t                            pool_size{ 1 };
+    // Cancellation and timeouts: a newer Query on a query_id supersedes
+    // that lane's queued Query|BatchRequest|Refresh, and interrupts the executing
+    // one. db_loop wakes every watchdog_ms to interrupt requests that have
+    // overrun their timeout_ms. Guarded by lane_mutex, except interrupt,
+    // which the executing worker polls between chunks, and busy, which
+    // the GUI thread's evict reads. busy is set while the lane is ready
+    // or executing.
+    enum LaneInterrupt : uint32_t { liNone = 0, liCancelled, liTimedOut };
+    struct LaneState {
+        uint64_t                            result_seq{ 0 };    // results posted, by the lane's worker
+        boost::atomic<uint32_t>             interrupt{ liNone };
+        boost::atomic<bool>                 busy{ false };
+        bool                                executing{ false };
+        bool                                supersedable{ false };  // Query|BatchRequest|Refresh
+        bool                                has_deadline{ false };
+        boost::chrono::steady_clock::time_point deadline;
+    };
+    std::unordered_map<std::string, LaneState> lane_states;
+    static constexpr uint32_t           watchdog_ms{ 100 };
+    // Scan fan out: with pool_size > 1, a Command whose scan call reads a
+    // list of files reads each into a part table of its own, on whichever
+    // worker is free, the Command's own included. The Command then runs
+    // on the UNION ALL of the parts. Guarded by lane_mutex, except
+    // interrupt, which the part workers poll: the Command's lane
+    // interrupt, or liCancelled once a part fails.
+    struct ScanJoin {
+        std::string                         qid;
+        StringVec                           part_sql;
+        size_t                              next_part{ 0 };     // first unclaimed
+        size_t                              finished{ 0 };
+        boost::atomic<uint32_t>             interrupt{ liNone };
+    };
+    std::deque<std::shared_ptr<ScanJoin>> scan_joins;  // with unclaimed parts
+    boost::condition_variable           scan_cond;      // a part finished
+    uint64_t                            scan_join_seq{ 0 };
+    // streaming: post a partial BatchResponse after stream_chunks chunks,
+    // then each time the chunk count doubles. Zero drains all chunks
+    // before a single BatchResponse.
+    uint32_t                            stream_chunks{ 0 };
+    // memory: mem_budget_mb caps the chunk bytes we hold, evicting LRU
+    // unpinned result sets, and max_rows caps the rows a BatchRequest
+    // admits. Zero means no limit.
+    uint32_t                            mem_budget_mb{ 0 };
+    uint32_t                            max_rows{ 0 };
+    ResultBudget                        budget;
+    // dictionary coding: low cardinality VARCHAR columns are fetched as
+    // USMALLINT codes into a dictionary of at most dict_max entries. Zero
+    // turns it off. encoder_map is the workers', by query_id, and guarded
+    // by map_mutex like result_map. dict_map is the GUI thread's.
+    uint32_t                            dict_max{ 65535 };
+    std::unordered_map<std::string, DictEncoders> encoder_map;
+    std::unordered_map<RSHandle, DictColumns>   dict_map;
+    // persistence: db_path opens an on disk database rather than an in
+    // memory one, and enables scan_cache, so a scan Command whose SQL and
+    // source files are unchanged since the last run is skipped
+    std::string                         db_path;
+    ScanCache                           scan_cache;
+    // progress: one slot per worker, published with the result rings,
+    // that the worker updates between duckdb_pending_execute_task calls
+    std::vector<std::unique_ptr<QueryProgress>> progress_slots;
+    // bumped by reset_handle, so render side caches such as CellCache
+    // know to drop what they formatted from the old chunks
+    uint32_t                            result_epoch{ 0 };
+    std::unordered_map<RSHandle, std::string>   handle_qids;
+    DBResult                            result_scratch;     // GUI thread
+    std::unordered_map<std::string, ResultSlot> result_slots;   // GUI thread
+    std::deque<RetiredVersion>          retired;            // GUI thread, oldest first
+    // guards result_map, encoder_map and version_seq, which the workers
+    // share, and which evict trims
+    boost::mutex                        map_mutex;
+    uint32_t                            version_seq{ 0 };
+    // DuckDB connection state: one connection per lane, so a lane's
+    // pending or streaming result is never disturbed by another lane
     duckdb_database                     duck_db;
-    duckdb_connection                   duck_conn;
     duckdb_config                       duck_config;
+    std::unordered_map<std::string, duckdb_connection> conn_map;
+    // prepared Query|Command statements, one per lane like conn_map, so
+    // a rerun with new params skips parse and plan. The template SQL is
+    // kept so a changed sql_cname value is prepared afresh.
+    struct PreparedQuery {
+        std::string                     sql;
+        duckdb_prepared_statement       stmt{ nullptr };
+    };
+    std::unordered_map<std::string, PreparedQuery> prepared_map;
+    // Refresh: a Query with a refresh_key keeps what it takes to rerun it
+    // for only the rows past the key's high water mark, which the zones
+    // of each fetched chunk raise. One per lane like prepared_map, and
+    // only the lane's worker touches it. The mark is a zone max, so a
+    // key must be exact in a double: TIMESTAMP_NS isn't, and BIGINT
+    // keys only up to 2^53.
+    struct RefreshState {
+        std::string                     key;            // empty: the Query isn't refreshable
+        std::string                     sql;
+        DBParamVec                      params;
+        int32_t                         key_col{ -1 };
+        duckdb_type                     key_type{ DUCKDB_TYPE_INVALID };
+        uint32_t                        version{ 0 };   // of the Query's result
+        bool                            fetched{ false };   // a BatchRequest has run on version
+        bool                            has_mark{ false };
+        double                          mark{ 0.0 };
+        uint64_t                        row_count{ 0 }; // admitted so far, for max_rows
+        PreparedQuery                   stmt;           // the watermarked SQL
+    };
+    std::unordered_map<std::string, RefreshState> refresh_map;
     idx_t                               duck_chunk_size;
     // schema
     std::unordered_map<RSHandle, StringVec>     col_names_map;
     std::unordered_map<RSHandle, std::vector<duckdb_type>> type_map;
     std::unordered_map<RSHandle, std::vector<duckdb_logical_type>> logical_type_map;
-    // data
-    std::unordered_map<std::string, duckdb_result>  result_map;
+    // data: result_map is the workers' view, the latest version of
+    // each query_id, and result_slots is the GUI thread's
+    std::unordered_map<std::string, ResultVersion*> result_map;
     std::unordered_map<RSHandle, Bobbin>        bobbin_map;
+    std::unordered_map<RSHandle, ChunkIndex>    index_map;
+    std::unordered_map<RSHandle, ZoneMap>       zone_maps;
+    // get_datum's per column formatters, compiled by get_meta_data
+    std::unordered_map<RSHandle, ColFormats>    formats_map;
     // working storage
-    int16_t* sidata = nullptr;
-    int32_t* idata = nullptr;
-    int64_t* bidata = nullptr;
     duckdb_hugeint* hidata = nullptr;
-    double* dbldata = nullptr;
     duckdb_string_t* vcdata = nullptr;
-    duckdb_type decimal_type;
-    uint8_t decimal_width = 0;
-    uint8_t decimal_scale = 0;
-    double  decimal_divisor = 1.0;
-    double  decimal_value = 0.0;
-    duckdb_timestamp_s*     ts_secs = nullptr;
-    duckdb_timestamp_ms*    ts_milli = nullptr;
-    duckdb_timestamp*       ts_micro = nullptr;
-    duckdb_timestamp_ns*    ts_nano = nullptr;
-    int     scan_count{ 0 };
-    int     query_count{ 0 };
-    int     batch_count{ 0 };
+    boost::atomic<int>  scan_count{ 0 };
+    boost::atomic<int>  query_count{ 0 };
+    boost::atomic<int>  batch_count{ 0 };
     char    string_buffer[STR_BUF_LEN];
-    char    format_buffer[FMT_BUF_LEN];
     double  double_int_buffer[CHUNK_SIZE];
-    fmt::format_to_n_result<char*> fmt_result;
 
 public:
     char* buffer{ 0 };  // zero copy accessor
 
     BBDuckDBCache() {
         memset(string_buffer, 0, STR_BUF_LEN);
-        memset(format_buffer, 0, FMT_BUF_LEN);
     }
 
     // GUI thread methods for accessing the data
     RSHandle get_handle(const std::string& qid) {
         static const char* method = "DuckDBCache::get_handle: ";
-        auto res_iter = result_map.find(qid);
-        if (res_iter != result_map.end()) {
-            RSHandle handle = reinterpret_cast<std::uint64_t>(&(res_iter->second));
+        auto slot_iter = result_slots.find(qid);
+        if (slot_iter != result_slots.end() && slot_iter->second.live != nullptr) {
+            RSHandle handle = reinterpret_cast<std::uint64_t>(&(slot_iter->second));
+            budget.touch(handle);
             return handle;
         }
         return 0;
     }
 
+    // NDContext calls at the start of each render cycle, so the handles
+    // fetched by get_handle in the cycle are pinned against eviction.
+    // Versions retired two or more frames ago can't be referenced by
+    // any view now, so they're freed.
+    void start_frame() {
+        budget.start_frame();
+        while (!retired.empty() && retired.front().frame + 2 <= budget.frame) {
+            RetiredVersion& old{ retired.front() };
+            for (auto& chunk : old.chunks) {
+                duckdb_destroy_data_chunk(&chunk);
+            }
+            for (auto& type_l : old.logical_types) {
+                duckdb_destroy_logical_type(&type_l);
+            }
+            if (old.result != nullptr) {
+                duckdb_destroy_result(&old.result->result);
+                delete old.result;
+            }
+            retired.pop_front();
+        }
+    }
+
+    uint32_t get_result_epoch() const { return result_epoch; }
+
+    // GUI thread: progress of the request a worker is executing for
+    // query_id, for render_loading_modal. False if there isn't one.
+    bool get_progress(const char* query_id, double& percent, double& rows_per_sec) const {
+        // worker slots follow db_loop's ring
+        uint32_t ring_count = result_ring_count.load(boost::memory_order_acquire);
+        uint64_t qid_hash = QueryProgress::hash(query_id);
+        for (uint32_t inx = 1; inx < ring_count; inx++) {
+            if (progress_slots[inx - 1]->read(qid_hash, percent, rows_per_sec))
+                return true;
+        }
+        return false;
+    }
+
     std::uint32_t get_row_count(RSHandle handle) {
-        auto bob_iter = bobbin_map.find(handle);
-        std::uint32_t row_count = 0;
-        if (bob_iter == bobbin_map.end())
+        auto inx_iter = index_map.find(handle);
+        if (inx_iter == index_map.end())
             return 0;
-        Bobbin& bob = bobbin_map.at(handle);
-        auto chunk_iter = bob.begin();
-        while (chunk_iter != bob.end()) {
-            row_count += duckdb_data_chunk_get_size(*chunk_iter);
-            chunk_iter++;
-        }
-        return row_count;
+        return inx_iter->second.row_count;
     }
 
+    // Axis limits come from the zone maps built at BatchResponse time
     bool get_min_max(RSHandle handle, const char* col_name, double& min, double& max) {
-        auto bob_iter = bobbin_map.find(handle);
-        std::uint32_t row_count = 0;
-        if (bob_iter == bobbin_map.end())
+        auto zone_iter = zone_maps.find(handle);
+        if (zone_iter == zone_maps.end())
             return false;
+        return zone_iter->second.get_min_max(get_col_index(handle, col_name), min, max);
+    }
 
-        // now we know the handle is good...
+    // Range restricted variant for zoomed plot windows: whole chunks
+    // from the zone maps, partial chunks at either end rescanned.
+    bool get_min_max(RSHandle handle, const char* col_name, uint32_t offset, uint32_t count,
+                        double& min, double& max) {
+        auto zone_iter = zone_maps.find(handle);
+        auto bob_iter = bobbin_map.find(handle);
+        auto type_iter = logical_type_map.find(handle);
+        if (zone_iter == zone_maps.end() || bob_iter == bobbin_map.end() || type_iter == logical_type_map.end())
+            return false;
         int32_t col_inx = get_col_index(handle, col_name);
-        uint32_t chunk_sz{0};
-        Bobbin& bob = bobbin_map.at(handle);
-        auto chunk_iter = bob.begin();
-        duckdb_data_chunk chunk;
-        // get type metadata for the colm vector and validities
-        const std::vector<duckdb_type>& types{ type_map.at(handle) };
-        duckdb_type colm_type(types[col_inx]);
-        const std::vector<duckdb_logical_type>& logical_types{ logical_type_map.at(handle) };
-        duckdb_logical_type colm_type_l(logical_types[col_inx]);
-        
-        bool min_max_initialized{ false };
-        while (chunk_iter != bob.end()) {
-            chunk = *chunk_iter;
-            duckdb_vector colm = duckdb_data_chunk_get_vector(chunk, col_inx);
-            uint64_t* validities = duckdb_vector_get_validity(colm);
-            chunk_sz = duckdb_data_chunk_get_size(chunk);
-            switch (colm_type) {
-            case DUCKDB_TYPE_DOUBLE:
-                dbldata = (double_t*)duckdb_vector_get_data(colm);
-                break;
-            case DUCKDB_TYPE_INTEGER:
-                idata = (int32_t*)duckdb_vector_get_data(colm);
-                break;
-            }
-            if (!min_max_initialized) {
-                switch (colm_type) {
-                case DUCKDB_TYPE_DOUBLE:
-                    min = dbldata[0];
-                    max = dbldata[0];
-                    break;
-                case DUCKDB_TYPE_INTEGER:
-                    min = static_cast<double>(idata[0]);
-                    max = static_cast<double>(idata[0]);
-                    break;
-                }
-                min_max_initialized = true;
-            }
-            for (int inx = 0; inx < chunk_sz; inx++) {
-                if (duckdb_validity_row_is_valid(validities, inx)) {
-                    switch (colm_type) {
-                    case DUCKDB_TYPE_DOUBLE:
-                        if (dbldata[inx] > max)
-                            max = dbldata[inx];
-                        if (dbldata[inx] < min)
-                            min = dbldata[inx];
-                        break;
-                    case DUCKDB_TYPE_INTEGER:
-                        if (static_cast<double>(idata[inx]) > max)
-                            max = static_cast<double>(idata[inx]);
-                        if (static_cast<double>(idata[inx]) < min)
-                            min = static_cast<double>(idata[inx]);
-                        break;
-                    }
-                }
-            }
-            chunk_iter++;
+        if (col_inx < 0)
+            return false;
+        const Bobbin& bob{ bob_iter->second };
+        duckdb_logical_type colm_type_l{ type_iter->second[col_inx] };
+        return zone_iter->second.get_min_max(index_map[handle], col_inx, offset, count, min, max,
+            [&bob, col_inx, colm_type_l](uint32_t chunk_inx, uint32_t begin, uint32_t end, ColumnZone& zone) {
+                zone_slice(bob[chunk_inx], col_inx, colm_type_l, begin, end, zone);
+            });
+    }
+
+    // Scan rows [begin,end) of one column of a chunk into zone. Used on the
+    // DB thread at ingest, and on the GUI thread for partial chunks, so it
+    // must not touch the working storage members.
+    static void zone_slice(duckdb_data_chunk chunk, idx_t col_inx, duckdb_logical_type colm_type_l,
+                            uint32_t begin, uint32_t end, ColumnZone& zone) {
+        duckdb_vector colm = duckdb_data_chunk_get_vector(chunk, col_inx);
+        uint64_t* validities = duckdb_vector_get_validity(colm);
+        void* data = duckdb_vector_get_data(colm);
+        double divisor{ 1.0 };
+        duckdb_type colm_type = duckdb_get_type_id(colm_type_l);
+        if (colm_type == DUCKDB_TYPE_DECIMAL) {
+            divisor = pow(10, duckdb_decimal_scale(colm_type_l));
+            colm_type = duckdb_decimal_internal_type(colm_type_l);
+        }
+        switch (colm_type) {
+        case DUCKDB_TYPE_SMALLINT:
+            zone_scan(zone, (int16_t*)data, validities, begin, end, divisor);
+            break;
+        case DUCKDB_TYPE_INTEGER:
+        case DUCKDB_TYPE_DATE:      // int32_t days
+            zone_scan(zone, (int32_t*)data, validities, begin, end, divisor);
+            break;
+        case DUCKDB_TYPE_BIGINT:
+        case DUCKDB_TYPE_TIMESTAMP_S:   // 4 duckdb_timestamp[_??] types, all
+        case DUCKDB_TYPE_TIMESTAMP_MS:  // holding a single int64_t
+        case DUCKDB_TYPE_TIMESTAMP:
+        case DUCKDB_TYPE_TIMESTAMP_NS:
+            zone_scan(zone, (int64_t*)data, validities, begin, end, divisor);
+            break;
+        case DUCKDB_TYPE_FLOAT:
+            zone_scan(zone, (float*)data, validities, begin, end);
+            break;
+        case DUCKDB_TYPE_DOUBLE:
+            zone_scan(zone, (double*)data, validities, begin, end);
+            break;
+        default:
+            // no min,max for VARCHAR etc, but we still count nulls
+            zone.row_count += end - begin;
+            zone.null_count += (end - begin) - simd_count_valid(validities, begin, end);
+            break;
         }
-        return true;
     }
 
     Range* init_range(RSHandle h, const char* col_name,
@@ -303,15 +536,18 @@ public:
         auto bob_iter = bobbin_map.find(h);
         if (bob_iter == bobbin_map.end())
             return nullptr;
+        // map offset to chunk via the row index, and clamp count
+        // so next_range cannot step past the last chunk
+        const ChunkIndex& cinx{ index_map[h] };
+        if (!cinx.locate(offset, range.start_chunk, range.chunk_offset))
+            return nullptr;
         // if the underlying is int, we cp into double_int_buffer
         Bobbin& bob = bobbin_map.at(h);
         range.bob = &bob;
         range.offset = offset;
-        range.row_count = count;
-        range.start_chunk = range.offset / CHUNK_SIZE;
-        range.chunk_offset = offset % CHUNK_SIZE;
+        range.row_count = std::min(count, cinx.row_count - offset);
         range.chunk_index = range.start_chunk;
-        range.remaining = count;
+        range.remaining = range.row_count;
         range.col_inx = get_col_index(h, col_name);
         const std::vector<duckdb_type>& types{ type_map.at(h) };
         range.col_type = types[range.col_inx];
@@ -330,14 +566,15 @@ public:
         auto bob_iter = bobbin_map.find(h);
         if (bob_iter == bobbin_map.end())
             return nullptr;
+        const ChunkIndex& cinx{ index_map[h] };
+        if (!cinx.locate(offset, range.start_chunk, range.chunk_offset))
+            return nullptr;
         Bobbin& bob = bobbin_map.at(h);
         range.bob = &bob;
         range.offset = offset;
-        range.row_count = count;
-        range.start_chunk = range.offset / CHUNK_SIZE;
-        range.chunk_offset = offset % CHUNK_SIZE;
+        range.row_count = std::min(count, cinx.row_count - offset);
         range.chunk_index = range.start_chunk;
-        range.remaining = count;
+        range.remaining = range.row_count;
         range.xcol_inx = get_col_index(h, xcol_name);
         range.ycol_inx = get_col_index(h, ycol_name);
         const std::vector<duckdb_type>& types{ type_map.at(h) };
@@ -397,11 +634,13 @@ public:
                 range->idata += range->chunk_offset;
                 range->anydata = reinterpret_cast<char*>(range->idata);
                 range->mem_size = range->edit_count * 4;
-                for (int i = 0; i < range->edit_count; i++)
-                    dbl_buf[i] = static_cast<double>(range->idata[i]);
+                simd_widen(range->idata, dbl_buf, range->edit_count);
                 range->dbldata = dbl_buf;
             break;
         }          
+        // nulls read as NaN in dbldata; anydata stays as Duck has it
+        range->dbldata = simd_nan_nulls(range->dbldata, duckdb_vector_get_validity(colm),
+                                        range->chunk_offset, range->edit_count, dbl_buf);
         if (range->chunk_index == range->start_chunk) {
             // Only apply offset to first chunk. 
             // And it may have been zero anyway
@@ -413,6 +652,7 @@ public:
 
     XYRange* next_xy_range(XYRange* range) {
         static double_t dbl_buf[CHUNK_SIZE];
+        static double_t ydbl_buf[CHUNK_SIZE];
 
         if (range == nullptr || range->bob == nullptr)
             return nullptr;
@@ -462,12 +702,16 @@ public:
             break;
         case DUCKDB_TYPE_INTEGER:
             range->idata += range->chunk_offset;
-            for (int i = 0; i < range->plot_count; i++)
-                dbl_buf[i] = static_cast<double>(range->idata[i]);
+            simd_widen(range->idata, dbl_buf, range->plot_count);
             range->xdata = dbl_buf;
             break;
         }
         range->ydata += range->chunk_offset;
+        // nulls are NaN, so ImPlot breaks the line there
+        range->xdata = simd_nan_nulls(range->xdata, duckdb_vector_get_validity(xcolm),
+                                        range->chunk_offset, range->plot_count, dbl_buf);
+        range->ydata = simd_nan_nulls(range->ydata, duckdb_vector_get_validity(ycolm),
+                                        range->chunk_offset, range->plot_count, ydbl_buf);
         if (range->chunk_index == range->start_chunk) {
             // Only apply offset to first chunk. 
             // And it may have been zero anyway
@@ -477,6 +721,69 @@ public:
         return range;
     }
 
+    // Zero copy view of one column over every chunk of h, for the ImPlot
+    // getters in render_shaded_plot. See series.hpp.
+    bool init_series(RSHandle h, const char* col_name, SeriesColumn& series) {
+        series.clear();
+        auto bob_iter = bobbin_map.find(h);
+        auto type_iter = logical_type_map.find(h);
+        auto inx_iter = index_map.find(h);
+        if (bob_iter == bobbin_map.end() || type_iter == logical_type_map.end() || inx_iter == index_map.end())
+            return false;
+        int32_t col_inx = get_col_index(h, col_name);
+        if (col_inx < 0)
+            return false;
+        duckdb_logical_type colm_type_l{ type_iter->second[col_inx] };
+        duckdb_type colm_type = duckdb_get_type_id(colm_type_l);
+        if (colm_type == DUCKDB_TYPE_DECIMAL) {
+            series.divisor = pow(10, duckdb_decimal_scale(colm_type_l));
+            colm_type = duckdb_decimal_internal_type(colm_type_l);
+        }
+        switch (colm_type) {
+        case DUCKDB_TYPE_SMALLINT:      series.type = stInt16; break;
+        case DUCKDB_TYPE_INTEGER:       series.type = stInt32; break;
+        case DUCKDB_TYPE_BIGINT:        series.type = stInt64; break;
+        case DUCKDB_TYPE_FLOAT:         series.type = stFloat; break;
+        case DUCKDB_TYPE_DOUBLE:        series.type = stDouble; break;
+        case DUCKDB_TYPE_VARCHAR:
+        case DUCKDB_TYPE_ENUM:
+            // sorts on a coded column compare the codes' ranks
+            series.dict = dict_column(h, col_inx);
+            if (series.dict != nullptr)
+                series.type = stDict;
+            else if (colm_type == DUCKDB_TYPE_VARCHAR)
+                series.type = stString16;
+            else
+                return false;
+            break;
+        case DUCKDB_TYPE_DATE:          // int32_t days
+            series.type = stInt32;
+            series.time = true;
+            series.divisor = 1.0 / 86400.0;
+            break;
+        case DUCKDB_TYPE_TIMESTAMP_S:
+        case DUCKDB_TYPE_TIMESTAMP_MS:
+        case DUCKDB_TYPE_TIMESTAMP:
+        case DUCKDB_TYPE_TIMESTAMP_NS:
+            series.type = stInt64;
+            series.time = true;
+            series.divisor = colm_type == DUCKDB_TYPE_TIMESTAMP_S ? 1.0
+                : colm_type == DUCKDB_TYPE_TIMESTAMP_MS ? 1e3
+                : colm_type == DUCKDB_TYPE_TIMESTAMP ? 1e6 : 1e9;
+            break;
+        default:
+            // BOOLEAN, HUGEINT DECIMALs etc
+            return false;
+        }
+        for (duckdb_data_chunk chunk : bob_iter->second) {
+            duckdb_vector colm = duckdb_data_chunk_get_vector(chunk, col_inx);
+            series.chunks.push_back(duckdb_vector_get_data(colm));
+            series.validities.push_back(duckdb_vector_get_validity(colm));
+        }
+        series.cinx = &inx_iter->second;
+        return series.ready();
+    }
+
     StringVec& get_col_names(RSHandle handle) {
         StringVec& colm_names = col_names_map[handle];
         return colm_names;
@@ -492,8 +799,11 @@ public:
         return rv;
     }
 
-    bool get_meta_data(RSHandle h, std::uint32_t& column_count, std::uint32_t& row_count) {
-        duckdb_result* result_ptr = reinterpret_cast<duckdb_result*>(h);
+    bool get_meta_data(RSHandle h, std::uint32_t& column_count, std::uint32_t& row_count, const char* col_formats = nullptr) {
+        ResultSlot* slot = reinterpret_cast<ResultSlot*>(h);
+        if (slot == nullptr || slot->live == nullptr)
+            return false;
+        duckdb_result* result_ptr = &slot->live->result;
 
         column_count = duckdb_column_count(result_ptr);
         row_count = get_row_count(h);
@@ -515,25 +825,91 @@ public:
                 types.push_back(duckdb_get_type_id(type_l));
                 col_names.push_back(duckdb_column_name(result_ptr, index));
             }
+            init_enum_dicts(h, logical_types);
+        }
+        ColFormats& formats{ formats_map[h] };
+        if (!formats.matches(col_formats, column_count)) {
+            compile_formats(formats, col_formats, types, logical_types, col_names);
         }
         return true;
     }
 
+    // An ENUM is dictionary coded by DuckDB itself: its chunks hold the
+    // codes, and its logical type the dictionary
+    void init_enum_dicts(RSHandle h, const std::vector<duckdb_logical_type>& logical_types) {
+        for (size_t col_inx = 0; col_inx < logical_types.size(); col_inx++) {
+            duckdb_logical_type type_l{ logical_types[col_inx] };
+            if (duckdb_get_type_id(type_l) != DUCKDB_TYPE_ENUM)
+                continue;
+            DictColumns& dicts{ dict_map[h] };
+            dicts.resize(logical_types.size());
+            DictColumn& dcol{ dicts[col_inx] };
+            dcol.code_bytes = static_cast<uint8_t>(fixed_width(type_l));
+            dcol.coded_chunks = UINT32_MAX;
+            dcol.dict.clear();
+            uint32_t entry_count = duckdb_enum_dictionary_size(type_l);
+            for (uint32_t code = 0; code < entry_count; code++) {
+                char* entry = duckdb_enum_dictionary_value(type_l, code);
+                dcol.dict.add(entry, static_cast<uint32_t>(strlen(entry)));
+                duckdb_free(entry);
+            }
+        }
+    }
+
+    // The dictionary of a coded VARCHAR or ENUM column, else nullptr
+    const DictColumn* dict_column(RSHandle h, uint32_t col_inx) const {
+        auto dict_iter = dict_map.find(h);
+        if (dict_iter == dict_map.end() || col_inx >= dict_iter->second.size()
+                || !dict_iter->second[col_inx].is_coded())
+            return nullptr;
+        return &dict_iter->second[col_inx];
+    }
+
+    // One ColFormatter per column, so get_datum doesn't look at logical
+    // types, or build printf formats, per cell
+    static void compile_formats(ColFormats& formats, const char* col_formats, const std::vector<duckdb_type>& types,
+                                const std::vector<duckdb_logical_type>& logical_types, const StringVec& col_names) {
+        std::vector<ColFormatSpec> specs{ parse_col_formats(col_formats, col_names) };
+        formats.cspec = col_formats ? col_formats : "";
+        formats.cols.clear();
+        for (size_t col_inx = 0; col_inx < types.size(); col_inx++) {
+            const ColFormatSpec& spec{ specs[col_inx] };
+            switch (types[col_inx]) {
+            case DUCKDB_TYPE_BOOLEAN:       formats.cols.emplace_back(cfkBool, spec); break;
+            case DUCKDB_TYPE_TINYINT:
+            case DUCKDB_TYPE_SMALLINT:
+            case DUCKDB_TYPE_INTEGER:
+            case DUCKDB_TYPE_BIGINT:        formats.cols.emplace_back(cfkInt, spec); break;
+            case DUCKDB_TYPE_HUGEINT:       formats.cols.push_back(ColFormatter::decimal(0, spec)); break;
+            case DUCKDB_TYPE_FLOAT:
+            case DUCKDB_TYPE_DOUBLE:        formats.cols.emplace_back(cfkDouble, spec); break;
+            case DUCKDB_TYPE_DATE:          formats.cols.emplace_back(cfkDate, spec); break;
+            case DUCKDB_TYPE_TIMESTAMP_S:   formats.cols.push_back(ColFormatter::timestamp(1, spec)); break;
+            case DUCKDB_TYPE_TIMESTAMP_MS:  formats.cols.push_back(ColFormatter::timestamp(1000, spec)); break;
+            case DUCKDB_TYPE_TIMESTAMP:     formats.cols.push_back(ColFormatter::timestamp(1000000, spec)); break;
+            case DUCKDB_TYPE_TIMESTAMP_NS:  formats.cols.push_back(ColFormatter::timestamp(1000000000, spec)); break;
+            case DUCKDB_TYPE_DECIMAL:
+                formats.cols.push_back(ColFormatter::decimal(duckdb_decimal_scale(logical_types[col_inx]), spec));
+                formats.cols.back().storage = duckdb_decimal_internal_type(logical_types[col_inx]);
+                break;
+            default:                        formats.cols.emplace_back(cfkNone, spec); break;
+            }
+        }
+    }
+
     const char* get_datum(RSHandle h, std::uint32_t colm_index, std::uint32_t row_index) {
         auto bmit = bobbin_map.find(h);
         if (bmit == bobbin_map.end())
             return nullptr;
         const Bobbin& bob{ bmit->second };
-        duckdb_data_chunk chunk;
-
-        uint64_t rel_index = row_index % duck_chunk_size;
-        uint64_t chunk_index = row_index / duck_chunk_size;
-        auto bob_iter = bob.cbegin();
-        while (chunk_index > 0) {
-            --chunk_index;
-            ++bob_iter;
+        uint32_t rel_index{ 0 };
+        uint32_t chunk_index{ 0 };
+        if (!index_map[h].locate(row_index, chunk_index, rel_index)) {
+            string_buffer[0] = 0;
+            buffer = string_buffer;
+            return nullptr;
         }
-        chunk = *bob_iter;
+        duckdb_data_chunk chunk{ bob[chunk_index] };
         duckdb_vector colm = duckdb_data_chunk_get_vector(chunk, colm_index);
         uint64_t* validities = duckdb_vector_get_validity(colm);
         // In most cases we'll copy into string_buffer, or
@@ -546,12 +922,25 @@ public:
             // NB we only do this work if the field is valid
             const std::vector<duckdb_type>& types{ type_map.at(h) };
             duckdb_type colm_type(types[colm_index]);
-            const std::vector<duckdb_logical_type>& logical_types{ logical_type_map.at(h) };
-            duckdb_logical_type colm_type_l(logical_types[colm_index]);
+            ColFormatter& fmtr{ formats_map.at(h).cols[colm_index] };
+            void* data = duckdb_vector_get_data(colm);
 
             switch (colm_type) {
-            case DUCKDB_TYPE_VARCHAR:
-                vcdata = (duckdb_string_t*)duckdb_vector_get_data(colm);
+            case DUCKDB_TYPE_ENUM:
+            case DUCKDB_TYPE_VARCHAR: {
+                // a coded cell is an index load, and an entry that was
+                // zero terminated once, when it joined the dictionary
+                const DictColumn* dcol{ dict_column(h, colm_index) };
+                if (dcol != nullptr && dcol->coded(chunk_index)) {
+                    uint32_t len{ 0 };
+                    buffer = const_cast<char*>(dcol->text_at(data, rel_index, len));
+                    return nullptr;
+                }
+                if (colm_type == DUCKDB_TYPE_ENUM) {
+                    string_buffer[0] = 0;
+                    break;
+                }
+                vcdata = (duckdb_string_t*)data;
                 if (duckdb_string_is_inlined(vcdata[rel_index])) {
                     // if inlined is 12 chars, there will be no zero terminator
                     memcpy(string_buffer, vcdata[rel_index].value.inlined.inlined, vcdata[rel_index].value.inlined.length);
@@ -564,65 +953,50 @@ public:
                     return vcdata[rel_index].value.pointer.ptr + vcdata[rel_index].value.pointer.length;
                 }
                 break;
-            case DUCKDB_TYPE_BIGINT:
-                bidata = (int64_t*)duckdb_vector_get_data(colm);
-                sprintf(string_buffer, "%I64d", bidata[rel_index]);
-                break;
+            }
+            case DUCKDB_TYPE_BOOLEAN:
+                return fmtr.format_bool(static_cast<bool*>(data)[rel_index], string_buffer);
+            case DUCKDB_TYPE_TINYINT:
+                return fmtr.format_int(static_cast<int8_t*>(data)[rel_index], string_buffer);
+            case DUCKDB_TYPE_SMALLINT:
+                return fmtr.format_int(static_cast<int16_t*>(data)[rel_index], string_buffer);
             case DUCKDB_TYPE_INTEGER:
-                idata = (int32_t*)duckdb_vector_get_data(colm);
-                fmt_result = fmt::format_to_n(string_buffer, STR_BUF_LEN, "{}", idata[rel_index]);
-                return buffer + fmt_result.size;
+                return fmtr.format_int(static_cast<int32_t*>(data)[rel_index], string_buffer);
+            case DUCKDB_TYPE_BIGINT:
+                return fmtr.format_int(static_cast<int64_t*>(data)[rel_index], string_buffer);
+            case DUCKDB_TYPE_HUGEINT:
+                hidata = static_cast<duckdb_hugeint*>(data);
+                return fmtr.format_decimal(hidata[rel_index].lower, hidata[rel_index].upper, string_buffer);
+            case DUCKDB_TYPE_FLOAT:
+                return fmtr.format_double(static_cast<float*>(data)[rel_index], string_buffer);
             case DUCKDB_TYPE_DOUBLE:
-                dbldata = (double_t*)duckdb_vector_get_data(colm);
-                fmt_result = fmt::format_to_n(string_buffer, STR_BUF_LEN, "{}", dbldata[rel_index]);
-                return buffer + fmt_result.size;
+                return fmtr.format_double(static_cast<double*>(data)[rel_index], string_buffer);
+            case DUCKDB_TYPE_DATE:      // int32_t days
+                return fmtr.format_date(static_cast<int32_t*>(data)[rel_index], string_buffer);
                 // 4 duckdb_timestamp[_??] types, all holding
                 // a single int64_t named differently
             case DUCKDB_TYPE_TIMESTAMP_S:
-                ts_secs = (duckdb_timestamp_s*)duckdb_vector_get_data(colm);
-                fmt_result = fmt::format_to_n(string_buffer, STR_BUF_LEN, "{:%F %T}", TPSecs{ std::chrono::seconds{ ts_secs->seconds } });
-                return buffer + fmt_result.size;
             case DUCKDB_TYPE_TIMESTAMP_MS:
-                ts_milli = (duckdb_timestamp_ms*)duckdb_vector_get_data(colm);
-                fmt_result = fmt::format_to_n(string_buffer, STR_BUF_LEN, "{:%F %T}", TPMilli{ std::chrono::milliseconds{ts_milli->millis} });
-                return buffer + fmt_result.size;
             case DUCKDB_TYPE_TIMESTAMP:
-                ts_micro = (duckdb_timestamp*)duckdb_vector_get_data(colm);
-                fmt_result = fmt::format_to_n(string_buffer, STR_BUF_LEN, "{:%F %T}", TPMicro{ std::chrono::microseconds{ ts_micro->micros } });
-                return buffer + fmt_result.size;
             case DUCKDB_TYPE_TIMESTAMP_NS:
-                ts_nano = (duckdb_timestamp_ns*)duckdb_vector_get_data(colm);
-                fmt_result = fmt::format_to_n(string_buffer, STR_BUF_LEN, "{:%F %T}", TPNano{ std::chrono::microseconds{ ts_nano->nanos } });
-                return buffer + fmt_result.size;
+                return fmtr.format_timestamp(static_cast<int64_t*>(data)[rel_index], string_buffer);
             case DUCKDB_TYPE_DECIMAL:
-                decimal_width = duckdb_decimal_width(colm_type_l);
-                decimal_scale = duckdb_decimal_scale(colm_type_l);
-                decimal_type = duckdb_decimal_internal_type(colm_type_l);
-                decimal_divisor = pow(10, decimal_scale);
-
-                switch (decimal_type) {
-                case DUCKDB_TYPE_SMALLINT:  // int16_t
-                    sidata = (int16_t*)duckdb_vector_get_data(colm);
-                    decimal_value = (double)sidata[rel_index] / decimal_divisor;
-                    break;
-                case DUCKDB_TYPE_INTEGER:   // int32_t
-                    idata = (int32_t*)duckdb_vector_get_data(colm);
-                    decimal_value = (double)idata[rel_index] / decimal_divisor;
-                    break;
-                case DUCKDB_TYPE_BIGINT:    // int64_t
-                    bidata = (int64_t*)duckdb_vector_get_data(colm);
-                    decimal_value = (double)bidata[rel_index] / decimal_divisor;
-                    break;
-                case DUCKDB_TYPE_HUGEINT:   // duckdb_hugeint: 128
-                    hidata = (duckdb_hugeint*)duckdb_vector_get_data(colm);
-                    decimal_value = duckdb_hugeint_to_double(hidata[rel_index]) / decimal_divisor;
-                    break;
+                // width and scale were taken once, in compile_formats
+                switch (fmtr.storage) {
+                case DUCKDB_TYPE_SMALLINT:
+                    return fmtr.format_decimal(static_cast<int16_t*>(data)[rel_index], string_buffer);
+                case DUCKDB_TYPE_INTEGER:
+                    return fmtr.format_decimal(static_cast<int32_t*>(data)[rel_index], string_buffer);
+                case DUCKDB_TYPE_BIGINT:
+                    return fmtr.format_decimal(static_cast<int64_t*>(data)[rel_index], string_buffer);
+                case DUCKDB_TYPE_HUGEINT:
+                    hidata = static_cast<duckdb_hugeint*>(data);
+                    return fmtr.format_decimal(hidata[rel_index].lower, hidata[rel_index].upper, string_buffer);
                 }
-                // decimal scale 2 means we want "%.2f"
-                // NB %% is the "escape sequence" for %
-                // in a printf format, not \%.
-                sprintf(format_buffer, "%%.%df", decimal_scale);
-                sprintf(string_buffer, format_buffer, decimal_value);
+                string_buffer[0] = 0;
+                break;
+            default:
+                string_buffer[0] = 0;
                 break;
             }
         }
@@ -632,36 +1006,465 @@ public:
         return nullptr;
     }
 
-    void get_db_responses(std::queue<nlohmann::json>& responses) {
+    // GUI thread: wait free when the rings are empty, which is most frames
+    void get_db_responses(std::queue<DBMsg>& responses) {
         static const char* method = "DBCache::get_db_responses: ";
-        boost::unique_lock<boost::mutex> from_lock(result_mutex);
-        db_results.swap(responses);
-        if (!responses.empty()) {
-            std::cout << method << responses.size() << " responses" << std::endl;
+        size_t response_count{ responses.size() };
+        uint32_t ring_count = result_ring_count.load(boost::memory_order_acquire);
+        for (uint32_t ring_inx = 0; ring_inx < ring_count; ring_inx++) {
+            ResultRing& ring(*result_rings[ring_inx]);
+            while (ring.try_pop(result_scratch)) {
+                if (result_scratch.seq == 0) {
+                    deliver(result_scratch, responses);
+                    continue;
+                }
+                ResultSlot& slot{ result_slots[result_scratch.is_chunk
+                    ? result_scratch.staged.qid : result_scratch.response.qid] };
+                if (result_scratch.seq != slot.next_seq) {
+                    // a result still on another ring comes first
+                    slot.held.emplace(result_scratch.seq, std::move(result_scratch));
+                    continue;
+                }
+                deliver(result_scratch, responses);
+                slot.next_seq++;
+                for (auto held_iter = slot.held.begin();
+                        held_iter != slot.held.end() && held_iter->first == slot.next_seq;
+                        held_iter = slot.held.erase(held_iter)) {
+                    deliver(held_iter->second, responses);
+                    slot.next_seq++;
+                }
+            }
+        }
+        if (responses.size() > response_count) {
+            std::cout << method << responses.size() - response_count << " responses" << std::endl;
+        }
+        if (budget.over()) {
+            evict();
+        }
+    }
+
+    void deliver(DBResult& result, std::queue<DBMsg>& responses) {
+        if (result.is_chunk) {
+            adopt(result.staged);
+        }
+        else {
+            if (result.version != 0) {
+                announce(result.response.qid, result.version);
+            }
+            responses.push(std::move(result.response));
+        }
+    }
+
+    // GUI thread: a chunk of the live version extends it, as a streamed
+    // or resumed batch does. One of a newer version waits in the slot
+    // until that version is published. Older versions' chunks are stale.
+    void adopt(StagedChunk& staged) {
+        ResultSlot& slot{ result_slots[staged.qid] };
+        RSHandle handle = reinterpret_cast<std::uint64_t>(&slot);
+        if (staged.reset) {
+            handle_qids[handle] = staged.qid;
+            stage_version(handle, slot, staged.result);
+            return;
+        }
+        if (slot.live != nullptr && staged.version == slot.live->version) {
+            adopt_chunk(handle, staged);
+        }
+        else if (staged.version > newest_version(slot)
+                || (slot.building != nullptr && staged.version == slot.building->version)) {
+            slot.staged.push_back(std::move(staged));
+        }
+        else {
+            duckdb_destroy_data_chunk(&staged.chunk);
+        }
+    }
+
+    static uint32_t newest_version(const ResultSlot& slot) {
+        if (slot.building != nullptr)
+            return slot.building->version;
+        return slot.live != nullptr ? slot.live->version : 0;
+    }
+
+    // GUI thread: a requery's result becomes the slot's building version,
+    // replacing any unpublished one. A query_id's results are released
+    // in seq order, but should an older one still
+    // turn up here, it's retired unseen.
+    void stage_version(RSHandle handle, ResultSlot& slot, ResultVersion* result) {
+        static const char* method = "DBCache::stage_version: ";
+        if (result->version <= newest_version(slot)) {
+            retire(result);
+            return;
+        }
+        if (slot.building != nullptr) {
+            std::cout << method << "QID(" << handle_qids[handle] << ") v" << slot.building->version
+                << " unpublished, superseded by v" << result->version << std::endl;
+            retire(slot.building);
+        }
+        slot.building = result;
+        // drop staged chunks of the versions this one supersedes
+        auto keep_iter = std::partition(slot.staged.begin(), slot.staged.end(),
+            [result](const StagedChunk& staged) { return staged.version >= result->version; });
+        for (auto stale_iter = keep_iter; stale_iter != slot.staged.end(); ++stale_iter) {
+            duckdb_destroy_data_chunk(&stale_iter->chunk);
+        }
+        slot.staged.erase(keep_iter, slot.staged.end());
+        if (slot.announced >= result->version) {
+            publish(handle, slot);
         }
     }
 
-    void db_dispatch(nlohmann::json& db_request) {
+    // GUI thread: a BatchResponse, partial or final, or an interrupted
+    // BatchRequest, reports on version. If that's the building version,
+    // its chunks so far are ready to draw.
+    void announce(const std::string& qid, uint32_t version) {
+        ResultSlot& slot{ result_slots[qid] };
+        slot.announced = std::max(slot.announced, version);
+        if (slot.building != nullptr && slot.building->version == version) {
+            publish(reinterpret_cast<std::uint64_t>(&slot), slot);
+        }
+    }
+
+    // GUI thread: swap the building version in for the live one, which
+    // is retired, along with its chunks and schema. The handle is the
+    // same, and the epoch bump tells views to rebuild.
+    void publish(RSHandle handle, ResultSlot& slot) {
+        reset_handle(handle, slot.live);
+        slot.live = slot.building;
+        slot.building = nullptr;
+        // chunks of a still newer version stay staged, in ring order
+        std::vector<StagedChunk> staged_chunks;
+        staged_chunks.swap(slot.staged);
+        for (StagedChunk& staged : staged_chunks) {
+            if (staged.version == slot.live->version)
+                adopt_chunk(handle, staged);
+            else
+                slot.staged.push_back(std::move(staged));
+        }
+    }
+
+    void adopt_chunk(RSHandle handle, StagedChunk& staged) {
+        Bobbin& bob{ bobbin_map[handle] };
+        bob.push_back(staged.chunk);
+        if (!staged.coded.empty()) {
+            // coded chunks are a prefix of each column's chunks, as a
+            // worker stops coding a column once its dictionary fills
+            DictColumns& dicts{ dict_map[handle] };
+            dicts.resize(staged.coded.size());
+            for (size_t col_inx = 0; col_inx < staged.coded.size(); col_inx++) {
+                DictColumn& dcol{ dicts[col_inx] };
+                if (col_inx < staged.dict_deltas.size())
+                    dcol.dict.append(staged.dict_deltas[col_inx]);
+                if (staged.coded[col_inx]) {
+                    dcol.code_bytes = sizeof(uint16_t);
+                    dcol.coded_chunks = static_cast<uint32_t>(bob.size());
+                }
+            }
+        }
+        index_map[handle].add_chunk(static_cast<uint32_t>(duckdb_data_chunk_get_size(staged.chunk)));
+        zone_maps[handle].add_chunk(std::move(staged.zones));
+        budget.add(handle, staged.bytes);
+    }
+
+    // GUI thread: free LRU result sets until we're back under budget.
+    // Pinned handles and those with lane work queued or executing stay.
+    // The slot and its handle_qids entry stay, the slot empty, so
+    // get_handle returns 0 until a requery is published. A worker only
+    // looks a version up in result_map while its lane is busy, and stays
+    // busy until it's done with it. So a version whose lane is idle
+    // under map_mutex can't be in use, and once it's out of result_map
+    // no worker can find it. lane_mutex isn't needed.
+    void evict() {
+        static const char* method = "DBCache::evict: ";
+        while (budget.over()) {
+            RSHandle victim{ 0 };
+            ResultVersion* evicted{ nullptr };
+            {
+                boost::unique_lock<boost::mutex> map_lock(map_mutex);
+                victim = budget.lru_victim([this](RSHandle h) {
+                    if (handle_qids.find(h) == handle_qids.end())
+                        return false;
+                    ResultVersion* live = reinterpret_cast<ResultSlot*>(h)->live;
+                    return live == nullptr || live->lane_busy == nullptr || !live->lane_busy->load();
+                });
+                if (victim == 0) {
+                    std::cerr << method << "OVER_BUDGET: used(" << budget.used_bytes << ") budget("
+                        << budget.budget_bytes << ") nothing evictable" << std::endl;
+                    return;
+                }
+                evicted = reinterpret_cast<ResultSlot*>(victim)->live;
+                // a BatchRequest on it now fails, as the result has gone,
+                // unless a requery has already replaced it
+                const std::string& qid{ handle_qids[victim] };
+                auto result_iter = result_map.find(qid);
+                if (result_iter != result_map.end() && result_iter->second == evicted) {
+                    result_map.erase(result_iter);
+                    encoder_map.erase(qid);
+                }
+            }
+            std::cout << method << "QID(" << handle_qids[victim] << ") bytes(" << budget.usage[victim].bytes << ")" << std::endl;
+            reset_handle(victim, evicted);
+            reinterpret_cast<ResultSlot*>(victim)->live = nullptr;
+        }
+    }
+
+    // Approximate chunk footprint: fixed width values plus validity, and
+    // the inline duckdb_string_t for VARCHAR, or its code if it's coded
+    static uint64_t chunk_bytes(idx_t row_count, const std::vector<duckdb_logical_type>& types,
+                                const std::vector<uint8_t>& coded) {
+        uint64_t row_bytes{ 0 };
+        for (size_t col_inx = 0; col_inx < types.size(); col_inx++) {
+            idx_t width = fixed_width(types[col_inx]);
+            if (col_inx < coded.size() && coded[col_inx])
+                width = sizeof(uint16_t);
+            else if (width == 0)
+                width = 16;     // duckdb_string_t, or a LIST's entry
+            row_bytes += width;
+        }
+        return row_count * row_bytes + ((row_count + 63) / 64) * 8 * types.size();
+    }
+
+    // Bytes per row of a fixed width type, zero for VARCHAR, BLOB, LIST etc
+    static idx_t fixed_width(duckdb_logical_type type_l) {
+        duckdb_type colm_type = duckdb_get_type_id(type_l);
+        if (colm_type == DUCKDB_TYPE_DECIMAL)
+            colm_type = duckdb_decimal_internal_type(type_l);
+        else if (colm_type == DUCKDB_TYPE_ENUM)
+            colm_type = duckdb_enum_internal_type(type_l);
+        switch (colm_type) {
+        case DUCKDB_TYPE_BOOLEAN:
+        case DUCKDB_TYPE_TINYINT:
+        case DUCKDB_TYPE_UTINYINT:
+            return 1;
+        case DUCKDB_TYPE_SMALLINT:
+        case DUCKDB_TYPE_USMALLINT:
+            return 2;
+        case DUCKDB_TYPE_INTEGER:
+        case DUCKDB_TYPE_UINTEGER:
+        case DUCKDB_TYPE_DATE:
+        case DUCKDB_TYPE_FLOAT:
+            return 4;
+        case DUCKDB_TYPE_BIGINT:
+        case DUCKDB_TYPE_UBIGINT:
+        case DUCKDB_TYPE_DOUBLE:
+        case DUCKDB_TYPE_TIME:
+        case DUCKDB_TYPE_TIME_TZ:
+        case DUCKDB_TYPE_TIMESTAMP_S:
+        case DUCKDB_TYPE_TIMESTAMP_MS:
+        case DUCKDB_TYPE_TIMESTAMP:
+        case DUCKDB_TYPE_TIMESTAMP_NS:
+        case DUCKDB_TYPE_TIMESTAMP_TZ:
+            return 8;
+        case DUCKDB_TYPE_HUGEINT:
+        case DUCKDB_TYPE_UHUGEINT:
+        case DUCKDB_TYPE_INTERVAL:
+        case DUCKDB_TYPE_UUID:
+            return 16;
+        default:
+            return 0;
+        }
+    }
+
+    // Worker threads: swap the strings of chunk's coded columns for
+    // USMALLINT codes. The first chunk decides which VARCHAR columns are
+    // worth coding: those with no more than a quarter as many distinct
+    // strings as rows. A column whose dictionary fills stays as strings
+    // from that chunk on. Returns a new chunk with the other columns
+    // copied over, coded and deltas filled in, or nullptr if no column
+    // was coded, when the caller keeps chunk as it is.
+    static duckdb_data_chunk encode_chunk(duckdb_data_chunk chunk, const std::vector<duckdb_logical_type>& types,
+                                uint32_t dict_max, DictEncoders& encoders,
+                                std::vector<uint8_t>& coded, std::vector<StringDict>& deltas) {
+        idx_t col_count = types.size();
+        idx_t row_count = duckdb_data_chunk_get_size(chunk);
+        bool deciding = !encoders.decided;
+        if (deciding) {
+            encoders.decided = true;
+            encoders.cols.resize(col_count);
+            // LIST, STRUCT etc can't be copied into the new chunk
+            bool copyable{ true };
+            for (idx_t col_inx = 0; col_inx < col_count; col_inx++) {
+                bool varchar = duckdb_get_type_id(types[col_inx]) == DUCKDB_TYPE_VARCHAR;
+                copyable = copyable && (varchar || fixed_width(types[col_inx]) > 0);
+                encoders.cols[col_inx].active = varchar;
+                encoders.cols[col_inx].max_codes = std::min(dict_max, 65535u);
+            }
+            if (!copyable) {
+                for (DictEncoder& enc : encoders.cols)
+                    enc.deactivate();
+            }
+        }
+        if (!encoders.any_active())
+            return nullptr;
+        std::vector<std::vector<uint16_t>> codes(col_count);
+        bool any_coded{ false };
+        for (idx_t col_inx = 0; col_inx < col_count; col_inx++) {
+            DictEncoder& enc{ encoders.cols[col_inx] };
+            if (!enc.active)
+                continue;
+            duckdb_vector colm = duckdb_data_chunk_get_vector(chunk, col_inx);
+            uint64_t* validities = duckdb_vector_get_validity(colm);
+            duckdb_string_t* strs = static_cast<duckdb_string_t*>(duckdb_vector_get_data(colm));
+            std::vector<uint16_t>& col_codes{ codes[col_inx] };
+            col_codes.assign(row_count, 0);     // nulls code 0 under their validity bit
+            bool full{ false };
+            for (idx_t row = 0; row < row_count && !full; row++) {
+                if (!duckdb_validity_row_is_valid(validities, row))
+                    continue;
+                duckdb_string_t& str{ strs[row] };
+                const char* text = duckdb_string_is_inlined(str) ? str.value.inlined.inlined : str.value.pointer.ptr;
+                uint32_t code{ 0 };
+                full = !enc.encode(text, str.value.inlined.length, code);
+                col_codes[row] = static_cast<uint16_t>(code);
+            }
+            if (full || (deciding && static_cast<idx_t>(enc.size()) * 4 > row_count)) {
+                enc.deactivate();
+                col_codes.clear();
+                continue;
+            }
+            any_coded = true;
+        }
+        if (!any_coded)
+            return nullptr;
+        duckdb_logical_type code_type = duckdb_create_logical_type(DUCKDB_TYPE_USMALLINT);
+        std::vector<duckdb_logical_type> coded_types(types);
+        coded.assign(col_count, 0);
+        deltas.resize(col_count);
+        for (idx_t col_inx = 0; col_inx < col_count; col_inx++) {
+            if (!codes[col_inx].empty()) {
+                coded_types[col_inx] = code_type;
+                coded[col_inx] = 1;
+                deltas[col_inx] = encoders.cols[col_inx].take_delta();
+            }
+        }
+        duckdb_data_chunk coded_chunk = duckdb_create_data_chunk(coded_types.data(), col_count);
+        duckdb_destroy_logical_type(&code_type);
+        for (idx_t col_inx = 0; col_inx < col_count; col_inx++) {
+            duckdb_vector src = duckdb_data_chunk_get_vector(chunk, col_inx);
+            duckdb_vector dst = duckdb_data_chunk_get_vector(coded_chunk, col_inx);
+            uint64_t* src_validity = duckdb_vector_get_validity(src);
+            if (src_validity) {
+                duckdb_vector_ensure_validity_writable(dst);
+                memcpy(duckdb_vector_get_validity(dst), src_validity, ((row_count + 63) / 64) * 8);
+            }
+            void* dst_data = duckdb_vector_get_data(dst);
+            idx_t width = fixed_width(types[col_inx]);
+            if (coded[col_inx]) {
+                memcpy(dst_data, codes[col_inx].data(), row_count * sizeof(uint16_t));
+            }
+            else if (width > 0) {
+                memcpy(dst_data, duckdb_vector_get_data(src), row_count * width);
+            }
+            else {
+                // a VARCHAR that isn't worth coding goes through Duck's
+                // string heap, as its long strings point into src's
+                duckdb_string_t* strs = static_cast<duckdb_string_t*>(duckdb_vector_get_data(src));
+                for (idx_t row = 0; row < row_count; row++) {
+                    if (!duckdb_validity_row_is_valid(src_validity, row))
+                        continue;
+                    duckdb_string_t& str{ strs[row] };
+                    const char* text = duckdb_string_is_inlined(str) ? str.value.inlined.inlined : str.value.pointer.ptr;
+                    duckdb_vector_assign_string_element_len(dst, row, text, str.value.inlined.length);
+                }
+            }
+        }
+        duckdb_data_chunk_set_size(coded_chunk, row_count);
+        return coded_chunk;
+    }
+
+    // GUI thread: empty the handle, so its ResultSlot can take another
+    // version or stay empty. The chunks, logical types and result go to
+    // retire, as views may hold pointers into them until the next frame.
+    void reset_handle(RSHandle handle, ResultVersion* result) {
+        RetiredVersion& old{ retire(result) };
+        auto bob_iter = bobbin_map.find(handle);
+        if (bob_iter != bobbin_map.end()) {
+            old.chunks = std::move(bob_iter->second);
+            bobbin_map.erase(bob_iter);
+        }
+        auto ltype_iter = logical_type_map.find(handle);
+        if (ltype_iter != logical_type_map.end()) {
+            old.logical_types = std::move(ltype_iter->second);
+            logical_type_map.erase(ltype_iter);
+        }
+        index_map.erase(handle);
+        zone_maps.erase(handle);
+        type_map.erase(handle);
+        col_names_map.erase(handle);
+        formats_map.erase(handle);
+        dict_map.erase(handle);
+        budget.remove(handle);
+        result_epoch++;
+    }
+
+    RetiredVersion& retire(ResultVersion* result) {
+        RetiredVersion& old{ retired.emplace_back() };
+        old.frame = budget.frame;
+        old.result = result;
+        return old;
+    }
+
+    void db_dispatch(DBMsg&& db_request) {
         const static char* method = "DBCache::db_dispatch: ";
         std::cout << method << db_request << std::endl;
-        try {
-            // grab lock for this Q: should be free as ::duck_loop should be in to_cond.wait()
-            boost::unique_lock<boost::mutex> request_lock(query_mutex);
-            db_queries.push(db_request);
+        // db_loop drains the ring far faster than the GUI can fill
+        // it, so a full ring means the DB thread is stuck. try_push
+        // only moves from db_request when it succeeds.
+        if (!request_ring.try_push(std::move(db_request))) {
+            std::cerr << method << "REQUEST_RING_FULL" << std::endl;
+            while (!request_ring.try_push(std::move(db_request))) {
+                boost::this_thread::yield();
+            }
         }
-        catch (...) {
-            std::cerr << "db_dispatch EXCEPTION!" << std::endl;
+        request_bell.ring();
+    }
+
+    void set_done(bool d) {
+        done = d;
+        // wake db_loop and the idle workers so they can exit
+        request_bell.ring();
+        {
+            boost::unique_lock<boost::mutex> lane_lock(lane_mutex);
+            lane_cond.notify_all();
+        }
+    }
+
+    // DB threads: a full ring means the GUI thread isn't pumping
+    // messages, so back off until it catches up
+    void post_result(ResultRing& ring, DBResult&& result) {
+        while (!ring.try_push(std::move(result))) {
+            if (done)
+                return;
+            boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
         }
-        // lock is out of scope so released: signal duck thread to wake up
-        query_cond.notify_one();
     }
 
-    void set_done(bool d) { done = d; }
+    void post_response(ResultRing& ring, DBMsg&& response, uint32_t version = 0) {
+        DBResult result;
+        result.response = std::move(response);
+        result.version = version;
+        post_result(ring, std::move(result));
+    }
+
+    void post_response(ResultPort& port, DBMsg&& response, uint32_t version = 0) {
+        DBResult result;
+        result.response = std::move(response);
+        result.seq = ++port.seq;
+        result.version = version;
+        post_result(port.ring, std::move(result));
+    }
+
+    void post_chunk(ResultPort& port, StagedChunk&& staged) {
+        DBResult result;
+        result.staged = std::move(staged);
+        result.seq = ++port.seq;
+        result.is_chunk = true;
+        post_result(port.ring, std::move(result));
+    }
 
 public:
     // db_init, db_fnls, db_loop: these three methods exec 
     // on the DB thread
     bool db_init() {
+        static const char* method = "DuckDBCache::db_init: ";
         char* duck_error = nullptr;
         if (duckdb_create_config(&duck_config) == DuckDBError) {
             std::cerr << "DUCK_INIT_FAIL duckdb_create_config" << std::endl;
@@ -675,25 +1478,121 @@ public:
             NDConfig<nlohmann::json>& cfg{ NDConfig<nlohmann::json>::get_instance() };
             StringStringMap cfg_map;
             if (cfg.get_nested_str_map(Static::db_config_cs, cfg_map)) {
+                take_config_value(cfg_map, Static::pool_size_cs, pool_size);
+                pool_size = std::max(pool_size, 1u);
+                take_config_value(cfg_map, Static::stream_chunks_cs, stream_chunks);
+                take_config_value(cfg_map, Static::mem_budget_mb_cs, mem_budget_mb);
+                take_config_value(cfg_map, Static::max_rows_cs, max_rows);
+                take_config_value(cfg_map, Static::db_path_cs, db_path);
+                take_config_value(cfg_map, Static::dict_max_cs, dict_max);
+                budget.budget_bytes = static_cast<uint64_t>(mem_budget_mb) << 20;
                 for (auto citer = cfg_map.cbegin(); citer != cfg_map.cend(); ++citer) {
                     duckdb_set_config(duck_config, citer->first.c_str(), citer->second.c_str());
                     std::cout << "DUCK_INIT: " << citer->first.c_str() << ":" << citer->second.c_str() << std::endl;
                 }
             }
         }
-        if (duckdb_open_ext(NULL, &duck_db, duck_config, &duck_error) == DuckDBError) {
+        const char* open_path = db_path.empty() ? NULL : db_path.c_str();
+        if (duckdb_open_ext(open_path, &duck_db, duck_config, &duck_error) == DuckDBError) {
             std::cerr << "DUCK_INIT_FAIL duckdb_open " << duck_error << std::endl;
             return false;
         }
-        if (duckdb_connect(duck_db, &duck_conn) == DuckDBError) {
-            std::cerr << "DUCK_INIT_FAIL duckdb_connect" << std::endl;
+        // nothing outlives an in memory database, so nothing to cache
+        if (!db_path.empty()) {
+            scan_cache.init(duck_db);
+        }
+        std::cout << method << "pool_size(" << pool_size << ") stream_chunks(" << stream_chunks
+            << ") mem_budget_mb(" << mem_budget_mb << ") max_rows(" << max_rows << ") db_path("
+            << (db_path.empty() ? ":memory:" : db_path) << ") scan_cache(" << scan_cache.is_enabled()
+            << ") dict_max(" << dict_max << ")" << std::endl;
+        return true;
+    }
+
+    // db_config holds Duck settings plus a few of our own, which
+    // we take out before the rest goes to duckdb_set_config
+    static void take_config_value(StringStringMap& cfg_map, const char* key, uint32_t& value) {
+        static const char* method = "DuckDBCache::take_config_value: ";
+        auto cfg_iter = cfg_map.find(key);
+        if (cfg_iter == cfg_map.end())
+            return;
+        try {
+            value = static_cast<uint32_t>(std::stoul(cfg_iter->second));
+        }
+        catch (...) {
+            std::cerr << method << "BAD_CONFIG_VALUE: " << key << ":" << cfg_iter->second << std::endl;
+        }
+        cfg_map.erase(cfg_iter);
+    }
+
+    static void take_config_value(StringStringMap& cfg_map, const char* key, std::string& value) {
+        auto cfg_iter = cfg_map.find(key);
+        if (cfg_iter == cfg_map.end())
+            return;
+        value = cfg_iter->second;
+        cfg_map.erase(cfg_iter);
+    }
+
+    // Worker threads: prepare the lane's statement on first use, or when
+    // the template SQL has changed, then bind db_request.params to $1..$n.
+    // DuckDB param indices are 1 based. extra_params are left for the
+    // caller to bind after $n, as Refresh does its mark.
+    static bool bind_prepared(duckdb_connection conn, PreparedQuery& prepared, const DBMsg& db_request,
+                                idx_t extra_params = 0) {
+        static const char* method = "DuckDBCache::bind_prepared: ";
+        if (prepared.stmt == nullptr || prepared.sql != db_request.sql) {
+            if (prepared.stmt != nullptr) {
+                duckdb_destroy_prepare(&prepared.stmt);
+            }
+            prepared.sql.clear();
+            if (duckdb_prepare(conn, db_request.sql.c_str(), &prepared.stmt) == DuckDBError) {
+                std::cerr << method << "PREPARE_FAIL: " << duckdb_prepare_error(prepared.stmt)
+                    << ": " << db_request.sql << std::endl;
+                duckdb_destroy_prepare(&prepared.stmt);
+                return false;
+            }
+            prepared.sql = db_request.sql;
+            std::cout << method << "PREPARED QID(" << db_request.qid << ")" << std::endl;
+        }
+        idx_t nparams = duckdb_nparams(prepared.stmt);
+        if (nparams != db_request.params.size() + extra_params) {
+            std::cerr << method << "PARAM_COUNT(" << db_request.params.size() + extra_params << ") SQL expects("
+                << nparams << "): " << db_request << std::endl;
             return false;
         }
+        duckdb_clear_bindings(prepared.stmt);
+        for (idx_t inx = 0; inx < db_request.params.size(); inx++) {
+            const DBParam& param(db_request.params[inx]);
+            duckdb_state dbstate{ DuckDBSuccess };
+            switch (param.type) {
+            case cdInt:     dbstate = duckdb_bind_int64(prepared.stmt, inx + 1, param.i); break;
+            case cdDouble:  dbstate = duckdb_bind_double(prepared.stmt, inx + 1, param.d); break;
+            case cdBool:    dbstate = duckdb_bind_boolean(prepared.stmt, inx + 1, param.b); break;
+            case cdStr:     dbstate = duckdb_bind_varchar(prepared.stmt, inx + 1, param.s.c_str()); break;
+            default:        dbstate = duckdb_bind_null(prepared.stmt, inx + 1); break;
+            }
+            if (dbstate == DuckDBError) {
+                std::cerr << method << "BIND_FAIL($" << inx + 1 << "): " << db_request << std::endl;
+                return false;
+            }
+        }
         return true;
     }
 
     void db_fnls() {
-        duckdb_disconnect(&duck_conn);
+        lane_cond.notify_all();
+        db_workers.join_all();
+        for (auto& prepared_pair : prepared_map) {
+            duckdb_destroy_prepare(&prepared_pair.second.stmt);
+        }
+        prepared_map.clear();
+        for (auto& refresh_pair : refresh_map) {
+            duckdb_destroy_prepare(&refresh_pair.second.stmt.stmt);
+        }
+        refresh_map.clear();
+        for (auto& conn_pair : conn_map) {
+            duckdb_disconnect(&conn_pair.second);
+        }
+        conn_map.clear();
         duckdb_close(&duck_db);
     }
 
@@ -706,132 +1605,752 @@ public:
             exit(1);
         }
         else {
-            // lock the result queue and post back to the GUI thread
-            // NB nd_type is the Event, and query_id is the Entity
-            nlohmann::json db_instance = {
-                {Static::nd_type_cs, Static::online_cs},
-                {Static::query_id_cs, Static::duck_db_cs}
-            };
-            boost::unique_lock<boost::mutex> results_lock(result_mutex);
-            db_results.push(db_instance);
+            // post back to the GUI thread
+            // NB type is the Event, and qid is the Entity
+            DBMsg db_instance;
+            db_instance.type = dbOnline;
+            db_instance.qid = Static::duck_db_cs;
+            // db_loop's own result ring goes first, then one per
+            // worker, all before the GUI thread can see any of them
+            for (uint32_t i = 0; i <= pool_size; i++) {
+                result_rings.emplace_back(new ResultRing());
+            }
+            for (uint32_t i = 0; i < pool_size; i++) {
+                progress_slots.emplace_back(new QueryProgress());
+            }
+            result_ring_count.store(pool_size + 1, boost::memory_order_release);
             std::cout << method << "DB: " << db_instance << std::endl;
+            post_response(*result_rings[0], std::move(db_instance));
         }
 
-        nlohmann::json response_list_j = nlohmann::json::array();
         duck_chunk_size = duckdb_vector_size();
+        for (uint32_t i = 0; i < pool_size; i++) {
+            ResultRing* ring = result_rings[i + 1].get();
+            QueryProgress* progress = progress_slots[i].get();
+            db_workers.create_thread([this, ring, progress]() { db_worker(*ring, *progress); });
+        }
 
-        // https://www.boost.org/doc/libs/1_34_0/doc/html/boost/condition.html
-        // A condition object is always used in conjunction with a mutex object (an object
-        // whose type is a model of a Mutex or one of its refinements). The mutex object
-        // must be locked prior to waiting on the condition, which is verified by passing a lock
-        // object (an object whose type is a model of Lock or one of its refinements) to the
-        // condition object's wait functions. Upon blocking on the condition object, the thread
-        // unlocks the mutex object. When the thread returns from a call to one of the condition object's
-        // wait functions the mutex object is again locked. The tricky unlock/lock sequence is performed
-        // automatically by the condition object's wait functions.
-
+        DBMsg db_request;
         while (!done) {
-            boost::unique_lock<boost::mutex> to_lock(query_mutex);
-            query_cond.wait(to_lock);
-            pix_begin_dbase();
-            // thead quiesces in the wait above, with query_mutex
-            // unlocked so the C++ thread can add work items
-            std::cout << method << "db_queries depth : " << db_queries.size() << std::endl;
-            while (!db_queries.empty()) {
-                nlohmann::json db_request(db_queries.front());
-                std::cout << method << "processing " << db_request.dump() << std::endl;
-                db_queries.pop();
-                if (!db_request.contains(Static::nd_type_cs)) {
+            // Take the doorbell key before checking the ring, so a request
+            // pushed after the check still wakes us. The wait times out so
+            // we can police request deadlines.
+            uint32_t key = request_bell.key();
+            if (request_ring.empty()) {
+                request_bell.wait_for(key, boost::chrono::milliseconds(watchdog_ms));
+            }
+            check_deadlines();
+            if (!request_ring.empty()) {
+                std::cout << method << "request_ring depth : " << request_ring.size() << std::endl;
+            }
+            while (request_ring.try_pop(db_request)) {
+                if (!db_event_is_valid(db_request.type)) {
                     std::cerr << method << "nd_type missing: " << db_request << std::endl;
                     continue;
                 }
-                const std::string& nd_type(db_request[Static::nd_type_cs]);
-                if ((nd_type == Static::command_cs || nd_type == Static::query_cs)
-                    && !db_request.contains(Static::sql_cs)) {
+                if ((db_request.type == dbCommand || db_request.type == dbQuery)
+                    && db_request.sql.empty()) {
                     std::cerr << method << "sql missing: " << db_request << std::endl;
                     continue;
                 }
-                if ((nd_type == Static::function_async_cs)  || 
-                    (nd_type == Static::function_sync_cs)) {
-                    int raw_func_inx = JAsInt(db_request, Static::query_id_cs);
-                    std::cerr << "NOT_YET_IMPLEMENTED(" << nd_type << "/" << raw_func_inx << "): " << db_request << std::endl;
+                if ((db_request.type == dbFunctionAsync) ||
+                    (db_request.type == dbFunctionSync)) {
+                    std::cerr << "NOT_YET_IMPLEMENTED(" << DBEventTypeToString(db_request.type) << "/"
+                        << db_request.func_inx << ")" << std::endl;
                     continue;
                 }
-                const std::string& qid(db_request[Static::query_id_cs]);
-                nlohmann::json db_response = { {Static::query_id_cs, qid}};
-                // Command request do not produce a result set, unlike queries
-                if (nd_type == Static::command_cs) {
-                    duckdb_state dbstate;
-                    const std::string& sql(db_request[Static::sql_cs]);
-                    db_response[Static::nd_type_cs] = Static::command_result_cs;
-                    // Duck C API scans may throw C++ duckdb.HTTPException
-                    std::exception_ptr active_exception;
-                    try {
-                        dbstate = duckdb_query(duck_conn, sql.c_str(), nullptr);
-                        pix_report(DBScan, static_cast<float>(scan_count++));
-                    }
-                    catch (...) {
-                        // DuckDB C API can throw exceptions from the parquet
-                        // extension. 
-                        std::cerr << method << "COMMAND_FAIL: " << db_request.dump() << std::endl;
-                        db_response[Static::error_cs] = 1;
-                    }
-                    // dbstate should be defaulted to DuckDBSuccess if an 
-                    // exception was thrown above, so this is the non except
-                    // error path
-                    if (dbstate == DuckDBError) {
-                        std::cerr << method << "COMMAND_FAIL: " << db_request.dump() << std::endl;
-                        db_response[Static::error_cs] = 1;
+                enqueue_lane(std::move(db_request));
+            }
+        }
+        db_fnls();
+    }
+
+    // DB dispatcher thread: add to the query_id's lane, and make the
+    // lane ready unless it's already ready or executing
+    void enqueue_lane(DBMsg&& db_request) {
+        static const char* method = "DuckDBCache::enqueue_lane: ";
+        std::string qid(db_request.qid);
+        boost::unique_lock<boost::mutex> lane_lock(lane_mutex);
+        if (db_request.type == dbQuery) {
+            supersede_lane(qid);
+        }
+        lanes[qid].push(std::move(db_request));
+        std::cout << method << "QID(" << qid << ") depth(" << lanes[qid].size() << ")" << std::endl;
+        LaneState& state(lane_states[qid]);
+        if (!state.busy) {
+            state.busy = true;
+            ready_lanes.push_back(qid);
+            lane_cond.notify_one();
+        }
+    }
+
+    // DB dispatcher thread, with lane_mutex held: a new Query makes any
+    // older Query or BatchRequest on the same query_id moot. Queued ones
+    // are replaced in the lane by their Cancelled response, which the
+    // worker posts in turn, so it follows the responses to the requests
+    // ahead of it. An executing one is interrupted. Commands are left
+    // alone as they may have side effects the app depends on.
+    void supersede_lane(const std::string& qid) {
+        static const char* method = "DuckDBCache::supersede_lane: ";
+        std::queue<DBMsg>& lane(lanes[qid]);
+        std::queue<DBMsg> kept;
+        while (!lane.empty()) {
+            DBMsg& queued(lane.front());
+            if (queued.type == dbCommand || queued.type == dbCancelled) {
+                kept.push(std::move(queued));
+            }
+            else {
+                std::cout << method << "CANCEL_QUEUED: " << queued << std::endl;
+                kept.push(interrupted_response(queued, liCancelled));
+            }
+            lane.pop();
+        }
+        lane.swap(kept);
+        LaneState& state(lane_states[qid]);
+        if (state.executing && state.supersedable) {
+            interrupt_lane(qid, state, liCancelled);
+        }
+    }
+
+    // DB dispatcher thread: interrupt requests that have overrun their
+    // timeout_ms. The worker posts TimedOut once Duck gives up.
+    void check_deadlines() {
+        boost::unique_lock<boost::mutex> lane_lock(lane_mutex);
+        auto now = boost::chrono::steady_clock::now();
+        for (auto& state_pair : lane_states) {
+            LaneState& state(state_pair.second);
+            if (state.executing && state.has_deadline && now >= state.deadline) {
+                state.has_deadline = false;
+                interrupt_lane(state_pair.first, state, liTimedOut);
+            }
+        }
+    }
+
+    // lane_mutex held. duckdb_interrupt is a no-op on an idle connection,
+    // and the worker clears interrupt before each request.
+    void interrupt_lane(const std::string& qid, LaneState& state, LaneInterrupt why) {
+        static const char* method = "DuckDBCache::interrupt_lane: ";
+        uint32_t expected{ liNone };
+        if (!state.interrupt.compare_exchange_strong(expected, why))
+            return;
+        std::cout << method << "QID(" << qid << ") " << (why == liTimedOut ? "TIMEOUT" : "SUPERSEDED") << std::endl;
+        auto conn_iter = conn_map.find(qid);
+        if (conn_iter != conn_map.end()) {
+            duckdb_interrupt(conn_iter->second);
+        }
+    }
+
+    // Cancelled|TimedOut in place of the request's usual response,
+    // echoing serial so NDContext can drop the waiting InFlight, and the
+    // request type in db_action.
+    static DBMsg interrupted_response(const DBMsg& db_request, LaneInterrupt why) {
+        DBMsg db_response{ response_to(db_request) };
+        db_response.type = why == liTimedOut ? dbTimedOut : dbCancelled;
+        db_response.db_action = db_request.type;
+        db_response.error = 1;
+        return db_response;
+    }
+
+    // A response echoes the request's query_id and serial, so NDContext
+    // can resume the sequence waiting on it without any lookups
+    static DBMsg response_to(const DBMsg& db_request) {
+        DBMsg db_response;
+        db_response.query_id = db_request.query_id;
+        db_response.qid = db_request.qid;
+        db_response.serial = db_request.serial;
+        return db_response;
+    }
+
+    // Worker threads: take the next request from the first ready lane,
+    // execute it on that lane's connection and post the response. Then
+    // requeue the lane at the back if it has more work, so busy lanes
+    // share the pool. With no lane ready, read a ScanJoin's next part on
+    // part_conn, this worker's own connection.
+    void db_worker(ResultRing& ring, QueryProgress& progress) {
+        static const char* method = "DuckDBCache::db_worker: ";
+        duckdb_connection part_conn{ nullptr };
+        while (true) {
+            std::string qid;
+            DBMsg db_request;
+            duckdb_connection conn{ nullptr };
+            PreparedQuery* prepared{ nullptr };
+            RefreshState* refresh{ nullptr };
+            LaneState* state{ nullptr };
+            {
+                boost::unique_lock<boost::mutex> lane_lock(lane_mutex);
+                lane_cond.wait(lane_lock, [this]() { return done || !ready_lanes.empty() || !scan_joins.empty(); });
+                if (done) {
+                    if (part_conn != nullptr)
+                        duckdb_disconnect(&part_conn);
+                    return;
+                }
+                if (ready_lanes.empty()) {
+                    std::shared_ptr<ScanJoin> join(scan_joins.front());
+                    size_t part{ 0 };
+                    claim_scan_part(join, part);
+                    lane_lock.unlock();
+                    if (part_conn == nullptr && duckdb_connect(duck_db, &part_conn) == DuckDBError) {
+                        std::cerr << method << "CONNECT_FAIL PART QID(" << join->qid << ")" << std::endl;
+                        part_conn = nullptr;
                     }
+                    progress.begin(join->qid);
+                    run_scan_part(part_conn, *join, part, progress);
+                    progress.end();
+                    continue;
                 }
-                else if (nd_type == Static::query_cs) {
-                    const std::string& sql(db_request[Static::sql_cs]);
-                    duckdb_result dbresult;
-                    duckdb_state dbstate = duckdb_query(duck_conn, sql.c_str(), &dbresult);
-                    db_response[Static::nd_type_cs] = Static::query_result_cs;
-                    if (dbstate == DuckDBError) {
-                        std::cerr << method << "QUERY_FAIL: " << db_request << std::endl;
-                        db_response[Static::error_cs] = 1;
+                qid = ready_lanes.front();
+                ready_lanes.pop_front();
+                std::queue<DBMsg>& lane(lanes[qid]);
+                db_request = std::move(lane.front());
+                lane.pop();
+                // element refs in unordered_map survive rehash
+                state = &lane_states[qid];
+                if (db_request.type != dbCancelled) {
+                    auto conn_iter = conn_map.find(qid);
+                    if (conn_iter != conn_map.end()) {
+                        conn = conn_iter->second;
+                    }
+                    else if (duckdb_connect(duck_db, &conn) == DuckDBError) {
+                        std::cerr << method << "CONNECT_FAIL QID(" << qid << ")" << std::endl;
+                        conn = nullptr;
                     }
                     else {
-                        result_map[qid] = dbresult;
-                        pix_report(DBQuery, static_cast<float>(query_count++));
+                        // duckdb_query_progress stays at -1 without the progress
+                        // bar, which is a connection setting, and which mustn't
+                        // draw on stdout
+                        duckdb_query(conn, "SET enable_progress_bar = true; SET enable_progress_bar_print = false;", nullptr);
+                        conn_map[qid] = conn;
                     }
-                }
-                else if (nd_type == Static::batch_request_cs) {
-                    db_response[Static::nd_type_cs] = Static::batch_response_cs;
-                    auto result_iter = result_map.find(qid);
-                    if (result_iter == result_map.end()) {
-                        db_response[Static::error_cs] = 1;
-                        std::cerr << method << "BATCH_FAIL: " << db_request << std::endl;
+                    if (db_request.prepared) {
+                        prepared = &prepared_map[qid];
                     }
-                    else {
-                        db_response[Static::error_cs] = 0;
-                        RSHandle handle = reinterpret_cast<std::uint64_t>(&(result_iter->second));
-                        Bobbin& chunk_deck(bobbin_map[handle]);
-                        while (true) {
-                            duckdb_data_chunk chunk = duckdb_fetch_chunk(result_iter->second);
-                            if (!chunk)
-                                break;
-                            chunk_deck.push_back(chunk);
-                            pix_report(DBBatch, static_cast<float>(batch_count++));
-                            idx_t row_count = duckdb_data_chunk_get_size(chunk);
-                            std::cout << method << "BATCH_OK(" << qid << ") rc(" << row_count << ") chunks(" << chunk_deck.size() << ")" << std::endl;
-                        }
+                    refresh = &refresh_map[qid];
+                    state->interrupt = liNone;
+                    state->executing = true;
+                    state->supersedable = db_request.type != dbCommand;
+                    state->has_deadline = db_request.timeout_ms > 0;
+                    if (state->has_deadline) {
+                        state->deadline = boost::chrono::steady_clock::now()
+                            + boost::chrono::milliseconds(db_request.timeout_ms);
                     }
                 }
+            }
+            // results are posted without lane_mutex, as post_result may
+            // have to wait for the GUI thread. The lane's next request
+            // can only run after this one's response is posted, so only
+            // this worker touches result_seq meanwhile.
+            ResultPort port{ ring, state->result_seq, state->busy };
+            if (db_request.type == dbCancelled) {
+                // superseded while queued: the entry is its own response
+                post_response(port, std::move(db_request));
+            }
+            else {
+                pix_begin_dbase();
+                std::cout << method << "processing " << db_request << std::endl;
+                // NB a null conn makes duckdb_query fail, so connect
+                // failures get the usual error response
+                DBMsg db_response{ response_to(db_request) };
+                progress.begin(qid);
+                uint32_t version{ 0 };
+                db_execute(conn, prepared, *refresh, db_request, db_response, state->interrupt, progress, port, version);
+                progress.end();
+                uint32_t why{ liNone };
+                {
+                    boost::unique_lock<boost::mutex> lane_lock(lane_mutex);
+                    state->executing = false;
+                    why = state->interrupt.exchange(liNone);
+                }
+                if (why != liNone) {
+                    // a timed out batch's rows so far are published, but a
+                    // superseded one's never are
+                    post_response(port, interrupted_response(db_request, static_cast<LaneInterrupt>(why)),
+                                  why == liTimedOut ? version : 0);
+                }
                 else {
-                    // unrecognised nd_type error!
-                    std::cerr << method << "BAD_ND_TYPE: " << nd_type << std::endl;
-                    continue;
+                    // post back to the GUI thread
+                    post_response(port, std::move(db_response), version);
                 }
-                // lock the result queue and post back to the GUI thread
-                boost::unique_lock<boost::mutex> results_lock(result_mutex);
-                db_results.push(db_response);
                 pix_end_event();
             }
+            boost::unique_lock<boost::mutex> lane_lock(lane_mutex);
+            if (lanes[qid].empty()) {
+                state->busy = false;
+            }
+            else {
+                ready_lanes.push_back(qid);
+                lane_cond.notify_one();
+            }
         }
-        db_fnls();
+    }
+
+    // Worker threads, lane_mutex held: claim join's next part, and take
+    // join off scan_joins once no part is left unclaimed
+    bool claim_scan_part(const std::shared_ptr<ScanJoin>& join, size_t& part) {
+        if (join->next_part >= join->part_sql.size())
+            return false;
+        part = join->next_part++;
+        if (join->next_part == join->part_sql.size()) {
+            scan_joins.erase(std::find(scan_joins.begin(), scan_joins.end(), join));
+        }
+        return true;
+    }
+
+    // Worker threads: read one file of a split scan into its part table.
+    // Once a part has failed, or the Command has been interrupted, the
+    // rest are skipped.
+    void run_scan_part(duckdb_connection conn, ScanJoin& join, size_t part, QueryProgress& progress) {
+        static const char* method = "DuckDBCache::run_scan_part: ";
+        duckdb_state dbstate{ DuckDBError };
+        if (join.interrupt == liNone) {
+            PendingExec exec{ conn, progress, join.interrupt };
+            try {
+                duckdb_result dbresult{};
+                dbstate = execute_sql(exec, join.part_sql[part], false, &dbresult);
+                duckdb_destroy_result(&dbresult);
+            }
+            catch (...) {
+                dbstate = DuckDBError;
+            }
+            if (dbstate == DuckDBError) {
+                std::cerr << method << "PART_FAIL QID(" << join.qid << "): " << join.part_sql[part] << std::endl;
+                uint32_t expected{ liNone };
+                join.interrupt.compare_exchange_strong(expected, liCancelled);
+            }
+        }
+        boost::unique_lock<boost::mutex> lane_lock(lane_mutex);
+        join.finished++;
+        scan_cond.notify_all();
+    }
+
+    // Worker threads: run a split scan Command. Its parts go on
+    // scan_joins for idle workers, and this worker reads them too until
+    // none is left unclaimed, so a busy pool only slows the scan down.
+    // Then it waits for the parts other workers took, passing on its
+    // lane's interrupt, and runs the Command on the UNION ALL of the
+    // part tables, which it drops afterwards.
+    duckdb_state execute_split(const PendingExec& exec, const std::string& qid, const ScanSplit& split,
+                               duckdb_result* result) {
+        auto join = std::make_shared<ScanJoin>();
+        join->qid = qid;
+        std::string parts;
+        std::string drops;
+        {
+            boost::unique_lock<boost::mutex> lane_lock(lane_mutex);
+            uint64_t seq = ++scan_join_seq;
+            for (size_t inx = 0; inx < split.part_selects.size(); inx++) {
+                std::string table = "\"__nd_scan_" + std::to_string(seq) + "_" + std::to_string(inx) + "\"";
+                join->part_sql.push_back("CREATE OR REPLACE TABLE " + table + " AS " + split.part_selects[inx]);
+                if (inx > 0)
+                    parts += split.by_name ? " UNION ALL BY NAME " : " UNION ALL ";
+                parts += "SELECT * FROM " + table;
+                drops += "DROP TABLE IF EXISTS " + table + ";";
+            }
+            scan_joins.push_back(join);
+            lane_cond.notify_all();
+        }
+        while (true) {
+            size_t part{ 0 };
+            {
+                boost::unique_lock<boost::mutex> lane_lock(lane_mutex);
+                if (!claim_scan_part(join, part))
+                    break;
+            }
+            if (exec.interrupt != liNone) {
+                uint32_t expected{ liNone };
+                join->interrupt.compare_exchange_strong(expected, exec.interrupt.load());
+            }
+            run_scan_part(exec.conn, *join, part, exec.progress);
+        }
+        {
+            boost::unique_lock<boost::mutex> lane_lock(lane_mutex);
+            while (join->finished < join->part_sql.size()) {
+                if (exec.interrupt != liNone) {
+                    uint32_t expected{ liNone };
+                    join->interrupt.compare_exchange_strong(expected, exec.interrupt.load());
+                }
+                scan_cond.wait_for(lane_lock, boost::chrono::milliseconds(watchdog_ms));
+            }
+        }
+        duckdb_state dbstate{ DuckDBError };
+        if (join->interrupt == liNone) {
+            dbstate = execute_sql(exec, split.prefix + "(" + parts + ")" + split.suffix, false, result);
+        }
+        duckdb_query(exec.conn, drops.c_str(), nullptr);
+        return dbstate;
+    }
+
+    // Worker threads: run one Command, Query, BatchRequest or Refresh.
+    // prepared is the lane's statement cache when the request binds
+    // params, and refresh its RefreshState. A BatchRequest or Refresh
+    // sets version to that of the result it fetched from or appended to.
+    void db_execute(duckdb_connection conn, PreparedQuery* prepared, RefreshState& refresh,
+                    const DBMsg& db_request, DBMsg& db_response,
+                    const boost::atomic<uint32_t>& interrupt, QueryProgress& progress, ResultPort& port,
+                    uint32_t& version) {
+        static const char* method = "DuckDBCache::db_execute: ";
+        const std::string& qid(db_request.qid);
+        const std::string& sql(db_request.sql);
+        // Commands and Queries execute a task at a time, publishing
+        // progress and checking interrupt in between
+        PendingExec exec{ conn, progress, interrupt };
+        // Command request do not produce a result set, unlike queries
+        if (db_request.type == dbCommand) {
+            duckdb_state dbstate{ DuckDBSuccess };
+            db_response.type = dbCommandResult;
+            // Duck C API scans may throw C++ duckdb.HTTPException
+            // scan_cache only covers plain SQL, as params aren't in the key
+            std::string fingerprint;
+            if (prepared == nullptr && scan_cache.is_enabled()) {
+                fingerprint = scan_cache.fingerprint(conn, sql);
+                if (!fingerprint.empty() && scan_cache.hit(conn, sql, fingerprint)) {
+                    std::cout << method << "SCAN_CACHE_HIT: " << db_request << std::endl;
+                    return;
+                }
+            }
+            try {
+                duckdb_result dbresult{};
+                ScanSplit split;
+                if (prepared == nullptr && pool_size > 1 && split_scan(sql, split)) {
+                    dbstate = execute_split(exec, qid, split, &dbresult);
+                }
+                else if (prepared == nullptr) {
+                    dbstate = execute_sql(exec, sql, false, &dbresult);
+                }
+                else if (!bind_prepared(conn, *prepared, db_request)) {
+                    dbstate = DuckDBError;
+                }
+                else {
+                    dbstate = execute_pending(exec, prepared->stmt, false, &dbresult);
+                }
+                duckdb_destroy_result(&dbresult);
+                pix_report(DBScan, static_cast<float>(scan_count++));
+            }
+            catch (...) {
+                // DuckDB C API can throw exceptions from the parquet
+                // extension. 
+                std::cerr << method << "COMMAND_FAIL: " << db_request << ": " << sql << std::endl;
+                db_response.error = 1;
+            }
+            // dbstate should be defaulted to DuckDBSuccess if an 
+            // exception was thrown above, so this is the non except
+            // error path
+            if (dbstate == DuckDBError) {
+                std::cerr << method << "COMMAND_FAIL: " << db_request << ": " << sql << std::endl;
+                db_response.error = 1;
+            }
+            // a failed scan may have dropped its tables, so forget it
+            if (!fingerprint.empty()) {
+                scan_cache.store(conn, sql, db_response.error ? std::string() : fingerprint);
+            }
+        }
+        else if (db_request.type == dbQuery) {
+            duckdb_result dbresult{};
+            duckdb_state dbstate{ DuckDBSuccess };
+            if (prepared == nullptr) {
+                dbstate = execute_sql(exec, sql, stream_chunks > 0, &dbresult);
+            }
+            else if (!bind_prepared(conn, *prepared, db_request)) {
+                dbstate = DuckDBError;
+            }
+            else {
+                dbstate = execute_pending(exec, prepared->stmt, stream_chunks > 0, &dbresult);
+            }
+            db_response.type = dbQueryResult;
+            if (dbstate == DuckDBError) {
+                // no result error when bind_prepared failed
+                const char* error = duckdb_result_error(&dbresult);
+                std::cerr << method << "QUERY_FAIL: " << (error ? error : "PREPARED") << ": " << sql << std::endl;
+                db_response.error = 1;
+                duckdb_destroy_result(&dbresult);
+                arm_refresh(refresh, db_request, nullptr, 0);
+            }
+            else {
+                // The GUI thread stages the new version before it sees
+                // this QueryResult, and keeps drawing the previous one
+                // until a BatchResponse publishes it. It retires the
+                // version this replaces, so we only repoint result_map.
+                StagedChunk reset_entry;
+                reset_entry.reset = true;
+                reset_entry.qid = qid;
+                reset_entry.result = new ResultVersion{ dbresult };
+                reset_entry.result->lane_busy = &port.busy;
+                {
+                    boost::unique_lock<boost::mutex> map_lock(map_mutex);
+                    reset_entry.result->version = ++version_seq;
+                    reset_entry.version = reset_entry.result->version;
+                    result_map[qid] = reset_entry.result;
+                    // the new result's columns start new dictionaries
+                    encoder_map[qid] = DictEncoders{};
+                }
+                arm_refresh(refresh, db_request, &reset_entry.result->result, reset_entry.version);
+                post_chunk(port, std::move(reset_entry));
+                pix_report(DBQuery, static_cast<float>(query_count++));
+            }
+        }
+        else if (db_request.type == dbBatchRequest || db_request.type == dbRefresh) {
+            db_response.type = dbBatchResponse;
+            duckdb_result* result{ nullptr };
+            DictEncoders* encoders{ nullptr };
+            {
+                // element refs in unordered_map survive rehash, so once
+                // we have one we can drop the lock. Only this lane
+                // requeries this query_id, and evict skips busy lanes,
+                // so the version stays put while we fetch.
+                boost::unique_lock<boost::mutex> map_lock(map_mutex);
+                auto result_iter = result_map.find(qid);
+                if (result_iter != result_map.end()) {
+                    result = &(result_iter->second->result);
+                    version = result_iter->second->version;
+                    // codes carry on from an earlier BatchRequest's
+                    encoders = &encoder_map[qid];
+                }
+            }
+            if (result == nullptr) {
+                db_response.error = 1;
+                std::cerr << method << "BATCH_FAIL: " << db_request << std::endl;
+            }
+            else if (db_request.type == dbBatchRequest) {
+                uint64_t admitted_rows{ 0 };
+                bool truncated{ false };
+                db_response.chunk_count = fetch_chunks(*result, db_request, version, *encoders, refresh,
+                                                        interrupt, port, admitted_rows, truncated);
+                db_response.done = true;
+                db_response.row_count = admitted_rows;
+                db_response.truncated = truncated;
+                if (refresh.version == version) {
+                    refresh.fetched = true;
+                    refresh.row_count += admitted_rows;
+                }
+            }
+            else {
+                db_response.db_action = dbRefresh;
+                db_refresh(exec, conn, refresh, db_request, db_response, version, *encoders, interrupt, port);
+            }
+        }
+        else {
+            // unrecognised nd_type error!
+            std::cerr << method << "BAD_ND_TYPE: " << db_request << std::endl;
+            db_response.type = db_request.type;
+            db_response.error = 1;
+        }
+    }
+
+    // Worker threads: fetch a BatchRequest's or Refresh's chunks. Each is
+    // zoned, coded and posted tagged with version, and a partial
+    // BatchResponse goes at stream_chunks chunks, then each time the count
+    // doubles. admitted_rows comes in as the rows already counted against
+    // max_rows. The zones of refresh's key column raise its mark.
+    uint32_t fetch_chunks(duckdb_result& result, const DBMsg& db_request, uint32_t version, DictEncoders& encoders,
+                            RefreshState& refresh, const boost::atomic<uint32_t>& interrupt, ResultPort& port,
+                            uint64_t& admitted_rows, bool& truncated) {
+        static const char* method = "DuckDBCache::fetch_chunks: ";
+        const std::string& qid(db_request.qid);
+        // logical types for zone_slice, released below
+        idx_t col_count = duckdb_column_count(&result);
+        std::vector<duckdb_logical_type> zone_types;
+        for (idx_t col_inx = 0; col_inx < col_count; col_inx++) {
+            zone_types.push_back(duckdb_column_logical_type(&result, col_inx));
+        }
+        bool marking = refresh.key_col >= 0 && refresh.version == version;
+        uint32_t chunk_count{ 0 };
+        uint32_t post_at{ stream_chunks };
+        // a superseded or timed out batch stops at the next chunk
+        while (interrupt == liNone) {
+            duckdb_data_chunk chunk = duckdb_fetch_chunk(result);
+            if (!chunk)
+                break;
+            pix_report(DBBatch, static_cast<float>(batch_count++));
+            idx_t row_count = duckdb_data_chunk_get_size(chunk);
+            // max_rows admission: the chunk that crosses it is cut
+            // short, and we say so in the BatchResponse rather than
+            // drop rows quietly
+            if (max_rows > 0 && admitted_rows + row_count > max_rows) {
+                truncated = true;
+                std::cerr << method << "BATCH_TRUNCATED(" << qid << ") max_rows(" << max_rows << ")" << std::endl;
+                row_count = admitted_rows < max_rows ? max_rows - admitted_rows : 0;
+                if (row_count == 0) {
+                    duckdb_destroy_data_chunk(&chunk);
+                    break;
+                }
+                duckdb_data_chunk_set_size(chunk, row_count);
+            }
+            admitted_rows += row_count;
+            ColumnZoneVec zones(col_count);
+            for (idx_t col_inx = 0; col_inx < col_count; col_inx++) {
+                zone_slice(chunk, col_inx, zone_types[col_inx], 0, static_cast<uint32_t>(row_count), zones[col_inx]);
+            }
+            if (marking && zones[refresh.key_col].has_values()) {
+                double chunk_max{ zones[refresh.key_col].max };
+                refresh.mark = refresh.has_mark ? std::max(refresh.mark, chunk_max) : chunk_max;
+                refresh.has_mark = true;
+            }
+            StagedChunk staged{ qid, version, chunk, std::move(zones) };
+            if (dict_max > 0) {
+                duckdb_data_chunk coded_chunk = encode_chunk(chunk, zone_types, dict_max, encoders,
+                                                                staged.coded, staged.dict_deltas);
+                if (coded_chunk) {
+                    duckdb_destroy_data_chunk(&chunk);
+                    staged.chunk = coded_chunk;
+                }
+            }
+            staged.bytes = chunk_bytes(row_count, zone_types, staged.coded);
+            for (const StringDict& delta : staged.dict_deltas)
+                staged.bytes += delta.bytes();
+            chunk_count++;
+            std::cout << method << "BATCH_OK(" << qid << ") rc(" << row_count << ") chunks(" << chunk_count << ")" << std::endl;
+            post_chunk(port, std::move(staged));
+            if (chunk_count == post_at) {
+                // partial BatchResponse with the chunk high water mark
+                // so the GUI can paint the rows we have so far
+                DBMsg partial{ response_to(db_request) };
+                partial.type = dbBatchResponse;
+                if (db_request.type == dbRefresh)
+                    partial.db_action = dbRefresh;
+                partial.chunk_count = chunk_count;
+                partial.done = false;
+                post_response(port, std::move(partial), version);
+                post_at *= 2;
+            }
+            if (truncated)
+                break;
+        }
+        for (auto& type_l : zone_types) {
+            duckdb_destroy_logical_type(&type_l);
+        }
+        return chunk_count;
+    }
+
+    // Worker threads: a Query rearms its lane's RefreshState, which is
+    // only refreshable when the Query names a refresh_key that's a column
+    // of its result, of a type a zone max can hold exactly
+    static void arm_refresh(RefreshState& refresh, const DBMsg& db_request, duckdb_result* result, uint32_t version) {
+        static const char* method = "DuckDBCache::arm_refresh: ";
+        refresh.key.clear();
+        refresh.key_col = -1;
+        refresh.version = version;
+        refresh.fetched = false;
+        refresh.has_mark = false;
+        refresh.row_count = 0;
+        if (result == nullptr || db_request.refresh_key.empty())
+            return;
+        idx_t col_count = duckdb_column_count(result);
+        int32_t key_col{ -1 };
+        for (idx_t col_inx = 0; col_inx < col_count && key_col < 0; col_inx++) {
+            if (db_request.refresh_key == duckdb_column_name(result, col_inx))
+                key_col = static_cast<int32_t>(col_inx);
+        }
+        duckdb_type key_type = key_col < 0 ? DUCKDB_TYPE_INVALID : duckdb_column_type(result, key_col);
+        switch (key_type) {
+        case DUCKDB_TYPE_SMALLINT:
+        case DUCKDB_TYPE_INTEGER:
+        case DUCKDB_TYPE_BIGINT:
+        case DUCKDB_TYPE_FLOAT:
+        case DUCKDB_TYPE_DOUBLE:
+        case DUCKDB_TYPE_DATE:
+        case DUCKDB_TYPE_TIMESTAMP:
+        case DUCKDB_TYPE_TIMESTAMP_S:
+        case DUCKDB_TYPE_TIMESTAMP_MS:
+            break;
+        default:
+            std::cerr << method << "BAD_REFRESH_KEY(" << db_request.refresh_key << "): " << db_request << std::endl;
+            return;
+        }
+        refresh.key = db_request.refresh_key;
+        refresh.key_col = key_col;
+        refresh.key_type = key_type;
+        refresh.sql = db_request.sql;
+        refresh.params = db_request.params;
+    }
+
+    // The Query's SQL, less any trailing ;, for rows past the mark, which
+    // binds to $n+1 after the Query's own $1..$n. Strictly past: rows
+    // tying the mark are taken to be fetched already, see refresh_key_cs.
+    static std::string refresh_sql(const RefreshState& refresh) {
+        std::string sql{ refresh.sql };
+        while (!sql.empty() && (std::isspace(static_cast<unsigned char>(sql.back())) || sql.back() == ';'))
+            sql.pop_back();
+        std::string key;
+        for (char c : refresh.key) {
+            if (c == '"')
+                key += '"';
+            key += c;
+        }
+        return "select * from (" + sql + ") where \"" + key + "\" > $" + std::to_string(refresh.params.size() + 1);
+    }
+
+    // The mark binds as the key column's own type, so DuckDB compares
+    // without casting the column
+    static duckdb_state bind_mark(const RefreshState& refresh, idx_t param_inx) {
+        duckdb_prepared_statement stmt{ refresh.stmt.stmt };
+        int64_t mark = static_cast<int64_t>(refresh.mark);
+        switch (refresh.key_type) {
+        case DUCKDB_TYPE_FLOAT:
+        case DUCKDB_TYPE_DOUBLE:
+            return duckdb_bind_double(stmt, param_inx, refresh.mark);
+        case DUCKDB_TYPE_DATE:
+            return duckdb_bind_date(stmt, param_inx, duckdb_date{ static_cast<int32_t>(mark) });
+        case DUCKDB_TYPE_TIMESTAMP_S:
+            return duckdb_bind_timestamp(stmt, param_inx, duckdb_timestamp{ mark * 1000000 });
+        case DUCKDB_TYPE_TIMESTAMP_MS:
+            return duckdb_bind_timestamp(stmt, param_inx, duckdb_timestamp{ mark * 1000 });
+        case DUCKDB_TYPE_TIMESTAMP:
+            return duckdb_bind_timestamp(stmt, param_inx, duckdb_timestamp{ mark });
+        default:
+            return duckdb_bind_int64(stmt, param_inx, mark);
+        }
+    }
+
+    // Worker threads: rerun a refreshable Query for the rows past its
+    // mark, and append them to the live version, so its handle, epoch,
+    // row index and zone maps carry on, and the cost is the new rows
+    // only. With no mark and no rows fetched so far, every row is new.
+    // With no mark but rows, the key has no non-null values to go past,
+    // so nothing is appended, as is the case before the first
+    // BatchRequest.
+    void db_refresh(const PendingExec& exec, duckdb_connection conn, RefreshState& refresh,
+                    const DBMsg& db_request, DBMsg& db_response, uint32_t version, DictEncoders& encoders,
+                    const boost::atomic<uint32_t>& interrupt, ResultPort& port) {
+        static const char* method = "DuckDBCache::db_refresh: ";
+        if (refresh.key.empty() || refresh.version != version) {
+            std::cerr << method << "NOT_REFRESHABLE: " << db_request << std::endl;
+            db_response.error = 1;
+            return;
+        }
+        if (!refresh.fetched) {
+            std::cout << method << "NOT_FETCHED: " << db_request << std::endl;
+            return;
+        }
+        if (!refresh.has_mark && refresh.row_count > 0) {
+            std::cerr << method << "NULL_KEY(" << refresh.key << ") no non-null values in "
+                << refresh.row_count << " rows: " << db_request << std::endl;
+            return;
+        }
+        DBMsg rerun{ response_to(db_request) };
+        rerun.sql = refresh.has_mark ? refresh_sql(refresh) : refresh.sql;
+        rerun.params = refresh.params;
+        duckdb_result dbresult{};
+        duckdb_state dbstate{ DuckDBError };
+        if (bind_prepared(conn, refresh.stmt, rerun, refresh.has_mark ? 1 : 0)
+                && (!refresh.has_mark || bind_mark(refresh, rerun.params.size() + 1) == DuckDBSuccess)) {
+            dbstate = execute_pending(exec, refresh.stmt.stmt, false, &dbresult);
+        }
+        if (dbstate == DuckDBError) {
+            const char* error = duckdb_result_error(&dbresult);
+            std::cerr << method << "REFRESH_FAIL: " << (error ? error : "PREPARED") << ": " << rerun.sql << std::endl;
+            db_response.error = 1;
+        }
+        else {
+            uint64_t admitted_rows{ refresh.row_count };
+            bool truncated{ false };
+            db_response.chunk_count = fetch_chunks(dbresult, db_request, version, encoders, refresh,
+                                                    interrupt, port, admitted_rows, truncated);
+            db_response.row_count = admitted_rows - refresh.row_count;
+            db_response.truncated = truncated;
+            refresh.row_count = admitted_rows;
+            std::cout << method << "REFRESH_OK(" << db_request.qid << ") rows(" << db_response.row_count
+                << ") mark(" << refresh.mark << ")" << std::endl;
+        }
+        duckdb_destroy_result(&dbresult);
     }
 
     void start_db_thread() {
@@ -852,119 +2371,168 @@ EM_JS(void, ems_db_dispatch, (emscripten::EM_VAL db_request_handle), {
 });
 
 class WebDuckDBCache {
+public:
+    using DBMsg = DBMessage<emscripten::val>;
 private:
-    // work Qs for talking to NDContext
-    std::queue<emscripten::val>         db_queries;
-    std::queue<emscripten::val>         db_results;
+    // work Q for talking to NDContext: results from duck_module.js
+    // are decoded once on arrival, see add_db_response
+    std::queue<DBMsg>                   db_results;
     // schema
     std::unordered_map<RSHandle, StringVec> column_map;
     std::unordered_map<RSHandle, std::vector<int>> type_map;
+    // get_datum's per column formatters, compiled by get_meta_data
+    std::unordered_map<RSHandle, ColFormats> formats_map;
+    // wdtDict columns' entries, from on_schema_cpp
+    std::unordered_map<RSHandle, DictColumns> dict_map;
     // data
     WasmChunkMap                        chunk_map;
+    std::unordered_map<RSHandle, ChunkIndex> index_map;
+    std::unordered_map<RSHandle, ZoneMap>   zone_maps;
+    // chunks from register_chunk that aren't filled yet: addr -> storage_key,
+    // size. They join chunk_map in on_chunk, so readers never see one
+    // materialize_worker.js is still writing.
+    std::unordered_map<uint32_t, std::pair<std::string, uint32_t>> pending_chunks;
+    // materialize_worker.js pushes the address of each chunk it fills
+    WordRing<256>                       chunk_queue;
     uint32_t                            duck_chunk_size{ CHUNK_SIZE };
+    // memory: see BBDuckDBCache. max_rows goes to duck_module.js on
+    // each BatchRequest, and open_batches are the query_ids whose
+    // batch generator may still register chunks, so can't be evicted.
+    uint32_t                            mem_budget_mb{ 0 };
+    uint32_t                            max_rows{ 0 };
+    ResultBudget                        budget;
+    // chunk storage: arena_mb is reserved at startup, and each query_id's
+    // chunks are released together by reset_handle
+    uint32_t                            arena_mb{ 0 };
+    ChunkArena                          arena;
+    // bumped by reset_handle, so render side caches such as CellCache
+    // know to drop what they formatted from the old chunks
+    uint32_t                            result_epoch{ 0 };
+    std::unordered_map<RSHandle, std::string> handle_qids;
+    StringSet                           open_batches;
+    // requery: a QueryResult puts its query_id in requeried, and if rows
+    // are held for it, the new schema and chunks build aside under
+    // building_key, in building. The query_id's view keeps the old rows
+    // until the first BatchResponse of the new ones, as on BB.
+    StringSet                           requeried;
+    StringSet                           building;
     // working storage
     char                                string_buffer[STR_BUF_LEN];
-    fmt::format_to_n_result<char*>      fmt_result;
 public:
     char* buffer{ 0 };
 
+    WebDuckDBCache() {
+        static const char* method = "DuckDBWebCache::ctor: ";
+        NDConfig<emscripten::val>& cfg{ NDConfig<emscripten::val>::get_instance() };
+        StringStringMap cfg_map;
+        if (cfg.get_nested_str_map(Static::db_config_cs, cfg_map)) {
+            config_value(cfg_map, Static::mem_budget_mb_cs, mem_budget_mb);
+            config_value(cfg_map, Static::max_rows_cs, max_rows);
+            config_value(cfg_map, Static::arena_mb_cs, arena_mb);
+            budget.budget_bytes = static_cast<uint64_t>(mem_budget_mb) << 20;
+        }
+        arena.reserve(static_cast<uint64_t>(arena_mb) << 20);
+        std::cout << method << "mem_budget_mb(" << mem_budget_mb << ") max_rows(" << max_rows
+            << ") arena_mb(" << arena_mb << ")" << std::endl;
+    }
+
+    static void config_value(const StringStringMap& cfg_map, const char* key, uint32_t& value) {
+        static const char* method = "DuckDBWebCache::config_value: ";
+        auto cfg_iter = cfg_map.find(key);
+        if (cfg_iter == cfg_map.end())
+            return;
+        try {
+            value = static_cast<uint32_t>(std::stoul(cfg_iter->second));
+        }
+        catch (...) {
+            std::cerr << method << "BAD_CONFIG_VALUE: " << key << ":" << cfg_iter->second << std::endl;
+        }
+    }
+
     // GUI thread methods for accessing the data
     RSHandle get_handle(const std::string& qname) {
         // const static char* method = "DuckDBWebCache::get_handle: ";
         auto cv_iter = chunk_map.find(qname);
-        if (cv_iter == chunk_map.end()) {
+        // a schema alone, from on_schema_cpp, isn't a result yet
+        if (cv_iter == chunk_map.end() || cv_iter->second.empty()) {
             // caller logs error
             return 0;
         }
-        WasmChunkVec& chunk_vector = chunk_map[qname];
-        return reinterpret_cast<RSHandle>(&chunk_vector);
+        RSHandle handle = reinterpret_cast<RSHandle>(&cv_iter->second);
+        budget.touch(handle);
+        return handle;
+    }
+
+    void start_frame() {
+        drain_chunk_queue();
+        budget.start_frame();
     }
 
+    uint32_t get_result_epoch() const { return result_epoch; }
+
+    // DuckDB-Wasm runs queries in its own worker, and doesn't report
+    // their progress to us
+    bool get_progress(const char* query_id, double& percent, double& rows_per_sec) const { return false; }
+
     uint32_t get_row_count(RSHandle handle) {
-        // First 3 32 bit words are done, ncols, nrows
-        uint32_t row_count{ 0 };
-        uint32_t* chunk_ptr = nullptr;
-        WasmChunkVec* wcv = reinterpret_cast<WasmChunkVec*>(handle);
-        if (wcv == nullptr)
-            return row_count;
-        for (auto scvit = wcv->begin(); scvit != wcv->end(); ++scvit) {
-            chunk_ptr = reinterpret_cast<uint32_t*>(scvit->addr);
-            row_count += *(chunk_ptr + 2);
-        }
-        return row_count;
+        // index_map is extended by on_chunk as each chunk is populated
+        auto inx_iter = index_map.find(handle);
+        if (inx_iter == index_map.end())
+            return 0;
+        return inx_iter->second.row_count;
     }
 
-    // NB implot works in doubles, even when our underlying is int
+    // NB implot works in doubles, even when our underlying is int.
+    // Axis limits come from the zone maps built by on_chunk.
     bool get_min_max(RSHandle handle, const char* col_name, double& min, double& max) {
+        auto zone_iter = zone_maps.find(handle);
+        if (zone_iter == zone_maps.end())
+            return false;
+        return zone_iter->second.get_min_max(get_col_index(handle, col_name), min, max);
+    }
+
+    // Range restricted variant for zoomed plot windows
+    bool get_min_max(RSHandle handle, const char* col_name, uint32_t offset, uint32_t count,
+                        double& min, double& max) {
         WasmChunkVec* wcv = reinterpret_cast<WasmChunkVec*>(handle);
-        if (wcv == nullptr)
+        auto zone_iter = zone_maps.find(handle);
+        if (wcv == nullptr || zone_iter == zone_maps.end())
             return false;
-        // now we know the handle is good...
-        IntVec tipes = type_map[handle];
         int32_t col_inx = get_col_index(handle, col_name);
-        uint32_t ncols = tipes.size();
-        int colm_type{ tipes[col_inx] };
-        // Next we have types, one 32bit int per col
-        // Have we already populated types and names?
-        bool min_max_initialized{ false };
-
-        uint32_t    this_chunk_row_count{ 0 };
-        uint32_t    col_offset{ 0 };
-        uint32_t*   chunk_ptr{ nullptr };
-        uint32_t*   col_ptr{ nullptr };
-        double*     dbldata{ nullptr };
-        int32_t*    idata{ nullptr };
-        int         chunk_inx{ 0 };
-        for (auto scvit = wcv->begin(); scvit != wcv->end(); ++scvit) {
-            chunk_ptr = reinterpret_cast<uint32_t*>(scvit->addr);
-            this_chunk_row_count = chunk_ptr[2];
-            col_offset = chunk_ptr[3+ncols+col_inx];
-            col_ptr = chunk_ptr + col_offset;
-            // col hdr: 32bit type, 32bit sz
-            // wind past col hdr
-            int32_t col_type = *col_ptr++;
-            int32_t col_size = *col_ptr++;
-            // fprintf(stdout, "get_min_max: chunk:%d, col:%d, type:%d, sz:%d\n", chunk_ptr, col_offset, col_type, col_size);
-            switch (colm_type) {
-            case wdtFloat:
-                dbldata = (double*)col_ptr;
-                break;
-            case wdtInt:
-                idata = (int*)col_ptr;
-                break;
-            }
-            if (!min_max_initialized) {
-                switch (colm_type) {
-                case wdtFloat:
-                    min = dbldata[0];
-                    max = dbldata[0];
-                    break;
-                case wdtInt:
-                    min = static_cast<double>(idata[0]);
-                    max = static_cast<double>(idata[0]);
-                    break;
-                }
-                min_max_initialized = true;
-            }
-            for (int inx = 0; inx < this_chunk_row_count; inx++) {
-                switch (colm_type) {
-                case wdtFloat:
-                    if (dbldata[inx] > max)
-                        max = dbldata[inx];
-                    if (dbldata[inx] < min)
-                        min = dbldata[inx];
-                    break;
-                case wdtInt:
-                    if (static_cast<double>(idata[inx]) > max)
-                        max = static_cast<double>(idata[inx]);
-                    if (static_cast<double>(idata[inx]) < min)
-                        min = static_cast<double>(idata[inx]);
-                    break;
-                }
-            }
-            chunk_inx++;
+        if (col_inx < 0)
+            return false;
+        int32_t col_type = type_map[handle][col_inx];
+        return zone_iter->second.get_min_max(index_map[handle], col_inx, offset, count, min, max,
+            [wcv, col_inx, col_type](uint32_t chunk_inx, uint32_t begin, uint32_t end, ColumnZone& zone) {
+                zone_slice(reinterpret_cast<uint32_t*>((*wcv)[chunk_inx].addr), col_inx, col_type, begin, end, zone);
+            });
+    }
+
+    // Scan rows [begin,end) of one column of a chunk into zone. The
+    // type is the schema's, as v2 chunks carry only values.
+    static void zone_slice(uint32_t* chunk_ptr, int32_t col_inx, int32_t col_type,
+                            uint32_t begin, uint32_t end, ColumnZone& zone) {
+        uint32_t* col_ptr = wasm_chunk_col(chunk_ptr, col_inx);
+        const uint64_t* validity = wasm_chunk_validity(chunk_ptr, col_inx);
+        switch (col_type) {
+        case wdtInt:
+            zone_scan(zone, reinterpret_cast<int32_t*>(col_ptr), validity, begin, end);
+            break;
+        case wdtFloat:
+            zone_scan(zone, reinterpret_cast<double*>(col_ptr), validity, begin, end);
+            break;
+        case wdtTimestamp_s:
+        case wdtTimestamp_ms:
+        case wdtTimestamp_us:
+        case wdtTimestamp_ns:
+            zone_scan(zone, reinterpret_cast<int64_t*>(col_ptr), validity, begin, end);
+            break;
+        default:
+            // no min,max for Utf8 etc, but we still count nulls
+            zone.row_count += end - begin;
+            zone.null_count += (end - begin) - simd_count_valid(validity, begin, end);
+            break;
         }
-        return true;
     }
 
     Range* init_range(RSHandle h, const char* col_name, 
@@ -975,15 +2543,15 @@ public:
         if (wcv == nullptr)
             return nullptr;
 
+        const ChunkIndex& cinx{ index_map[h] };
+        if (!cinx.locate(offset, range.start_chunk, range.chunk_offset))
+            return nullptr;
         // if the underlying is int, we cp into double_int_buffer
         range.bob = wcv;
         range.offset = offset;
-        range.offset = offset;
-        range.row_count = count;
-        range.start_chunk = range.offset / CHUNK_SIZE;
-        range.chunk_offset = offset % CHUNK_SIZE;
+        range.row_count = std::min(count, cinx.row_count - offset);
         range.chunk_index = range.start_chunk;
-        range.remaining = count;
+        range.remaining = range.row_count;
         range.col_inx = get_col_index(h, col_name);
 
         const std::vector<int>& types{ type_map.at(h) };
@@ -1000,14 +2568,15 @@ public:
         if (wcv == nullptr)
             return nullptr;
 
+        const ChunkIndex& cinx{ index_map[h] };
+        if (!cinx.locate(offset, range.start_chunk, range.chunk_offset))
+            return nullptr;
         // signal that static range needs [re]init
         range.bob = wcv;
         range.offset = offset;
-        range.row_count = count;
-        range.start_chunk = range.offset / CHUNK_SIZE;
-        range.chunk_offset = offset % CHUNK_SIZE;
+        range.row_count = std::min(count, cinx.row_count - offset);
         range.chunk_index = range.start_chunk;
-        range.remaining = count;
+        range.remaining = range.row_count;
         range.xcol_inx = get_col_index(h, xcol_name);
         range.ycol_inx = get_col_index(h, ycol_name);
 
@@ -1018,6 +2587,46 @@ public:
         return &range;
     }
 
+    // Zero copy view of one column over every chunk of h, for the ImPlot
+    // getters in render_shaded_plot. A Timestamp's schema type has its unit.
+    bool init_series(RSHandle h, const char* col_name, SeriesColumn& series) {
+        series.clear();
+        WasmChunkVec* wcv = reinterpret_cast<WasmChunkVec*>(h);
+        auto inx_iter = index_map.find(h);
+        if (wcv == nullptr || wcv->empty() || inx_iter == index_map.end())
+            return false;
+        int32_t col_inx = get_col_index(h, col_name);
+        if (col_inx < 0)
+            return false;
+        WasmDuckType col_type{ type_map[h][col_inx] };
+        switch (col_type) {
+        case wdtInt:            series.type = stInt32; break;
+        case wdtFloat:          series.type = stDouble; break;
+        case wdtUtf8:           series.type = stUtf8; break;
+        case wdtDict:
+            series.type = stDict;
+            series.dict = dict_column(h, col_inx);
+            break;
+        case wdtTimestamp_s:    series.divisor = 1.0; break;
+        case wdtTimestamp_ms:   series.divisor = 1e3; break;
+        case wdtTimestamp_us:   series.divisor = 1e6; break;
+        case wdtTimestamp_ns:   series.divisor = 1e9; break;
+        default:
+            return false;
+        }
+        if (series.type == stNone) {
+            series.type = stInt64;
+            series.time = true;
+        }
+        for (const WasmChunk& chunk : *wcv) {
+            uint32_t* chunk_ptr = reinterpret_cast<uint32_t*>(chunk.addr);
+            series.chunks.push_back(wasm_chunk_col(chunk_ptr, col_inx));
+            series.validities.push_back(wasm_chunk_validity(chunk_ptr, col_inx));
+        }
+        series.cinx = &inx_iter->second;
+        return series.ready();
+    }
+
     Range* next_range(Range* range) {
         static double_t dbl_buf[CHUNK_SIZE];
 
@@ -1038,7 +2647,7 @@ public:
         WasmChunkVec& bob{ *range->bob };
         WasmChunk chunk = bob[range->chunk_index];
         uint32_t* chunk_ptr = reinterpret_cast<uint32_t*>(chunk.addr);
-        uint32_t this_chunk_sz = chunk_ptr[2];
+        uint32_t this_chunk_sz = wasm_chunk_rows(chunk_ptr);
         uint32_t available = this_chunk_sz - range->chunk_offset;
         if (available > range->remaining) {
             range->edit_count = range->remaining;
@@ -1048,8 +2657,7 @@ public:
             range->edit_count = available;
             range->remaining -= available;
         }
-        uint32_t ncols = chunk_ptr[1];
-        uint32_t col_offset = chunk_ptr[3 + ncols + range->col_inx];
+        uint32_t* col_ptr = wasm_chunk_col(chunk_ptr, range->col_inx);
 
         // Unlike the BB win32 ver of this func above, we can handle
         // set anydata and mem_size from the WasmChunk directly
@@ -1058,10 +2666,10 @@ public:
 
         switch (range->col_type) {
         case wdtFloat:
-            range->dbldata = reinterpret_cast<double_t*>(chunk_ptr + col_offset);
+            range->dbldata = reinterpret_cast<double_t*>(col_ptr);
             break;
         case wdtInt:
-            range->idata = reinterpret_cast<int32_t*>(chunk_ptr + col_offset);
+            range->idata = reinterpret_cast<int32_t*>(col_ptr);
             range->dbldata = dbl_buf;
             break;
         }
@@ -1072,10 +2680,12 @@ public:
             break;
         case wdtInt:
             range->idata += range->chunk_offset;
-            for (int i = 0; i < range->edit_count; i++)
-                dbl_buf[i] = static_cast<double>(range->idata[i]);
+            simd_widen(range->idata, dbl_buf, range->edit_count);
             break;
         }
+        // nulls read as NaN in dbldata; anydata is the raw chunk
+        range->dbldata = simd_nan_nulls(range->dbldata, wasm_chunk_validity(chunk_ptr, range->col_inx),
+                                        range->chunk_offset, range->edit_count, dbl_buf);
         if (range->chunk_index == range->start_chunk) {
             // Only apply offset to first chunk. 
             // And it may have been zero anyway
@@ -1087,6 +2697,7 @@ public:
 
     XYRange* next_xy_range(XYRange* range) {
         static double_t dbl_buf[CHUNK_SIZE];
+        static double_t ydbl_buf[CHUNK_SIZE];
 
         if (range == nullptr || range->bob == nullptr)
             return nullptr;
@@ -1109,7 +2720,7 @@ public:
         WasmChunk chunk{ bob[range->chunk_index] };
         uint32_t* chunk_ptr = reinterpret_cast<uint32_t*>(chunk.addr);
 
-        uint32_t this_chunk_sz = chunk_ptr[2];
+        uint32_t this_chunk_sz = wasm_chunk_rows(chunk_ptr);
         uint32_t available = this_chunk_sz - range->chunk_offset;
         if (available > range->remaining) {
             range->plot_count = range->remaining;
@@ -1119,18 +2730,16 @@ public:
             range->plot_count = available;
             range->remaining -= available;
         }
-        uint32_t ncols = chunk_ptr[1];
-        // extra +2 below to wind past type and size sanity checks
-        uint32_t xcol_offset = chunk_ptr[3 + ncols + range->xcol_inx] + 2;
-        uint32_t ycol_offset = chunk_ptr[3 + ncols + range->ycol_inx] + 2;
+        uint32_t* xcol_ptr = wasm_chunk_col(chunk_ptr, range->xcol_inx);
+        uint32_t* ycol_ptr = wasm_chunk_col(chunk_ptr, range->ycol_inx);
 
-        range->ydata = reinterpret_cast<double_t*>(chunk_ptr + ycol_offset);
+        range->ydata = reinterpret_cast<double_t*>(ycol_ptr);
         switch (range->xcol_type) {
         case wdtFloat:
-            range->xdata = reinterpret_cast<double_t*>(chunk_ptr + xcol_offset);
+            range->xdata = reinterpret_cast<double_t*>(xcol_ptr);
             break;
         case wdtInt:
-            range->idata = reinterpret_cast<int32_t*>(chunk_ptr + xcol_offset);
+            range->idata = reinterpret_cast<int32_t*>(xcol_ptr);
             range->xdata = dbl_buf;
             break;
         }
@@ -1141,11 +2750,15 @@ public:
             break;
         case wdtInt:
             range->idata += range->chunk_offset;
-            for (int i = 0; i < range->plot_count; i++)
-                dbl_buf[i] = static_cast<double>(range->idata[i]);
+            simd_widen(range->idata, dbl_buf, range->plot_count);
             break;
         }
         range->ydata += range->chunk_offset;
+        // nulls are NaN, so ImPlot breaks the line there
+        range->xdata = simd_nan_nulls(range->xdata, wasm_chunk_validity(chunk_ptr, range->xcol_inx),
+                                        range->chunk_offset, range->plot_count, dbl_buf);
+        range->ydata = simd_nan_nulls(range->ydata, wasm_chunk_validity(chunk_ptr, range->ycol_inx),
+                                        range->chunk_offset, range->plot_count, ydbl_buf);
         if (range->chunk_index == range->start_chunk) {
             // Only apply offset to first chunk. 
             // And it may have been zero anyway
@@ -1157,7 +2770,6 @@ public:
 
 
     StringVec& get_col_names(RSHandle handle) {
-        // First 3 32 bit words are done, ncols, nrows
         StringVec& colm_names = column_map[handle];
         return colm_names;
     }
@@ -1177,58 +2789,55 @@ public:
         return colm_types;
     }
 
-    bool get_meta_data(RSHandle handle, std::uint32_t& colm_count, std::uint32_t& row_count) {
+    // The dictionary of a wdtDict column, else nullptr
+    const DictColumn* dict_column(RSHandle handle, uint32_t col_inx) const {
+        auto dict_iter = dict_map.find(handle);
+        if (dict_iter == dict_map.end() || col_inx >= dict_iter->second.size()
+                || !dict_iter->second[col_inx].is_coded())
+            return nullptr;
+        return &dict_iter->second[col_inx];
+    }
+
+    bool get_meta_data(RSHandle handle, std::uint32_t& colm_count, std::uint32_t& row_count, const char* col_formats = nullptr) {
         WasmChunkVec* wcv = reinterpret_cast<WasmChunkVec*>(handle);
         if (wcv == nullptr || wcv->empty())
             return false;
-
-        // First 3 32 bit words are done, ncols, nrows
-        uint32_t* chunk_ptr = reinterpret_cast<uint32_t*>(wcv->front().addr);
-        colm_count = chunk_ptr[1];
+        // types and names came ahead of the first chunk, from on_schema_cpp
+        auto type_iter = type_map.find(handle);
+        if (type_iter == type_map.end())
+            return false;
+        const IntVec& tipes{ type_iter->second };
+        colm_count = static_cast<uint32_t>(tipes.size());
         row_count = get_row_count(handle);
-        // Next we have types, one 32bit int per col
-        // Have we already populated types and names?
-        std::vector<int>& tipes = type_map[handle];
-        if (tipes.empty()) {
-            for (int i = 0; i < colm_count; i++) {
-                // NB int32_t, not uint32_t as wasm Duck types may be -ve
-                WasmDuckType tipe{ static_cast<int32_t>(chunk_ptr[3 + i]) };
-                tipes.push_back(tipe);
-            }
-
-            // wind past the colm addrs
-            chunk_ptr += 3 + (2 * colm_count);
-            // After types we have column names
-            StringVec& colm_names = column_map[handle];
-            colm_names.clear();
-            for (int i = 0; i < colm_count; i++) {
-                std::string name;
-                // Build name str one char at a time
-                while (*chunk_ptr != 0)
-                    name.push_back(*chunk_ptr++);
-                // Skip over null term
-                chunk_ptr++;
-                colm_names.push_back(name);
-            }
+        ColFormats& formats{ formats_map[handle] };
+        if (!formats.matches(col_formats, colm_count)) {
+            compile_formats(formats, col_formats, tipes, column_map[handle]);
         }
         return true;
     }
 
+    // One ColFormatter per column from the schema's types
+    static void compile_formats(ColFormats& formats, const char* col_formats, const IntVec& tipes,
+                                const StringVec& col_names) {
+        std::vector<ColFormatSpec> specs{ parse_col_formats(col_formats, col_names) };
+        formats.cspec = col_formats ? col_formats : "";
+        formats.cols.clear();
+        for (uint32_t col_inx = 0; col_inx < tipes.size() && col_inx < specs.size(); col_inx++) {
+            const ColFormatSpec& spec{ specs[col_inx] };
+            switch (tipes[col_inx]) {
+            case wdtInt:            formats.cols.emplace_back(cfkInt, spec); break;
+            case wdtFloat:          formats.cols.emplace_back(cfkDouble, spec); break;
+            case wdtTimestamp_s:    formats.cols.push_back(ColFormatter::timestamp(1, spec)); break;
+            case wdtTimestamp_ms:   formats.cols.push_back(ColFormatter::timestamp(1000, spec)); break;
+            case wdtTimestamp_us:   formats.cols.push_back(ColFormatter::timestamp(1000000, spec)); break;
+            case wdtTimestamp_ns:   formats.cols.push_back(ColFormatter::timestamp(1000000000, spec)); break;
+            default:                formats.cols.emplace_back(cfkNone, spec); break;
+            }
+        }
+    }
+
     const char* get_datum(RSHandle handle, std::uint32_t colm_index, std::uint32_t row_index) {
         const static char* method = "DuckDBWebCache::get_datum: ";
-        static std::map<WasmDuckType, int64_t>  timestamp_scale_map{
-            {wdtTimestamp_s, 1},
-            {wdtTimestamp_ms, 1e3},
-            {wdtTimestamp_us, 1e6},
-            {wdtTimestamp_ns, 1e9}
-        };
-        static std::map<WasmDuckType, const char*> timestamp_dec_fmt_map{
-            {wdtTimestamp_s, nullptr},
-            {wdtTimestamp_ms, "%03.3f"},
-            {wdtTimestamp_us, "%06.6f"},
-            {wdtTimestamp_ns, "%09.9f"}
-        };
-        static int error_count{ 0 };
 
         WasmChunkVec* wcv = reinterpret_cast<WasmChunkVec*>(handle);
         assert(wcv != nullptr);
@@ -1238,69 +2847,61 @@ public:
         // earlier invocation of get_meta_data()
         auto& tipes = type_map[handle];
 
-        uint32_t rel_index = row_index % duck_chunk_size;
-        uint32_t chunk_index = row_index / duck_chunk_size;
-        assert(chunk_index <= wcv->size());
+        uint32_t rel_index{ 0 };
+        uint32_t chunk_index{ 0 };
+        if (!index_map[handle].locate(row_index, chunk_index, rel_index)) {
+            string_buffer[0] = 0;
+            buffer = string_buffer;
+            return 0;
+        }
+        assert(chunk_index < wcv->size());
         WasmChunk& chunk{ (*wcv)[chunk_index] };
         uint32_t* chunk_ptr = reinterpret_cast<uint32_t*>(chunk.addr);
-        // First block in a chunk is metadata, so calc how far we
-        // skip fwd to get to the col block addrs
-        // uint32_t* base_chunk_ptr = reinterpret_cast<uint32_t*>(handle);
-        // ffwd past done,ncols,nrows,types to the col addresses
-        uint32_t ncols = chunk_ptr[1];
-        // and point to the colm_index col addr
-        // uint32_t colm_addr_offset = colm_addrs[colm_index];
-        uint32_t colm_addr_offset = chunk_ptr[3 + ncols + colm_index];
-        // set chunk_ptr to col addr. NB addr is written after
-        // 64bit bump, so we don't need to recorrect.
-        uint32_t* col_ptr = chunk_ptr + colm_addr_offset;
-        // sanity check column type and row count
-        int32_t col_type = *col_ptr++;
-        int32_t col_size = *col_ptr++;
-
+        uint32_t* col_ptr = wasm_chunk_col(chunk_ptr, colm_index);
+        if (!zone_row_is_valid(wasm_chunk_validity(chunk_ptr, colm_index), rel_index)) {
+            buffer = (char*)Static::null_cs;
+            return nullptr;
+        }
         /* For debugging chunking mechanism; see logging in duck_module.js
-        fprintf(stdout, "%s: chunk_ptr:%d, col:%d, col_addr_off:%d, col_ptr:%d\n",
-            method, (int)chunk_ptr, (int)colm_index, (int)colm_addr_offset, (int)col_ptr);
+        fprintf(stdout, "%s: chunk:%d, col:%d, col_ptr:%d\n",
+            method, (int)chunk.addr, (int)colm_index, (int)col_ptr);
         */
-        if (col_type != tipes[colm_index] && tipes[colm_index] != wdtTimestamp) {
-            error_count++;
-            fprintf(stderr, "%s: COL_TYPE_MISMATCH: base_chunk:%d, col:%d, col_addr_off:%d, wasm_type:%d, schema_type:%d, err_count:%d, col_sz:%d\n",
-                method, (int)chunk_ptr, (int)colm_index, (int)colm_addr_offset, col_type, tipes[colm_index], error_count, col_size);
-        }
         // stride 1 for 32bit data and 2 for 64bit inc str
-        WasmDuckType dt{ col_type };
+        WasmDuckType dt{ tipes[colm_index] };
         int32_t* i32data = reinterpret_cast<int32_t*>(col_ptr);
         int64_t* i64data = reinterpret_cast<int64_t*>(col_ptr);
         double* dbldata = reinterpret_cast<double*>(col_ptr);
-        // In most cases we'll copy into string_buffer, or
-        // use sprintf to format into buffer. 
+        ColFormatter& fmtr{ formats_map.at(handle).cols[colm_index] };
+        // In most cases we'll format into string_buffer
         buffer = string_buffer;
         switch (dt) {
         case WasmDuckType::wdtInt:
-            sprintf(string_buffer, "%d", i32data[rel_index]);
-            return 0;
+            return fmtr.format_int(i32data[rel_index], string_buffer);
         case WasmDuckType::wdtFloat:
-            sprintf(string_buffer, "%f", dbldata[rel_index]);
-            return 0;
+            return fmtr.format_double(dbldata[rel_index], string_buffer);
         case WasmDuckType::wdtTimestamp_ns:
-            fmt_result = fmt::format_to_n(string_buffer, STR_BUF_LEN, "{:%F %T}", TPNano{ std::chrono::nanoseconds{ i64data[rel_index] } });
-            string_buffer[fmt_result.size] = 0;
-            return 0;
         case WasmDuckType::wdtTimestamp_us:
-            fmt_result = fmt::format_to_n(string_buffer, STR_BUF_LEN, "{:%F %T}", TPMicro{ std::chrono::microseconds{ i64data[rel_index] } });
-            string_buffer[fmt_result.size] = 0;
-            return 0;
         case WasmDuckType::wdtTimestamp_ms:
-            fmt_result = fmt::format_to_n(string_buffer, STR_BUF_LEN, "{:%F %T}", TPMilli{ std::chrono::milliseconds{ i64data[rel_index] } });
-            string_buffer[fmt_result.size] = 0;
-            return 0;
         case WasmDuckType::wdtTimestamp_s:
-            fmt_result = fmt::format_to_n(string_buffer, STR_BUF_LEN, "{:%F %T}", TPSecs{ std::chrono::seconds{ i64data[rel_index] } });
-            string_buffer[fmt_result.size] = 0;
-            return 0;
-        case WasmDuckType::wdtUtf8:    // null term trunc to 8 bytes
-            sprintf(string_buffer, "%s", (char*)&(i64data[rel_index]));
-            return 0;
+            return fmtr.format_timestamp(i64data[rel_index], string_buffer);
+        case WasmDuckType::wdtUtf8: {
+            // begin and end straight into the chunk's string heap,
+            // like BBDuckDBCache with a string Duck didn't inline
+            const char* heap = wasm_utf8_heap(col_ptr, wasm_chunk_rows(chunk_ptr));
+            buffer = const_cast<char*>(heap + i32data[rel_index]);
+            return heap + i32data[rel_index + 1];
+        }
+        case WasmDuckType::wdtDict: {
+            // an index load, and the entry, zero terminated once
+            const DictColumn* dcol{ dict_column(handle, colm_index) };
+            if (dcol == nullptr) {
+                string_buffer[0] = 0;
+                return nullptr;
+            }
+            uint32_t len{ 0 };
+            buffer = const_cast<char*>(dcol->text_at(col_ptr, rel_index, len));
+            return nullptr;
+        }
         default:
             sprintf(string_buffer, "%s", "UNK");
             return 0;
@@ -1309,7 +2910,7 @@ public:
     }
 
     // standard DB methods implemented by every cache
-    void get_db_responses(std::queue<emscripten::val>& responses) {
+    void get_db_responses(std::queue<DBMsg>& responses) {
         static const char* method = "DuckDBWebCache::get_db_responses: ";
         db_results.swap(responses);
         if (!responses.empty()) {
@@ -1317,29 +2918,257 @@ public:
         }
     }
 
-    void db_dispatch(emscripten::val& db_request) {
+    void db_dispatch(DBMsg&& db_request) {
         // const static char* method = "DuckDBWebCache::db_dispatch: ";
-        ems_db_dispatch(db_request.as_handle());
+        if (db_request.type == dbBatchRequest || db_request.type == dbRefresh) {
+            db_request.max_rows = max_rows;
+        }
+        // duck_module.js boundary: the only place a request is JSON
+        emscripten::val js_request = db_message_to_json(db_request);
+        ems_db_dispatch(js_request.as_handle());
     }
 
     void set_done(bool) { }
 
     // register with DBResultDispatcher at startup time
     void add_db_response(emscripten::EM_VAL result_handle) {
+        // duck_module.js posts a BatchResponse once the worker has pushed
+        // its chunk, so drain first and the chunk is always adopted first
+        drain_chunk_queue();
         emscripten::val result = emscripten::val::take_ownership(result_handle);
-        db_results.push(result);
+        DBMsg db_result{ db_message_from_json(result) };
+        // a requery's rows replace those we hold for the query_id once
+        // they're ready to show, see register_schema
+        if (db_result.type == dbQueryResult) {
+            requeried.insert(db_result.qid);
+        }
+        else if (db_result.type == dbBatchResponse || db_result.type == dbCancelled
+                || db_result.type == dbTimedOut) {
+            // as on BB, a cancelled batch is never published, and a timed
+            // out one publishes the rows it has
+            if (building.count(db_result.qid)) {
+                if (db_result.type == dbCancelled) {
+                    building.erase(db_result.qid);
+                    reset_handle(building_key(db_result.qid));
+                }
+                else {
+                    publish(db_result.qid);
+                }
+            }
+            if (db_result.type != dbBatchResponse || db_result.done) {
+                open_batches.erase(db_result.qid);
+                if (budget.over())
+                    evict();
+            }
+        }
+        db_results.push(std::move(db_result));
+    }
+
+    // chunk_map, arena and pending_chunks key of a requery's rows while
+    // they build aside; no query_id has a unit separator
+    static std::string building_key(const std::string& qid) {
+        return qid + '\x1f';
+    }
+
+    std::string storage_key(const std::string& qid) const {
+        return building.count(qid) ? building_key(qid) : qid;
+    }
+
+    // The rows built aside for qid replace the ones it shows. The handle
+    // may change, and the epoch bump tells views to rebuild.
+    void publish(const std::string& qid) {
+        static const char* method = "DuckDBWebCache::publish: ";
+        std::string key{ building_key(qid) };
+        building.erase(qid);
+        auto build_iter = chunk_map.find(key);
+        if (build_iter == chunk_map.end())
+            return;
+        RSHandle built = reinterpret_cast<RSHandle>(&build_iter->second);
+        reset_handle(qid);
+        WasmChunkVec& chunks{ chunk_map[qid] };
+        chunks = std::move(build_iter->second);
+        chunk_map.erase(build_iter);
+        RSHandle handle = reinterpret_cast<RSHandle>(&chunks);
+        arena.transfer(key, qid);
+        for (auto& pend_pair : pending_chunks) {
+            if (pend_pair.second.first == key)
+                pend_pair.second.first = qid;
+        }
+        move_entry(index_map, built, handle);
+        move_entry(zone_maps, built, handle);
+        move_entry(type_map, built, handle);
+        move_entry(column_map, built, handle);
+        move_entry(dict_map, built, handle);
+        formats_map.erase(built);
+        handle_qids.erase(built);
+        handle_qids[handle] = qid;
+        auto usage_iter = budget.usage.find(built);
+        uint64_t bytes = usage_iter == budget.usage.end() ? 0 : usage_iter->second.bytes;
+        budget.remove(built);
+        budget.add(handle, bytes);
+        std::cout << method << "QID(" << qid << ") chunks(" << chunks.size() << ")" << std::endl;
+    }
+
+    template <typename MAP>
+    static void move_entry(MAP& map, RSHandle from, RSHandle to) {
+        auto from_iter = map.find(from);
+        if (from_iter == map.end())
+            return;
+        map[to] = std::move(from_iter->second);
+        map.erase(from);
+    }
+
+    // free LRU result sets until we're back under budget
+    void evict() {
+        static const char* method = "DuckDBWebCache::evict: ";
+        while (budget.over()) {
+            RSHandle victim = budget.lru_victim([this](RSHandle h) {
+                auto qid_iter = handle_qids.find(h);
+                return qid_iter != handle_qids.end() && open_batches.find(qid_iter->second) == open_batches.end();
+            });
+            if (victim == 0) {
+                std::cerr << method << "OVER_BUDGET: used(" << budget.used_bytes << ") budget("
+                    << budget.budget_bytes << ") nothing evictable" << std::endl;
+                return;
+            }
+            std::string qid{ handle_qids[victim] };
+            std::cout << method << "QID(" << qid << ") bytes(" << budget.usage[victim].bytes << ")" << std::endl;
+            reset_handle(qid);
+        }
+    }
+
+    // qid is a storage_key: a query_id, or a building_key
+    void reset_handle(const std::string& qid) {
+        static const char* method = "DuckDBWebCache::reset_handle: ";
+        auto cv_iter = chunk_map.find(qid);
+        if (cv_iter == chunk_map.end())
+            return;
+        RSHandle handle = reinterpret_cast<RSHandle>(&cv_iter->second);
+        arena.release(qid);
+        for (auto pend_iter = pending_chunks.begin(); pend_iter != pending_chunks.end();) {
+            if (pend_iter->second.first == qid)
+                pend_iter = pending_chunks.erase(pend_iter);
+            else
+                ++pend_iter;
+        }
+        std::cout << method << "QID(" << qid << ") arena reserved(" << arena.reserved_bytes
+            << ") in_use(" << arena.in_use_bytes << ") free(" << arena.free_bytes() << ")" << std::endl;
+        index_map.erase(handle);
+        zone_maps.erase(handle);
+        type_map.erase(handle);
+        column_map.erase(handle);
+        formats_map.erase(handle);
+        dict_map.erase(handle);
+        budget.remove(handle);
+        result_epoch++;
+        handle_qids.erase(handle);
+        // get_handle reports 0 until the first new chunk registers
+        chunk_map.erase(cv_iter);
     }
 
     void add_db_response(const emscripten::val& result) {
-        db_results.push(result);
+        db_results.push(db_message_from_json(result));
     }
 
-    void register_chunk(const char* qid, int size, int addr) {
+    // on_schema_cpp: batch_materializer sends qid's column names and
+    // types once, ahead of its first chunk. A Timestamp's type has its
+    // unit, so it's wdtTimestamp_s|ms|us|ns, never wdtTimestamp. A
+    // wdtDict column, a DuckDB ENUM, has the same dictionary in every
+    // batch, so its entries come once too, and chunks hold only codes.
+    void register_schema(const std::string& qid, const StringVec& names, const IntVec& types,
+                            const std::vector<StringVec>& dicts) {
+        static const char* method = "DuckDBWebCache::register_schema: ";
+        // a requery's first schema: build aside if there are rows to keep
+        // showing, and drop any earlier requery still building
+        if (requeried.erase(qid)) {
+            reset_handle(building_key(qid));
+            auto cv_iter = chunk_map.find(qid);
+            if (cv_iter != chunk_map.end() && !cv_iter->second.empty()) {
+                building.insert(qid);
+            }
+            else {
+                building.erase(qid);
+                reset_handle(qid);
+            }
+        }
+        RSHandle handle = reinterpret_cast<RSHandle>(&chunk_map[storage_key(qid)]);
+        std::cout << method << "QID(" << qid << ") ncols(" << types.size() << ")" << std::endl;
+        column_map[handle] = names;
+        type_map[handle] = types;
+        formats_map.erase(handle);
+        DictColumns& dcols{ dict_map[handle] };
+        dcols.assign(types.size(), DictColumn{});
+        for (size_t col_inx = 0; col_inx < types.size() && col_inx < dicts.size(); col_inx++) {
+            if (types[col_inx] != wdtDict)
+                continue;
+            dcols[col_inx].code_bytes = sizeof(int32_t);
+            dcols[col_inx].coded_chunks = UINT32_MAX;
+            for (const std::string& entry : dicts[col_inx])
+                dcols[col_inx].dict.add(entry.data(), static_cast<uint32_t>(entry.size()));
+        }
+        handle_qids[handle] = qid;
+        open_batches.insert(qid);
+    }
+
+    // get_chunk_cpp: storage for size 32 bit words from qid's arena
+    // blocks, which batch_materializer fills. Returns its address.
+    int register_chunk(const char* qid, int size) {
         static const char* method = "DuckDBWebCache::register_chunk: ";
-        // Will ctor ChunkVec on first batch...
-        std::cout << method << "QID(" << qid << ") sz(" << size << ") addr(" << addr << ")" << std::endl;
-        WasmChunkVec& chunk_vector = chunk_map[qid];
-        chunk_vector.emplace_back(WasmChunk(size, addr));
+        uint64_t bytes = static_cast<uint64_t>(size) * 4;
+        std::string key{ storage_key(qid) };
+        int addr = reinterpret_cast<int>(arena.alloc(key, bytes));
+        std::cout << method << "QID(" << qid << ") sz(" << size << ") addr(" << addr << ") arena in_use("
+            << arena.in_use_bytes << "/" << arena.reserved_bytes << ")" << std::endl;
+        pending_chunks[static_cast<uint32_t>(addr)] = { key, static_cast<uint32_t>(size) };
+        open_batches.insert(qid);
+        return addr;
+    }
+
+    // A chunk from register_chunk is filled: by batch_materializer, which
+    // calls on_chunk_cpp, or by materialize_worker.js, which pushes it on
+    // chunk_queue. Either way its row count and values are final, so it
+    // joins its query_id's chunks, or those building aside for a requery,
+    // and extends the row index and zone maps. The worker fills chunks in
+    // the order they're registered.
+    void on_chunk(uint32_t addr) {
+        static const char* method = "DuckDBWebCache::on_chunk: ";
+        auto pend_iter = pending_chunks.find(addr);
+        if (pend_iter == pending_chunks.end()) {
+            std::cerr << method << "UNREGISTERED_CHUNK addr(" << addr << ")" << std::endl;
+            return;
+        }
+        std::string key{ std::move(pend_iter->second.first) };
+        uint32_t size{ pend_iter->second.second };
+        pending_chunks.erase(pend_iter);
+        auto cv_iter = chunk_map.find(key);
+        RSHandle handle = cv_iter == chunk_map.end() ? 0 : reinterpret_cast<RSHandle>(&cv_iter->second);
+        // register_schema set handle_qids with the type_map entry
+        auto type_iter = type_map.find(handle);
+        if (type_iter == type_map.end()) {
+            std::cerr << method << "NO_SCHEMA QID(" << key << ") addr(" << addr << ")" << std::endl;
+            return;
+        }
+        cv_iter->second.emplace_back(WasmChunk(size, addr));
+        budget.add(handle, static_cast<uint64_t>(size) * 4);
+        const IntVec& tipes{ type_iter->second };
+        uint32_t* chunk_ptr = reinterpret_cast<uint32_t*>(addr);
+        uint32_t ncols = static_cast<uint32_t>(tipes.size());
+        uint32_t nrows = wasm_chunk_rows(chunk_ptr);
+        index_map[handle].add_chunk(nrows);
+        ColumnZoneVec zones(ncols);
+        for (uint32_t col_inx = 0; col_inx < ncols; col_inx++) {
+            zone_slice(chunk_ptr, col_inx, tipes[col_inx], 0, nrows, zones[col_inx]);
+        }
+        zone_maps[handle].add_chunk(std::move(zones));
+    }
+
+    // get_chunk_queue_cpp: materialize_worker.js views chunk_queue here
+    uint32_t chunk_queue_addr() const { return chunk_queue.addr(); }
+
+    void drain_chunk_queue() {
+        uint32_t addr{ 0 };
+        while (chunk_queue.try_pop(addr))
+            on_chunk(addr);
     }
 };
 
@@ -1350,7 +3179,10 @@ private:
     DBResultDispatcher() {};
     Dispatcher dispatcher_func = nullptr;
     AsyncDispatcher async_dispatcher_func = nullptr;
+    RegWasmSchemaFunc reg_schema_func = nullptr;
     RegWasmChunkFunc reg_chunk_func = nullptr;
+    OnWasmChunkFunc on_chunk_func = nullptr;
+    WasmChunkQueueFunc chunk_queue_func = nullptr;
 public:
     static DBResultDispatcher& get_instance() {
         static DBResultDispatcher instance;
@@ -1358,7 +3190,10 @@ public:
     }
     void set_dispatcher(Dispatcher df) { dispatcher_func = df; }
     void set_async_dispatcher(AsyncDispatcher adf) { async_dispatcher_func = adf; }
+    void set_reg_schema(RegWasmSchemaFunc sf) { reg_schema_func = sf; }
     void set_reg_chunk(RegWasmChunkFunc cf) { reg_chunk_func = cf; }
+    void set_on_chunk(OnWasmChunkFunc ocf) { on_chunk_func = ocf; }
+    void set_chunk_queue(WasmChunkQueueFunc cqf) { chunk_queue_func = cqf; }
     void dispatch(emscripten::EM_VAL result_handle) {
         if (dispatcher_func != nullptr) dispatcher_func(result_handle);
         else fprintf(stderr, "NULL Dispatcher func\n");
@@ -1368,9 +3203,27 @@ public:
         else fprintf(stderr, "NULL AsyncDispatcher func\n");
     }
 
-    void register_chunk(const std::string& qid, int sz, int addr) {
-        if (reg_chunk_func != nullptr) reg_chunk_func(qid, sz, addr);
-        else fprintf(stderr, "NULL RegWasmChunkFunc func\n");       
+    void register_schema(const std::string& qid, const StringVec& names, const IntVec& types,
+                            const std::vector<StringVec>& dicts) {
+        if (reg_schema_func != nullptr) reg_schema_func(qid, names, types, dicts);
+        else fprintf(stderr, "NULL RegWasmSchemaFunc func\n");
+    }
+
+    int register_chunk(const std::string& qid, int sz) {
+        if (reg_chunk_func != nullptr) return reg_chunk_func(qid, sz);
+        fprintf(stderr, "NULL RegWasmChunkFunc func\n");
+        return 0;
+    }
+
+    void on_chunk(uint32_t addr) {
+        if (on_chunk_func != nullptr) on_chunk_func(addr);
+        else fprintf(stderr, "NULL OnWasmChunkFunc func\n");
+    }
+
+    uint32_t chunk_queue() {
+        if (chunk_queue_func != nullptr) return chunk_queue_func();
+        fprintf(stderr, "NULL WasmChunkQueueFunc func\n");
+        return 0;
     }
 };
 
@@ -1387,87 +3240,56 @@ extern "C" {
         d.async_dispatch(jevent);
     }
 
+    void on_schema_cpp(const char* qid, const char* schema) {
+        const static char* method = "on_schema_cpp";
+        // batch_materializer sends {"names":[...],"types":[...],"dicts":[...]}
+        // once per query_id, before get_chunk_cpp for its first chunk.
+        // dicts has an array of entries per column, empty bar wdtDict's.
+        emscripten::val jschema{ JParse<emscripten::val>(schema) };
+        StringVec names{ emscripten::vecFromJSArray<std::string>(jschema[Static::names_cs]) };
+        IntVec types{ emscripten::vecFromJSArray<int>(jschema[Static::types_cs]) };
+        std::vector<StringVec> dicts;
+        emscripten::val jdicts{ jschema[Static::dicts_cs] };
+        if (!jdicts.isUndefined()) {
+            for (const emscripten::val& jdict : emscripten::vecFromJSArray<emscripten::val>(jdicts))
+                dicts.push_back(emscripten::vecFromJSArray<std::string>(jdict));
+        }
+        printf("%s: qid: %s, schema: %s\n", method, qid, schema);
+        auto d = DBResultDispatcher::get_instance();
+        d.register_schema(qid, names, types, dicts);
+    }
+
     int get_chunk_cpp(const char* qid, int size) {
-        // size in 64bit words
+        // size in 32bit words
         const static char* method = "get_chunk_cpp";
         // batch_materializer calls us to get a handle on WASM memory
         // https://stackoverflow.com/questions/56010390/emscripten-how-to-get-uint8-t-array-from-c-to-javascript
-        // Real impl will use some kind of mem pooling
-        uint64_t* buffer = new uint64_t[size];
-        memset(buffer, 0, size * 8);
-        int buffer_address = reinterpret_cast<int>(buffer);
-        printf("%s: size: %d, buffer_address: %d\n", method, size, buffer_address);
+        // The chunk comes from the cache's ChunkArena, uninitialised
         auto d = DBResultDispatcher::get_instance();
-        d.register_chunk(qid, size, buffer_address);
+        int buffer_address = d.register_chunk(qid, size);
+        printf("%s: size: %d, buffer_address: %d\n", method, size, buffer_address);
         return buffer_address;
     }
 
     void on_chunk_cpp(int* chunk) {
         const static char* method = "on_chunk_cpp";
 
+        // v2 chunks are values only, so the cache, which has the
+        // query_id's schema, walks the columns in on_chunk
         uint32_t* chunk_ptr = reinterpret_cast<uint32_t*>(chunk);
-        printf("%s: METADATA\n", method);
-        // First 3 words are done, col_count, row_count
-        int bptr = 0;
-        int done = chunk_ptr[bptr++];
-        int col_count = chunk_ptr[bptr++];
-        int row_count = chunk_ptr[bptr++];
-        printf("%s: done: %d, col_count: %d, row_count: %d\n", method, done, col_count, row_count);
-        // next col_count words are the types
-        printf("%s: types:", method);
-        for (int i = 0; i < col_count; i++) {
-            WasmDuckType tipe{ static_cast<int32_t>(chunk_ptr[bptr++]) };
-            const char* dt = WasmDuckTypeToString(tipe);
-            printf("%d/%s", tipe, dt);
-            printf_comma(i, col_count);
-        }
-        // next col_count words are the col addrs
-        printf("%s: caddr:", method);
-        for (int i = 0; i < col_count; i++) {
-            uint32_t* col_addr = reinterpret_cast<uint32_t*>(chunk_ptr[bptr++]);
-            printf("%d/%d", i, (uint32_t)col_addr);
-            printf_comma(i, col_count);
-        }
-        // next col_count zero terminated ASCII strings
-        std::vector<std::string> col_names;
-        printf("%s: names:", method);
-        for (int i = 0; i < col_count; i++) {
-            std::string name;
-            while (chunk[bptr] != 0) {
-                name.push_back(chunk[bptr]);
-                bptr++;
-            }
-            printf("%s", name.c_str());
-            printf_comma(i, col_count);
-            bptr++;
-            col_names.push_back(name);
-        }
-        // And now the columns themselves. Each one has
-        // a type(32),row_count(32) preamble. We check the
-        // lo bit of bptr first to see if it's "odd" ie on
-        // a 4 byte boundary.
-        printf("%s: COLUMNS bptr(%d)\n", method, bptr);
-        char cbuf[128];
-        for (int i = 0; i < col_count; i++) {
-            // mv bptr fwd to next 8 byte boundary
-            if (bptr & 1) {
-                bptr++;
-                printf("%s: incremented bptr to %d\n", method, bptr);
-            }
-            else {
-                printf("%s:             bptr on %d\n", method, bptr);
-            }
-            int32_t tipe = chunk_ptr[bptr++];
-            uint32_t stored_sz = chunk_ptr[bptr++];
-            const std::string& name(col_names[i]);
-            printf("%s type(%d) sz(%d) rows(%d)\n", name.c_str(), tipe, stored_sz, row_count);
-            int stride = stored_sz / 4;    // 1 for 4 bytes, 2 for 8 bytes
-            sprintf_value(cbuf, chunk_ptr, bptr, tipe, 0);
-            sprintf_value(cbuf, chunk_ptr, bptr + stride, tipe, 1);
-            sprintf_value(cbuf, chunk_ptr, bptr + (stride * (row_count - 2)), tipe, row_count - 2);
-            sprintf_value(cbuf, chunk_ptr, bptr + (stride * (row_count - 1)), tipe, row_count - 1);
-            bptr += stride * row_count;
-        }
+        printf("%s: chunk: %d, row_count: %d\n", method, (int)chunk, wasm_chunk_rows(chunk_ptr));
+        auto d = DBResultDispatcher::get_instance();
+        d.on_chunk(reinterpret_cast<uint32_t>(chunk));
+    }
+
+    uint32_t get_chunk_queue_cpp() {
+        const static char* method = "get_chunk_queue_cpp";
+        // duck_module.js hands this to materialize_worker.js, which
+        // pushes each chunk it fills, for the render thread to drain
+        auto d = DBResultDispatcher::get_instance();
+        uint32_t queue_address = d.chunk_queue();
+        printf("%s: queue_address: %u\n", method, queue_address);
+        return queue_address;
     }
 };
 
@@ -0,0 +1,147 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "nd_types.hpp"
+#include "dl_types.hpp"
+#include "static_strings.hpp"
+#include "json_ops.hpp"
+
+// DBMessage: the requests NDContext sends a bulk cache, and the events the
+// cache sends back. Typed fields instead of a JSON object per message, so
+// the GUI thread switches on type rather than comparing nd_type strings,
+// and on ems doesn't cross into JS for every field. JSON only appears at
+// the duck_module.js boundary: db_message_to_json when WebDuckDBCache
+// posts a request, db_message_from_json when a result arrives. Function
+// requests and results keep their data in payload, as only the JS func
+// and DataLayoutCache::on_data_change know its shape.
+
+// DBParam: a value resolved from the DLC for one of a prepared Query or
+// Command's $n params. EndDataTypes binds NULL. Dates go as "YYYY-MM-DD"
+// strings in s, which DuckDB casts where the SQL compares with a DATE.
+struct DBParam {
+    CacheDataType   type{ EndDataTypes };
+    int             i{ 0 };
+    double          d{ 0.0 };
+    bool            b{ false };
+    std::string     s;
+};
+using DBParamVec = std::vector<DBParam>;
+
+template <typename JSON>
+struct DBMessage {
+    DBEventType     type{ EndDBEventTypes };
+    // query_id is interned by NDContext, and echoed on the responses to
+    // its requests. qid is the same string, which the DB side keys its
+    // lanes, connections and results on. Func requests use func_inx.
+    EntityInx       query_id;
+    std::string     qid;
+    int             func_inx{ -1 };
+    uint32_t        serial{ 0 };        // see NDContext::db_dispatch
+    uint32_t        error{ 0 };         // zero is OK
+    // requests: the SQL is copied from the DLC entry at sql_cname, as the
+    // DB threads cannot read the DLC
+    AddrInx         sql_cname;
+    std::string     sql;
+    uint32_t        timeout_ms{ 0 };
+    uint32_t        max_rows{ 0 };
+    // prepared: sql is a template, bound positionally from params, and
+    // the DB side keeps its prepared statement per qid for the next run
+    bool            prepared{ false };
+    DBParamVec      params;
+    // Query: the column a later Refresh fetches past, see Static::refresh_key_cs
+    std::string     refresh_key;
+    // responses
+    DBEventType     db_action{ EndDBEventTypes };  // Cancelled|TimedOut: type of the interrupted request, BatchResponse: Refresh
+    uint32_t        chunk{ 0 };         // ems BatchResponse: WASM chunk address
+    uint32_t        chunk_count{ 0 };
+    uint64_t        row_count{ 0 };
+    bool            done{ true };       // false on a streamed BatchResponse
+    bool            truncated{ false }; // at max_rows
+    JSON            payload;            // FunctionSync|Async data, FunctionResult
+};
+
+template <typename JSON>
+std::ostream& operator<<(std::ostream& os, const DBMessage<JSON>& msg) {
+    const char* nd_type = DBEventTypeToString(msg.type);
+    os << (nd_type == nullptr ? "BAD_ND_TYPE" : nd_type) << " QID(" << msg.qid << ")";
+    if (msg.serial)
+        os << " serial(" << msg.serial << ")";
+    if (msg.error)
+        os << " error(" << msg.error << ")";
+    if (msg.type == dbBatchResponse)
+        os << " chunks(" << msg.chunk_count << ") done(" << msg.done << ")";
+    return os;
+}
+
+// ems: request for ems_db_dispatch
+template <typename JSON>
+JSON db_message_to_json(const DBMessage<JSON>& msg) {
+    JSON db_request = JNewObject();
+    JSet(db_request, Static::nd_type_cs, DBEventTypeToString(msg.type));
+    if (msg.type == dbFunctionSync || msg.type == dbFunctionAsync) {
+        JSet(db_request, Static::query_id_cs, msg.func_inx);
+        JSet(db_request, Static::data_cs, msg.payload);
+        return db_request;
+    }
+    JSet(db_request, Static::query_id_cs, msg.qid);
+    JSet(db_request, Static::serial_cs, msg.serial);
+    if (msg.timeout_ms > 0)
+        JSet(db_request, Static::timeout_ms_cs, msg.timeout_ms);
+    if (msg.max_rows > 0)
+        JSet(db_request, Static::max_rows_cs, msg.max_rows);
+    if (!msg.sql.empty())
+        JSet(db_request, Static::sql_cs, msg.sql);
+    if (!msg.refresh_key.empty())
+        JSet(db_request, Static::refresh_key_cs, msg.refresh_key);
+    if (msg.prepared) {
+        JSet(db_request, Static::prepared_cs, true);
+        JSON jparams = JNewArray();
+        for (const DBParam& param : msg.params) {
+            switch (param.type) {
+            case cdInt:     JPush(jparams, param.i); break;
+            case cdDouble:  JPush(jparams, param.d); break;
+            case cdBool:    JPush(jparams, param.b); break;
+            case cdStr:     JPush(jparams, param.s); break;
+            default:        JPush(jparams, JNull()); break;
+            }
+        }
+        JSet(db_request, Static::params_cs, jparams);
+    }
+    return db_request;
+}
+
+// ems: decode a result from duck_module.js or a JS func once, on arrival
+template <typename JSON>
+DBMessage<JSON> db_message_from_json(const JSON& db_result) {
+    DBMessage<JSON> msg;
+    if (!JContains(db_result, Static::nd_type_cs))
+        return msg;
+    msg.type = DBEventTypeFromString(JAsString(db_result, Static::nd_type_cs));
+    if (msg.type == dbFunctionResult) {
+        // error is the JS func's message, left in payload
+        msg.func_inx = JAsInt(db_result, Static::query_id_cs);
+        msg.error = JContains(db_result, Static::error_cs) ? 1 : 0;
+        msg.payload = db_result;
+        return msg;
+    }
+    if (JContains(db_result, Static::query_id_cs))
+        msg.qid = JAsString(db_result, Static::query_id_cs);
+    if (JContains(db_result, Static::serial_cs))
+        msg.serial = JAsInt(db_result, Static::serial_cs);
+    if (JContains(db_result, Static::error_cs))
+        msg.error = JAsInt(db_result, Static::error_cs);
+    if (JContains(db_result, Static::db_action_cs))
+        msg.db_action = DBEventTypeFromString(JAsString(db_result, Static::db_action_cs));
+    if (JContains(db_result, Static::chunk_cs))
+        msg.chunk = JAsInt(db_result, Static::chunk_cs);
+    if (JContains(db_result, Static::chunk_count_cs))
+        msg.chunk_count = JAsInt(db_result, Static::chunk_count_cs);
+    if (JContains(db_result, Static::row_count_cs))
+        msg.row_count = static_cast<uint64_t>(JAsDouble(db_result, Static::row_count_cs));
+    if (JContains(db_result, Static::done_cs))
+        msg.done = JAsBool(db_result, Static::done_cs);
+    if (JContains(db_result, Static::truncated_cs))
+        msg.truncated = JAsBool(db_result, Static::truncated_cs);
+    return msg;
+}
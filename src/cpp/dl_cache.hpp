@@ -47,6 +47,8 @@ protected:
     ActionMap                   action_map;
     ActionInternMap             action_interned_map;
     ActionErrorMap              action_error_map;
+    // raw AddrInx of a param's cname or cindex -> DB actions to rerun
+    BoundActionMap              bound_action_map;
     StringVec                   bad_action_keys;
     StringVec                   action_errors;
 
@@ -215,6 +217,7 @@ protected:
         action_map.clear();
         action_interned_map.clear();
         action_error_map.clear();
+        bound_action_map.clear();
         bad_action_keys.clear();
         action_errors.clear();
 
@@ -279,7 +282,7 @@ protected:
                 interned.push_ui = (char*)get_string_value(action.push_ui);
             }
             if (JContains(action_defn, Static::db_action_cs)) {
-                // Command, Query & BatchRequest DB actions all require query_id
+                // Command, Query, BatchRequest & Refresh DB actions all require query_id
                 // Command & Query need sql_cname too
                 std::string db_action = JAsString(action_defn, Static::db_action_cs);
                 action.db_action = DBEventTypeFromString(db_action);
@@ -329,10 +332,13 @@ protected:
                     }
 
                 }
-                else {  // Command|Query|BatchRequest
+                else {  // Command|Query|BatchRequest|Refresh
                     std::string query_id = JAsString(action_defn, Static::query_id_cs);
                     action.query_id = add_query_id(query_id);
                     interned.query_id = (char*)get_string_value(action.query_id);
+                    if (JContains(action_defn, Static::timeout_ms_cs)) {
+                        action.timeout_ms = static_cast<uint32_t>(JAsInt(action_defn, Static::timeout_ms_cs));
+                    }
 
                     if (action.db_action == dbCommand || action.db_action == dbQuery) {
                         std::string sql_cache_key = JAsString(action_defn, Static::sql_cname_cs);
@@ -360,6 +366,12 @@ protected:
                             data_ref.ref_inx = get_string_index<CIT::Value>(sql)();
                             data_ref_map[data_ref.addr_inx] = data_ref;
                         }
+                        if (JContains(action_defn, Static::params_cs)) {
+                            parse_params(action_defn[Static::params_cs], action, inx, errors);
+                        }
+                        if (action.db_action == dbQuery && JContains(action_defn, Static::refresh_key_cs)) {
+                            action.refresh_key = JAsString(action_defn, Static::refresh_key_cs);
+                        }
                     }
                 }
             }
@@ -373,6 +385,62 @@ protected:
         }
     }
 
+    // params: [{cname[, cindex]}...] where each address must already be
+    // in address_map from data keys parsing. The DataRefs are resolved at
+    // dispatch time, as layout parsing may not have created them yet.
+    void parse_params(const JSON& jparams, NDAction& action, int inx, NDActionErrors& errors) {
+        int params_len = JSize(jparams);
+        for (int pinx = 0; pinx < params_len; pinx++) {
+            const JSON& jparam(jparams[pinx]);
+            ActionParam param;
+            if (!JContains(jparam, Static::cname_cs)) {
+                std::stringstream ss;
+                ss << "PARAM_CNAME_NOT_FOUND(" << pinx << ")";
+                std::string error{ ss.str() };
+                errors.error_vec.push_back(error);
+                errors.inx = inx;
+                action_errors.push_back(error);
+                continue;
+            }
+            const char* keys[2] = { Static::cname_cs, Static::cindex_cs };
+            AddrInx* addrs[2] = { &param.cname, &param.cindex };
+            for (int kinx = 0; kinx < 2; kinx++) {
+                if (!JContains(jparam, keys[kinx]))
+                    continue;
+                std::string addr = JAsString(jparam, keys[kinx]);
+                auto amit = address_map.find(addr);
+                if (amit == address_map.end()) {
+                    std::stringstream ss;
+                    ss << "PARAM_NOT_FOUND(" << addr << ")";
+                    std::string error{ ss.str() };
+                    errors.error_vec.push_back(error);
+                    errors.inx = inx;
+                    action_errors.push_back(error);
+                    continue;
+                }
+                *addrs[kinx] = amit->second;
+            }
+            action.params.push_back(param);
+        }
+    }
+
+    // Once action_map is complete, index the param bound DB actions by
+    // the addresses they're bound to, so end_render_cycle can find the
+    // ones a dirty address invalidates.
+    void index_bound_actions() {
+        bound_action_map.clear();
+        for (auto ait = action_map.begin(); ait != action_map.end(); ++ait) {
+            ActionVec& action_vec{ ait->second };
+            for (int inx = 0; inx < action_vec.size(); inx++) {
+                for (ActionParam param : action_vec[inx].params) {
+                    bound_action_map[param.cname()].push_back(BoundAction{ &action_vec, inx });
+                    if (param.cindex.is_valid())
+                        bound_action_map[param.cindex()].push_back(BoundAction{ &action_vec, inx });
+                }
+            }
+        }
+    }
+
     void print_parsed_action(const NDAction& action, const NDActionInterned& interned) {
         // TODO: debuggable output from action parsing
         bool prefix_comma = false;
@@ -404,6 +472,17 @@ protected:
             if (prefix_comma) NDLogger::cout() << ", ";
             NDLogger::cout() << "ctype(" << action.ctype << "/" << interned.ctype << ")";
         }
+        if (!action.params.empty()) {
+            NDLogger::cout() << ", params(";
+            for (int pinx = 0; pinx < action.params.size(); pinx++) {
+                ActionParam param{ action.params[pinx] };
+                if (pinx) NDLogger::cout() << ",";
+                NDLogger::cout() << get_addr_value(param.cname);
+                if (param.cindex.is_valid())
+                    NDLogger::cout() << "[" << get_addr_value(param.cindex) << "]";
+            }
+            NDLogger::cout() << ")";
+        }
         NDLogger::cout() << "]";
         NDLogger::cout().flush();
     }
@@ -484,6 +563,7 @@ protected:
                 action_interned_map[action_key] = action_intern_vec;
                 action_error_map[action_key] = action_error_vec;
             }
+            index_bound_actions();
         }
     }
 
@@ -688,7 +768,7 @@ protected:
             std::string ref_name = cspec_names[spec];   // [cindex|cname|query_id|menubar]
             if (!JContains(cspec, ref_name.c_str())) {
                 // menubar & menupop both optional in the Home and Window cspec
-                if (is_optional(spec))
+                if (is_optional(spec, widget->rname))
                     continue;
                 bad_data_refs.push_back(ref_name);
                 std::stringstream ss;
@@ -937,6 +1017,7 @@ public:
     size_t widget_vec_size() { return widget_vec.size(); }
     size_t pushables_size() { return pushables.size(); }
     size_t action_map_size() { return action_map.size(); }
+    size_t bound_action_map_size() { return bound_action_map.size(); }
     size_t data_ref_map_size() { return data_ref_map.size(); }
     size_t menu_data_ref_map_size() { return menu_data_ref_map.size(); }
     size_t error_count() { return action_errors.size() + layout_errors.size(); }
@@ -1031,6 +1112,14 @@ public:
         return nullptr;
     }
 
+    const std::vector<BoundAction>* get_bound_actions(uint32_t addr_inx) {
+        auto it = bound_action_map.find(addr_inx);
+        if (it != bound_action_map.end()) {
+            return &(it->second);
+        }
+        return nullptr;
+    }
+
     DataRef* get_data_ref(AddrInx ainx) {
         auto it = data_ref_map.find(ainx);
         if (it != data_ref_map.end()) {
@@ -1243,12 +1332,15 @@ public:
 
     // a set is nothing more than a truth function for set membership :)
     // because Quine:"to be is to be the value of a bound variable"
-    bool is_optional(CacheSpecifier spec) {
+    bool is_optional(CacheSpecifier spec, RenderMethod rm) {
         switch (spec) {
         case cs_menu_bar:
         case cs_menu_pop:
         case cs_tooltip:
             return true;
+        case cs_query_id:
+            // LoadingModal only shows progress if it names a query_id
+            return rm == LoadingModal;
         default:
             return false;
         }
@@ -1377,8 +1469,13 @@ private:
         Static::query_result_cs,
         Static::batch_request_cs,
         Static::batch_response_cs,
+        Static::function_sync_cs,
         Static::function_async_cs,
-        Static::function_result_cs
+        Static::function_result_cs,
+        Static::cancelled_cs,
+        Static::timed_out_cs,
+        Static::online_cs,
+        Static::refresh_cs
     };
 
     inline static std::array<const char*, cs_end_cache_specs> cspec_names{
@@ -1429,7 +1526,9 @@ private:
         Static::cindex_cs,
         Static::query_id_cs,
         Static::xname_cs,
-        Static::yname_cs
+        Static::yname_cs,
+        Static::col_formats_cs,
+        Static::refresh_ms_cs
     };
 
     inline static std::array<CacheDataType, cs_end_cache_specs> cspec_types{
@@ -1480,7 +1579,9 @@ private:
         cdAny,      // cs_cindex
         cdResultSet,// cs_query_id
         cdStr,      // cs_xname
-        cdStr       // cs_yname
+        cdStr,      // cs_yname
+        cdStr,      // cs_col_formats
+        cdInt       // cs_refresh_ms
     };
 
     inline static  std::map<RenderMethod, CacheSpecVec> value_cspecs{
@@ -1495,7 +1596,8 @@ private:
         {Button, {cs_text, cs_tooltip}},
         {Table, {cs_title, cs_title_font, cs_title_font_size,
                     cs_body_font, cs_body_font_size,
-                    cs_table_flags, cs_window_flags, cs_column_flags}},
+                    cs_table_flags, cs_window_flags, cs_column_flags,
+                    cs_col_formats, cs_refresh_ms}},
         {Footer, {cs_show_footer_db, cs_show_footer_fps, cs_show_footer_demo, 
                     cs_show_footer_id_stack, cs_show_footer_font_scale, 
                         cs_show_footer_style, cs_show_footer_dlc}},
@@ -1513,7 +1615,7 @@ private:
                     cs_window_flags}},
         {Window, {cs_title, cs_title_font, cs_title_font_size,
                     cs_window_flags, cs_close_button}},
-        {ShadedPlot, {cs_title, cs_show_lines, cs_show_fills, cs_shaded_plot_flags}},
+        {ShadedPlot, {cs_title, cs_show_lines, cs_show_fills, cs_shaded_plot_flags, cs_refresh_ms}},
         {PushFont, {cs_font, cs_font_size}},
         {BeginChild, {cs_title}},
         {MemoryEditor, {cs_title}}
@@ -1536,7 +1638,10 @@ private:
         }},
         {Checkbox, {{cs_cname, cdBool}}},
         {DatePicker, {{cs_cname, cdIntVec}}},
-        {LoadingModal, {{cs_cname, cdStrVec}}},
+        {LoadingModal, {
+            {cs_cname, cdStrVec},
+            {cs_query_id, cdResultSet}  // optional: shows its progress
+        }},
         {DuckTableSummaryModal, {
             {cs_query_id, cdResultSet}
         }},
@@ -65,7 +65,7 @@
 // index: AddrInx:[
 //          Combo:Int,
 // ]
-// == Queries: Table
+// == Queries: Table, LoadingModal
 // qname: AddrInx
 // == Footer switches: Footer
 // db:bool
@@ -171,13 +171,24 @@ using InxCspecVecMap = std::map<uint32_t, CacheSpecVec>;
 using WCSCSFunc = std::function<void(WidgetPtr, CacheSpecifier, CacheSpecifier)>;
 
 
+// A bound SQL param: the value at cname, or if cindex is valid,
+// the cname StrVec entry that cindex selects, as for a Combo
+struct ActionParam {
+    AddrInx cname;
+    AddrInx cindex;
+};
+using ActionParamVec = std::vector<ActionParam>;
+
 struct NDAction {
     EntityInx push_ui;
     RenderMethod pop_ui{ EndRenderMethod };
-    DBEventType db_action{ EndDBEventTypes }; // Query|Command|BatchRequest
+    DBEventType db_action{ EndDBEventTypes }; // Query|Command|BatchRequest|Refresh
     EntityInx query_id;
     AddrInx sql_cname;
     CacheDataType ctype{ EndDataTypes };
+    uint32_t timeout_ms{ 0 };   // zero: no timeout
+    ActionParamVec params;      // Query|Command: $1..$n, prepared statement
+    std::string refresh_key;    // Query: makes it refreshable, see Static::refresh_key_cs
 };
 
 struct NDActionInterned {
@@ -205,6 +216,14 @@ using ActionErrorVec = std::vector<NDActionErrors>;
 using ActionMap = std::map<ActionKey, ActionVec>;
 using ActionInternMap = std::map<ActionKey, ActionInternVec>;
 using ActionErrorMap = std::map<ActionKey, ActionErrorVec>;
+
+// A param bound action: the sequence and the DB action's index in it.
+// ActionMap is a std::map, so sequence is stable once actions are parsed.
+struct BoundAction {
+    ActionVec*  sequence{ nullptr };
+    int         inx{ 0 };
+};
+using BoundActionMap = std::map<uint32_t, std::vector<BoundAction>>;
 using BufferMap = std::map<EntityInx, char*>;
 
 inline RenderMethod RenderMethodFromString(const std::string& method) {
@@ -296,6 +315,14 @@ inline DBEventType DBEventTypeFromString(const std::string& evt) {
         return dbFunctionAsync;
     if (evt == Static::function_result_cs)
         return dbFunctionResult;
+    if (evt == Static::cancelled_cs)
+        return dbCancelled;
+    if (evt == Static::timed_out_cs)
+        return dbTimedOut;
+    if (evt == Static::online_cs)
+        return dbOnline;
+    if (evt == Static::refresh_cs)
+        return dbRefresh;
     return EndDBEventTypes;
 }
 
@@ -319,6 +346,14 @@ inline const char* DBEventTypeToString(DBEventType dbet) {
         return Static::function_async_cs;
     case dbFunctionResult:
         return Static::function_result_cs;
+    case dbCancelled:
+        return Static::cancelled_cs;
+    case dbTimedOut:
+        return Static::timed_out_cs;
+    case dbOnline:
+        return Static::online_cs;
+    case dbRefresh:
+        return Static::refresh_cs;
     case EndDBEventTypes:
         return nullptr;
     }
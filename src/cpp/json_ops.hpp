@@ -56,6 +56,11 @@ JSON JArray(const std::vector<V>& values) {
 	return JSON(values);
 }
 
+// JPush: append to an array, which may mix atomic types,
+// unlike JArray's std::vector<V>
+template <typename JSON, typename V>
+void JPush(JSON& arr, const V& val);
+
 template <typename JSON>
 std::string JPrettyPrint(const JSON& cache_object);
 
@@ -130,6 +135,15 @@ nlohmann::json JArray(const std::vector<V>& values) {
 
 inline nlohmann::json JNewObject() { return nlohmann::json::object(); }
 
+inline nlohmann::json JNewArray() { return nlohmann::json::array(); }
+
+inline nlohmann::json JNull() { return nlohmann::json(nullptr); }
+
+template <typename V>
+void JPush(nlohmann::json& arr, const V& val) {
+	arr.push_back(val);
+}
+
 template <>
 inline std::string JPrettyPrint(const nlohmann::json& cache_object) {
 	std::string pp = cache_object.dump(2);
@@ -211,6 +225,15 @@ inline emscripten::val JParse(const std::string& json_string) {
 // lambda to invoke the static object() method
 inline emscripten::val JNewObject() { return emscripten::val::object(); }
 
+inline emscripten::val JNewArray() { return emscripten::val::array(); }
+
+inline emscripten::val JNull() { return emscripten::val::null(); }
+
+template <typename V>
+void JPush(emscripten::val& arr, const V& val) {
+	arr.call<void>("push", val);
+}
+
 template <>
 inline std::string JPrettyPrint(const emscripten::val& v) {
 	emscripten::val json_global = emscripten::val::global("JSON");
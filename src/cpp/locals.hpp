@@ -2,6 +2,7 @@
 #pragma once
 #include "nd_types.hpp"
 #include "dl_types.hpp"
+#include "series.hpp"
 #include "imgui.h"
 #include "imgui_internal.h"
 
@@ -53,6 +54,7 @@ struct ShadedPlotLocals {
     double      ymax_dbl{ 0.0 };
     uint32_t    row_count{ 0 };
     uint32_t    offset{ 0 };
+    XYSeries    series;     // rebuilt each frame, as chunks may have landed
 };
 
 struct TextAreaLocals {
@@ -0,0 +1,183 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "nd_types.hpp"
+#include "series.hpp"
+
+// LODPyramid: min/max decimation of one x,y series for render_shaded_plot,
+// so the vertices ImPlot draws per frame are bounded by the plot's pixel
+// width rather than the row count. Level 0 folds every base_rows rows
+// into their min y and max y points, each level above folds two buckets
+// of the level below, and a spike in any bucket survives to the top.
+// Built through SeriesColumn::at, so it is the same for BBDuckDBCache and
+// WebDuckDBCache chunk layouts. The pyramid is built when a plot first
+// binds a (handle, x, y), and extended as BatchResponses add rows, by
+// refolding only the trailing partial bucket of each level.
+
+struct LODPoint {
+    double  x{ 0.0 };
+    double  y{ 0.0 };
+};
+
+struct LODLevel {
+    uint32_t                bucket_rows{ 0 };
+    // two per bucket, its min y and max y points in x order. A bucket
+    // whose y values are all null has two NaN y points, so lines break.
+    std::vector<LODPoint>   points;
+
+    uint32_t bucket_count() const { return static_cast<uint32_t>(points.size() / 2); }
+};
+
+struct LODPyramid {
+    static constexpr uint32_t base_rows{ 8 };
+    static constexpr uint32_t min_buckets{ 64 };   // no level above this many
+
+    RSHandle                handle{ 0 };
+    uint32_t                epoch{ 0 };
+    std::string             x_name;
+    std::string             y_name;
+    uint32_t                row_count{ 0 };     // rows folded in so far
+    bool                    x_sorted{ true };   // non null and non decreasing, so x ranges map to rows
+    double                  last_x{ 0.0 };
+    std::vector<LODLevel>   levels;
+    uint32_t                extend_count{ 0 };  // for tests and pix
+
+    bool matches(RSHandle h, uint32_t e, const char* xn, const char* yn) const {
+        return handle == h && epoch == e && x_name == xn && y_name == yn;
+    }
+
+    void reset(RSHandle h, uint32_t e, const char* xn, const char* yn) {
+        handle = h;
+        epoch = e;
+        x_name = xn;
+        y_name = yn;
+        row_count = 0;
+        x_sorted = true;
+        last_x = 0.0;
+        levels.clear();
+    }
+
+    // Fold rows [row_count, rows) of series into every level
+    void extend(XYSeries& series, uint32_t rows) {
+        if (rows <= row_count)
+            return;
+        if (levels.empty())
+            levels.push_back(LODLevel{ base_rows });
+        // level 0 from the rows, from the old partial bucket on
+        LODLevel& level0{ levels[0] };
+        uint32_t from_bucket = row_count / base_rows;
+        level0.points.resize(from_bucket * 2);
+        for (uint32_t begin = from_bucket * base_rows; begin < rows; begin += base_rows) {
+            uint32_t end = std::min(begin + base_rows, rows);
+            LODPoint lo{ series.x.at(begin), std::nan("") };
+            LODPoint hi{ lo };
+            for (uint32_t row = begin; row < end; row++) {
+                double x = series.x.at(row);
+                double y = series.y.at(row);
+                if (row >= row_count) {
+                    // a null x is NaN, which no comparison catches
+                    if (std::isnan(x) || (row > 0 && x < last_x))
+                        x_sorted = false;
+                    last_x = x;
+                }
+                if (std::isnan(y))
+                    continue;
+                if (std::isnan(lo.y) || y < lo.y)
+                    lo = LODPoint{ x, y };
+                if (std::isnan(hi.y) || y > hi.y)
+                    hi = LODPoint{ x, y };
+            }
+            push_bucket(level0, lo, hi);
+        }
+        // each level above from the one below
+        for (size_t inx = 1; levels[inx - 1].bucket_count() > min_buckets; inx++) {
+            if (inx == levels.size())
+                levels.push_back(LODLevel{ base_rows << inx });
+            const LODLevel& below{ levels[inx - 1] };
+            LODLevel& level{ levels[inx] };
+            // a level new on this extend starts from scratch
+            from_bucket = std::min(row_count / level.bucket_rows, level.bucket_count());
+            level.points.resize(from_bucket * 2);
+            for (uint32_t bucket = from_bucket; bucket * 2 < below.bucket_count(); bucket++) {
+                const LODPoint* pts = &below.points[bucket * 4];
+                LODPoint lo{ min_point(pts[0], pts[1]) };
+                LODPoint hi{ max_point(pts[0], pts[1]) };
+                if (bucket * 2 + 1 < below.bucket_count()) {
+                    LODPoint lo2{ min_point(pts[2], pts[3]) };
+                    LODPoint hi2{ max_point(pts[2], pts[3]) };
+                    if (std::isnan(lo.y) || lo2.y < lo.y) lo = lo2;
+                    if (std::isnan(hi.y) || hi2.y > hi.y) hi = hi2;
+                }
+                push_bucket(level, lo, hi);
+            }
+        }
+        row_count = rows;
+        extend_count++;
+    }
+
+    // Level whose bucket count over visible_rows fits pixel_width, so
+    // two points per pixel. -1 if the raw rows already fit.
+    int select(uint32_t visible_rows, float pixel_width) const {
+        uint32_t target = std::max(1u, static_cast<uint32_t>(pixel_width));
+        if (visible_rows <= target * 2 || levels.empty())
+            return -1;
+        for (size_t inx = 0; inx < levels.size(); inx++) {
+            if (visible_rows / levels[inx].bucket_rows <= target)
+                return static_cast<int>(inx);
+        }
+        return static_cast<int>(levels.size()) - 1;
+    }
+
+    // Rows [begin, end) of [0, row_count) that fall in [xmin, xmax], plus
+    // one either side so lines run to the plot edge. The whole range if
+    // x isn't sorted or has nulls.
+    void visible_rows(SeriesColumn& x, double xmin, double xmax, uint32_t& begin, uint32_t& end) const {
+        begin = 0;
+        end = row_count;
+        if (!x_sorted || row_count == 0)
+            return;
+        uint32_t lo{ 0 };
+        uint32_t hi{ row_count };
+        while (lo < hi) {   // first row with x >= xmin
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (x.at(mid) < xmin) lo = mid + 1; else hi = mid;
+        }
+        begin = lo > 0 ? lo - 1 : 0;
+        hi = row_count;
+        while (lo < hi) {   // first row with x > xmax
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (x.at(mid) <= xmax) lo = mid + 1; else hi = mid;
+        }
+        end = std::min(lo + 1, row_count);
+    }
+
+private:
+    static LODPoint min_point(const LODPoint& a, const LODPoint& b) {
+        return std::isnan(a.y) || b.y < a.y ? b : a;
+    }
+
+    static LODPoint max_point(const LODPoint& a, const LODPoint& b) {
+        return std::isnan(a.y) || b.y > a.y ? b : a;
+    }
+
+    static void push_bucket(LODLevel& level, const LODPoint& lo, const LODPoint& hi) {
+        if (hi.x < lo.x) {
+            level.points.push_back(hi);
+            level.points.push_back(lo);
+        }
+        else {
+            level.points.push_back(lo);
+            level.points.push_back(hi);
+        }
+    }
+};
+
+// A run of one level's points for the ImPlot getters
+struct LODView {
+    const LODPoint*     points{ nullptr };
+    uint32_t            count{ 0 };
+    double              y_ref{ 0.0 };
+};
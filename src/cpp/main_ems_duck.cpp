@@ -69,8 +69,15 @@ int main(int argc, char* argv[]) {
     dbrd.set_async_dispatcher([&server](const emscripten::val& v)
         {server.add_db_response(v); });
 
-    dbrd.set_reg_chunk([&server](const std::string& qid, int sz, int addr)
-                                    {server.register_chunk(qid.c_str(), sz, addr); });
+    dbrd.set_reg_schema([&server](const std::string& qid, const StringVec& names, const IntVec& types,
+                                    const std::vector<StringVec>& dicts)
+                                    {server.register_schema(qid, names, types, dicts); });
+    dbrd.set_reg_chunk([&server](const std::string& qid, int sz)
+                                    {return server.register_chunk(qid.c_str(), sz); });
+    dbrd.set_on_chunk([&server](uint32_t addr)
+                                    {server.on_chunk(addr); });
+    dbrd.set_chunk_queue([&server]()
+                                    {return server.chunk_queue_addr(); });
     StringVec font_list;
     cfg.get_nested_str_list(Static::fonts_cs, font_list);
     IDBFileCache font_cache(
@@ -44,7 +44,7 @@ using VSFunc = std::function<void(const std::string&)>;
 using VVFunc = std::function<void()>;
 
 // DuckDBWebCache chunk helpers
-using RegWasmChunkFunc = std::function<void(const std::string&, int, int)>;
+using RegWasmChunkFunc = std::function<int(const std::string&, int)>;
 struct WasmChunk {
     WasmChunk(uint32_t sz, uint32_t address) :size(sz), addr(address) {}
     uint32_t    size;
@@ -52,6 +52,87 @@ struct WasmChunk {
 };
 using WasmChunkVec = std::vector<WasmChunk>;
 using WasmChunkMap = std::map<std::string, WasmChunkVec>;
+using OnWasmChunkFunc = std::function<void(uint32_t)>;
+using RegWasmSchemaFunc = std::function<void(const std::string&, const StringVec&, const IntVec&,
+                                            const std::vector<StringVec>&)>;
+using WasmChunkQueueFunc = std::function<uint32_t()>;
+// v2 chunk layout, in 32 bit words: [0] row count, then two words per
+// column, the offsets from the chunk start of its values and of its
+// validity bitmap, both 8 byte aligned. A zero validity offset means the
+// column has no nulls in the chunk, so the bitmap is skipped. Types and
+// names are sent once per query_id by on_schema_cpp, so a chunk is just
+// the values and bitmaps, as copied from the Arrow buffers. A wdtDict
+// column's values are int32 codes, and on_schema_cpp sends its entries.
+inline uint32_t wasm_chunk_rows(const uint32_t* chunk_ptr) { return chunk_ptr[0]; }
+inline uint32_t* wasm_chunk_col(uint32_t* chunk_ptr, uint32_t col_inx) { return chunk_ptr + chunk_ptr[1 + col_inx * 2]; }
+// Same bit layout as duckdb_validity_row_is_valid, or nullptr if all valid
+inline const uint64_t* wasm_chunk_validity(const uint32_t* chunk_ptr, uint32_t col_inx) {
+    uint32_t offset = chunk_ptr[2 + col_inx * 2];
+    return offset ? reinterpret_cast<const uint64_t*>(chunk_ptr + offset) : nullptr;
+}
+// A wdtUtf8 column is Arrow's layout: int32 offsets[nrows + 1] from 0,
+// then the UTF-8 they index, so row i is [heap + offsets[i], heap +
+// offsets[i + 1]), never truncated, nor zero terminated.
+inline const char* wasm_utf8_heap(const uint32_t* col_ptr, uint32_t nrows) {
+    return reinterpret_cast<const char*>(col_ptr + nrows + 1);
+}
+
+// Bulk cache row index: one per result set handle, extended as each
+// chunk lands. offsets[i] is the row number of the first row in chunk i,
+// so the prefix sum maps row_index to (chunk, offset) without walking
+// the chunk list. Duck chunks are usually duckdb_vector_size() rows, but
+// the tail is short and parquet scans can yield short chunks mid result.
+// So we only divide directly while every chunk bar the last is the same
+// size as chunk 0, and fall back to binary search otherwise.
+struct ChunkIndex {
+    UintVec     offsets;
+    uint32_t    row_count{ 0 };     // cached total over all chunks
+    uint32_t    stride{ 0 };        // row count of chunk 0
+    bool        uniform{ true };    // all chunks bar the last are stride rows
+
+    void clear() {
+        offsets.clear();
+        row_count = 0;
+        stride = 0;
+        uniform = true;
+    }
+
+    uint32_t chunk_count() const { return static_cast<uint32_t>(offsets.size()); }
+
+    void add_chunk(uint32_t chunk_rows) {
+        if (offsets.empty()) {
+            stride = chunk_rows;
+            uniform = chunk_rows > 0;
+        }
+        else if (row_count - offsets.back() != stride) {
+            // the old tail was short, and it's no longer the tail
+            uniform = false;
+        }
+        offsets.push_back(row_count);
+        row_count += chunk_rows;
+    }
+
+    uint32_t chunk_rows(uint32_t chunk_inx) const {
+        uint32_t end = chunk_inx + 1 < offsets.size() ? offsets[chunk_inx + 1] : row_count;
+        return end - offsets[chunk_inx];
+    }
+
+    bool locate(uint32_t row_index, uint32_t& chunk_inx, uint32_t& rel_index) const {
+        if (row_index >= row_count)
+            return false;
+        if (uniform) {
+            // tail chunk may be longer than stride, so clamp
+            chunk_inx = std::min(row_index / stride, chunk_count() - 1);
+        }
+        else {
+            // last chunk whose first row is <= row_index
+            auto iter = std::upper_bound(offsets.begin(), offsets.end(), row_index);
+            chunk_inx = static_cast<uint32_t>(std::distance(offsets.begin(), iter)) - 1;
+        }
+        rel_index = row_index - offsets[chunk_inx];
+        return true;
+    }
+};
 
 // DuckDB helpers for DuckDB-WASM.
 // ND these enums are not the same as duckdb.h
@@ -60,6 +141,7 @@ using WasmChunkMap = std::map<std::string, WasmChunkVec>;
 // ...so do not make size explicit like C/C++ types.
 enum WasmDuckType : int32_t {
     wdtNone = 0,
+    wdtDict = -1,
     wdtInt = 2,
     wdtFloat = 3,
     wdtUtf8 = 5,
@@ -238,6 +320,10 @@ enum DBEventType : uint32_t {
     dbFunctionSync,
     dbFunctionAsync,
     dbFunctionResult,
+    dbCancelled,        // superseded by a newer Query on the same query_id
+    dbTimedOut,         // exceeded the action's timeout_ms
+    dbOnline,           // DB instance up: DuckDB.Online is a SubSysEvent
+    dbRefresh,          // rerun a Query for rows past its refresh_key, answered by BatchResponse
     EndDBEventTypes
 };
 
@@ -328,7 +414,7 @@ struct DataCacheIndex {
         return magic_index & MAX_DCI;
     }
 
-    bool operator==(const DataCacheIndex& rhs) {
+    bool operator==(const DataCacheIndex& rhs) const {
         if ((magic_index & MAX_DCI) != (rhs.magic_index & MAX_DCI))
             return false;
         if (data_type != rhs.data_type)
@@ -483,6 +569,8 @@ enum CacheSpecifier : uint32_t {
     cs_query_id,
     cs_xname,
     cs_yname,
+    cs_col_formats,
+    cs_refresh_ms,
     cs_end_cache_specs
 };
 
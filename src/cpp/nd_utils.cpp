@@ -39,6 +39,8 @@ const char* WasmDuckTypeToString(WasmDuckType dt) {
         return "TS_ns";
     case WasmDuckType::wdtUtf8:
         return "Utf8";
+    case WasmDuckType::wdtDict:
+        return "Dict";
     }
     return "Unknown";
 }
@@ -47,6 +49,8 @@ const char* WasmDuckTypeToString(WasmDuckType dt) {
 int WasmDuckTypeToSize(WasmDuckType dt) {
     switch (dt) {
     case WasmDuckType::wdtInt:
+    case WasmDuckType::wdtUtf8:     // int32 offsets; the chars follow them
+    case WasmDuckType::wdtDict:     // int32 codes
         return 4;
     case WasmDuckType::wdtFloat:
     case WasmDuckType::wdtTimestamp:
@@ -54,7 +58,6 @@ int WasmDuckTypeToSize(WasmDuckType dt) {
     case WasmDuckType::wdtTimestamp_ms:
     case WasmDuckType::wdtTimestamp_us:
     case WasmDuckType::wdtTimestamp_ns:
-    case WasmDuckType::wdtUtf8:
         return 8;
     }
     return 0;
@@ -99,8 +102,8 @@ void sprintf_value(char* cbuf, uint32_t* chunk_ptr, int bptr, int32_t tipe, int
         dbldata = reinterpret_cast<double*>(ui32data);
         sprintf(cbuf, "[%d]=%f", row_index, *dbldata);
         break;
-    case WasmDuckType::wdtUtf8:    // null term trunc to 8 bytes
-        sprintf(cbuf, "[%d]=%s", row_index, (char*)ui32data);
+    case WasmDuckType::wdtUtf8:    // stride 4: the offset into the heap
+        sprintf(cbuf, "[%d]=@%d", row_index, *i32data);
         break;
     case WasmDuckType::wdtTimestamp_ns:
         fmt_result = fmt::format_to_n(dbuf, dbuf_size, "{:%F %T}", TPNano{ std::chrono::nanoseconds{ *i64data } });
@@ -0,0 +1,151 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <boost/atomic.hpp>
+#include <boost/chrono.hpp>
+#include <boost/thread.hpp>
+#include <duckdb.h>
+
+// QueryProgress: how far a BBDuckDBCache worker has got with the request
+// it's executing, for render_loading_modal. A long parquet scan used to
+// sit inside one blocking duckdb_query, so the modal could only spin, and
+// a slow scan looked just like a hung one. Now the worker runs each
+// statement with duckdb_pending_prepared, a duckdb_pending_execute_task
+// at a time, and after each task publishes duckdb_query_progress to its
+// own slot. There's one slot per worker, as a worker executes a single
+// request at a time. Every field is an atomic, so the GUI thread reads
+// them without a lock. It may see fields from either side of an update,
+// which a progress bar can live with. The worker checks its lane's
+// interrupt between tasks too, so a superseded or timed out request stops
+// at the next task boundary.
+
+struct QueryProgress {
+    // of the query_id executing, zero when the worker is idle
+    boost::atomic<uint64_t>     qid_hash{ 0 };
+    // hundredths of a percent, negative until Duck can estimate it
+    boost::atomic<int32_t>      centi_percent{ -1 };
+    boost::atomic<uint64_t>     rows{ 0 };
+    boost::atomic<uint64_t>     total_rows{ 0 };
+    boost::atomic<int64_t>      begin_us{ 0 };
+
+    // never zero, so it can't match an idle slot
+    static uint64_t hash(const std::string& qid) {
+        return static_cast<uint64_t>(std::hash<std::string>{}(qid)) | 1;
+    }
+
+    static int64_t now_us() {
+        return boost::chrono::duration_cast<boost::chrono::microseconds>(
+            boost::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Worker thread, either side of each request. qid_hash goes last, so
+    // a reader that matches it sees the reset fields.
+    void begin(const std::string& qid) {
+        centi_percent = -1;
+        rows = 0;
+        total_rows = 0;
+        begin_us = now_us();
+        qid_hash = hash(qid);
+    }
+
+    void end() { qid_hash = 0; }
+
+    void publish(const duckdb_query_progress_type& qp) {
+        centi_percent = qp.percentage < 0.0 ? -1 : static_cast<int32_t>(qp.percentage * 100.0);
+        rows = qp.rows_processed;
+        total_rows = qp.total_rows_to_process;
+    }
+
+    // GUI thread: false unless this slot is executing the query_id whose
+    // hash is qh. percent is negative while Duck can't estimate it.
+    bool read(uint64_t qh, double& percent, double& rows_per_sec) const {
+        if (qid_hash != qh)
+            return false;
+        int32_t cp = centi_percent;
+        percent = cp < 0 ? -1.0 : cp / 100.0;
+        double secs = static_cast<double>(now_us() - begin_us) / 1e6;
+        rows_per_sec = secs > 0.0 ? static_cast<double>(rows) / secs : 0.0;
+        return true;
+    }
+};
+
+// What a worker needs to run a request's statements task by task.
+// interrupt is the lane's LaneInterrupt, non zero once the request has
+// been superseded or has timed out.
+struct PendingExec {
+    duckdb_connection                   conn{ nullptr };
+    QueryProgress&                      progress;
+    const boost::atomic<uint32_t>&      interrupt;
+};
+
+// Execute stmt a task at a time into result. With streaming, Duck
+// declares the result ready once the first chunks are, as
+// duckdb_execute_pending on a streaming pending result always has.
+inline duckdb_state execute_pending(const PendingExec& exec, duckdb_prepared_statement stmt,
+                                    bool streaming, duckdb_result* result) {
+    static const char* method = "execute_pending: ";
+    duckdb_pending_result pending{ nullptr };
+    duckdb_state dbstate = streaming ? duckdb_pending_prepared_streaming(stmt, &pending)
+                                     : duckdb_pending_prepared(stmt, &pending);
+    if (dbstate == DuckDBError) {
+        const char* error = duckdb_pending_error(pending);
+        std::cerr << method << "PENDING_FAIL: " << (error ? error : "NULL") << std::endl;
+    }
+    else {
+        duckdb_pending_state pstate{ DUCKDB_PENDING_RESULT_NOT_READY };
+        while (!duckdb_pending_execution_is_finished(pstate)) {
+            if (exec.interrupt != 0) {
+                std::cerr << method << "INTERRUPTED" << std::endl;
+                dbstate = DuckDBError;
+                break;
+            }
+            pstate = duckdb_pending_execute_task(pending);
+            exec.progress.publish(duckdb_query_progress(exec.conn));
+            // Duck's own threads have the tasks, so don't spin on them
+            if (pstate == DUCKDB_PENDING_NO_TASKS_AVAILABLE)
+                boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+        }
+        // on DUCKDB_PENDING_ERROR this puts the error in result
+        if (dbstate == DuckDBSuccess)
+            dbstate = duckdb_execute_pending(pending, result);
+    }
+    duckdb_destroy_pending(&pending);
+    return dbstate;
+}
+
+// Execute each of sql's statements in turn with execute_pending, so the
+// BEGIN; CREATE TABLE ... AS SELECT; COMMIT; of a scan Command reports
+// progress too, as it can't be prepared whole. Each statement is prepared
+// after the one before has run, so it can bind to tables that one made.
+// result holds the last statement's result, the only one that streams,
+// or the error of the one that failed. Caller destroys result.
+inline duckdb_state execute_sql(const PendingExec& exec, const std::string& sql,
+                                bool streaming, duckdb_result* result) {
+    static const char* method = "execute_sql: ";
+    duckdb_extracted_statements extracted{ nullptr };
+    idx_t count = duckdb_extract_statements(exec.conn, sql.c_str(), &extracted);
+    duckdb_state dbstate{ DuckDBSuccess };
+    if (count == 0) {
+        const char* error = duckdb_extract_statements_error(extracted);
+        std::cerr << method << "PARSE_FAIL: " << (error ? error : "NO_STATEMENTS") << ": " << sql << std::endl;
+        dbstate = DuckDBError;
+    }
+    for (idx_t inx = 0; inx < count && dbstate == DuckDBSuccess; inx++) {
+        duckdb_prepared_statement stmt{ nullptr };
+        dbstate = duckdb_prepare_extracted_statement(exec.conn, extracted, inx, &stmt);
+        if (dbstate == DuckDBError) {
+            const char* error = duckdb_prepare_error(stmt);
+            std::cerr << method << "PREPARE_FAIL(" << inx << "): " << (error ? error : "NULL") << ": " << sql << std::endl;
+        }
+        else {
+            if (inx > 0)
+                duckdb_destroy_result(result);
+            dbstate = execute_pending(exec, stmt, streaming && inx + 1 == count, result);
+        }
+        duckdb_destroy_prepare(&stmt);
+    }
+    duckdb_destroy_extracted(&extracted);
+    return dbstate;
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <cstdint>
+#include <unordered_map>
+#include "nd_types.hpp"
+
+// ResultBudget: memory accounting for the result sets held by a bulk
+// cache. Each handle's chunk bytes are summed against a budget, and
+// get_handle stamps the handle with the current frame. Render methods
+// call get_handle every frame for the result sets they show, so a handle
+// stamped in this frame or the last is pinned by a widget on the render
+// stack. Over budget, the cache evicts the least recently used unpinned
+// handle. Both BBDuckDBCache and WebDuckDBCache use this on the GUI thread.
+
+struct ResultBudget {
+    struct Usage {
+        uint64_t    bytes{ 0 };
+        uint32_t    last_used{ 0 };     // frame
+    };
+    std::unordered_map<RSHandle, Usage> usage;
+    uint64_t    budget_bytes{ 0 };      // zero: no budget
+    uint64_t    used_bytes{ 0 };
+    uint32_t    frame{ 0 };
+
+    void start_frame() { frame++; }
+
+    void touch(RSHandle handle) {
+        if (handle != 0)
+            usage[handle].last_used = frame;
+    }
+
+    // new handles start pinned, so a fresh result is not evicted
+    // before any widget has had the chance to render it
+    void add(RSHandle handle, uint64_t bytes) {
+        auto [iter, inserted] = usage.try_emplace(handle);
+        if (inserted)
+            iter->second.last_used = frame;
+        iter->second.bytes += bytes;
+        used_bytes += bytes;
+    }
+
+    void remove(RSHandle handle) {
+        auto iter = usage.find(handle);
+        if (iter == usage.end())
+            return;
+        used_bytes -= iter->second.bytes;
+        usage.erase(iter);
+    }
+
+    bool is_pinned(const Usage& u) const { return u.last_used + 1 >= frame; }
+
+    bool over() const { return budget_bytes > 0 && used_bytes > budget_bytes; }
+
+    // Least recently used handle that holds memory, isn't pinned and
+    // that the cache says can go. Zero if there's no candidate.
+    template <typename EVICTABLE>
+    RSHandle lru_victim(EVICTABLE can_evict) const {
+        RSHandle victim{ 0 };
+        uint32_t oldest{ UINT32_MAX };
+        for (const auto& usage_pair : usage) {
+            const Usage& u{ usage_pair.second };
+            if (u.bytes == 0 || is_pinned(u) || u.last_used >= oldest)
+                continue;
+            if (!can_evict(usage_pair.first))
+                continue;
+            victim = usage_pair.first;
+            oldest = u.last_used;
+        }
+        return victim;
+    }
+};
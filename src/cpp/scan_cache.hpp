@@ -0,0 +1,342 @@
+#pragma once
+#include <cctype>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <duckdb.h>
+#include "nd_types.hpp"
+
+// ScanCache: lets a persistent BBDuckDBCache skip Commands that would
+// rebuild a table from unchanged files. With db_config's db_path set,
+// DuckDB opens an on disk database, so the tables a scan Command creates
+// outlive the process. Before a worker runs a Command that reads files
+// with read_parquet et al and creates tables, it fingerprints the
+// sources with read_blob: name, size and last modified time. That is a
+// HEAD per URL for httpfs, and a stat per local file, with no file
+// content read. If the Command's SQL text and fingerprint match the
+// nd_scan_cache row from an earlier run, and the tables are still
+// there, the worker posts the CommandResult without running the SQL.
+// ETags aren't visible through read_blob, so a server that rewrites a
+// file with the same size inside the same second would go unnoticed.
+
+// A call of one of the scan functions in sql: where it starts, where
+// its file argument starts and ends, and the files, as the quoted
+// literals they appear as, so they can go into a read_blob list
+// verbatim. Only the first argument counts, as read_csv's options are
+// literals too.
+struct ScanCall {
+    size_t      begin{ 0 };         // the function name
+    size_t      arg_begin{ 0 };     // the literal, or the [ of a list
+    size_t      arg_end{ 0 };       // just past it
+    bool        list{ false };
+    StringVec   sources;
+};
+
+inline std::vector<ScanCall> scan_calls(const std::string& sql) {
+    static const char* scan_funcs[] = { "read_parquet", "parquet_scan", "read_csv_auto", "read_csv",
+                                        "read_json_auto", "read_json" };
+    std::vector<ScanCall> calls;
+    std::string lower_sql(sql);
+    for (char& c : lower_sql)
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    for (const char* func : scan_funcs) {
+        size_t func_len = strlen(func);
+        for (size_t pos = lower_sql.find(func); pos != std::string::npos; pos = lower_sql.find(func, pos + func_len)) {
+            // whole identifier only, so read_csv doesn't match read_csv_auto
+            size_t inx = pos + func_len;
+            if ((pos > 0 && (std::isalnum(static_cast<unsigned char>(lower_sql[pos - 1])) || lower_sql[pos - 1] == '_'))
+                    || (inx < lower_sql.size() && lower_sql[inx] == '_'))
+                continue;
+            while (inx < sql.size() && std::isspace(static_cast<unsigned char>(sql[inx])))
+                inx++;
+            if (inx >= sql.size() || sql[inx] != '(')
+                continue;
+            inx++;
+            while (inx < sql.size() && std::isspace(static_cast<unsigned char>(sql[inx])))
+                inx++;
+            ScanCall call;
+            call.begin = pos;
+            call.arg_begin = inx;
+            call.list = inx < sql.size() && sql[inx] == '[';
+            if (call.list)
+                inx++;
+            while (inx < sql.size()) {
+                while (inx < sql.size() && (std::isspace(static_cast<unsigned char>(sql[inx])) || sql[inx] == ','))
+                    inx++;
+                if (inx >= sql.size() || sql[inx] != '\'')
+                    break;
+                // '' escapes a quote inside a literal
+                size_t begin = inx++;
+                while (inx < sql.size()) {
+                    if (sql[inx] == '\'') {
+                        if (inx + 1 < sql.size() && sql[inx + 1] == '\'')
+                            inx++;
+                        else
+                            break;
+                    }
+                    inx++;
+                }
+                if (inx >= sql.size())
+                    break;
+                call.sources.push_back(sql.substr(begin, ++inx - begin));
+                call.arg_end = inx;
+                if (!call.list)
+                    break;
+            }
+            if (call.list) {
+                // a list of literals only, or arg_end stays short of the ]
+                while (inx < sql.size() && std::isspace(static_cast<unsigned char>(sql[inx])))
+                    inx++;
+                call.arg_end = inx < sql.size() && sql[inx] == ']' ? inx + 1 : 0;
+            }
+            if (!call.sources.empty())
+                calls.push_back(call);
+        }
+    }
+    return calls;
+}
+
+// The file arguments of the scan functions in sql
+inline StringVec scan_sources(const std::string& sql) {
+    StringVec sources;
+    for (const ScanCall& call : scan_calls(sql))
+        sources.insert(sources.end(), call.sources.begin(), call.sources.end());
+    return sources;
+}
+
+// ScanSplit: a scan Command whose only scan call reads a list of files,
+// taken apart so BBDuckDBCache can read each file into a table of its
+// own on a worker of its own. The Command then runs with the call
+// replaced by the UNION ALL of those tables, so it still creates its
+// tables in one transaction. part_selects are the call with one file
+// each, and the rest of its arguments.
+struct ScanSplit {
+    StringVec   part_selects;
+    std::string prefix;             // sql before the call
+    std::string suffix;             // sql after the call's )
+    bool        by_name{ false };   // union_by_name=true
+};
+
+inline bool split_scan(const std::string& sql, ScanSplit& split) {
+    std::vector<ScanCall> calls = scan_calls(sql);
+    if (calls.size() != 1 || !calls[0].list || calls[0].sources.size() < 2 || calls[0].arg_end == 0)
+        return false;
+    const ScanCall& call(calls[0]);
+    // the call's closing ), skipping literals and nested ()
+    size_t inx = call.arg_end;
+    uint32_t depth{ 1 };
+    for (; inx < sql.size(); inx++) {
+        if (sql[inx] == '\'') {
+            inx = sql.find('\'', inx + 1);
+            if (inx == std::string::npos)
+                return false;
+        }
+        else if (sql[inx] == '(') {
+            depth++;
+        }
+        else if (sql[inx] == ')' && --depth == 0) {
+            break;
+        }
+    }
+    if (inx >= sql.size())
+        return false;
+    std::string head(sql.substr(call.begin, call.arg_begin - call.begin));
+    std::string tail(sql.substr(call.arg_end, inx + 1 - call.arg_end));
+    split.part_selects.clear();
+    for (const std::string& source : call.sources)
+        split.part_selects.push_back("SELECT * FROM " + head + source + tail);
+    split.prefix = sql.substr(0, call.begin);
+    split.suffix = sql.substr(inx + 1);
+    std::string lower_tail(tail);
+    for (char& c : lower_tail)
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    size_t opt = lower_tail.find("union_by_name");
+    split.by_name = false;
+    if (opt != std::string::npos) {
+        opt += strlen("union_by_name");
+        while (opt < lower_tail.size() && (std::isspace(static_cast<unsigned char>(lower_tail[opt])) || lower_tail[opt] == '='))
+            opt++;
+        split.by_name = lower_tail.compare(opt, 4, "true") == 0;
+    }
+    return true;
+}
+
+// Names of the tables sql creates, unqualified and unquoted
+inline StringVec created_tables(const std::string& sql) {
+    StringVec tables;
+    std::vector<std::string> words;
+    std::string word;
+    // split into words, keeping "quoted identifiers" and (, ; whole
+    for (size_t inx = 0; inx <= sql.size(); inx++) {
+        char c = inx < sql.size() ? sql[inx] : ' ';
+        if (c == '"') {
+            size_t close = sql.find('"', inx + 1);
+            if (close == std::string::npos)
+                close = sql.size();
+            word += sql.substr(inx + 1, close - inx - 1);
+            inx = close;
+        }
+        else if (std::isspace(static_cast<unsigned char>(c)) || c == '(' || c == ';') {
+            if (!word.empty())
+                words.push_back(word);
+            word.clear();
+            if (c == '(' || c == ';')
+                words.push_back(std::string(1, c));
+        }
+        else {
+            word += c;
+        }
+    }
+    auto is = [&words](size_t inx, const char* kw) {
+        if (inx >= words.size() || words[inx].size() != strlen(kw))
+            return false;
+        for (size_t c = 0; c < words[inx].size(); c++) {
+            if (std::tolower(static_cast<unsigned char>(words[inx][c])) != kw[c])
+                return false;
+        }
+        return true;
+    };
+    for (size_t inx = 0; inx < words.size(); inx++) {
+        if (!is(inx, "create"))
+            continue;
+        size_t next = inx + 1;
+        if (is(next, "or") && is(next + 1, "replace"))
+            next += 2;
+        if (is(next, "temp") || is(next, "temporary"))
+            continue;
+        if (!is(next, "table"))
+            continue;
+        next++;
+        if (is(next, "if") && is(next + 1, "not") && is(next + 2, "exists"))
+            next += 3;
+        if (next >= words.size())
+            break;
+        const std::string& name{ words[next] };
+        size_t dot = name.rfind('.');
+        tables.push_back(dot == std::string::npos ? name : name.substr(dot + 1));
+    }
+    return tables;
+}
+
+class ScanCache {
+    bool    enabled{ false };
+
+public:
+    bool is_enabled() const { return enabled; }
+
+    // DB thread, once the database is open
+    bool init(duckdb_database db) {
+        static const char* method = "ScanCache::init: ";
+        duckdb_connection conn{ nullptr };
+        if (duckdb_connect(db, &conn) == DuckDBError) {
+            std::cerr << method << "CONNECT_FAIL" << std::endl;
+            return false;
+        }
+        duckdb_state dbstate = duckdb_query(conn, "CREATE TABLE IF NOT EXISTS nd_scan_cache "
+            "(sql VARCHAR PRIMARY KEY, fingerprint VARCHAR, stored TIMESTAMP);", nullptr);
+        duckdb_disconnect(&conn);
+        if (dbstate == DuckDBError) {
+            std::cerr << method << "CREATE_FAIL nd_scan_cache" << std::endl;
+            return false;
+        }
+        enabled = true;
+        return true;
+    }
+
+    // Worker threads. Empty if sql isn't a cacheable scan, or if its
+    // sources can't be listed, in which case the Command just runs.
+    std::string fingerprint(duckdb_connection conn, const std::string& sql) {
+        static const char* method = "ScanCache::fingerprint: ";
+        StringVec sources = scan_sources(sql);
+        if (sources.empty() || created_tables(sql).empty())
+            return std::string();
+        std::string blob_sql("SELECT filename, size, epoch_us(last_modified) FROM read_blob([");
+        for (size_t inx = 0; inx < sources.size(); inx++) {
+            blob_sql += inx ? ", " : "";
+            blob_sql += sources[inx];
+        }
+        blob_sql += "]) ORDER BY filename;";
+        std::string fp;
+        duckdb_result result;
+        try {
+            if (duckdb_query(conn, blob_sql.c_str(), &result) == DuckDBError) {
+                std::cerr << method << "STAT_FAIL: " << duckdb_result_error(&result) << std::endl;
+                duckdb_destroy_result(&result);
+                return std::string();
+            }
+        }
+        catch (...) {
+            // httpfs can throw, as in db_execute's Commands
+            std::cerr << method << "STAT_FAIL: " << blob_sql << std::endl;
+            return std::string();
+        }
+        idx_t rows = duckdb_row_count(&result);
+        for (idx_t row = 0; row < rows; row++) {
+            for (idx_t col = 0; col < 3; col++) {
+                char* val = duckdb_value_varchar(&result, col, row);
+                fp += val ? val : "NULL";
+                fp += col < 2 ? '|' : '\n';
+                duckdb_free(val);
+            }
+        }
+        duckdb_destroy_result(&result);
+        return fp;
+    }
+
+    // True if sql last ran against sources matching fp, and every table
+    // it creates is still in the database
+    bool hit(duckdb_connection conn, const std::string& sql, const std::string& fp) {
+        std::string stored;
+        if (!lookup(conn, "SELECT fingerprint FROM nd_scan_cache WHERE sql = $1;", sql, &stored) || stored != fp)
+            return false;
+        for (const std::string& table : created_tables(sql)) {
+            if (!lookup(conn, "SELECT table_name FROM duckdb_tables() WHERE lower(table_name) = lower($1);", table, nullptr))
+                return false;
+        }
+        return true;
+    }
+
+    // After the Command succeeded, or with an empty fp after it failed
+    void store(duckdb_connection conn, const std::string& sql, const std::string& fp) {
+        static const char* method = "ScanCache::store: ";
+        duckdb_prepared_statement stmt{ nullptr };
+        const char* store_sql = fp.empty() ? "DELETE FROM nd_scan_cache WHERE sql = $1;"
+            : "INSERT OR REPLACE INTO nd_scan_cache VALUES ($1, $2, current_timestamp::TIMESTAMP);";
+        duckdb_state dbstate = duckdb_prepare(conn, store_sql, &stmt);
+        if (dbstate == DuckDBSuccess) {
+            duckdb_bind_varchar(stmt, 1, sql.c_str());
+            if (!fp.empty())
+                duckdb_bind_varchar(stmt, 2, fp.c_str());
+            duckdb_result result;
+            dbstate = duckdb_execute_prepared(stmt, &result);
+            duckdb_destroy_result(&result);
+        }
+        duckdb_destroy_prepare(&stmt);
+        if (dbstate == DuckDBError)
+            std::cerr << method << "STORE_FAIL: " << sql << std::endl;
+    }
+
+private:
+    // Run a one param query; true if it returns a row. The first column
+    // of the first row goes to out if given.
+    static bool lookup(duckdb_connection conn, const char* sql, const std::string& param, std::string* out) {
+        duckdb_prepared_statement stmt{ nullptr };
+        bool found{ false };
+        if (duckdb_prepare(conn, sql, &stmt) == DuckDBSuccess
+                && duckdb_bind_varchar(stmt, 1, param.c_str()) == DuckDBSuccess) {
+            duckdb_result result;
+            if (duckdb_execute_prepared(stmt, &result) == DuckDBSuccess && duckdb_row_count(&result) > 0) {
+                found = true;
+                if (out) {
+                    char* val = duckdb_value_varchar(&result, 0, 0);
+                    *out = val ? val : "";
+                    duckdb_free(val);
+                }
+            }
+            duckdb_destroy_result(&result);
+        }
+        duckdb_destroy_prepare(&stmt);
+        return found;
+    }
+};
@@ -0,0 +1,172 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+#include "nd_types.hpp"
+#include "string_dict.hpp"
+
+// SeriesColumn: a zero copy view of one numeric column over all of a
+// result set's chunks, for ImPlot's getter API. render_shaded_plot used
+// to walk init_xy_range and next_xy_range, issuing a PlotShaded and a
+// PlotLine per chunk, copying INTEGER x columns into dbl_buf, and
+// rejecting every other type. A bulk cache's init_series fills in the
+// column pointer of each chunk, and at(row) converts one value as ImPlot
+// asks for it, so a single PlotLineG or PlotShadedG covers the range.
+// Getters visit rows in order, so the current chunk is cached, and
+// ChunkIndex::locate only runs on a chunk boundary.
+
+enum SeriesType : uint8_t {
+    stNone = 0,
+    stDouble,
+    stFloat,
+    stInt16,
+    stInt32,
+    stInt64,
+    // not plottable, but read by str_at for render_table's sorts
+    stString16,     // BB VARCHAR: duckdb_string_t
+    stUtf8,         // ems wdtUtf8: int32 offsets, then the UTF-8 heap
+    stDict          // codes into dict, or stString16 in a BB chunk past dict->coded_chunks
+};
+
+struct SeriesColumn {
+    SeriesType                      type{ stNone };
+    // DECIMAL scale, or the unit of a timestamp or date in seconds, as
+    // ImPlot's time axis wants seconds since the epoch
+    double                          divisor{ 1.0 };
+    bool                            time{ false };
+    std::vector<const void*>        chunks;         // column data per chunk
+    std::vector<const uint64_t*>    validities;     // per chunk, null if all valid
+    const ChunkIndex*               cinx{ nullptr };
+    const DictColumn*               dict{ nullptr };    // stDict only
+    // current chunk: rows [chunk_begin, chunk_end)
+    uint32_t                        chunk_begin{ 0 };
+    uint32_t                        chunk_end{ 0 };
+    const void*                     data{ nullptr };
+    const uint64_t*                 validity{ nullptr };
+    bool                            coded{ false };
+
+    void clear() {
+        type = stNone;
+        divisor = 1.0;
+        time = false;
+        chunks.clear();
+        validities.clear();
+        cinx = nullptr;
+        dict = nullptr;
+        chunk_begin = chunk_end = 0;
+        data = nullptr;
+        validity = nullptr;
+        coded = false;
+    }
+
+    bool numeric() const { return type >= stDouble && type <= stInt64; }
+
+    bool ready() const {
+        return type != stNone && cinx != nullptr && !chunks.empty()
+            && chunks.size() == cinx->chunk_count()
+            && (type != stDict || dict != nullptr);
+    }
+
+    // every chunk holds codes, so rows can be ordered by rank_at
+    bool all_coded() const {
+        return type == stDict && dict->coded_chunks >= chunks.size();
+    }
+
+    // Raw axis limits from the zone maps are in the column's own units,
+    // bar DECIMALs, which zone_scan has already scaled.
+    double axis_value(double zone_value) const {
+        return time ? zone_value / divisor : zone_value;
+    }
+
+    // NaN for a null, which ImPlot leaves out of the fit and the lines.
+    // Caller keeps row < cinx->row_count.
+    double at(uint32_t row) {
+        if (row < chunk_begin || row >= chunk_end)
+            seek(row);
+        uint32_t rel_index = row - chunk_begin;
+        if (validity && !((validity[rel_index >> 6] >> (rel_index & 63)) & 1))
+            return std::numeric_limits<double>::quiet_NaN();
+        double val{ 0.0 };
+        switch (type) {
+        case stDouble:  val = static_cast<const double*>(data)[rel_index]; break;
+        case stFloat:   val = static_cast<const float*>(data)[rel_index]; break;
+        case stInt16:   val = static_cast<const int16_t*>(data)[rel_index]; break;
+        case stInt32:   val = static_cast<const int32_t*>(data)[rel_index]; break;
+        case stInt64:   val = static_cast<double>(static_cast<const int64_t*>(data)[rel_index]); break;
+        default:        return std::numeric_limits<double>::quiet_NaN();
+        }
+        return divisor == 1.0 ? val : val / divisor;
+    }
+
+    // Text of a string column's row, or nullptr for a null
+    const char* str_at(uint32_t row, uint32_t& len) {
+        len = 0;
+        if (row < chunk_begin || row >= chunk_end)
+            seek(row);
+        uint32_t rel_index = row - chunk_begin;
+        if (validity && !((validity[rel_index >> 6] >> (rel_index & 63)) & 1))
+            return nullptr;
+        const char* base = static_cast<const char*>(data);
+        switch (type) {
+        case stDict:
+            if (coded)
+                return dict->text_at(data, rel_index, len);
+            [[fallthrough]];
+        case stString16: {
+            // duckdb_string_t: 32bit length, then 12 inlined chars, or a 4
+            // char prefix and a pointer to the whole string if it's longer
+            base += rel_index * 16;
+            memcpy(&len, base, sizeof(uint32_t));
+            if (len <= 12)
+                return base + 4;
+            const char* ptr{ nullptr };
+            memcpy(&ptr, base + 8, sizeof(ptr));
+            return ptr;
+        }
+        case stUtf8: {
+            const int32_t* offsets = static_cast<const int32_t*>(data);
+            const char* heap = wasm_utf8_heap(static_cast<const uint32_t*>(data), chunk_end - chunk_begin);
+            len = static_cast<uint32_t>(offsets[rel_index + 1] - offsets[rel_index]);
+            return heap + offsets[rel_index];
+        }
+        default:
+            return nullptr;
+        }
+    }
+
+    // Sort position of a coded row's string in its dictionary, NaN for a
+    // null. Caller checks all_coded.
+    double rank_at(uint32_t row, const std::vector<uint32_t>& ranks) {
+        if (row < chunk_begin || row >= chunk_end)
+            seek(row);
+        uint32_t rel_index = row - chunk_begin;
+        if (validity && !((validity[rel_index >> 6] >> (rel_index & 63)) & 1))
+            return std::numeric_limits<double>::quiet_NaN();
+        uint32_t code = dict->code_at(data, rel_index);
+        return code < ranks.size() ? ranks[code] : ranks.size();
+    }
+
+private:
+    void seek(uint32_t row) {
+        uint32_t chunk_inx{ 0 };
+        uint32_t rel_index{ 0 };
+        cinx->locate(row, chunk_inx, rel_index);
+        chunk_begin = row - rel_index;
+        chunk_end = chunk_begin + cinx->chunk_rows(chunk_inx);
+        data = chunks[chunk_inx];
+        validity = validities[chunk_inx];
+        coded = dict != nullptr && dict->coded(chunk_inx);
+    }
+};
+
+// x,y over rows [offset, offset + count). y_ref is the lower bound of
+// the fill for PlotShadedG.
+struct XYSeries {
+    SeriesColumn    x;
+    SeriesColumn    y;
+    uint32_t        offset{ 0 };
+    uint32_t        count{ 0 };
+    double          y_ref{ 0.0 };
+};
@@ -0,0 +1,408 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+// Vectorized kernels for the bulk caches' numeric columns: stats over
+// valid rows for the zone maps and get_min_max, and the int -> double
+// widening and null masking that next_range and next_xy_range do into
+// dbl_buf for ImPlot.
+// On x86-64 the AVX2 versions are picked at runtime, so breadboard still
+// runs on a CPU without AVX2. The WASM build gets simd128 when compiled
+// with -msimd128, as Makefile.nodom* are. Everything else, including
+// float and int16 columns, uses the scalar loops, which the vector paths
+// must match: same values, same NaN handling, same sorted semantics.
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define ND_SIMD_AVX2 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define ND_AVX2_TARGET
+#else
+#define ND_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#elif defined(__wasm_simd128__)
+#define ND_SIMD_WASM 1
+#include <wasm_simd128.h>
+#endif
+
+// Stats over the valid rows of a column slice. prev starts at lowest as
+// in zone_scan, so that a slice's first value never unsorts it.
+struct SimdStats {
+    double      min{ std::numeric_limits<double>::max() };
+    double      max{ std::numeric_limits<double>::lowest() };
+    double      sum{ 0.0 };
+    uint32_t    count{ 0 };         // valid rows
+    bool        sorted{ true };     // non decreasing over valid rows
+    double      prev{ std::numeric_limits<double>::lowest() };
+
+    void step(double val) {
+        if (val < prev)
+            sorted = false;
+        prev = val;
+        if (val < min) min = val;
+        if (val > max) max = val;
+        sum += val;
+        count++;
+    }
+};
+
+inline uint32_t simd_popcount(uint64_t word) {
+#if defined(_MSC_VER) && !defined(__clang__) && defined(_M_X64)
+    return static_cast<uint32_t>(__popcnt64(word));
+#elif defined(__GNUC__) || defined(__clang__)
+    return static_cast<uint32_t>(__builtin_popcountll(word));
+#else
+    uint32_t count{ 0 };
+    for (; word; count++)
+        word &= word - 1;
+    return count;
+#endif
+}
+
+// word must be non zero
+inline uint32_t simd_ctz(uint64_t word) {
+#if defined(_MSC_VER) && !defined(__clang__) && defined(_M_X64)
+    unsigned long inx{ 0 };
+    _BitScanForward64(&inx, word);
+    return static_cast<uint32_t>(inx);
+#elif defined(__GNUC__) || defined(__clang__)
+    return static_cast<uint32_t>(__builtin_ctzll(word));
+#else
+    uint32_t inx{ 0 };
+    for (; (word & 1) == 0; inx++)
+        word >>= 1;
+    return inx;
+#endif
+}
+
+// Valid rows in [begin, end). Same bit layout as duckdb_validity_row_is_valid,
+// and a null validity ptr means all rows are valid.
+inline uint32_t simd_count_valid(const uint64_t* validity, uint32_t begin, uint32_t end) {
+    if (end <= begin)
+        return 0;
+    if (validity == nullptr)
+        return end - begin;
+    uint32_t count{ 0 };
+    uint32_t first_word = begin >> 6;
+    uint32_t last_word = (end - 1) >> 6;
+    for (uint32_t w = first_word; w <= last_word; w++) {
+        uint64_t word = validity[w];
+        if (w == first_word)
+            word &= ~0ull << (begin & 63);
+        if (w == last_word && (end & 63))
+            word &= ~0ull >> (64 - (end & 63));
+        count += simd_popcount(word);
+    }
+    return count;
+}
+
+// Scalar reference for one run of all valid rows
+template <typename T>
+void simd_stats_run_scalar(const T* data, uint32_t n, double divisor, SimdStats& stats) {
+    for (uint32_t inx = 0; inx < n; inx++)
+        stats.step(static_cast<double>(data[inx]) / divisor);
+}
+
+template <typename T>
+void simd_widen_scalar(const T* src, double* dst, uint32_t n, double divisor = 1.0) {
+    if (divisor == 1.0) {
+        for (uint32_t inx = 0; inx < n; inx++)
+            dst[inx] = static_cast<double>(src[inx]);
+    }
+    else {
+        for (uint32_t inx = 0; inx < n; inx++)
+            dst[inx] = static_cast<double>(src[inx]) / divisor;
+    }
+}
+
+#ifdef ND_SIMD_AVX2
+
+inline bool simd_has_avx2() {
+    static const bool has_avx2 = []() {
+#if defined(_MSC_VER) && !defined(__clang__)
+        int regs[4]{ 0 };
+        __cpuid(regs, 0);
+        if (regs[0] < 7)
+            return false;
+        __cpuid(regs, 1);
+        // OSXSAVE and AVX, then check the OS saves the YMM registers
+        if ((regs[2] & (1 << 27)) == 0 || (regs[2] & (1 << 28)) == 0)
+            return false;
+        if ((_xgetbv(0) & 6) != 6)
+            return false;
+        __cpuidex(regs, 7, 0);
+        return (regs[1] & (1 << 5)) != 0;
+#else
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") != 0;
+#endif
+    }();
+    return has_avx2;
+}
+
+ND_AVX2_TARGET inline __m256d avx2_load_pd(const double* p) {
+    return _mm256_loadu_pd(p);
+}
+
+ND_AVX2_TARGET inline __m256d avx2_load_pd(const int32_t* p) {
+    return _mm256_cvtepi32_pd(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+}
+
+// No int64 -> double before AVX-512DQ. Split each lane into its top 16
+// bits and low 48 bits, turn both into exact doubles with the magic
+// number trick, and add, which rounds once as static_cast<double> does.
+ND_AVX2_TARGET inline __m256d avx2_load_pd(const int64_t* p) {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    __m256i hi = _mm256_srai_epi32(x, 16);
+    hi = _mm256_blend_epi16(hi, _mm256_setzero_si256(), 0x33);
+    hi = _mm256_add_epi64(hi, _mm256_castpd_si256(_mm256_set1_pd(442721857769029238784.0)));  // 3*2^67
+    __m256i lo = _mm256_blend_epi16(x, _mm256_castpd_si256(_mm256_set1_pd(4503599627370496.0)), 0x88);  // 2^52
+    __m256d f = _mm256_sub_pd(_mm256_castsi256_pd(hi), _mm256_set1_pd(442726361368656609280.0));  // 3*2^67 + 2^52
+    return _mm256_add_pd(f, _mm256_castsi256_pd(lo));
+}
+
+template <typename T>
+ND_AVX2_TARGET void simd_stats_run_avx2(const T* data, uint32_t n, double divisor, SimdStats& stats) {
+    uint32_t inx{ 0 };
+    if (n >= 4) {
+        const bool scaled = divisor != 1.0;
+        const __m256d vdiv = _mm256_set1_pd(divisor);
+        __m256d vmin = _mm256_set1_pd(stats.min);
+        __m256d vmax = _mm256_set1_pd(stats.max);
+        __m256d vsum = _mm256_setzero_pd();
+        __m256d unsorted = _mm256_setzero_pd();
+        __m256d last = _mm256_set1_pd(stats.prev);
+        for (; inx + 4 <= n; inx += 4) {
+            __m256d v = avx2_load_pd(data + inx);
+            if (scaled)
+                v = _mm256_div_pd(v, vdiv);
+            // each lane's predecessor: [last[3], v0, v1, v2]
+            __m256d before = _mm256_blend_pd(_mm256_permute4x64_pd(v, 0x90), last, 1);
+            unsorted = _mm256_or_pd(unsorted, _mm256_cmp_pd(v, before, _CMP_LT_OQ));
+            // v first, so a NaN in v leaves the accumulator as it was,
+            // like the scalar compares do
+            vmin = _mm256_min_pd(v, vmin);
+            vmax = _mm256_max_pd(v, vmax);
+            vsum = _mm256_add_pd(vsum, v);
+            last = _mm256_permute4x64_pd(v, 0xFF);
+        }
+        alignas(32) double lanes[4];
+        _mm256_store_pd(lanes, vmin);
+        for (double val : lanes)
+            if (val < stats.min) stats.min = val;
+        _mm256_store_pd(lanes, vmax);
+        for (double val : lanes)
+            if (val > stats.max) stats.max = val;
+        _mm256_store_pd(lanes, vsum);
+        stats.sum += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+        if (_mm256_movemask_pd(unsorted))
+            stats.sorted = false;
+        stats.prev = _mm256_cvtsd_f64(last);
+        stats.count += inx;
+    }
+    simd_stats_run_scalar(data + inx, n - inx, divisor, stats);
+}
+
+template <typename T>
+ND_AVX2_TARGET void simd_widen_avx2(const T* src, double* dst, uint32_t n, double divisor) {
+    uint32_t inx{ 0 };
+    const __m256d vdiv = _mm256_set1_pd(divisor);
+    if (divisor == 1.0) {
+        for (; inx + 4 <= n; inx += 4)
+            _mm256_storeu_pd(dst + inx, avx2_load_pd(src + inx));
+    }
+    else {
+        for (; inx + 4 <= n; inx += 4)
+            _mm256_storeu_pd(dst + inx, _mm256_div_pd(avx2_load_pd(src + inx), vdiv));
+    }
+    simd_widen_scalar(src + inx, dst + inx, n - inx, divisor);
+}
+
+#endif  // ND_SIMD_AVX2
+
+#ifdef ND_SIMD_WASM
+
+inline v128_t wasm_load_f64x2(const double* p) {
+    return wasm_v128_load(p);
+}
+
+inline v128_t wasm_load_f64x2(const int32_t* p) {
+    return wasm_f64x2_convert_low_i32x4(wasm_v128_load64_zero(p));
+}
+
+// no i64x2 -> f64x2 in simd128, so convert the lanes one at a time
+inline v128_t wasm_load_f64x2(const int64_t* p) {
+    return wasm_f64x2_make(static_cast<double>(p[0]), static_cast<double>(p[1]));
+}
+
+template <typename T>
+void simd_stats_run_wasm(const T* data, uint32_t n, double divisor, SimdStats& stats) {
+    uint32_t inx{ 0 };
+    if (n >= 2) {
+        const bool scaled = divisor != 1.0;
+        const v128_t vdiv = wasm_f64x2_splat(divisor);
+        v128_t vmin = wasm_f64x2_splat(stats.min);
+        v128_t vmax = wasm_f64x2_splat(stats.max);
+        v128_t vsum = wasm_f64x2_splat(0.0);
+        v128_t unsorted = wasm_i64x2_splat(0);
+        v128_t last = wasm_f64x2_splat(stats.prev);
+        for (; inx + 2 <= n; inx += 2) {
+            v128_t v = wasm_load_f64x2(data + inx);
+            if (scaled)
+                v = wasm_f64x2_div(v, vdiv);
+            // each lane's predecessor: [last[1], v0]
+            v128_t before = wasm_i64x2_shuffle(last, v, 1, 2);
+            unsorted = wasm_v128_or(unsorted, wasm_f64x2_lt(v, before));
+            // pmin(a, b) is b < a ? b : a, so a NaN in v is ignored
+            vmin = wasm_f64x2_pmin(vmin, v);
+            vmax = wasm_f64x2_pmax(vmax, v);
+            vsum = wasm_f64x2_add(vsum, v);
+            last = v;
+        }
+        double lanes[2]{ wasm_f64x2_extract_lane(vmin, 0), wasm_f64x2_extract_lane(vmin, 1) };
+        for (double val : lanes)
+            if (val < stats.min) stats.min = val;
+        lanes[0] = wasm_f64x2_extract_lane(vmax, 0);
+        lanes[1] = wasm_f64x2_extract_lane(vmax, 1);
+        for (double val : lanes)
+            if (val > stats.max) stats.max = val;
+        stats.sum += wasm_f64x2_extract_lane(vsum, 0) + wasm_f64x2_extract_lane(vsum, 1);
+        if (wasm_v128_any_true(unsorted))
+            stats.sorted = false;
+        stats.prev = wasm_f64x2_extract_lane(last, 1);
+        stats.count += inx;
+    }
+    simd_stats_run_scalar(data + inx, n - inx, divisor, stats);
+}
+
+template <typename T>
+void simd_widen_wasm(const T* src, double* dst, uint32_t n, double divisor) {
+    uint32_t inx{ 0 };
+    const v128_t vdiv = wasm_f64x2_splat(divisor);
+    if (divisor == 1.0) {
+        for (; inx + 2 <= n; inx += 2)
+            wasm_v128_store(dst + inx, wasm_load_f64x2(src + inx));
+    }
+    else {
+        for (; inx + 2 <= n; inx += 2)
+            wasm_v128_store(dst + inx, wasm_f64x2_div(wasm_load_f64x2(src + inx), vdiv));
+    }
+    simd_widen_scalar(src + inx, dst + inx, n - inx, divisor);
+}
+
+#endif  // ND_SIMD_WASM
+
+// Vector paths for double, int32 (INTEGER, DATE) and int64 (BIGINT and
+// the TIMESTAMPs), scalar for the rest.
+template <typename T>
+struct SimdVectorType {
+    static constexpr bool value = std::is_same<T, double>::value
+        || std::is_same<T, int32_t>::value || std::is_same<T, int64_t>::value;
+};
+
+template <typename T>
+void simd_stats_run(const T* data, uint32_t n, double divisor, SimdStats& stats) {
+#if defined(ND_SIMD_AVX2)
+    if constexpr (SimdVectorType<T>::value) {
+        if (simd_has_avx2()) {
+            simd_stats_run_avx2(data, n, divisor, stats);
+            return;
+        }
+    }
+#elif defined(ND_SIMD_WASM)
+    if constexpr (SimdVectorType<T>::value) {
+        simd_stats_run_wasm(data, n, divisor, stats);
+        return;
+    }
+#endif
+    simd_stats_run_scalar(data, n, divisor, stats);
+}
+
+// Stats over the valid rows of [begin, end). Runs of all valid 64 row
+// validity words go to the vector kernel in one call, all null words are
+// skipped, and mixed words are split into their runs of valid rows.
+template <typename T>
+void simd_stats(const T* data, const uint64_t* validity, uint32_t begin, uint32_t end,
+                    double divisor, SimdStats& stats) {
+    if (validity == nullptr) {
+        if (end > begin)
+            simd_stats_run(data + begin, end - begin, divisor, stats);
+        return;
+    }
+    uint32_t row = begin;
+    while (row < end) {
+        uint32_t word_end = std::min((row & ~63u) + 64, end);
+        uint64_t word = validity[row >> 6];
+        if (word == ~0ull) {
+            uint32_t run_end = word_end;
+            while (run_end < end && validity[run_end >> 6] == ~0ull)
+                run_end = std::min(run_end + 64, end);
+            simd_stats_run(data + row, run_end - row, divisor, stats);
+            row = run_end;
+            continue;
+        }
+        // mixed: walk the runs of valid rows, as sparse nulls still
+        // leave most of each word to the vector kernel
+        uint32_t base = row & ~63u;
+        word &= ~0ull << (row & 63);
+        if (word_end - base < 64)
+            word &= ~0ull >> (64 - (word_end - base));
+        while (word) {
+            uint32_t run_begin = simd_ctz(word);
+            uint32_t run_len = simd_ctz(~(word >> run_begin));
+            if (run_begin + run_len >= 64)
+                run_len = 64 - run_begin;
+            simd_stats_run(data + base + run_begin, run_len, divisor, stats);
+            word = run_begin + run_len >= 64 ? 0 : word & (~0ull << (run_begin + run_len));
+        }
+        row = word_end;
+    }
+}
+
+// dst[i] = src[i] / divisor for i in [0, n). The divisor scales DECIMALs
+// and TIMESTAMP units.
+template <typename T>
+void simd_widen(const T* src, double* dst, uint32_t n, double divisor = 1.0) {
+#if defined(ND_SIMD_AVX2)
+    if constexpr (SimdVectorType<T>::value && !std::is_same<T, double>::value) {
+        if (simd_has_avx2()) {
+            simd_widen_avx2(src, dst, n, divisor);
+            return;
+        }
+    }
+#elif defined(ND_SIMD_WASM)
+    if constexpr (SimdVectorType<T>::value && !std::is_same<T, double>::value) {
+        simd_widen_wasm(src, dst, n, divisor);
+        return;
+    }
+#endif
+    simd_widen_scalar(src, dst, n, divisor);
+}
+
+// For next_range and next_xy_range: data holds rows [begin, begin + n)
+// of a column whose validity is for the whole chunk. Nulls come back as
+// NaN, which ImPlot leaves out of lines and fits, so if the slice has any
+// data is copied to buf first, unless it's there already. A null validity
+// ptr, or a slice with no nulls, costs a popcount per word, and data is
+// returned as is.
+inline double* simd_nan_nulls(double* data, const uint64_t* validity, uint32_t begin, uint32_t n, double* buf) {
+    if (validity == nullptr || simd_count_valid(validity, begin, begin + n) == n)
+        return data;
+    if (data != buf)
+        std::copy(data, data + n, buf);
+    uint32_t end = begin + n;
+    for (uint32_t row = begin; row < end;) {
+        uint32_t base = row & ~63u;
+        uint32_t word_end = std::min(base + 64, end);
+        uint64_t nulls = ~validity[row >> 6] & (~0ull << (row & 63));
+        if (word_end - base < 64)
+            nulls &= ~0ull >> (64 - (word_end - base));
+        for (; nulls; nulls &= nulls - 1)
+            buf[base + simd_ctz(nulls) - begin] = std::numeric_limits<double>::quiet_NaN();
+        row = word_end;
+    }
+    return buf;
+}
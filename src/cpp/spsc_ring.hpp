@@ -0,0 +1,232 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+#include <boost/chrono.hpp>
+#if defined(__linux__)
+#include <climits>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define ND_DOORBELL_FUTEX
+#elif defined(_WIN32) && _WIN32_WINNT >= 0x0602
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "Synchronization.lib")
+#endif
+#define ND_DOORBELL_WAIT_ON_ADDRESS
+#endif
+
+// Lock free handoff between the GUI thread and the DB threads.
+// SPSCRing is a bounded single producer, single consumer ring: push and
+// pop are wait free, so the render thread can check for DB responses
+// every frame without taking a lock. Doorbell is an eventcount for the
+// consuming side that wants to sleep when its ring is empty. Producers
+// only make a syscall when the consumer is actually asleep.
+
+// Keep producer and consumer indices on their own cache lines so the
+// two threads don't false share.
+static constexpr size_t CACHE_LINE_SIZE = 64;
+
+template <typename T, size_t N>
+class SPSCRing {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "SPSCRing size must be a power of 2");
+    static constexpr size_t mask = N - 1;
+
+    // written by the producer, read by the consumer
+    alignas(CACHE_LINE_SIZE) boost::atomic<size_t>  tail{ 0 };
+    // producer private: consumer's head as last seen, which spares
+    // the producer a cross core read on most pushes
+    size_t                                          head_cache{ 0 };
+    // written by the consumer, read by the producer
+    alignas(CACHE_LINE_SIZE) boost::atomic<size_t>  head{ 0 };
+    size_t                                          tail_cache{ 0 };
+    alignas(CACHE_LINE_SIZE) std::array<T, N>       slots;
+
+public:
+    // producer thread only
+    bool try_push(T&& val) {
+        size_t t = tail.load(boost::memory_order_relaxed);
+        if (t - head_cache == N) {
+            head_cache = head.load(boost::memory_order_acquire);
+            if (t - head_cache == N)
+                return false;   // full
+        }
+        slots[t & mask] = std::move(val);
+        tail.store(t + 1, boost::memory_order_release);
+        return true;
+    }
+
+    bool try_push(const T& val) {
+        T copy{ val };
+        return try_push(std::move(copy));
+    }
+
+    // consumer thread only
+    bool try_pop(T& val) {
+        size_t h = head.load(boost::memory_order_relaxed);
+        if (h == tail_cache) {
+            tail_cache = tail.load(boost::memory_order_acquire);
+            if (h == tail_cache)
+                return false;   // empty
+        }
+        val = std::move(slots[h & mask]);
+        head.store(h + 1, boost::memory_order_release);
+        return true;
+    }
+
+    // either thread: a snapshot, so only the consumer can trust empty
+    // and only the producer can trust !full
+    bool empty() const {
+        return head.load(boost::memory_order_acquire) == tail.load(boost::memory_order_acquire);
+    }
+
+    size_t size() const {
+        return tail.load(boost::memory_order_acquire) - head.load(boost::memory_order_acquire);
+    }
+
+    static constexpr size_t capacity() { return N; }
+};
+
+// WordRing: an SPSCRing of 32 bit words for a JS producer, such as
+// materialize_worker.js, that writes through a SharedArrayBuffer view of
+// the WASM heap. So the layout is fixed, and JS mirrors it in
+// materialize.js with Atomics on an Int32Array: word 0 tail, word 1 the
+// capacity, head on the next cache line, and the slots on the one after.
+template <uint32_t N>
+class WordRing {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "WordRing size must be a power of 2");
+    static constexpr uint32_t mask = N - 1;
+
+    alignas(CACHE_LINE_SIZE) boost::atomic<uint32_t>    tail{ 0 };
+    const uint32_t                                      size{ N };
+    alignas(CACHE_LINE_SIZE) boost::atomic<uint32_t>    head{ 0 };
+    alignas(CACHE_LINE_SIZE) uint32_t                   slots[N]{};
+
+public:
+    static constexpr uint32_t tail_word{ 0 };
+    static constexpr uint32_t capacity_word{ 1 };
+    static constexpr uint32_t head_word{ CACHE_LINE_SIZE / 4 };
+    static constexpr uint32_t slots_word{ CACHE_LINE_SIZE / 2 };
+
+    WordRing() {
+        static_assert(sizeof(boost::atomic<uint32_t>) == 4, "JS sees a WordRing as words");
+        static_assert(offsetof(WordRing, size) == capacity_word * 4, "WordRing layout");
+        static_assert(offsetof(WordRing, head) == head_word * 4, "WordRing layout");
+        static_assert(offsetof(WordRing, slots) == slots_word * 4, "WordRing layout");
+    }
+    WordRing(const WordRing&) = delete;
+    WordRing& operator=(const WordRing&) = delete;
+
+    // consumer thread only
+    bool try_pop(uint32_t& val) {
+        uint32_t h = head.load(boost::memory_order_relaxed);
+        if (h == tail.load(boost::memory_order_acquire))
+            return false;   // empty
+        val = slots[h & mask];
+        head.store(h + 1, boost::memory_order_release);
+        return true;
+    }
+
+    // producer thread only: JS pushes in materialize.js, so this is
+    // for C++ producers and the tests
+    bool try_push(uint32_t val) {
+        uint32_t t = tail.load(boost::memory_order_relaxed);
+        if (t - head.load(boost::memory_order_acquire) == N)
+            return false;   // full
+        slots[t & mask] = val;
+        tail.store(t + 1, boost::memory_order_release);
+        return true;
+    }
+
+    // the address JS views the ring at
+    uint32_t addr() const { return static_cast<uint32_t>(reinterpret_cast<uintptr_t>(this)); }
+
+    static constexpr uint32_t capacity() { return N; }
+};
+
+// Eventcount: the consumer takes a key, checks its rings, and only if
+// they're all empty waits for the key to change. Producers bump the
+// sequence after publishing, and only wake the consumer when someone is
+// waiting. seq_cst on seq and waiters closes the window where the
+// consumer decides to sleep just as a producer decides not to wake it.
+// The consumer sleeps on seq itself: a futex on Linux, WaitOnAddress on
+// Windows 8 and up, so a wake is one syscall with no lock to hand over.
+// Elsewhere it falls back to a mutex and condition_variable. Either way
+// a wake may be spurious, so wait_for rechecks seq and the deadline.
+class Doorbell {
+    alignas(CACHE_LINE_SIZE) boost::atomic<uint32_t>    seq{ 0 };
+    alignas(CACHE_LINE_SIZE) boost::atomic<uint32_t>    waiters{ 0 };
+#if !defined(ND_DOORBELL_FUTEX) && !defined(ND_DOORBELL_WAIT_ON_ADDRESS)
+    boost::mutex                                        mutex;
+    boost::condition_variable                           cond;
+#endif
+
+    void* seq_addr() {
+        static_assert(sizeof(boost::atomic<uint32_t>) == 4, "Doorbell waits on seq as a word");
+        return &seq;
+    }
+
+    // sleep while seq is key, for at most timeout
+    void sleep(uint32_t key, boost::chrono::nanoseconds timeout) {
+#if defined(ND_DOORBELL_FUTEX)
+        timespec ts;
+        ts.tv_sec = static_cast<time_t>(timeout.count() / 1000000000);
+        ts.tv_nsec = static_cast<long>(timeout.count() % 1000000000);
+        syscall(SYS_futex, seq_addr(), FUTEX_WAIT_PRIVATE, key, &ts, nullptr, 0);
+#elif defined(ND_DOORBELL_WAIT_ON_ADDRESS)
+        // rounded up, so a short timeout still sleeps
+        DWORD ms = static_cast<DWORD>((timeout.count() + 999999) / 1000000);
+        WaitOnAddress(seq_addr(), &key, sizeof(key), ms);
+#else
+        boost::unique_lock<boost::mutex> lock(mutex);
+        cond.wait_for(lock, timeout, [this, key]() {
+            return seq.load(boost::memory_order_seq_cst) != key; });
+#endif
+    }
+
+    void wake() {
+#if defined(ND_DOORBELL_FUTEX)
+        syscall(SYS_futex, seq_addr(), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+#elif defined(ND_DOORBELL_WAIT_ON_ADDRESS)
+        WakeByAddressAll(seq_addr());
+#else
+        boost::unique_lock<boost::mutex> lock(mutex);
+        cond.notify_all();
+#endif
+    }
+
+public:
+    uint32_t key() const { return seq.load(boost::memory_order_seq_cst); }
+
+    void ring() {
+        seq.fetch_add(1, boost::memory_order_seq_cst);
+        if (waiters.load(boost::memory_order_seq_cst) > 0) {
+            wake();
+        }
+    }
+
+    // true if rung since key was taken, false on timeout
+    template <typename DURATION>
+    bool wait_for(uint32_t key, const DURATION& timeout) {
+        auto deadline = boost::chrono::steady_clock::now() + timeout;
+        waiters.fetch_add(1, boost::memory_order_seq_cst);
+        bool rung{ false };
+        while (true) {
+            rung = seq.load(boost::memory_order_seq_cst) != key;
+            auto now = boost::chrono::steady_clock::now();
+            if (rung || now >= deadline)
+                break;
+            sleep(key, boost::chrono::duration_cast<boost::chrono::nanoseconds>(deadline - now));
+        }
+        waiters.fetch_sub(1, boost::memory_order_seq_cst);
+        return rung;
+    }
+};
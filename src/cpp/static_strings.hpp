@@ -93,6 +93,8 @@ struct Static {
 	inline static const char* rname_cs{ "rname" };
 	inline static const char* xname_cs{ "xname" };
 	inline static const char* yname_cs{ "yname" };
+	inline static const char* col_formats_cs{ "col_formats" };
+	inline static const char* refresh_ms_cs{ "refresh_ms" };
 	inline static const char* cindex_cs{ "cindex" };
 
 	inline static const char* sql_cs{ "sql" };
@@ -151,6 +153,19 @@ struct Static {
 	// but for FunctionSync|FunctionAsync sql_cname could be any
 	// type of DataRef, so we check ctype 
 	inline static const char* ctype_cs{ "ctype" };
+	// Command|Query|BatchRequest may set timeout_ms; the DB thread
+	// interrupts the request and posts TimedOut when it expires
+	inline static const char* timeout_ms_cs{ "timeout_ms" };
+	// Command|Query may bind params: a list of {cname[, cindex]} DLC
+	// addresses whose values fill $1..$n in the SQL at sql_cname. The
+	// statement is prepared once and rerun when a bound address changes.
+	inline static const char* params_cs{ "params" };
+	inline static const char* prepared_cs{ "prepared" };
+	// Query may name a refresh_key: a column that only grows as rows are
+	// added, so Refresh can fetch just the rows past the highest it has.
+	// Each append's keys must exceed every key already fetched. They may
+	// repeat within one append, but a row tying the mark is never fetched.
+	inline static const char* refresh_key_cs{ "refresh_key" };
 
 	// Menus: data.[menu_bars|menus|menu_items]
 	inline static const char* menus_cs{ "menus" };
@@ -166,6 +181,9 @@ struct Static {
 	inline static const char* cache_key_cs{ "cache_key" };
 	inline static const char* on_data_change_cs{ "on_data_change" };
 	inline static const char* query_id_cs{ "query_id" };
+	// db_dispatch numbers each request, and the DB thread echoes it
+	// so Cancelled|TimedOut can be matched to an in flight sequence
+	inline static const char* serial_cs{ "serial" };
 
 	// Events: possible values for nd_type
 	inline static const char* batch_request_cs{ "BatchRequest" };
@@ -184,6 +202,9 @@ struct Static {
 	inline static const char* function_sync_cs{ "FunctionSync" };
 	inline static const char* function_async_cs{ "FunctionAsync" };
 	inline static const char* function_result_cs{ "FunctionResult" };
+	inline static const char* cancelled_cs{ "Cancelled" };
+	inline static const char* timed_out_cs{ "TimedOut" };
+	inline static const char* refresh_cs{ "Refresh" };
 
 	// NDF (NoDOM Forth) operands
 	inline static const char* ndfop_index_cs{ "[]" };
@@ -203,9 +224,25 @@ struct Static {
 	inline static const char* space_cs{ " " };
 	inline static const char* indent_cs{ "  " };
 	inline static const char* chunk_cs{ "chunk" };
+	inline static const char* chunk_count_cs{ "chunk_count" };
+	// on_schema_cpp: a query_id's column names and WasmDuckTypes, and
+	// the entries of its Dictionary columns
+	inline static const char* names_cs{ "names" };
+	inline static const char* types_cs{ "types" };
+	inline static const char* dicts_cs{ "dicts" };
+	inline static const char* done_cs{ "done" };
+	inline static const char* truncated_cs{ "truncated" };
+	inline static const char* row_count_cs{ "row_count" };
 	inline static const char* period_cs{ "." };
 	inline static const char* colon_cs{ ":" };
 	inline static const char* db_config_cs{ "db_config" };
+	inline static const char* pool_size_cs{ "pool_size" };
+	inline static const char* stream_chunks_cs{ "stream_chunks" };
+	inline static const char* mem_budget_mb_cs{ "mem_budget_mb" };
+	inline static const char* max_rows_cs{ "max_rows" };
+	inline static const char* db_path_cs{ "db_path" };
+	inline static const char* dict_max_cs{ "dict_max" };
+	inline static const char* arena_mb_cs{ "arena_mb" };
 	inline static const char* app_key_cs{ "app_key" };
 	inline static const char* fonts_cs{ "fonts" };
 	inline static const char* funcs_cs{ "funcs" };
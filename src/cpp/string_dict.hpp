@@ -0,0 +1,157 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// StringDict: the distinct strings of a dictionary encoded column. Trade
+// and depth results are mostly low cardinality strings, such as venue,
+// side and instrument, so a column holds an integer code per row, and
+// the text of each code is stored once, here. BBDuckDBCache codes
+// VARCHAR columns as they're fetched, and takes ENUMs as DuckDB has
+// them. WebDuckDBCache takes Arrow Dictionary columns, which is how
+// DuckDB-WASM sends ENUMs. Entries are zero terminated, so get_datum
+// hands back an entry with no copy, and ranks gives the sort position of
+// each code, so sorts compare integers, not strings.
+
+struct StringDict {
+    std::vector<char>               arena;      // entry i is arena[offsets[i], offsets[i+1]), terminator included
+    std::vector<uint32_t>           offsets{ 0 };
+    // rank_vec[code] is the code's position in byte order, built on
+    // demand by ranks, and dropped when an entry is added
+    mutable std::vector<uint32_t>   rank_vec;
+
+    uint32_t size() const { return static_cast<uint32_t>(offsets.size() - 1); }
+    bool empty() const { return offsets.size() == 1; }
+    uint64_t bytes() const { return arena.size() + offsets.size() * sizeof(uint32_t); }
+
+    uint32_t add(const char* text, uint32_t len) {
+        arena.insert(arena.end(), text, text + len);
+        arena.push_back(0);
+        offsets.push_back(static_cast<uint32_t>(arena.size()));
+        rank_vec.clear();
+        return size() - 1;
+    }
+
+    void append(const StringDict& delta) {
+        for (uint32_t code = 0; code < delta.size(); code++)
+            add(delta.entry(code), delta.length(code));
+    }
+
+    // "" for a code we don't have, rather than read past the arena
+    const char* entry(uint32_t code) const {
+        return code < size() ? arena.data() + offsets[code] : "";
+    }
+
+    uint32_t length(uint32_t code) const {
+        return code < size() ? offsets[code + 1] - offsets[code] - 1 : 0;
+    }
+
+    const std::vector<uint32_t>& ranks() const {
+        if (rank_vec.size() == size())
+            return rank_vec;
+        std::vector<uint32_t> order(size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+            return std::string_view(entry(a), length(a)) < std::string_view(entry(b), length(b));
+        });
+        rank_vec.resize(size());
+        for (uint32_t pos = 0; pos < order.size(); pos++)
+            rank_vec[order[pos]] = pos;
+        return rank_vec;
+    }
+
+    void clear() {
+        arena.clear();
+        offsets.assign(1, 0);
+        rank_vec.clear();
+    }
+};
+
+// One column's dictionary, and how its codes are stored. A coded column
+// holds code_bytes wide unsigned codes in chunks [0, coded_chunks). On
+// BB a VARCHAR column stops being coded when its dictionary fills, so
+// its later chunks hold duckdb_string_t as usual.
+struct DictColumn {
+    StringDict      dict;
+    uint8_t         code_bytes{ 0 };    // 1, 2 or 4, or 0 if the column isn't coded
+    uint32_t        coded_chunks{ 0 };
+
+    bool is_coded() const { return code_bytes != 0; }
+    bool coded(uint32_t chunk_inx) const { return code_bytes != 0 && chunk_inx < coded_chunks; }
+
+    uint32_t code_at(const void* data, uint32_t rel_index) const {
+        switch (code_bytes) {
+        case 1:     return static_cast<const uint8_t*>(data)[rel_index];
+        case 2:     return static_cast<const uint16_t*>(data)[rel_index];
+        default:    return static_cast<const uint32_t*>(data)[rel_index];
+        }
+    }
+
+    const char* text_at(const void* data, uint32_t rel_index, uint32_t& len) const {
+        uint32_t code = code_at(data, rel_index);
+        len = dict.length(code);
+        return dict.entry(code);
+    }
+};
+using DictColumns = std::vector<DictColumn>;
+
+// Worker side: codes a column's strings as they're met. Keys view the
+// encoder's own copies, so a lookup doesn't allocate. delta holds the
+// entries added since the last take_delta, for the GUI thread to append
+// to its StringDict when it adopts the chunk that uses them.
+struct DictEncoder {
+    bool                                            active{ false };
+    uint32_t                                        max_codes{ 0 };
+    std::deque<std::string>                         strings;
+    std::unordered_map<std::string_view, uint32_t>  codes;
+    StringDict                                      delta;
+
+    // False when text is new and the dictionary is full
+    bool encode(const char* text, uint32_t len, uint32_t& code) {
+        auto code_iter = codes.find(std::string_view(text, len));
+        if (code_iter != codes.end()) {
+            code = code_iter->second;
+            return true;
+        }
+        if (codes.size() >= max_codes)
+            return false;
+        code = static_cast<uint32_t>(codes.size());
+        strings.emplace_back(text, len);
+        codes.emplace(std::string_view(strings.back()), code);
+        delta.add(text, len);
+        return true;
+    }
+
+    uint32_t size() const { return static_cast<uint32_t>(codes.size()); }
+
+    StringDict take_delta() {
+        StringDict taken{ std::move(delta) };
+        delta.clear();
+        return taken;
+    }
+
+    // a full dictionary, or too many distinct strings to be worth it
+    void deactivate() {
+        active = false;
+        codes.clear();
+        strings.clear();
+        delta.clear();
+    }
+};
+
+// One DictEncoder per column of a result. decided is set once the first
+// chunk has shown which columns are worth coding.
+struct DictEncoders {
+    bool                        decided{ false };
+    std::vector<DictEncoder>    cols;
+
+    bool any_active() const {
+        return std::any_of(cols.begin(), cols.end(), [](const DictEncoder& enc) { return enc.active; });
+    }
+};
@@ -0,0 +1,317 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#ifndef __EMSCRIPTEN__
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+#endif
+#include "nd_types.hpp"
+#include "series.hpp"
+
+// TableSort: client side sort for render_table. Clicking a header used
+// to mean editing the SQL and fetching every batch again. Here the
+// ImGuiTableSortSpecs become a stable permutation of the result's rows,
+// and render_table's clipper reads row perm[i] for display row i. Keys
+// are copied out of the chunks on the GUI thread, as eviction could free
+// the chunks under a sort thread, then sorted on a thread of their own on
+// BB, and inline on ems, which has no threads. Permutations are cached by
+// sort spec, so toggling between specs costs nothing, and dropped when
+// the handle or result epoch changes. When rows are appended, as by a
+// Refresh, the applied permutation is extended: only the new rows are
+// sorted, then merged into it.
+
+struct SortColumnSpec {
+    int32_t     col_inx{ 0 };
+    bool        descending{ false };
+};
+using SortSpecVec = std::vector<SortColumnSpec>;
+
+// One sort column's values. Numerics are doubles, NaN for null, and
+// strings are copied into an arena. A dictionary coded column is keyed
+// on its codes' ranks, so sorts as a numeric. Nulls sort last in either
+// direction.
+struct SortKeys {
+    bool                    descending{ false };
+    bool                    numeric{ true };
+    std::vector<double>     nums;
+    std::vector<char>       arena;      // row i is arena[offsets[i], offsets[i+1])
+    std::vector<uint32_t>   offsets;
+    std::vector<uint8_t>    nulls;      // strings only
+
+    void extract(SeriesColumn& col, uint32_t rows) {
+        numeric = col.numeric() || col.all_coded();
+        if (col.all_coded()) {
+            const std::vector<uint32_t>& ranks{ col.dict->dict.ranks() };
+            nums.resize(rows);
+            for (uint32_t row = 0; row < rows; row++)
+                nums[row] = col.rank_at(row, ranks);
+            return;
+        }
+        if (numeric) {
+            nums.resize(rows);
+            for (uint32_t row = 0; row < rows; row++)
+                nums[row] = col.at(row);
+            return;
+        }
+        offsets.reserve(rows + 1);
+        nulls.resize(rows);
+        for (uint32_t row = 0; row < rows; row++) {
+            uint32_t len{ 0 };
+            const char* text = col.str_at(row, len);
+            offsets.push_back(static_cast<uint32_t>(arena.size()));
+            nulls[row] = text == nullptr;
+            if (text)
+                arena.insert(arena.end(), text, text + len);
+        }
+        offsets.push_back(static_cast<uint32_t>(arena.size()));
+    }
+
+    // <0, 0, >0 as row a sorts before, with or after row b
+    int compare(uint32_t a, uint32_t b) const {
+        if (numeric) {
+            double va = nums[a];
+            double vb = nums[b];
+            bool na = std::isnan(va);
+            bool nb = std::isnan(vb);
+            if (na || nb)
+                return na == nb ? 0 : (na ? 1 : -1);
+            if (va == vb)
+                return 0;
+            return (va < vb) != descending ? -1 : 1;
+        }
+        if (nulls[a] || nulls[b])
+            return nulls[a] == nulls[b] ? 0 : (nulls[a] ? 1 : -1);
+        uint32_t len_a = offsets[a + 1] - offsets[a];
+        uint32_t len_b = offsets[b + 1] - offsets[b];
+        int rv = memcmp(arena.data() + offsets[a], arena.data() + offsets[b], std::min(len_a, len_b));
+        if (rv == 0)
+            rv = len_a == len_b ? 0 : (len_a < len_b ? -1 : 1);
+        return descending ? -rv : rv;
+    }
+};
+
+struct SortJob {
+    std::vector<SortKeys>   keys;
+    uint32_t                row_count{ 0 };
+    std::vector<uint32_t>   base;   // rows [0, base.size()) already sorted, else empty
+    std::vector<uint32_t>   perm;
+#ifndef __EMSCRIPTEN__
+    boost::atomic<bool>     done{ false };
+#else
+    bool                    done{ false };
+#endif
+
+    int compare_from(uint32_t a, uint32_t b, size_t first_key) const {
+        for (size_t inx = first_key; inx < keys.size(); inx++) {
+            int rv = keys[inx].compare(a, b);
+            if (rv != 0)
+                return rv;
+        }
+        return 0;
+    }
+
+    void run() {
+        perm.resize(row_count);
+        if (!base.empty()) {
+            merge_base();
+        }
+        else if (!keys.empty() && keys[0].numeric) {
+            // The common case: sort (key, row) pairs so the first key's
+            // compares don't chase rows, and only ties look further.
+            struct Entry {
+                double      key;
+                uint32_t    row;
+            };
+            std::vector<Entry> entries(row_count);
+            const SortKeys& first{ keys[0] };
+            for (uint32_t row = 0; row < row_count; row++)
+                entries[row] = Entry{ first.descending ? -first.nums[row] : first.nums[row], row };
+            std::stable_sort(entries.begin(), entries.end(), [this](const Entry& a, const Entry& b) {
+                bool na = std::isnan(a.key);
+                bool nb = std::isnan(b.key);
+                if (na || nb) {
+                    if (na != nb)
+                        return nb;
+                }
+                else if (a.key != b.key) {
+                    return a.key < b.key;
+                }
+                return compare_from(a.row, b.row, 1) < 0;
+            });
+            for (uint32_t inx = 0; inx < row_count; inx++)
+                perm[inx] = entries[inx].row;
+        }
+        else {
+            for (uint32_t row = 0; row < row_count; row++)
+                perm[row] = row;
+            if (!keys.empty()) {
+                std::stable_sort(perm.begin(), perm.end(), [this](uint32_t a, uint32_t b) {
+                    return compare_from(a, b, 0) < 0;
+                });
+            }
+        }
+        keys.clear();
+        done = true;
+    }
+
+    // Sort the rows appended since base, then merge them in. Ties take
+    // base rows first, as their row indices are lower, so the result is
+    // what a stable sort of all the rows gives.
+    void merge_base() {
+        auto before = [this](uint32_t a, uint32_t b) { return compare_from(a, b, 0) < 0; };
+        std::vector<uint32_t> appended;
+        appended.reserve(row_count - base.size());
+        for (uint32_t row = static_cast<uint32_t>(base.size()); row < row_count; row++)
+            appended.push_back(row);
+        std::stable_sort(appended.begin(), appended.end(), before);
+        std::merge(base.begin(), base.end(), appended.begin(), appended.end(), perm.begin(), before);
+        base.clear();
+    }
+};
+
+struct TableSort {
+    static constexpr size_t max_cached{ 4 };
+
+    RSHandle                handle{ 0 };
+    uint32_t                epoch{ 0 };
+    uint32_t                row_count{ 0 };
+    SortSpecVec             specs;          // from ImGuiTableSortSpecs, empty for unsorted
+    std::map<std::string, std::vector<uint32_t>>   perms;  // by spec_key
+    std::string             applied_key;    // perm render_table reads through
+    uint32_t                order{ 0 };     // bumped when the applied perm changes
+    std::shared_ptr<SortJob> job;           // in flight, for pending_key
+    std::string             pending_key;
+    uint32_t                sort_count{ 0 };    // jobs started, for tests and pix
+
+    // "2a,0d": column index and direction of each sort column
+    static std::string spec_key(const SortSpecVec& spec_vec) {
+        std::string key;
+        for (const SortColumnSpec& spec : spec_vec) {
+            if (!key.empty())
+                key += ',';
+            key += std::to_string(spec.col_inx);
+            key += spec.descending ? 'd' : 'a';
+        }
+        return key;
+    }
+
+    bool matches(RSHandle h, uint32_t e, uint32_t rows) const {
+        return handle == h && epoch == e && row_count == rows;
+    }
+
+    bool grows(RSHandle h, uint32_t e, uint32_t rows) const {
+        return handle == h && epoch == e && row_count < rows;
+    }
+
+    // A job in flight is abandoned: it holds its own keys, and drops its
+    // result when its thread exits.
+    void reset(RSHandle h, uint32_t e, uint32_t rows) {
+        handle = h;
+        epoch = e;
+        row_count = rows;
+        perms.clear();
+        job.reset();
+        pending_key.clear();
+        set_applied(std::string());
+    }
+
+    // Rows appended to the same handle and epoch. Until the merge lands,
+    // the applied perm shows the new rows after the sorted ones. Other
+    // cached perms are dropped, and a sort in flight is started again.
+    template <typename DB>
+    void extend(DB& bulk, uint32_t rows) {
+        uint32_t sorted_rows{ row_count };
+        row_count = rows;
+        job.reset();
+        pending_key.clear();
+        auto perm_iter = perms.find(applied_key);
+        if (perm_iter == perms.end() || applied_key != spec_key(specs)) {
+            perms.clear();
+            set_applied(std::string());
+            return;
+        }
+        std::vector<uint32_t> base{ std::move(perm_iter->second) };
+        perms.clear();
+        std::vector<uint32_t>& shown{ perms[applied_key] };
+        shown = base;
+        for (uint32_t row = sorted_rows; row < rows; row++)
+            shown.push_back(row);
+        order++;
+        start(bulk, applied_key, std::move(base));
+    }
+
+    // Once a frame: adopt a finished sort, start one if the specs have no
+    // perm yet, and apply the perm for the specs when there is one. While
+    // a sort runs the table keeps its previous order.
+    template <typename DB>
+    void update(DB& bulk) {
+        if (job && job->done) {
+            if (perms.size() >= max_cached) {
+                auto iter = perms.begin();
+                if (iter->first == applied_key)
+                    iter++;
+                if (iter != perms.end())
+                    perms.erase(iter);
+            }
+            perms[pending_key] = std::move(job->perm);
+            // a merged perm replaces the one being shown
+            if (pending_key == applied_key)
+                order++;
+            job.reset();
+        }
+        std::string key = spec_key(specs);
+        if (key.empty() || perms.count(key))
+            set_applied(key);
+        else if (!job)
+            start(bulk, key);
+    }
+
+    // nullptr for the result's own order
+    const uint32_t* permutation() const {
+        if (applied_key.empty())
+            return nullptr;
+        auto iter = perms.find(applied_key);
+        return iter == perms.end() ? nullptr : iter->second.data();
+    }
+
+private:
+    void set_applied(const std::string& key) {
+        if (key != applied_key) {
+            applied_key = key;
+            order++;
+        }
+    }
+
+    template <typename DB>
+    void start(DB& bulk, const std::string& key, std::vector<uint32_t>&& base = std::vector<uint32_t>()) {
+        std::shared_ptr<SortJob> new_job{ std::make_shared<SortJob>() };
+        new_job->row_count = row_count;
+        new_job->base = std::move(base);
+        StringVec& col_names = bulk.get_col_names(handle);
+        SeriesColumn col;
+        for (const SortColumnSpec& spec : specs) {
+            // BOOLEAN etc don't take part
+            if (spec.col_inx < 0 || spec.col_inx >= static_cast<int32_t>(col_names.size())
+                    || !bulk.init_series(handle, col_names[spec.col_inx].c_str(), col))
+                continue;
+            new_job->keys.emplace_back();
+            new_job->keys.back().descending = spec.descending;
+            new_job->keys.back().extract(col, row_count);
+        }
+        pending_key = key;
+        job = new_job;
+        sort_count++;
+#ifdef __EMSCRIPTEN__
+        new_job->run();
+#else
+        boost::thread sort_thread([new_job]() { new_job->run(); });
+        sort_thread.detach();
+#endif
+    }
+};
@@ -65,6 +65,7 @@ private:
     std::string             uri;
     NDContext<JSON, DB>&    ctx;
     std::queue<JSON>        server_responses;
+    std::queue<DBMessage<JSON>> db_responses;
     DB&                     server;
     bool                    connected{ false };
 
@@ -123,18 +124,17 @@ public:
             // handle incoming websock from server
             ctx.dispatch_events(server_responses);
         }
-        // win32: potential lock contention in get_db_responses()
-        // which attempts to acquire server.result_mutex, when
-        // db_loop() may be holding result_mutex to enqueue
-        // DB responses. NB this is _just_ contention, not deadlock.
+        // win32: get_db_responses() polls the DB result rings
+        // without locking, so no contention with the DB threads.
         // Also note that we cannot handle DB events until data and
-        // layout have been loaded.
+        // layout have been loaded. DB events are typed DBMessages,
+        // decoded by the bulk cache, so no JSON past this point.
         if (ctx.cache_is_loaded()) {
-            server.get_db_responses(server_responses);
+            server.get_db_responses(db_responses);
         }
-        if (!server_responses.empty()) {
+        if (!db_responses.empty()) {
             // now handle results from DB
-            ctx.dispatch_events(server_responses);
+            ctx.dispatch_db_events(db_responses);
         }
     }
 
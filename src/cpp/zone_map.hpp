@@ -0,0 +1,134 @@
+#pragma once
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include "nd_types.hpp"
+#include "simd_kernels.hpp"
+
+// Zone maps: per chunk, per column stats computed once when a chunk
+// lands in a bulk cache, so that plot axis limits don't rescan every
+// row on every frame. Both BBDuckDBCache and WebDuckDBCache fill these
+// from their own chunk layouts via zone_scan, and answer get_min_max
+// from them. zone_scan runs on the simd_kernels.hpp stats kernel.
+
+struct ColumnZone {
+    double      min{ std::numeric_limits<double>::max() };
+    double      max{ std::numeric_limits<double>::lowest() };
+    double      sum{ 0.0 };
+    uint32_t    null_count{ 0 };
+    uint32_t    row_count{ 0 };
+    bool        numeric{ false };   // false for VARCHAR etc: min,max unset
+    bool        sorted{ true };     // non decreasing over valid rows
+
+    bool has_values() const { return numeric && null_count < row_count; }
+
+    // Fold in the zone of the next chunk, or the next slice of a chunk.
+    // Order matters for sorted: z must follow this in row order.
+    void merge(const ColumnZone& z) {
+        if (has_values() && z.has_values() && z.min < max)
+            sorted = false;
+        sorted = sorted && z.sorted;
+        numeric = numeric || z.numeric;
+        if (z.has_values()) {
+            if (z.min < min) min = z.min;
+            if (z.max > max) max = z.max;
+            sum += z.sum;
+        }
+        null_count += z.null_count;
+        row_count += z.row_count;
+    }
+};
+
+using ColumnZoneVec = std::vector<ColumnZone>;
+
+// Same bit layout as duckdb_validity_row_is_valid, and a null
+// validity ptr means all rows are valid.
+inline bool zone_row_is_valid(const uint64_t* validity, uint32_t row) {
+    return validity == nullptr || ((validity[row >> 6] >> (row & 63)) & 1);
+}
+
+// Scan rows [begin, end) of one column into zone. divisor is for
+// DECIMAL columns held as scaled ints.
+template <typename T>
+void zone_scan(ColumnZone& zone, const T* data, const uint64_t* validity,
+                uint32_t begin, uint32_t end, double divisor = 1.0) {
+    zone.numeric = true;
+    zone.row_count += end - begin;
+    SimdStats stats;
+    simd_stats(data, validity, begin, end, divisor, stats);
+    zone.null_count += (end - begin) - stats.count;
+    zone.sorted = zone.sorted && stats.sorted;
+    if (stats.count == 0)
+        return;
+    if (stats.min < zone.min) zone.min = stats.min;
+    if (stats.max > zone.max) zone.max = stats.max;
+    zone.sum += stats.sum;
+}
+
+struct ZoneMap {
+    std::vector<ColumnZoneVec>  chunks;     // [chunk][col]
+    ColumnZoneVec               columns;    // [col] rolled up over all chunks
+
+    void clear() {
+        chunks.clear();
+        columns.clear();
+    }
+
+    void add_chunk(ColumnZoneVec&& zones) {
+        if (columns.empty())
+            columns.resize(zones.size());
+        for (size_t col = 0; col < zones.size() && col < columns.size(); col++)
+            columns[col].merge(zones[col]);
+        chunks.emplace_back(std::move(zones));
+    }
+
+    // O(1) whole column limits
+    bool get_min_max(int32_t col_inx, double& min, double& max) const {
+        if (col_inx < 0 || col_inx >= static_cast<int32_t>(columns.size()))
+            return false;
+        const ColumnZone& zone{ columns[col_inx] };
+        if (!zone.has_values())
+            return false;
+        min = zone.min;
+        max = zone.max;
+        return true;
+    }
+
+    // Limits over rows [offset, offset+count). Chunks wholly inside the
+    // range are answered from their zones, and only the partial chunks
+    // at either end are rescanned via scan_slice(chunk, begin, end, zone).
+    template <typename SLICE_SCANNER>
+    bool get_min_max(const ChunkIndex& cinx, int32_t col_inx, uint32_t offset, uint32_t count,
+                        double& min, double& max, SLICE_SCANNER scan_slice) const {
+        if (col_inx < 0 || col_inx >= static_cast<int32_t>(columns.size()) || count == 0)
+            return false;
+        if (offset == 0 && count >= cinx.row_count)
+            return get_min_max(col_inx, min, max);
+        uint32_t first_chunk{ 0 };
+        uint32_t first_row{ 0 };
+        uint32_t last_chunk{ 0 };
+        uint32_t last_row{ 0 };
+        if (!cinx.locate(offset, first_chunk, first_row))
+            return false;
+        uint32_t end = std::min(offset + count, cinx.row_count);
+        cinx.locate(end - 1, last_chunk, last_row);
+        ColumnZone range_zone;
+        for (uint32_t chunk = first_chunk; chunk <= last_chunk && chunk < chunks.size(); chunk++) {
+            uint32_t begin_row = chunk == first_chunk ? first_row : 0;
+            uint32_t end_row = chunk == last_chunk ? last_row + 1 : cinx.chunk_rows(chunk);
+            if (begin_row == 0 && end_row == cinx.chunk_rows(chunk)) {
+                range_zone.merge(chunks[chunk][col_inx]);
+            }
+            else {
+                ColumnZone slice_zone;
+                scan_slice(chunk, begin_row, end_row, slice_zone);
+                range_zone.merge(slice_zone);
+            }
+        }
+        if (!range_zone.has_values())
+            return false;
+        min = range_zone.min;
+        max = range_zone.max;
+        return true;
+    }
+};
@@ -69,11 +69,20 @@ class ParquetHandler(tornado.web.StaticFileHandler):
         self.set_header("Connection", "keep-alive")
 
 
+# Cross origin isolation, so the -pthread WASM heap is a SharedArrayBuffer
+# that materialize_worker.js can fill chunks in. credentialless, not
+# require-corp, as DuckDB-WASM comes from the jsDelivr CDN.
+def set_isolation_headers(handler):
+    handler.set_header("Cross-Origin-Opener-Policy", "same-origin")
+    handler.set_header("Cross-Origin-Embedder-Policy", "credentialless")
+
+
 class HomeHandler(tornado.web.RequestHandler):
     def set_default_headers(self, *args, **kwargs):
         self.set_header("Content-Type", "text/html")
         self.set_header("Access-Control-Allow-Origin", f"*")
         self.set_header("Permissions-Policy", f"local-fonts=*")
+        set_isolation_headers(self)
 
     def get(self, slug):
         self.render(slug, duck_db=self.application.service.is_duck_app)
@@ -85,6 +94,8 @@ class StaticJSFileHandler(tornado.web.StaticFileHandler):
         self.set_header(
             "Access-Control-Allow-Origin", f"http://{options.host}:{options.node_port}"
         )
+        # worker scripts need it too, or they aren't isolated
+        set_isolation_headers(self)
 
     def get_content_type(self):
         return "application/javascript"
@@ -5,6 +5,8 @@
 //   Submit queries to DDBW
 //   Pre process query results
 //   Fetch Parquet and load into DDBW
+// Materialize thread: fills chunks in the WASM heap, see
+//   materialize_worker.js
 
 // Some worker scope vars...
 let duck_db = null;
@@ -52,6 +54,18 @@ import {
   TimestampNanosecond,
 } from "./apache-arrow-17-0-0.js";
 import * as duck from "./duckdb-duckdb-wasm-1-33-1-dev18-0.js";
+import {
+  column_parts,
+  column_buffers,
+  chunk_layout,
+  write_chunk,
+} from "./materialize.js";
+import {
+  column_max,
+  later_mark,
+  mark_literal,
+  refresh_sql,
+} from "./watermark.js";
 
 const JSDELIVR_BUNDLES = duck.getJsDelivrBundles();
 const bundle = await duck.selectBundle(JSDELIVR_BUNDLES);
@@ -98,12 +112,134 @@ BigInt.prototype.toJSON = function () {
 
 const nd_null = "null";
 
-async function exec_duck_command(db_request) {
+// Per request state so that a newer Query can supersede an older one on
+// the same query_id, and timeout_ms can interrupt a runaway request.
+// interrupt is null, "Cancelled" or "TimedOut".
+function new_request_state(db_request) {
+  return {
+    duck_conn: null,
+    batch_gen: null,
+    serial: db_request.serial,
+    interrupt: null,
+    batching: false, // a BatchRequest is driving batch_gen, and will close it
+    max_rows: 0,
+    row_count: 0,
+    truncated: false,
+    schema_sent: false, // by the batch generator, ahead of the first chunk
+    in_flight: null, // the chunk materialize_worker.js is filling
+    failed: false, // a chunk couldn't be materialized
+    keep_conn: false, // prepared: the connection outlives the request
+    refresh: null, // the query_id's refresh state, if its Query has a refresh_key
+  };
+}
+
+// query_id -> refresh state of the latest Query that named a refresh_key:
+// the SQL and params a Refresh reruns, and the key's high water mark,
+// which batch_generator raises as each chunk is materialized. fetched is
+// set once a BatchRequest has run, as only then is there a mark to go
+// past. running is the state of the Refresh in progress, if any.
+let global_refresh_map = new Map();
+
+function new_refresh(db_request) {
+  return {
+    key: db_request.refresh_key,
+    sql: db_request.sql,
+    params: db_request.prepared ? db_request.params : [],
+    mark: null,
+    type_id: null, // of the key column, and its Date or Time unit
+    unit: 0,
+    bad_key: false, // not a column, or not of a type mark_literal takes
+    fetched: false,
+    schema_sent: false,
+    row_count: 0,
+    running: null,
+  };
+}
+
+// The largest refresh_key in batch, before its buffers go to the worker
+function batch_mark(refresh, batch) {
+  if (refresh.bad_key) return null;
+  let key_col = batch.schema.fields.findIndex((d) => d.name == refresh.key);
+  let type = key_col < 0 ? null : batch.schema.fields[key_col].type;
+  if (!type || mark_literal(type.typeId, type.unit || 0, 0) === null) {
+    console.error("duck_module: BAD_REFRESH_KEY(" + refresh.key + ")\n");
+    refresh.bad_key = true;
+    return null;
+  }
+  refresh.type_id = type.typeId;
+  refresh.unit = type.unit || 0;
+  return column_max(
+    column_parts(batch.getChildAt(key_col).data[0]),
+    batch.numRows,
+  );
+}
+
+// A newer Query resets the chunks a Refresh appends to, so the old
+// Query's Refresh mustn't be writing one
+async function retire_refresh(refresh) {
+  let running = refresh.running;
+  if (!running) return;
+  await interrupt_request(running, "Cancelled");
+  if (running.in_flight) await running.in_flight;
+}
+
+// query_id -> { duck_conn, sql, stmt } for prepared Query|Command
+// requests. A prepared statement belongs to its connection, so the
+// connection is kept too. A rerun with new params skips parse and plan;
+// a changed template SQL is prepared afresh.
+let global_prepared_map = new Map();
+
+async function get_prepared(db_request) {
+  let prepared = global_prepared_map.get(db_request.query_id);
+  if (!prepared) {
+    prepared = { duck_conn: await duck_db.connect(), sql: null, stmt: null };
+    global_prepared_map.set(db_request.query_id, prepared);
+  }
+  if (prepared.sql !== db_request.sql) {
+    if (prepared.stmt) await prepared.stmt.close();
+    prepared.stmt = null;
+    prepared.sql = null;
+    prepared.stmt = await prepared.duck_conn.prepare(db_request.sql);
+    prepared.sql = db_request.sql;
+    console.log("duck_module: PREPARED QID(" + db_request.query_id + ")\n");
+  }
+  return prepared;
+}
+
+async function interrupt_request(state, why) {
+  if (state.interrupt) return;
+  console.log("duck_module: " + why + " serial(" + state.serial + ")\n");
+  state.interrupt = why;
+  // stops a pending send; a batching generator sees interrupt
+  // before it materializes the next chunk
+  if (state.duck_conn) await state.duck_conn.cancelSent();
+}
+
+function arm_timeout(state, db_request) {
+  if (!db_request.timeout_ms) return null;
+  return setTimeout(
+    () => interrupt_request(state, "TimedOut"),
+    db_request.timeout_ms,
+  );
+}
+
+// Cancelled|TimedOut replaces the usual response, echoing serial so
+// NDContext can drop the waiting sequence, and the request type
+function post_interrupted(db_request, why) {
+  on_db_result({
+    nd_type: why,
+    query_id: db_request.query_id,
+    db_action: db_request.nd_type,
+    serial: db_request.serial,
+    error: 1,
+  });
+}
+
+async function exec_duck_command(db_request, state) {
   if (!duck_db) {
     console.error("duck_module:DuckDB-Wasm not initialized");
     return;
   }
-  let duck_conn = await duck_db.connect();
   console.log(
     "exec_duck_command: QID(" +
       db_request.query_id +
@@ -111,17 +247,57 @@ async function exec_duck_command(db_request) {
       db_request.sql +
       "]\n",
   );
-  await duck_conn.send(db_request.sql);
-  duck_conn.close();
+  if (db_request.prepared) {
+    // params bind positionally to $1..$n
+    let prepared = await get_prepared(db_request);
+    state.duck_conn = prepared.duck_conn;
+    state.keep_conn = true;
+    await prepared.stmt.query(...db_request.params);
+    return;
+  }
+  let duck_conn = await duck_db.connect();
+  state.duck_conn = duck_conn;
+  try {
+    await duck_conn.send(db_request.sql);
+  } finally {
+    duck_conn.close();
+  }
   return;
 }
 
-async function exec_duck_query(db_request) {
+// A Refresh reruns its Query's SQL, or the rows of it past the mark, on
+// a connection of its own. The new rows are few, so the result is
+// materialized, not streamed, and its batches go through batch_generator
+// as a BatchRequest's do.
+async function exec_refresh(db_request, refresh, sql, state) {
   if (!duck_db) {
     console.error("duck_module:DuckDB-Wasm not initialized");
-    return;
+    return null;
   }
+  console.log(
+    "exec_refresh: QID(" + db_request.query_id + ") SQL[" + sql + "]\n",
+  );
   let duck_conn = await duck_db.connect();
+  state.duck_conn = duck_conn;
+  try {
+    if (!refresh.params.length) return await duck_conn.query(sql);
+    let stmt = await duck_conn.prepare(sql);
+    try {
+      return await stmt.query(...refresh.params);
+    } finally {
+      await stmt.close();
+    }
+  } catch (err) {
+    duck_conn.close();
+    throw err;
+  }
+}
+
+async function exec_duck_query(db_request, state) {
+  if (!duck_db) {
+    console.error("duck_module:DuckDB-Wasm not initialized");
+    return;
+  }
   console.log(
     "exec_duck_query: QID(" +
       db_request.query_id +
@@ -129,215 +305,115 @@ async function exec_duck_query(db_request) {
       db_request.sql +
       "]\n",
   );
-  let duck_result = await duck_conn.send(db_request.sql);
-  return [duck_conn, duck_result];
+  if (db_request.prepared) {
+    let prepared = await get_prepared(db_request);
+    state.duck_conn = prepared.duck_conn;
+    state.keep_conn = true;
+    let duck_result = await prepared.stmt.send(...db_request.params);
+    return [prepared.duck_conn, duck_result];
+  }
+  let duck_conn = await duck_db.connect();
+  state.duck_conn = duck_conn;
+  try {
+    let duck_result = await duck_conn.send(db_request.sql);
+    return [duck_conn, duck_result];
+  } catch (err) {
+    duck_conn.close();
+    throw err;
+  }
 }
 
-// DuckDB-WASM uses Apache Arrow JS as the result set API
-// Which is NOT isomorphic with the DuckDB C API as there
-// is no [u]int8, [u]int16, [u]int32, [u]int64 etc.
-// https://github.com/apache/arrow-js/blob/main/src/enum.ts
-// Here we decide how many WASM bytes are used to store
-// the arrow-js type
-function get_duck_type_size(tipe) {
-  switch (tipe) {
-    case Type.Float: // 3: // ArrowType.Float:
-    case Type.Utf8: // 5: // ArrowType.Utf8:
-    case Type.Date: // 8: // ArrowType.Date:
-    case Type.Timestamp: // 10: // Timestamp: arrow API returns JS num
-      return 8; // 8 bytes wide
-    case Type.Int: // 2: // ArrowType.Int: Signed or unsigned 8, 16, 32, or 64-bit little-endian integer
-      return 4; // 4 bytes wide
+// The WasmDuckType C++ sees: the arrow typeId, except that a Timestamp
+// has its unit folded in, as C++ needs it to scale the int64 values
+function get_wasm_type(type) {
+  if (type.typeId != Type.Timestamp) return type.typeId;
+  switch (type.unit) {
+    case TimeUnit.SECOND:
+      return Type.TimestampSecond;
+    case TimeUnit.MILLISECOND:
+      return Type.TimestampMillisecond;
+    case TimeUnit.MICROSECOND:
+      return Type.TimestampMicrosecond;
   }
-  return 0;
+  return Type.TimestampNanosecond;
+}
+
+// The entries of a Dictionary column, which is how DuckDB-WASM sends an
+// ENUM, so the same in every batch. Chunks carry only its codes.
+function dict_entries(data) {
+  if (data.typeId != Type.Dictionary || !data.dictionary) return [];
+  return Array.from(data.dictionary, (v) => (v == null ? "" : String(v)));
 }
 
-function get_value(vec, inx, tipe) {
-  let x = vec.get(inx);
-  if (typeof x?.valueOf === "function") {
-    return x.valueOf();
+// A query_id's column names and types go to C++ once, ahead of its
+// first chunk, so chunks carry only values
+function schema_materializer(qid, batch) {
+  let schema = batch.schema;
+  let schema_json = JSON.stringify({
+    names: schema.fields.map((d) => d.name),
+    types: schema.fields.map((d) => get_wasm_type(d.type)),
+    dicts: schema.fields.map((d, ic) => dict_entries(batch.getChildAt(ic).data[0])),
+  });
+  console.log("schema_materializer: QID(" + qid + ") " + schema_json);
+  Module.ccall("on_schema_cpp", "void", ["string", "string"], [qid, schema_json]);
+}
+
+// Chunks are filled off the main thread by materialize_worker.js when the
+// WASM heap is a SharedArrayBuffer: a -pthread build, served cross origin
+// isolated. Otherwise, as in Makefile.duck_materialize builds, they're
+// filled here. worker is null until the first chunk, as Module isn't
+// ready when this module loads.
+let materializer = { worker: undefined, jobs: new Map(), next_job: 1 };
+
+function get_worker() {
+  if (materializer.worker !== undefined) return materializer.worker;
+  materializer.worker = null;
+  let shared =
+    typeof SharedArrayBuffer !== "undefined" &&
+    Module.HEAPU8.buffer instanceof SharedArrayBuffer &&
+    typeof Module._get_chunk_queue_cpp === "function";
+  if (!shared) {
+    console.log("duck_module: materializing on the main thread\n");
+    return null;
   }
-  return x;
+  let worker = new Worker(new URL("./materialize_worker.js", import.meta.url), {
+    type: "module",
+  });
+  worker.onmessage = (event) => {
+    let done = event.data;
+    let resolve = materializer.jobs.get(done.job_id);
+    materializer.jobs.delete(done.job_id);
+    resolve(done.error ? 0 : done.buffer_offset);
+  };
+  worker.onerror = (event) => {
+    console.error("duck_module: materialize_worker: " + event.message);
+  };
+  worker.postMessage({
+    nd_type: "Init",
+    memory: Module.wasmMemory,
+    chunk_queue: Module.ccall("get_chunk_queue_cpp", "number", [], []),
+  });
+  materializer.worker = worker;
+  return worker;
 }
 
+// Resolves to the chunk's heap address once it's filled, and C++ has it,
+// or to 0 if it couldn't be. The layout and get_chunk_cpp stay on this
+// thread, as only it may call into WASM; they're per column, not per row.
 function batch_materializer(qid, batch) {
-  // First, extract metadata from batch...
-  let row_count = batch.data.length;
-  let types = batch.schema.fields.map((d) => d.type.typeId);
-  let type_objs = batch.schema.fields.map((d) => d.type);
-  let type_units = batch.schema.fields.map((d) => d.type.unit);
-  let names = batch.schema.fields.map((d) => d.name);
-  console.log("batch_materializer: row_count=" + row_count);
-  console.log("batch_materializer: types=" + types);
-  console.log("batch_materializer: typ_o=" + type_objs);
-  console.log("batch_materializer: units=" + type_units);
-  console.log("batch_materializer: names=" + names);
-  // ...second, calc batch size in mem
-  // Usually 2048 rows per chunk. Assume each col is 64bits wide...
-  // row_count * types.length * 8 (bytes per word)
-  // types.length for type info
-  // sum(strlen+1) for names
-  // Assuming 32bit words...
-  let names_sum_length = names.reduce((accumulator, current_value) => {
-    return accumulator + current_value.length + 1;
-  }, 0);
-  // space for columns, assuming 64bit wide
-  let buffer_size = row_count * types.length * 2; // 32bit word *2 = 64bits
-  // 32bits for each type, and 32bit chars for col names,
-  // and 32bits for column count
-  buffer_size += types.length + names_sum_length + 3; // 3 for done, cols, row_count
+  let row_count = batch.numRows;
+  let columns = batch.schema.fields.map((d, ic) =>
+    column_parts(batch.getChildAt(ic).data[0]),
+  );
+  let layout = chunk_layout(columns, row_count);
   // Get C++ wasm to create buffer. NB cwrapped funcs not
-  // recognised inside the generator, so we Module.ccall
+  // recognised inside the generator, so we Module.ccall.
   let buffer_offset = Module.ccall(
     "get_chunk_cpp",
     "number",
     ["string", "number"],
-    [qid, buffer_size],
-  );
-  // Now create Uint64Array with underlying storage buffer_offset, which is a uint64_t ptr,
-  // so guaranteed to be on an 8 byte boundary. So we know that will work for
-  // 32,16 and 8 arrays. Note the element count adjustment in buffer_size/2.
-  // Obviously half as many array elements in same size for 64 vs 32.
-  let dbl_heap64 = new Float64Array(
-    Module.HEAPU64.buffer,
-    buffer_offset,
-    buffer_size / 2,
-  );
-  let bui_heap64 = new BigUint64Array(
-    Module.HEAPU64.buffer,
-    buffer_offset,
-    buffer_size / 2,
-  );
-  let bi_heap64 = new BigInt64Array(
-    Module.HEAPU64.buffer,
-    buffer_offset,
-    buffer_size / 2,
-  );
-  let ui_heap32 = new Uint32Array(
-    Module.HEAPU32.buffer,
-    buffer_offset,
-    buffer_size,
+    [qid, layout.words],
   );
-  // Now write the first block; metadata done, number of cols, then row count
-  let bptr = 0;
-  let done = false;
-  if (row_count < 2048) done = true;
-  ui_heap32[bptr++] = done;
-  ui_heap32[bptr++] = types.length;
-  ui_heap32[bptr++] = row_count;
-  // Now column types, addresses and names
-  types.forEach((tipe) => {
-    ui_heap32[bptr++] = tipe;
-  });
-  // Memoize the start of the col addresses as 0 until we
-  // can calc caddrs below...
-  let caddr = bptr;
-  types.forEach((tipe) => {
-    ui_heap32[bptr++] = 0;
-  });
-  names.forEach((name) => {
-    for (var i = 0; i < name.length; i++) {
-      ui_heap32[bptr++] = name.charCodeAt(i);
-    }
-    // null terminator for string
-    ui_heap32[bptr++] = 0;
-  });
-  // Now write a block for each column, starting on 8 byte boundary
-  // Now write the columns into the wasm chunk...
-  for (var ic = 0; ic < types.length; ic++) {
-    let vec = batch.getChildAt(ic);
-    let tipe = types[ic];
-    let sz = get_duck_type_size(tipe);
-    let unit = type_units[ic];
-    // Column must start on 8 byte boundary; bptr has 32bit/4byte stride,
-    //  so if it's odd it's not on 8 byte boundary
-    if (bptr % 2) bptr++;
-    console.log(
-      "batch_materializer: ic=" +
-        ic +
-        ", bptr=" +
-        bptr +
-        ", tipe=" +
-        tipe +
-        ", unit=" +
-        unit +
-        ", sz=" +
-        sz,
-    );
-    // record the addr of the column
-    ui_heap32[caddr + ic] = bptr;
-    // tipe(32) and count(32) as sanity checks at head of col
-    if (tipe == Type.Timestamp) {
-      switch (unit) {
-        case 0: // see the unit enum; diff from typeId
-          ui_heap32[bptr++] = Type.TimestampSecond;
-          break;
-        case 1:
-          ui_heap32[bptr++] = Type.TimestampMillisecond;
-          break;
-        case 2:
-          ui_heap32[bptr++] = Type.TimestampMicrosecond;
-          break;
-        case 3:
-          ui_heap32[bptr++] = Type.TimestampNanosecond;
-          break;
-      }
-    } else {
-      ui_heap32[bptr++] = tipe;
-    }
-    ui_heap32[bptr++] = sz;
-    // Use heap32 or heap64 depending on column size
-    if (tipe == Type.Utf8) {
-      // varchar: variable length. We'll take 8 or less bytes,
-      // and store them via stringToUTF8
-      let bptr8 = buffer_offset + bptr * 4;
-      for (var ir = 0; ir < row_count; ir++) {
-        // JSON.stringify handles vec.get(ir) returning
-        // null gracefully, unlike toString()
-        let sval = JSON.stringify(vec.get(ir));
-        // strip away quotes
-        sval = sval.replaceAll('"', "");
-        // we'll use 8 bytes per str to show a max
-        // of 7 chars to keep a regular stride,
-        stringToUTF8(sval, bptr8, 8);
-        bptr8 += 8;
-      }
-      bptr += row_count * 2;
-    } else if (sz == 4) {
-      // continue with heap32
-      for (var ir = 0; ir < row_count; ir++) {
-        ui_heap32[bptr + ir] = vec.get(ir);
-      }
-      bptr += row_count;
-    } else if (sz == 8) {
-      // switch to heap64
-      // tipe:3|8|10,dbl,date,ts
-      // At this point we know bptr is on an 8 byte boundary
-      // because col block starts on 8 boundary, and we've
-      // just written 8 above, so bptr/2 gives us the heap64
-      // addr...
-      let bptr64 = bptr / 2;
-      for (var ir = 0; ir < row_count; ir++) {
-        switch (tipe) {
-          case Type.Float:
-          case Type.Date:
-            dbl_heap64[bptr64 + ir] = get_value(vec, ir, tipe);
-            break;
-          case Type.Timestamp:
-            bi_heap64[bptr64 + ir] = vec.data[0].values[ir];
-            break;
-        }
-      }
-      bptr += row_count * 2;
-    } else {
-      let val = get_value(vec, 0, tipe);
-      console.error("batch_materializer: bad sz!\n");
-    }
-  }
-  // Let C++ WASM code know we've populated the chunk
-  // We pass buffer_offset as number/int, and cast to uint8_t on
-  // the C++ side
-  Module.ccall("on_chunk_cpp", "void", ["number"], [buffer_offset]);
   console.log(
     "batch_materializer: buffer_offset=" +
       buffer_offset +
@@ -345,16 +421,78 @@ function batch_materializer(qid, batch) {
       row_count +
       "\n",
   );
-  return buffer_offset;
+  let worker = get_worker();
+  if (!worker) {
+    // Only view the heap after get_chunk_cpp returns: a heap resize
+    // detaches views made earlier
+    write_chunk(Module.HEAPU8.buffer, buffer_offset, layout, columns, row_count);
+    // Let C++ WASM code know we've populated the chunk
+    Module.ccall("on_chunk_cpp", "void", ["number"], [buffer_offset]);
+    return Promise.resolve(buffer_offset);
+  }
+  // The batch's buffers move to the worker, so batch is unusable here
+  // after the post. DuckDB-WASM fetches each batch into its own buffer.
+  let job_id = materializer.next_job++;
+  return new Promise((resolve) => {
+    materializer.jobs.set(job_id, resolve);
+    worker.postMessage(
+      {
+        nd_type: "Materialize",
+        job_id: job_id,
+        buffer_offset: buffer_offset,
+        row_count: row_count,
+        layout: layout,
+        columns: columns,
+      },
+      column_buffers(columns),
+    );
+  });
 }
 
-async function* batch_generator(query_id, duck_conn, duck_result) {
-  for await (const batch of duck_result) {
-    yield batch_materializer(query_id, batch);
+async function* batch_generator(query_id, duck_conn, duck_result, state) {
+  try {
+    for await (let batch of duck_result) {
+      // A superseded query must not materialize: the newer
+      // Query's QueryResult has already reset the C++ chunks
+      if (state.interrupt) return;
+      // max_rows admission, as in BBDuckDBCache: the batch that
+      // crosses it is sliced short
+      if (state.max_rows && state.row_count + batch.numRows > state.max_rows) {
+        state.truncated = true;
+        let room = state.max_rows - state.row_count;
+        if (room <= 0) return;
+        batch = batch.slice(0, room);
+      }
+      state.row_count += batch.numRows;
+      if (!state.schema_sent) {
+        schema_materializer(query_id, batch);
+        state.schema_sent = true;
+        if (state.refresh) state.refresh.schema_sent = true;
+      }
+      // One chunk at a time: DuckDB fetches the next batch meanwhile.
+      // batch goes to the worker, so keep its row count, and its mark.
+      let row_count = batch.numRows;
+      let mark = state.refresh ? batch_mark(state.refresh, batch) : null;
+      state.in_flight = batch_materializer(query_id, batch);
+      let chunk = await state.in_flight;
+      // interrupted while the worker filled it: a newer Query resets it
+      if (state.interrupt) return;
+      if (!chunk) {
+        state.row_count -= row_count;
+        state.failed = true;
+        return;
+      }
+      if (state.refresh)
+        state.refresh.mark = later_mark(state.refresh.mark, mark);
+      yield chunk;
+      if (state.truncated) return;
+    }
+  } finally {
+    if (!state.keep_conn) duck_conn.close();
   }
-  duck_conn.close();
 }
 
+// query_id -> request state of the latest Query
 let global_query_map = new Map();
 
 self.onmessage = async (event) => {
@@ -362,48 +500,136 @@ self.onmessage = async (event) => {
   let batch_gen = null;
   const nd_db_request = event.data;
   switch (nd_db_request.nd_type) {
-    case "Command":
+    case "Command": {
       // NB result set from "CREATE TABLE <tbl> as select * from parquet_scan([...])"
       // is None on success
-      await exec_duck_command(nd_db_request);
+      let command = new_request_state(nd_db_request);
+      let timer = arm_timeout(command, nd_db_request);
+      try {
+        await exec_duck_command(nd_db_request, command);
+      } catch (err) {
+        if (!command.interrupt) console.error(err.message);
+      }
+      clearTimeout(timer);
+      if (command.interrupt) {
+        post_interrupted(nd_db_request, command.interrupt);
+        break;
+      }
       console.log("duck_module: Command done for " + nd_db_request.query_id);
       on_db_result({
         nd_type: "CommandResult",
         query_id: nd_db_request.query_id,
+        serial: nd_db_request.serial,
       });
       break;
-    case "Query":
-      let duck_conn_result_pair = await exec_duck_query(nd_db_request);
+    }
+    case "Query": {
+      // A newer Query supersedes the last one on this query_id, whether
+      // it's still executing or part way through its batches
+      let query = new_request_state(nd_db_request);
+      let old_query = global_query_map.get(nd_db_request.query_id);
+      global_query_map.set(nd_db_request.query_id, query);
+      if (old_query) {
+        await interrupt_request(old_query, "Cancelled");
+        // an idle generator won't see interrupt, so close it here
+        if (old_query.batch_gen && !old_query.batching)
+          await old_query.batch_gen.return();
+        // our QueryResult releases the old chunks in C++, so the worker
+        // mustn't be writing one
+        if (old_query.in_flight) await old_query.in_flight;
+      }
+      let old_refresh = global_refresh_map.get(nd_db_request.query_id);
+      global_refresh_map.delete(nd_db_request.query_id);
+      if (old_refresh) await retire_refresh(old_refresh);
+      if (nd_db_request.refresh_key) {
+        query.refresh = new_refresh(nd_db_request);
+        global_refresh_map.set(nd_db_request.query_id, query.refresh);
+      }
+      let timer = arm_timeout(query, nd_db_request);
+      try {
+        let duck_conn_result_pair = await exec_duck_query(nd_db_request, query);
+        query.batch_gen = batch_generator(
+          nd_db_request.query_id,
+          ...duck_conn_result_pair,
+          query,
+        );
+      } catch (err) {
+        if (!query.interrupt) console.error(err.message);
+      }
+      clearTimeout(timer);
+      if (query.interrupt || !query.batch_gen) {
+        if (query.batch_gen) await query.batch_gen.return();
+        if (global_query_map.get(nd_db_request.query_id) === query)
+          global_query_map.delete(nd_db_request.query_id);
+        if (global_refresh_map.get(nd_db_request.query_id) === query.refresh)
+          global_refresh_map.delete(nd_db_request.query_id);
+        if (query.interrupt) {
+          post_interrupted(nd_db_request, query.interrupt);
+        } else {
+          on_db_result({
+            nd_type: "QueryResult",
+            query_id: nd_db_request.query_id,
+            serial: nd_db_request.serial,
+            error: 1,
+          });
+        }
+        break;
+      }
       console.log(
         "duck_module: QueryResult QID(" + nd_db_request.query_id + ")\n",
       );
-      batch_gen = batch_generator(
-        nd_db_request.query_id,
-        ...duck_conn_result_pair,
-      );
-      global_query_map.set(nd_db_request.query_id, batch_gen);
       let query_result = {
         nd_type: "QueryResult",
         query_id: nd_db_request.query_id,
+        serial: nd_db_request.serial,
       };
       on_db_result(query_result);
       break;
+    }
     case "BatchRequest":
       if (global_query_map.has(nd_db_request.query_id)) {
         console.log(
           "duck_module: BatchRequest QID(" + nd_db_request.query_id + ")\n",
         );
-        batch_gen = global_query_map.get(nd_db_request.query_id);
+        let query = global_query_map.get(nd_db_request.query_id);
+        query.serial = nd_db_request.serial;
+        query.batching = true;
+        batch_gen = query.batch_gen;
+        let timer = arm_timeout(query, nd_db_request);
+        // one BatchResponse per chunk, each carrying the chunk count
+        // so far; done is only true on the final chunk:0 response
+        let chunk_count = 0;
+        // max_rows comes from the WebDuckDBCache config, and the
+        // generator stops short of it, flagging truncation
+        query.max_rows = nd_db_request.max_rows || 0;
         while (true) {
+          if (query.interrupt) {
+            await batch_gen.return();
+            post_interrupted(nd_db_request, query.interrupt);
+            break;
+          }
           let batch_next = await batch_gen.next();
+          // the generator returns early once interrupted
+          if (batch_next.done && query.interrupt) continue;
           if (batch_next.done) {
-            global_query_map.delete(nd_db_request.query_id);
+            if (global_query_map.get(nd_db_request.query_id) === query)
+              global_query_map.delete(nd_db_request.query_id);
+          } else {
+            chunk_count++;
           }
           let batch_result = {
             nd_type: "BatchResponse",
             query_id: nd_db_request.query_id,
+            serial: nd_db_request.serial,
             chunk: batch_next.done ? 0 : batch_next.value,
+            chunk_count: chunk_count,
+            done: batch_next.done,
           };
+          if (batch_next.done) {
+            batch_result.row_count = query.row_count;
+            batch_result.truncated = query.truncated;
+            if (query.failed) batch_result.error = 1;
+          }
           console.log(
             "duck_module: BatchResponse QID:" +
               nd_db_request.query_id +
@@ -414,18 +640,123 @@ self.onmessage = async (event) => {
           on_db_result(batch_result);
           if (batch_next.done) break;
         }
+        clearTimeout(timer);
+        // a Refresh can now fetch past the rows we have
+        if (query.refresh) {
+          query.refresh.fetched = true;
+          query.refresh.row_count = query.row_count;
+        }
       } else {
         on_db_result({
           nd_type: "BatchResponse",
           query_id: nd_db_request.query_id,
-          error: "unknown",
+          serial: nd_db_request.serial,
+          error: 1,
         });
       }
       break;
+    case "Refresh": {
+      // Append the rows past the mark to the query_id's chunks, on the
+      // same handle, answering with a single BatchResponse for them
+      let refresh = global_refresh_map.get(nd_db_request.query_id);
+      let refresh_result = {
+        nd_type: "BatchResponse",
+        db_action: "Refresh",
+        query_id: nd_db_request.query_id,
+        serial: nd_db_request.serial,
+        chunk: 0,
+        chunk_count: 0,
+        row_count: 0,
+        done: true,
+      };
+      if (!refresh || refresh.bad_key) {
+        console.error(
+          "duck_module: NOT_REFRESHABLE QID(" + nd_db_request.query_id + ")\n",
+        );
+        refresh_result.error = 1;
+        on_db_result(refresh_result);
+        break;
+      }
+      // nothing to go past before the first BatchRequest, and one
+      // Refresh at a time; either way no new rows yet
+      if (!refresh.fetched || refresh.running) {
+        on_db_result(refresh_result);
+        break;
+      }
+      // with no mark but rows, the key has no non-null values to go
+      // past, so nothing is new either
+      if (refresh.mark === null && refresh.row_count > 0) {
+        console.error(
+          "duck_module: NULL_KEY(" +
+            refresh.key +
+            ") no non-null values in " +
+            refresh.row_count +
+            " rows QID(" +
+            nd_db_request.query_id +
+            ")\n",
+        );
+        on_db_result(refresh_result);
+        break;
+      }
+      let state = new_request_state(nd_db_request);
+      state.refresh = refresh;
+      state.schema_sent = refresh.schema_sent;
+      state.max_rows = nd_db_request.max_rows || 0;
+      state.row_count = refresh.row_count;
+      refresh.running = state;
+      let timer = arm_timeout(state, nd_db_request);
+      // with no mark, there were no rows so far, so all rows are new
+      let sql =
+        refresh.mark === null
+          ? refresh.sql
+          : refresh_sql(
+              refresh.sql,
+              refresh.key,
+              mark_literal(refresh.type_id, refresh.unit, refresh.mark),
+            );
+      try {
+        let table = await exec_refresh(nd_db_request, refresh, sql, state);
+        if (table) {
+          let refresh_gen = batch_generator(
+            nd_db_request.query_id,
+            state.duck_conn,
+            table.batches,
+            state,
+          );
+          for await (const chunk of refresh_gen) refresh_result.chunk_count++;
+        }
+      } catch (err) {
+        if (!state.interrupt) {
+          console.error(err.message);
+          state.failed = true;
+        }
+      }
+      clearTimeout(timer);
+      refresh.running = null;
+      if (state.interrupt) {
+        post_interrupted(nd_db_request, state.interrupt);
+        break;
+      }
+      refresh_result.row_count = state.row_count - refresh.row_count;
+      refresh_result.truncated = state.truncated;
+      if (state.failed) refresh_result.error = 1;
+      refresh.row_count = state.row_count;
+      console.log(
+        "duck_module: Refresh QID(" +
+          nd_db_request.query_id +
+          ") rows(" +
+          refresh_result.row_count +
+          ")\n",
+      );
+      on_db_result(refresh_result);
+      break;
+    }
     case "QueryResult":
     case "CommandResult":
     case "BatchResponse":
     case "FunctionResult":
+    case "Cancelled":
+    case "TimedOut":
       // we do not process our own results!
       break;
     case "Online":
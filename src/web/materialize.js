@@ -0,0 +1,236 @@
+// materialize: writes v2 chunks into the WASM heap, for duck_module.js on
+// the main thread, or for materialize_worker.js off it when the heap is a
+// SharedArrayBuffer. A column arrives as the plain parts of its Arrow
+// Data, see column_parts, so nothing here needs Arrow itself, and the
+// parts post to the worker with their buffers transferred, not copied.
+
+// Arrow typeIds, as WasmDuckType in nd_types.hpp, plus Date
+export const ChunkType = {
+  Dict: -1,
+  Int: 2,
+  Float: 3,
+  Utf8: 5,
+  Date: 8,
+  Timestamp: 10,
+};
+
+// Arrow's DateUnit
+const DateDay = 0;
+const MillisPerDay = 86400000;
+
+// DuckDB-WASM uses Apache Arrow JS as the result set API
+// Which is NOT isomorphic with the DuckDB C API as there
+// is no [u]int8, [u]int16, [u]int32, [u]int64 etc.
+// https://github.com/apache/arrow-js/blob/main/src/enum.ts
+// Here we decide how many WASM bytes are used to store
+// the arrow-js type
+export function get_duck_type_size(tipe) {
+  switch (tipe) {
+    case ChunkType.Float:
+    case ChunkType.Date:
+    case ChunkType.Timestamp: // arrow API returns JS num
+      return 8; // 8 bytes wide
+    case ChunkType.Int: // Signed or unsigned 8, 16, 32, or 64-bit little-endian integer
+    case ChunkType.Utf8: // int32 offsets, then utf8_bytes
+    case ChunkType.Dict: // int32 codes; the entries go once, in the schema
+      return 4; // 4 bytes wide
+  }
+  return 0;
+}
+
+// What a chunk needs of an Arrow Data: its buffers, and where this
+// batch's rows start in them. A Dictionary's values are its indices.
+export function column_parts(data) {
+  return {
+    type_id: data.typeId,
+    date_unit: data.typeId == ChunkType.Date ? data.type.unit : 0,
+    offset: data.offset,
+    null_count: data.nullCount,
+    values: data.values,
+    value_offsets: data.typeId == ChunkType.Utf8 ? data.valueOffsets : null,
+    null_bitmap: data.nullCount > 0 ? data.nullBitmap : null,
+  };
+}
+
+// The ArrayBuffers behind columns, once each, for a postMessage transfer
+// list. A SharedArrayBuffer is shared anyway, so can't be transferred.
+export function column_buffers(columns) {
+  let buffers = new Set();
+  for (const col of columns) {
+    for (const view of [col.values, col.value_offsets, col.null_bitmap]) {
+      if (view && !(view.buffer instanceof SharedArrayBuffer))
+        buffers.add(view.buffer);
+    }
+  }
+  return [...buffers];
+}
+
+// Copy an Arrow values buffer into a heap view with one TypedArray.set,
+// a memcpy when the element types match, and a native converting copy
+// for eg Int16 to Int32 or Float32 to Float64. Only BigInt to Number,
+// or back, can't go through set.
+function set_values(dst, values) {
+  let big_dst = dst instanceof BigInt64Array;
+  let big_src =
+    values instanceof BigInt64Array || values instanceof BigUint64Array;
+  if (big_dst == big_src) {
+    dst.set(values);
+    return;
+  }
+  for (let ir = 0; ir < values.length; ir++)
+    dst[ir] = big_dst ? BigInt(values[ir]) : Number(values[ir]);
+}
+
+// Dates go to C++ as epoch millis in doubles, from DateDay's int32 days
+// or DateMillisecond's int64 millis
+function set_dates(dst, values, date_unit) {
+  let scale = date_unit == DateDay ? MillisPerDay : 1;
+  for (let ir = 0; ir < dst.length; ir++)
+    dst[ir] = Number(values[ir]) * scale;
+}
+
+// Utf8 keeps Arrow's layout: int32 offsets[row_count + 1], then the
+// UTF-8 they index, so strings of any length go in two copies
+function utf8_bytes(col, row_count) {
+  let offsets = col.value_offsets;
+  return offsets[col.offset + row_count] - offsets[col.offset];
+}
+
+function set_utf8(heap, at, col, row_count) {
+  let offsets = col.value_offsets.subarray(
+    col.offset,
+    col.offset + row_count + 1,
+  );
+  let base = offsets[0];
+  let dst = new Int32Array(heap, at, row_count + 1);
+  dst.set(offsets);
+  // a sliced batch's offsets don't start at zero
+  if (base != 0) for (let ir = 0; ir <= row_count; ir++) dst[ir] -= base;
+  let byte_count = offsets[row_count] - base;
+  new Uint8Array(heap, at + (row_count + 1) * 4, byte_count).set(
+    col.values.subarray(base, base + byte_count),
+  );
+}
+
+// Validity, as in Arrow and DuckDB: bit i set if row i isn't null. Copied
+// as bytes when the batch starts on a byte boundary, as it does unless
+// sliced. The bitmap is padded to whole 64 bit words for C++.
+function set_validity(heap, at, col, row_count) {
+  let words = new Uint32Array(heap, at, validity_words(row_count));
+  words.fill(0);
+  let bytes = new Uint8Array(heap, at, (row_count + 7) >> 3);
+  let bitmap = col.null_bitmap;
+  if (col.offset % 8 == 0) {
+    let begin = col.offset >> 3;
+    bytes.set(bitmap.subarray(begin, begin + bytes.length));
+    // clear the bits past row_count, which belong to later rows
+    if (row_count % 8) bytes[bytes.length - 1] &= (1 << row_count % 8) - 1;
+    return;
+  }
+  for (let ir = 0; ir < row_count; ir++) {
+    let bit = col.offset + ir;
+    if ((bitmap[bit >> 3] >> (bit & 7)) & 1) bytes[ir >> 3] |= 1 << (ir & 7);
+  }
+}
+
+function validity_words(row_count) {
+  return ((row_count + 63) >> 6) * 2;
+}
+
+// v2 chunk, in 32 bit words: the row count, then a values offset and a
+// validity offset per column, then the columns. Each column's values,
+// then its validity bitmap if it has nulls, start on an 8 byte boundary.
+// See wasm_chunk_col in nd_types.hpp. The chunk is sized exactly from
+// the layout, as C++ hands out uninitialised arena blocks.
+// col_offsets[ic * 2 + 1] stays zero for a column without nulls, which
+// C++ takes as all valid.
+export function chunk_layout(columns, row_count) {
+  let col_offsets = new Uint32Array(columns.length * 2);
+  let bptr = 1 + columns.length * 2;
+  columns.forEach((col, ic) => {
+    // Column must start on 8 byte boundary; bptr has 32bit/4byte stride,
+    //  so if it's odd it's not on 8 byte boundary
+    if (bptr % 2) bptr++;
+    col_offsets[ic * 2] = bptr;
+    bptr += row_count * (get_duck_type_size(col.type_id) / 4);
+    if (col.type_id == ChunkType.Utf8) {
+      bptr += 1 + Math.ceil(utf8_bytes(col, row_count) / 4);
+    }
+    if (col.null_count > 0) {
+      if (bptr % 2) bptr++;
+      col_offsets[ic * 2 + 1] = bptr;
+      bptr += validity_words(row_count);
+    }
+  });
+  return { col_offsets: col_offsets, words: bptr };
+}
+
+// Fill the chunk at buffer_offset, which C++ sized from layout. heap is
+// the WASM heap's buffer as it is now: a heap resize detaches views, or
+// on a SharedArrayBuffer leaves them short, so views are made here.
+export function write_chunk(heap, buffer_offset, layout, columns, row_count) {
+  let col_offsets = layout.col_offsets;
+  let ui_heap32 = new Uint32Array(heap, buffer_offset, 1 + columns.length * 2);
+  ui_heap32[0] = row_count;
+  ui_heap32.set(col_offsets, 1);
+  columns.forEach((col, ic) => {
+    let at = buffer_offset + col_offsets[ic * 2] * 4;
+    if (col_offsets[ic * 2 + 1])
+      set_validity(heap, buffer_offset + col_offsets[ic * 2 + 1] * 4, col, row_count);
+    let values = col.values.subarray(col.offset, col.offset + row_count);
+    switch (col.type_id) {
+      case ChunkType.Int:
+      case ChunkType.Dict:
+        set_values(new Int32Array(heap, at, row_count), values);
+        break;
+      case ChunkType.Float:
+        set_values(new Float64Array(heap, at, row_count), values);
+        break;
+      case ChunkType.Timestamp:
+        set_values(new BigInt64Array(heap, at, row_count), values);
+        break;
+      case ChunkType.Utf8:
+        set_utf8(heap, at, col, row_count);
+        break;
+      case ChunkType.Date:
+        set_dates(new Float64Array(heap, at, row_count), values, col.date_unit);
+        break;
+      default:
+        console.error("write_chunk: unsupported type " + col.type_id + "\n");
+    }
+  });
+}
+
+// The producer side of WordRing<N> in spsc_ring.hpp, which C++ drains at
+// the start of each frame. Word indices match WordRing's layout. Atomics
+// are seq_cst, so the slot store is visible before the tail store.
+export const ChunkQueueWords = {
+  tail: 0,
+  capacity: 1,
+  head: 16,
+  slots: 32,
+};
+
+export class ChunkQueue {
+  constructor(heap, addr) {
+    let capacity = new Int32Array(heap, addr, 2)[ChunkQueueWords.capacity];
+    this.mask = capacity - 1;
+    this.capacity = capacity;
+    this.words = new Int32Array(heap, addr, ChunkQueueWords.slots + capacity);
+  }
+
+  // Worker only: waits for the render thread to make room, as Atomics.wait
+  // isn't allowed on the main thread. The ring only fills if the GUI has
+  // stopped rendering.
+  push(value) {
+    let words = this.words;
+    let tail = Atomics.load(words, ChunkQueueWords.tail);
+    while (true) {
+      let head = Atomics.load(words, ChunkQueueWords.head);
+      if (((tail - head) | 0) < this.capacity) break;
+      Atomics.wait(words, ChunkQueueWords.head, head, 1);
+    }
+    Atomics.store(words, ChunkQueueWords.slots + (tail & this.mask), value);
+    Atomics.store(words, ChunkQueueWords.tail, (tail + 1) | 0);
+  }
+}
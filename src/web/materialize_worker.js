@@ -0,0 +1,64 @@
+// materialize_worker: fills v2 chunks off the main thread, so a big
+// BatchRequest doesn't stall the ImGui frame loop. duck_module.js lays out
+// each chunk, has C++ allocate it, and posts the Arrow parts here with
+// their buffers transferred. We write the chunk straight into the WASM
+// heap, a SharedArrayBuffer, push its address onto C++'s chunk queue, and
+// tell duck_module.js it's done, so it can post the BatchResponse.
+//
+// Messages in:
+//   { nd_type: "Init", memory, chunk_queue }: the WASM Memory and the
+//     heap address of WebDuckDBCache::chunk_queue
+//   { nd_type: "Materialize", job_id, buffer_offset, row_count, layout, columns }
+// Messages out:
+//   { nd_type: "Materialized", job_id, buffer_offset, error? }
+//
+// Runs as a browser module Worker, or under node worker_threads for the
+// headless tests in test/unit/js.
+import { write_chunk, ChunkQueue } from "./materialize.js";
+
+const port =
+  typeof WorkerGlobalScope !== "undefined"
+    ? self
+    : (await import("node:worker_threads")).parentPort;
+
+let memory = null;
+let chunk_queue = null;
+
+function on_message(job) {
+  switch (job.nd_type) {
+    case "Init":
+      memory = job.memory;
+      chunk_queue = new ChunkQueue(memory.buffer, job.chunk_queue);
+      break;
+    case "Materialize": {
+      let materialized = {
+        nd_type: "Materialized",
+        job_id: job.job_id,
+        buffer_offset: job.buffer_offset,
+      };
+      try {
+        // memory.buffer, not a cached one: the heap may have grown since
+        write_chunk(
+          memory.buffer,
+          job.buffer_offset,
+          job.layout,
+          job.columns,
+          job.row_count,
+        );
+        chunk_queue.push(job.buffer_offset);
+      } catch (err) {
+        // C++ never adopts a chunk that isn't pushed
+        console.error("materialize_worker: " + err.message);
+        materialized.error = 1;
+      }
+      port.postMessage(materialized);
+      break;
+    }
+    default:
+      console.error("materialize_worker: unexpected message: " + job.nd_type);
+  }
+}
+
+port.addEventListener("message", (event) => on_message(event.data));
+// a node MessagePort only delivers to addEventListener once started
+if (port.start) port.start();
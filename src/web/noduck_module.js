@@ -25,23 +25,23 @@ self.onmessage = async (event) => {
   switch (nd_db_request.nd_type) {
     case "Command":
       on_db_result({
-        nd_type: "CommandResponse",
+        nd_type: "CommandResult",
         query_id: nd_db_request.query_id,
-        error: "noduck",
+        error: 1,
       });
       break;
     case "Query":
       on_db_result({
         nd_type: "QueryResult",
         query_id: nd_db_request.query_id,
-        error: "noduck",
+        error: 1,
       });
       break;
     case "BatchRequest":
       on_db_result({
         nd_type: "BatchResponse",
         query_id: nd_db_request.query_id,
-        error: "noduck",
+        error: 1,
       });
       break;
     case "QueryResult":
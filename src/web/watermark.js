@@ -0,0 +1,82 @@
+// watermark: the high water mark of a refreshable Query's refresh_key
+// column, which duck_module.js raises as each chunk is materialized, and
+// the SQL a Refresh runs to fetch only the rows past it. Columns are the
+// parts column_parts makes of Arrow Data, so nothing here needs Arrow or
+// DuckDB, and the headless tests in test/unit/js can run it.
+import { ChunkType } from "./materialize.js";
+
+// Arrow's DateUnit and TimeUnit
+const DateDay = 0;
+export const TimeUnit = {
+  Second: 0,
+  Millisecond: 1,
+  Microsecond: 2,
+  Nanosecond: 3,
+};
+
+// Largest valid value in the first row_count rows of col, or null if
+// they're all null, or its type can't be a refresh_key. Int and Float
+// are Numbers, BIGINT included, as duck_module.js has DuckDB cast it to
+// double. Dates are in their DateUnit, Timestamps BigInts in their
+// TimeUnit.
+export function column_max(col, row_count) {
+  switch (col.type_id) {
+    case ChunkType.Int:
+    case ChunkType.Float:
+    case ChunkType.Date:
+    case ChunkType.Timestamp:
+      break;
+    default:
+      return null;
+  }
+  let values = col.values;
+  let bitmap = col.null_bitmap;
+  let max = null;
+  for (let ir = 0; ir < row_count; ir++) {
+    let bit = col.offset + ir;
+    if (bitmap && !((bitmap[bit >> 3] >> (bit & 7)) & 1)) continue;
+    let value = values[bit];
+    if (max === null || value > max) max = value;
+  }
+  return max;
+}
+
+// The later of two marks, either of which may be null
+export function later_mark(a, b) {
+  if (a === null) return b;
+  if (b === null) return a;
+  return b > a ? b : a;
+}
+
+// mark as a SQL literal DuckDB compares with the key column without a
+// cast of the column, or null if the type can't be a refresh_key. unit
+// is a Date's DateUnit, or a Timestamp's TimeUnit. TIMESTAMP_NS has no
+// exact microsecond literal, so isn't supported, as on BB.
+export function mark_literal(type_id, unit, mark) {
+  switch (type_id) {
+    case ChunkType.Int:
+    case ChunkType.Float:
+      return String(mark);
+    case ChunkType.Date:
+      if (unit == DateDay) return "DATE '1970-01-01' + " + Number(mark);
+      return "epoch_ms(" + Number(mark) + ")::DATE";
+    case ChunkType.Timestamp: {
+      let micros = BigInt(mark);
+      if (unit == TimeUnit.Second) micros *= 1000000n;
+      else if (unit == TimeUnit.Millisecond) micros *= 1000n;
+      else if (unit != TimeUnit.Microsecond) return null;
+      return "make_timestamp(" + micros + ")";
+    }
+  }
+  return null;
+}
+
+// The Query's SQL, less any trailing ;, for the rows strictly past
+// literal: a later row tying the mark is never fetched, so appends must
+// bring keys above every key already fetched
+export function refresh_sql(sql, key, literal) {
+  let body = sql.replace(/[\s;]+$/, "");
+  return (
+    "select * from (" + body + ') where "' + key.replaceAll('"', '""') + '" > ' + literal
+  );
+}
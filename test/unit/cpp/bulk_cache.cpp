@@ -4,14 +4,19 @@
 #include <math.h>
 #define FMT_HEADER_ONLY
 #include "db_cache.hpp"
+#include "cell_cache.hpp"
+#include "lod_pyramid.hpp"
+#include "table_sort.hpp"
+#include "col_format.hpp"
 #include "nd_types.hpp"
 
 using BulkCache_t = BBDuckDBCache;
+using DBMsg = BBDuckDBCache::DBMsg;
 
 
 struct BulkCacheFixture {
     BulkCache_t bulk;
-    std::queue<nlohmann::json> responses;
+    std::queue<DBMsg> responses;
 
     std::string depth_scan_sql_fmt{ "BEGIN; DROP TABLE IF EXISTS depth; CREATE TABLE depth as select * from read_parquet('{}'); COMMIT;" };
     std::string depth_query_sql{ "select * from depth where LastTradeSize!=0 and AskQty5!=0 and BidQty5!=0 order by SeqNo;" };
@@ -32,16 +37,15 @@ struct BulkCacheFixture {
     }
 
 
-    void db_dispatch(const std::string& request_type, const std::string& qid, const std::string& sql) {
-        // implicitly using nlohmann JSON here via json_ops.hpp
-        auto db_request = JNewObject();
-        JSet(db_request, Static::nd_type_cs, request_type);
-        JSet(db_request, Static::query_id_cs, qid);
+    void db_dispatch(DBEventType request_type, const std::string& qid, const std::string& sql) {
+        DBMsg db_request;
+        db_request.type = request_type;
+        db_request.qid = qid;
         // BatchRequest just needs QID, no SQL; Command and Query need SQL
-        if (request_type != Static::batch_request_cs) { 
-            JSet(db_request, Static::sql_cs, sql);
+        if (request_type != dbBatchRequest) {
+            db_request.sql = sql;
         }
-        bulk.db_dispatch(db_request);
+        bulk.db_dispatch(std::move(db_request));
     }
 
     void setup_depth_table() {
@@ -49,20 +53,22 @@ struct BulkCacheFixture {
         bulk.get_db_responses(responses);
         BOOST_TEST(!responses.empty());
         BOOST_TEST(responses.size() == 1);
-        nlohmann::json resp{ responses.back() };
+        BOOST_TEST(responses.back().type == dbOnline);
         responses.pop();
 
-        db_dispatch(Static::command_cs, scan_qid, depth_scan_sql);
+        db_dispatch(dbCommand, scan_qid, depth_scan_sql);
         Sleep(1000);
         bulk.get_db_responses(responses);
         BOOST_TEST(!responses.empty());
         BOOST_TEST(responses.size() == 1);
 
-        db_dispatch(Static::query_cs, select_qid, depth_query_sql);
+        db_dispatch(dbQuery, select_qid, depth_query_sql);
         Sleep(1000);
 
-        db_dispatch(Static::batch_request_cs, select_qid, Static::empty_cs);
+        db_dispatch(dbBatchRequest, select_qid, Static::empty_cs);
         Sleep(1000);
+        // fetched chunks are adopted on the GUI thread, as in pump_messages
+        bulk.get_db_responses(responses);
     }
 };
    
@@ -122,3 +128,1522 @@ BOOST_FIXTURE_TEST_CASE(SmallXYRange, BulkCacheFixture)
     }
     BOOST_TEST(total_plot_count == 420);
 }
+
+// The getter series must see the same points as the per chunk XYRange
+// walk, across the chunk boundaries
+BOOST_FIXTURE_TEST_CASE(XYSeriesMatchesRange, BulkCacheFixture)
+{
+    setup_depth_table();
+
+    RSHandle h = bulk.get_handle(select_qid);
+    uint32_t col_count{ 0 };
+    uint32_t row_count{ 0 };
+    bulk.get_meta_data(h, col_count, row_count);
+    XYSeries series;
+    BOOST_TEST(bulk.init_series(h, "SeqNo", series.x));
+    BOOST_TEST(bulk.init_series(h, "AskPrice1", series.y));
+    BOOST_TEST(!series.x.time);
+    series.offset = 1340;
+    series.count = 4000;
+    uint32_t row = series.offset;
+    uint32_t mismatches{ 0 };
+    XYRange* range = bulk.init_xy_range(h, "SeqNo", "AskPrice1", 1340, 4000);
+    range = bulk.next_xy_range(range);
+    while (range != nullptr) {
+        for (uint32_t i = 0; i < range->plot_count; i++, row++) {
+            if (series.x.at(row) != range->xdata[i] || series.y.at(row) != range->ydata[i])
+                mismatches++;
+        }
+        range = bulk.next_xy_range(range);
+    }
+    BOOST_TEST(row == 1340 + 4000);
+    BOOST_TEST(mismatches == 0);
+}
+
+// Hand built chunks: short middle chunk, int64 micros on a time axis,
+// and a null
+BOOST_AUTO_TEST_CASE(SeriesColumnChunks)
+{
+    ChunkIndex cinx;
+    std::vector<int64_t> c0{ 1000000, 2000000, 3000000, 4000000 };
+    std::vector<int64_t> c1{ 5000000, 6000000 };
+    std::vector<int64_t> c2{ 7000000, 8000000, 9000000 };
+    cinx.add_chunk(4);
+    cinx.add_chunk(2);
+    cinx.add_chunk(3);
+    uint64_t c2_validity{ 0b101 };  // row 7 null
+    SeriesColumn col;
+    col.type = stInt64;
+    col.time = true;
+    col.divisor = 1e6;
+    col.chunks = { c0.data(), c1.data(), c2.data() };
+    col.validities = { nullptr, nullptr, &c2_validity };
+    col.cinx = &cinx;
+    BOOST_TEST(col.ready());
+    for (uint32_t row : { 0u, 3u, 4u, 5u, 6u, 8u }) {
+        BOOST_TEST(col.at(row) == static_cast<double>(row + 1));
+    }
+    BOOST_TEST(std::isnan(col.at(7)));
+    // out of order access relocates
+    BOOST_TEST(col.at(1) == 2.0);
+    BOOST_TEST(col.axis_value(9000000.0) == 9.0);
+    col.clear();
+    BOOST_TEST(!col.ready());
+}
+
+// WASM chunk VARCHAR: offsets then the heap, with strings well past the
+// 7 chars the old inline slots held
+BOOST_AUTO_TEST_CASE(SeriesColumnUtf8)
+{
+    // offsets[rows + 1], then the heap, in 32 bit words as a chunk is
+    auto utf8_column = [](const StringVec& strs) {
+        std::vector<int32_t> offsets{ 0 };
+        std::string heap;
+        for (const std::string& str : strs) {
+            heap += str;
+            offsets.push_back(static_cast<int32_t>(heap.size()));
+        }
+        std::vector<uint32_t> col(offsets.size() + (heap.size() + 3) / 4);
+        memcpy(col.data(), offsets.data(), offsets.size() * 4);
+        memcpy(col.data() + offsets.size(), heap.data(), heap.size());
+        return col;
+    };
+    StringVec s0{ "XLON", "BATS-EUROPE-DARK", "" };
+    StringVec s1{ "ORDER-0000000000000042", "\xc3\xa9t\xc3\xa9" };
+    std::vector<uint32_t> c0{ utf8_column(s0) };
+    std::vector<uint32_t> c1{ utf8_column(s1) };
+    BOOST_TEST(std::string(wasm_utf8_heap(c1.data(), 2), 22) == s1[0]);
+    ChunkIndex cinx;
+    cinx.add_chunk(3);
+    cinx.add_chunk(2);
+    SeriesColumn col;
+    col.type = stUtf8;
+    col.chunks = { c0.data(), c1.data() };
+    col.validities = { nullptr, nullptr };
+    col.cinx = &cinx;
+    BOOST_TEST(col.ready());
+    StringVec all{ s0 };
+    all.insert(all.end(), s1.begin(), s1.end());
+    for (uint32_t row : { 4u, 0u, 1u, 2u, 3u }) {
+        uint32_t len{ 0 };
+        const char* str = col.str_at(row, len);
+        BOOST_TEST(str != nullptr);
+        BOOST_TEST(std::string(str, len) == all[row]);
+    }
+    BOOST_TEST(std::isnan(col.at(0)));
+}
+
+// Dictionary coded strings: the worker's encoder and its deltas, the GUI
+// thread's dictionary, and a sort that compares ranks, not strings
+BOOST_AUTO_TEST_CASE(StringDictCodes)
+{
+    DictEncoder enc;
+    enc.active = true;
+    enc.max_codes = 3;
+    StringVec venues{ "XEUR", "BATS-EUROPE-DARK", "XEUR", "CHIX", "XEUR" };
+    std::vector<uint16_t> c0;
+    for (const std::string& venue : venues) {
+        uint32_t code{ 0 };
+        BOOST_TEST(enc.encode(venue.data(), static_cast<uint32_t>(venue.size()), code));
+        c0.push_back(static_cast<uint16_t>(code));
+    }
+    BOOST_TEST(std::vector<uint16_t>(c0) == std::vector<uint16_t>({ 0, 1, 0, 2, 0 }), boost::test_tools::per_element());
+    uint32_t code{ 0 };
+    BOOST_TEST(!enc.encode("XLON", 4, code));
+    DictColumn dcol;
+    dcol.code_bytes = sizeof(uint16_t);
+    dcol.coded_chunks = 2;
+    dcol.dict.append(enc.take_delta());
+    BOOST_TEST(enc.delta.empty());
+    BOOST_TEST(dcol.dict.size() == 3u);
+    BOOST_TEST(std::string(dcol.dict.entry(1)) == "BATS-EUROPE-DARK");
+    BOOST_TEST(dcol.dict.length(2) == 4u);
+    BOOST_TEST(std::string(dcol.dict.entry(7)).empty());
+    // BATS, CHIX, XEUR
+    BOOST_TEST(dcol.dict.ranks() == std::vector<uint32_t>({ 2, 0, 1 }), boost::test_tools::per_element());
+
+    std::vector<uint16_t> c1{ 2, 1, 0 };
+    uint64_t c1_validity{ 0b101 };      // row 6 null
+    ChunkIndex cinx;
+    cinx.add_chunk(5);
+    cinx.add_chunk(3);
+    SeriesColumn col;
+    col.type = stDict;
+    col.dict = &dcol;
+    col.chunks = { c0.data(), c1.data() };
+    col.validities = { nullptr, &c1_validity };
+    col.cinx = &cinx;
+    BOOST_TEST(col.ready());
+    BOOST_TEST(col.all_coded());
+    uint32_t len{ 0 };
+    BOOST_TEST(std::string(col.str_at(5, len)) == "CHIX");
+    BOOST_TEST(len == 4u);
+    BOOST_TEST(col.str_at(6, len) == nullptr);
+    const char* text = col.str_at(1, len);
+    BOOST_TEST(std::string(text, len) == "BATS-EUROPE-DARK");
+
+    SortJob job;
+    job.row_count = 8;
+    job.keys.emplace_back();
+    job.keys.back().extract(col, 8);
+    BOOST_TEST(job.keys.back().numeric);
+    job.run();
+    std::vector<uint32_t> expected{ 1, 3, 5, 0, 2, 4, 7, 6 };
+    BOOST_TEST(job.perm == expected, boost::test_tools::per_element());
+}
+
+// Pyramid over hand built chunks: spikes survive every level, an
+// incremental build matches a one shot build, and level choice tracks
+// the visible rows per pixel
+BOOST_AUTO_TEST_CASE(LODPyramidLevels)
+{
+    const uint32_t rows{ 10000 };
+    const uint32_t chunk_rows{ 2048 };
+    std::vector<int32_t> xs(rows);
+    std::vector<double> ys(rows);
+    for (uint32_t row = 0; row < rows; row++) {
+        xs[row] = static_cast<int32_t>(row);
+        ys[row] = std::sin(row / 100.0);
+    }
+    ys[4321] = 50.0;
+    ys[777] = -50.0;
+    ChunkIndex cinx;
+    XYSeries series;
+    series.x.type = stInt32;
+    series.y.type = stDouble;
+    for (uint32_t row = 0; row < rows; row += chunk_rows) {
+        cinx.add_chunk(std::min(chunk_rows, rows - row));
+        series.x.chunks.push_back(xs.data() + row);
+        series.y.chunks.push_back(ys.data() + row);
+        series.x.validities.push_back(nullptr);
+        series.y.validities.push_back(nullptr);
+    }
+    series.x.cinx = series.y.cinx = &cinx;
+
+    LODPyramid whole;
+    whole.reset(1, 0, "x", "y");
+    whole.extend(series, rows);
+    BOOST_TEST(whole.x_sorted);
+    BOOST_TEST(whole.levels.size() > 3);
+    BOOST_TEST(whole.levels[0].bucket_count() == (rows + LODPyramid::base_rows - 1) / LODPyramid::base_rows);
+    for (const LODLevel& level : whole.levels) {
+        double lo{ 0.0 };
+        double hi{ 0.0 };
+        for (const LODPoint& pt : level.points) {
+            lo = std::min(lo, pt.y);
+            hi = std::max(hi, pt.y);
+        }
+        BOOST_TEST(lo == -50.0);
+        BOOST_TEST(hi == 50.0);
+        for (size_t inx = 1; inx < level.points.size(); inx++)
+            BOOST_TEST(level.points[inx - 1].x <= level.points[inx].x);
+    }
+    // as if BatchResponses landed in uneven steps
+    LODPyramid stepped;
+    stepped.reset(1, 0, "x", "y");
+    for (uint32_t step : { 1000u, 1001u, 4099u, 8191u, rows }) {
+        stepped.extend(series, step);
+    }
+    BOOST_TEST(stepped.extend_count == 5);
+    BOOST_TEST(stepped.levels.size() == whole.levels.size());
+    for (size_t inx = 0; inx < whole.levels.size(); inx++) {
+        const std::vector<LODPoint>& a{ whole.levels[inx].points };
+        const std::vector<LODPoint>& b{ stepped.levels[inx].points };
+        BOOST_TEST(a.size() == b.size());
+        bool same = a.size() == b.size();
+        for (size_t pinx = 0; same && pinx < a.size(); pinx++)
+            same = a[pinx].x == b[pinx].x && a[pinx].y == b[pinx].y;
+        BOOST_TEST(same, "level " << inx);
+    }
+    // 1000 px: raw up to 2000 rows, then the first level with <= 1000 buckets
+    BOOST_TEST(whole.select(2000, 1000.0f) == -1);
+    int level = whole.select(rows, 1000.0f);
+    BOOST_TEST(level >= 0);
+    BOOST_TEST(rows / whole.levels[level].bucket_rows <= 1000u);
+    BOOST_TEST(rows / (whole.levels[level].bucket_rows / 2) > 1000u);
+    // x range to rows, with a row of margin either side
+    uint32_t begin{ 0 };
+    uint32_t end{ 0 };
+    whole.visible_rows(series.x, 2500.0, 2600.0, begin, end);
+    BOOST_TEST(begin == 2499u);
+    BOOST_TEST(end == 2602u);
+    whole.visible_rows(series.x, -10.0, 1e9, begin, end);
+    BOOST_TEST(begin == 0u);
+    BOOST_TEST(end == rows);
+
+    // a null x, here mid column and first in a later extend, unsorts x,
+    // so visible_rows falls back to every row
+    for (uint32_t null_row : { 50u, 64u }) {
+        std::vector<double> nxs(100);
+        for (uint32_t row = 0; row < 100; row++)
+            nxs[row] = row == null_row ? std::nan("") : static_cast<double>(row);
+        ChunkIndex ncinx;
+        ncinx.add_chunk(100);
+        XYSeries nseries;
+        nseries.x.type = stDouble;
+        nseries.y.type = stDouble;
+        nseries.x.chunks.push_back(nxs.data());
+        nseries.y.chunks.push_back(nxs.data());
+        nseries.x.validities.push_back(nullptr);
+        nseries.y.validities.push_back(nullptr);
+        nseries.x.cinx = nseries.y.cinx = &ncinx;
+        LODPyramid nulls;
+        nulls.reset(2, 0, "x", "y");
+        nulls.extend(nseries, 64);
+        nulls.extend(nseries, 100);
+        BOOST_TEST(!nulls.x_sorted);
+        nulls.visible_rows(nseries.x, 70.0, 80.0, begin, end);
+        BOOST_TEST(begin == 0u);
+        BOOST_TEST(end == 100u);
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(QueryTimeout, BulkCacheFixture)
+{
+    Sleep(1000);
+    bulk.get_db_responses(responses);   // Online
+    BOOST_TEST(responses.size() == 1);
+    responses.pop();
+
+    // runaway cross join: interrupted by the db_loop watchdog
+    DBMsg db_request;
+    db_request.type = dbQuery;
+    db_request.qid = select_qid;
+    db_request.sql = "select count(*) from range(100000000) a, range(100000000) b;";
+    db_request.serial = 7;
+    db_request.timeout_ms = 200;
+    bulk.db_dispatch(std::move(db_request));
+    Sleep(2000);
+    bulk.get_db_responses(responses);
+    BOOST_TEST(responses.size() == 1);
+    const DBMsg& resp{ responses.front() };
+    BOOST_TEST(resp.type == dbTimedOut);
+    BOOST_TEST(resp.db_action == dbQuery);
+    BOOST_TEST(resp.serial == 7);
+    BOOST_TEST(resp.qid == select_qid);
+    BOOST_TEST(bulk.get_handle(select_qid) == 0);
+}
+
+// Lanes aren't pinned to workers: with two workers, "quick" would have
+// gone round robin onto the worker running "slow", and waited for it.
+// Here it runs on the worker "other" has finished with.
+BOOST_AUTO_TEST_CASE(LaneTakesFreeWorker)
+{
+    NDConfig<nlohmann::json>::get_instance().initialize(std::string(R"({"db_config":{"pool_size":"2"}})"));
+    BulkCache_t bulk;
+    std::queue<DBMsg> responses;
+    bulk.start_db_thread();
+    Sleep(1000);
+    bulk.get_db_responses(responses);   // Online
+    responses.pop();
+
+    DBMsg slow;
+    slow.type = dbQuery;
+    slow.qid = "slow";
+    slow.sql = "select count(*) from range(100000000) a, range(100000000) b;";
+    slow.timeout_ms = 3000;
+    bulk.db_dispatch(std::move(slow));
+    Sleep(100);
+    DBMsg other;
+    other.type = dbQuery;
+    other.qid = "other";
+    other.sql = "select 1 as one;";
+    bulk.db_dispatch(std::move(other));
+    Sleep(200);
+    DBMsg quick;
+    quick.type = dbQuery;
+    quick.qid = "quick";
+    quick.sql = "select 42 as answer;";
+    bulk.db_dispatch(std::move(quick));
+    Sleep(500);
+    bulk.get_db_responses(responses);
+    StringSet answered;
+    while (!responses.empty()) {
+        if (responses.front().type == dbQueryResult)
+            answered.insert(responses.front().qid);
+        responses.pop();
+    }
+    BOOST_TEST(answered.count("other") == 1u);
+    BOOST_TEST(answered.count("quick") == 1u);
+    BOOST_TEST(answered.count("slow") == 0u);
+    // slow is still the first worker's until its deadline
+    Sleep(3500);
+    bulk.get_db_responses(responses);
+    BOOST_TEST(responses.size() == 1u);
+    BOOST_TEST(responses.front().type == dbTimedOut);
+    BOOST_TEST(responses.front().qid == "slow");
+    bulk.set_done(true);
+    NDConfig<nlohmann::json>::get_instance().initialize(std::string("{}"));
+}
+
+// A scan Command over a list of files reads each into a part table on
+// a worker of its own, then creates its table from their UNION ALL and
+// drops the parts
+BOOST_AUTO_TEST_CASE(ScanSplitJoin)
+{
+    NDConfig<nlohmann::json>::get_instance().initialize(std::string(R"({"db_config":{"pool_size":"2"}})"));
+    BulkCache_t bulk;
+    std::queue<DBMsg> responses;
+    bulk.start_db_thread();
+    Sleep(1000);
+    bulk.get_db_responses(responses);   // Online
+    responses.pop();
+
+    auto dispatch = [&bulk](DBEventType type, const std::string& qid, const std::string& sql) {
+        DBMsg db_request;
+        db_request.type = type;
+        db_request.qid = qid;
+        db_request.sql = sql;
+        bulk.db_dispatch(std::move(db_request));
+    };
+    dispatch(dbCommand, "split_make", "COPY (SELECT range AS a FROM range(10)) TO 'split_a.parquet' (FORMAT parquet);"
+        "COPY (SELECT range + 10 AS a FROM range(20)) TO 'split_b.parquet' (FORMAT parquet);");
+    Sleep(500);
+    dispatch(dbCommand, "split_scan", "BEGIN; DROP TABLE IF EXISTS split_test; CREATE TABLE split_test AS "
+        "SELECT * FROM read_parquet(['split_a.parquet', 'split_b.parquet']); COMMIT;");
+    Sleep(1000);
+    bulk.get_db_responses(responses);
+    BOOST_TEST(responses.size() == 2u);
+    while (!responses.empty()) {
+        BOOST_TEST(responses.front().type == dbCommandResult);
+        BOOST_TEST(responses.front().error == 0);
+        responses.pop();
+    }
+    dispatch(dbQuery, "split_rows", "SELECT DISTINCT a FROM split_test;");
+    dispatch(dbBatchRequest, "split_rows", Static::empty_cs);
+    dispatch(dbQuery, "split_parts", "SELECT table_name FROM duckdb_tables() WHERE starts_with(table_name, '__nd_scan_');");
+    dispatch(dbBatchRequest, "split_parts", Static::empty_cs);
+    Sleep(1000);
+    bulk.get_db_responses(responses);
+    BOOST_TEST(responses.size() == 4u);
+    while (!responses.empty()) {
+        if (responses.front().type == dbBatchResponse)
+            BOOST_TEST(responses.front().row_count == (responses.front().qid == "split_rows" ? 30u : 0u));
+        responses.pop();
+    }
+    // a missing file fails the Command, and still drops the parts
+    dispatch(dbCommand, "split_scan", "CREATE OR REPLACE TABLE split_test AS "
+        "SELECT * FROM read_parquet(['split_a.parquet', 'split_missing.parquet']);");
+    dispatch(dbQuery, "split_parts", "SELECT table_name FROM duckdb_tables() WHERE starts_with(table_name, '__nd_scan_');");
+    dispatch(dbBatchRequest, "split_parts", Static::empty_cs);
+    Sleep(1000);
+    bulk.get_db_responses(responses);
+    while (!responses.empty()) {
+        if (responses.front().qid == "split_scan")
+            BOOST_TEST(responses.front().error == 1);
+        else if (responses.front().type == dbBatchResponse)
+            BOOST_TEST(responses.front().row_count == 0u);
+        responses.pop();
+    }
+    bulk.set_done(true);
+    NDConfig<nlohmann::json>::get_instance().initialize(std::string("{}"));
+}
+
+// Over budget, a result set whose lane is still busy isn't evicted,
+// and is once the lane goes idle
+BOOST_AUTO_TEST_CASE(EvictSkipsBusyLane)
+{
+    NDConfig<nlohmann::json>::get_instance().initialize(std::string(R"({"db_config":{"mem_budget_mb":"1"}})"));
+    BulkCache_t bulk;
+    std::queue<DBMsg> responses;
+    bulk.start_db_thread();
+    Sleep(1000);
+    bulk.get_db_responses(responses);   // Online
+    responses.pop();
+
+    std::string big_qid{ "evict_big" };
+    DBMsg query;
+    query.type = dbQuery;
+    query.qid = big_qid;
+    query.sql = "select range as a from range(200000);";
+    bulk.db_dispatch(std::move(query));
+    DBMsg batch;
+    batch.type = dbBatchRequest;
+    batch.qid = big_qid;
+    bulk.db_dispatch(std::move(batch));
+    // keeps the lane busy until its deadline
+    DBMsg slow;
+    slow.type = dbCommand;
+    slow.qid = big_qid;
+    slow.sql = "select count(*) from range(100000000) a, range(100000000) b;";
+    slow.timeout_ms = 2000;
+    bulk.db_dispatch(std::move(slow));
+    Sleep(1000);
+    bulk.get_db_responses(responses);
+    uint32_t epoch = bulk.get_result_epoch();
+    // unpinned two frames on, but busy
+    bulk.start_frame();
+    bulk.start_frame();
+    bulk.get_db_responses(responses);
+    BOOST_TEST(bulk.get_result_epoch() == epoch);
+    Sleep(2000);
+    bulk.start_frame();
+    bulk.get_db_responses(responses);
+    Sleep(100);
+    bulk.get_db_responses(responses);
+    BOOST_TEST(responses.back().type == dbTimedOut);
+    BOOST_TEST(bulk.get_result_epoch() != epoch);
+    BOOST_TEST(bulk.get_handle(big_qid) == 0u);
+    bulk.set_done(true);
+    NDConfig<nlohmann::json>::get_instance().initialize(std::string("{}"));
+}
+
+BOOST_AUTO_TEST_CASE(ChunkIndexVariableChunks)
+{
+    ChunkIndex cinx;
+    uint32_t chunk_inx{ 0 };
+    uint32_t rel_index{ 0 };
+    BOOST_TEST(!cinx.locate(0, chunk_inx, rel_index));
+
+    // regular chunks plus a short tail take the direct divide path
+    cinx.add_chunk(2048);
+    cinx.add_chunk(2048);
+    cinx.add_chunk(1244);
+    BOOST_TEST(cinx.uniform);
+    BOOST_TEST(cinx.row_count == 5340);
+    BOOST_TEST(cinx.locate(2048, chunk_inx, rel_index));
+    BOOST_TEST(chunk_inx == 1);
+    BOOST_TEST(rel_index == 0);
+    BOOST_TEST(cinx.locate(5339, chunk_inx, rel_index));
+    BOOST_TEST(chunk_inx == 2);
+    BOOST_TEST(rel_index == 1243);
+    BOOST_TEST(!cinx.locate(5340, chunk_inx, rel_index));
+
+    // a short chunk mid result forces the binary search path
+    cinx.add_chunk(2048);
+    BOOST_TEST(!cinx.uniform);
+    BOOST_TEST(cinx.row_count == 7388);
+    BOOST_TEST(cinx.chunk_rows(2) == 1244);
+    BOOST_TEST(cinx.locate(5340, chunk_inx, rel_index));
+    BOOST_TEST(chunk_inx == 3);
+    BOOST_TEST(rel_index == 0);
+    BOOST_TEST(cinx.locate(4095, chunk_inx, rel_index));
+    BOOST_TEST(chunk_inx == 1);
+    BOOST_TEST(rel_index == 2047);
+}
+
+BOOST_AUTO_TEST_CASE(ZoneMapMinMax)
+{
+    // two chunks of four rows; row 1 of chunk 0 is null
+    std::vector<std::vector<double>> data{ {1.0, -99.0, 3.0, 4.0}, {2.0, 8.0, 6.0, 7.0} };
+    uint64_t validity[1]{ 0xD };
+    ChunkIndex cinx;
+    ZoneMap zones;
+    for (int chunk = 0; chunk < 2; chunk++) {
+        ColumnZoneVec col_zones(1);
+        zone_scan(col_zones[0], data[chunk].data(), chunk == 0 ? validity : nullptr, 0, 4);
+        cinx.add_chunk(4);
+        zones.add_chunk(std::move(col_zones));
+    }
+    BOOST_TEST(zones.chunks[0][0].null_count == 1);
+    BOOST_TEST(zones.chunks[0][0].sorted);
+    BOOST_TEST(!zones.chunks[1][0].sorted);
+    BOOST_TEST(!zones.columns[0].sorted);
+
+    double min{ 0.0 };
+    double max{ 0.0 };
+    BOOST_TEST(zones.get_min_max(0, min, max));
+    BOOST_TEST(min == 1.0);
+    BOOST_TEST(max == 8.0);
+
+    // rows 2..4 span the tail of chunk 0 and the head of chunk 1
+    int slice_scans{ 0 };
+    auto scan_slice = [&](uint32_t chunk, uint32_t begin, uint32_t end, ColumnZone& zone) {
+        slice_scans++;
+        zone_scan(zone, data[chunk].data(), chunk == 0 ? validity : nullptr, begin, end);
+    };
+    BOOST_TEST(zones.get_min_max(cinx, 0, 2, 3, min, max, scan_slice));
+    BOOST_TEST(slice_scans == 2);
+    BOOST_TEST(min == 2.0);
+    BOOST_TEST(max == 4.0);
+    BOOST_TEST(!zones.get_min_max(cinx, 1, 2, 3, min, max, scan_slice));
+}
+
+BOOST_AUTO_TEST_CASE(ResultBudgetLRU)
+{
+    ResultBudget budget;
+    budget.budget_bytes = 1000;
+    budget.start_frame();
+    budget.add(1, 400);
+    budget.add(2, 400);
+    BOOST_TEST(!budget.over());
+    budget.add(3, 400);
+    BOOST_TEST(budget.over());
+    // new handles are pinned for this frame and the next
+    BOOST_TEST(budget.lru_victim([](RSHandle) { return true; }) == 0);
+
+    budget.start_frame();
+    budget.start_frame();
+    budget.touch(1);    // 1 is on the render stack, so pinned
+    budget.start_frame();
+    budget.touch(3);
+    budget.start_frame();
+    // 2 untouched since frame 1, 1 touched in 3, 3 touched in 4 so pinned
+    BOOST_TEST(budget.lru_victim([](RSHandle) { return true; }) == 2);
+    BOOST_TEST(budget.lru_victim([](RSHandle h) { return h != 2; }) == 1);
+    budget.remove(2);
+    BOOST_TEST(budget.used_bytes == 800);
+    BOOST_TEST(!budget.over());
+}
+
+// Size classes, reuse of a released result's blocks, and the counters
+// as the arena runs out and chunks outgrow the biggest class
+BOOST_AUTO_TEST_CASE(ChunkArenaPool)
+{
+    BOOST_TEST(ChunkArena::class_bytes(0) == 1024u);
+    BOOST_TEST(ChunkArena::class_bytes(1) == 1280u);
+    BOOST_TEST(ChunkArena::class_bytes(4) == 2048u);
+    BOOST_TEST(ChunkArena::class_bytes(ChunkArena::class_count - 1) == 16u << 20);
+    BOOST_TEST(ChunkArena::size_class(1) == 0u);
+    BOOST_TEST(ChunkArena::size_class(1024 - ChunkArena::header_bytes) == 0u);
+    BOOST_TEST(ChunkArena::size_class(1024) == 1u);
+    BOOST_TEST(ChunkArena::size_class(uint64_t(16) << 20) == ChunkArena::large_class);
+    ChunkArena arena;
+    arena.reserve(1 << 20);
+    BOOST_TEST(arena.reserved_bytes == uint64_t(1) << 20);
+    // a 2048 row chunk of 8 doubles lands in the 160 KiB class
+    uint64_t chunk_bytes = 2048 * 8 * 8 + 512;
+    std::vector<char*> first;
+    for (int inx = 0; inx < 4; inx++) {
+        char* chunk = arena.alloc("the_depth_query", chunk_bytes);
+        BOOST_TEST(reinterpret_cast<uintptr_t>(chunk) % 8 == 0u);
+        memset(chunk, 0xAB, chunk_bytes);
+        first.push_back(chunk);
+    }
+    char* summary = arena.alloc("the_depth_summary", 3000);
+    BOOST_TEST(arena.owned_bytes("the_depth_query") == 4u * 160 * 1024);
+    BOOST_TEST(arena.in_use_bytes == 4u * 160 * 1024 + 3072);
+    BOOST_TEST(arena.reserved_bytes == uint64_t(1) << 20);
+    // past the arena: the heap tops it up
+    for (int inx = 0; inx < 4; inx++)
+        arena.alloc("the_depth_query", chunk_bytes);
+    BOOST_TEST(arena.reserved_bytes > uint64_t(1) << 20);
+    uint64_t reserved = arena.reserved_bytes;
+    arena.release("the_depth_query");
+    BOOST_TEST(arena.in_use_bytes == 3072u);
+    BOOST_TEST(arena.free_bytes() == reserved - 3072);
+    // a requery's chunks reuse the released blocks, with no growth
+    std::vector<char*> second;
+    for (int inx = 0; inx < 8; inx++)
+        second.push_back(arena.alloc("the_depth_query", chunk_bytes - 100));
+    BOOST_TEST(arena.reserved_bytes == reserved);
+    for (char* chunk : first)
+        BOOST_TEST((std::find(second.begin(), second.end(), chunk) != second.end()));
+    // the summary's block is untouched by all that
+    BOOST_TEST(summary != nullptr);
+    BOOST_TEST(arena.owned_bytes("the_depth_summary") == 3072u);
+    // a summary built aside takes over from the one it replaces
+    arena.alloc("the_depth_summary\x1f", 5000);
+    arena.transfer("the_depth_summary\x1f", "the_depth_summary");
+    BOOST_TEST(arena.owned_bytes("the_depth_summary\x1f") == 0u);
+    BOOST_TEST(arena.owned_bytes("the_depth_summary") == 5120u);
+    BOOST_TEST(arena.in_use_bytes == 8u * 160 * 1024 + 5120);
+    // large chunks go back to the heap on release
+    arena.alloc("the_big_query", uint64_t(20) << 20);
+    BOOST_TEST(arena.reserved_bytes > reserved + (uint64_t(20) << 20));
+    arena.release("the_big_query");
+    BOOST_TEST(arena.reserved_bytes == reserved);
+    arena.release("no_such_query");
+}
+
+BOOST_FIXTURE_TEST_CASE(PreparedQuery, BulkCacheFixture)
+{
+    Sleep(1000);
+    bulk.get_db_responses(responses);   // Online
+    BOOST_TEST(responses.size() == 1);
+    responses.pop();
+
+    // same template, rebound: the second run reuses the lane's statement
+    int64_t bounds[2][2] = { { 5000, 1000 }, { 3000, 0 } };
+    for (auto& bound : bounds) {
+        DBMsg db_request;
+        db_request.type = dbQuery;
+        db_request.qid = select_qid;
+        db_request.sql = "select * from range($1) where range >= $2;";
+        db_request.prepared = true;
+        for (int64_t val : bound) {
+            DBParam param;
+            param.type = cdInt;
+            param.i = static_cast<int>(val);
+            db_request.params.push_back(param);
+        }
+        bulk.db_dispatch(std::move(db_request));
+        db_dispatch(dbBatchRequest, select_qid, Static::empty_cs);
+        Sleep(1000);
+        bulk.get_db_responses(responses);
+        BOOST_TEST(responses.size() == 2);
+        BOOST_TEST(responses.front().type == dbQueryResult);
+        BOOST_TEST(responses.front().error == 0);
+        BOOST_TEST(responses.back().type == dbBatchResponse);
+        BOOST_TEST(responses.back().row_count == static_cast<uint64_t>(bound[0] - bound[1]));
+        responses = std::queue<DBMsg>();
+        RSHandle h = bulk.get_handle(select_qid);
+        BOOST_TEST(h != 0);
+        BOOST_TEST(bulk.get_row_count(h) == static_cast<uint32_t>(bound[0] - bound[1]));
+    }
+
+    // too few params fails without reaching Duck
+    DBMsg bad_request;
+    bad_request.type = dbQuery;
+    bad_request.qid = select_qid;
+    bad_request.sql = "select * from range($1) where range >= $2;";
+    bad_request.prepared = true;
+    bad_request.params.push_back(DBParam{ cdInt, 10 });
+    bulk.db_dispatch(std::move(bad_request));
+    Sleep(1000);
+    bulk.get_db_responses(responses);
+    BOOST_TEST(responses.size() == 1);
+    BOOST_TEST(responses.front().error == 1);
+}
+
+BOOST_FIXTURE_TEST_CASE(RequeryKeepsLastVersion, BulkCacheFixture)
+{
+    Sleep(1000);
+    bulk.get_db_responses(responses);   // Online
+    responses.pop();
+
+    // each pass returns one more row than the last
+    std::string sql_fmt{ "select range as x from range({});" };
+    db_dispatch(dbQuery, select_qid, fmt::format(sql_fmt, 5000));
+    db_dispatch(dbBatchRequest, select_qid, Static::empty_cs);
+    Sleep(1000);
+    bulk.start_frame();
+    bulk.get_db_responses(responses);
+    RSHandle h = bulk.get_handle(select_qid);
+    BOOST_TEST(h != 0);
+    BOOST_TEST(bulk.get_row_count(h) == 5000u);
+    for (uint32_t pass = 1; pass <= 3; pass++) {
+        responses = std::queue<DBMsg>();
+        uint32_t epoch = bulk.get_result_epoch();
+        // requeried, but not fetched: the previous version is still drawn
+        db_dispatch(dbQuery, select_qid, fmt::format(sql_fmt, 5000 + pass));
+        Sleep(500);
+        bulk.start_frame();
+        bulk.get_db_responses(responses);
+        BOOST_TEST(responses.back().type == dbQueryResult);
+        BOOST_TEST(bulk.get_handle(select_qid) == h);
+        BOOST_TEST(bulk.get_result_epoch() == epoch);
+        BOOST_TEST(bulk.get_row_count(h) == 5000u + pass - 1);
+        uint32_t col_count{ 0 }, row_count{ 0 };
+        BOOST_TEST(bulk.get_meta_data(h, col_count, row_count));
+        const char* end = bulk.get_datum(h, 0, 4999);
+        BOOST_TEST(std::string(static_cast<const char*>(bulk.buffer), end) == "4999");
+        // the BatchResponse publishes it, on the same handle
+        db_dispatch(dbBatchRequest, select_qid, Static::empty_cs);
+        Sleep(500);
+        bulk.start_frame();
+        bulk.get_db_responses(responses);
+        BOOST_TEST(responses.back().type == dbBatchResponse);
+        BOOST_TEST(bulk.get_handle(select_qid) == h);
+        BOOST_TEST(bulk.get_result_epoch() > epoch);
+        BOOST_TEST(bulk.get_row_count(h) == 5000u + pass);
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(RefreshAppendsNewRows, BulkCacheFixture)
+{
+    Sleep(1000);
+    bulk.get_db_responses(responses);   // Online
+    responses.pop();
+
+    std::string ticks_qid{ "ticks" };
+    db_dispatch(dbCommand, ticks_qid, "create table ticks as select range as seq, range * 0.5 as px from range(3000);");
+    DBMsg query;
+    query.type = dbQuery;
+    query.qid = ticks_qid;
+    query.sql = "select * from ticks order by seq;";
+    query.refresh_key = "seq";
+    bulk.db_dispatch(std::move(query));
+    db_dispatch(dbBatchRequest, ticks_qid, Static::empty_cs);
+    Sleep(1000);
+    bulk.start_frame();
+    bulk.get_db_responses(responses);
+    RSHandle h = bulk.get_handle(ticks_qid);
+    BOOST_TEST(h != 0);
+    BOOST_TEST(bulk.get_row_count(h) == 3000u);
+    uint32_t epoch = bulk.get_result_epoch();
+
+    // each Refresh fetches only the rows past the last seq we have
+    for (uint32_t pass = 1; pass <= 2; pass++) {
+        responses = std::queue<DBMsg>();
+        db_dispatch(dbCommand, ticks_qid, fmt::format(
+            "insert into ticks select range as seq, range * 0.5 as px from range({}, {});",
+            1000 + 2000 * pass, 3000 + 2000 * pass));
+        db_dispatch(dbRefresh, ticks_qid, Static::empty_cs);
+        Sleep(1000);
+        bulk.start_frame();
+        bulk.get_db_responses(responses);
+        BOOST_TEST(responses.back().type == dbBatchResponse);
+        BOOST_TEST(responses.back().db_action == dbRefresh);
+        BOOST_TEST(responses.back().error == 0);
+        BOOST_TEST(responses.back().row_count == 2000u);
+        BOOST_TEST(bulk.get_handle(ticks_qid) == h);
+        BOOST_TEST(bulk.get_result_epoch() == epoch);
+        BOOST_TEST(bulk.get_row_count(h) == 3000u + 2000 * pass);
+    }
+    double min{ 0.0 }, max{ 0.0 };
+    BOOST_TEST(bulk.get_min_max(h, "seq", min, max));
+    BOOST_TEST(max == 6999.0);
+    uint32_t col_count{ 0 }, row_count{ 0 };
+    BOOST_TEST(bulk.get_meta_data(h, col_count, row_count));
+    const char* end = bulk.get_datum(h, 0, 6999);
+    BOOST_TEST(std::string(static_cast<const char*>(bulk.buffer), end) == "6999");
+}
+
+// Keys may repeat within an append, but the mark is strictly passed: a
+// row appended with a key tying the mark is never fetched
+BOOST_FIXTURE_TEST_CASE(RefreshDuplicateKeys, BulkCacheFixture)
+{
+    Sleep(1000);
+    bulk.get_db_responses(responses);   // Online
+    responses.pop();
+
+    std::string dups_qid{ "dups" };
+    db_dispatch(dbCommand, dups_qid, "create table dups as select range // 2 as seq, range as n from range(3000);");
+    DBMsg query;
+    query.type = dbQuery;
+    query.qid = dups_qid;
+    query.sql = "select * from dups order by n;";
+    query.refresh_key = "seq";
+    bulk.db_dispatch(std::move(query));
+    db_dispatch(dbBatchRequest, dups_qid, Static::empty_cs);
+    Sleep(1000);
+    bulk.start_frame();
+    bulk.get_db_responses(responses);
+    RSHandle h = bulk.get_handle(dups_qid);
+    BOOST_TEST(h != 0);
+    BOOST_TEST(bulk.get_row_count(h) == 3000u);
+
+    // seq 1499 ties the mark; seq 1500..1999 come twice each
+    responses = std::queue<DBMsg>();
+    db_dispatch(dbCommand, dups_qid, "insert into dups values (1499, 3000);"
+        "insert into dups select range // 2 + 1500 as seq, range + 3001 as n from range(1000);");
+    db_dispatch(dbRefresh, dups_qid, Static::empty_cs);
+    Sleep(1000);
+    bulk.start_frame();
+    bulk.get_db_responses(responses);
+    BOOST_TEST(responses.back().type == dbBatchResponse);
+    BOOST_TEST(responses.back().db_action == dbRefresh);
+    BOOST_TEST(responses.back().error == 0);
+    BOOST_TEST(responses.back().row_count == 1000u);
+    BOOST_TEST(bulk.get_row_count(h) == 4000u);
+    double min{ 0.0 }, max{ 0.0 };
+    BOOST_TEST(bulk.get_min_max(h, "seq", min, max));
+    BOOST_TEST(max == 1999.0);
+    const char* end = bulk.get_datum(h, 1, 3000);
+    BOOST_TEST(std::string(static_cast<const char*>(bulk.buffer), end) == "3001");
+    const char* seq_end = bulk.get_datum(h, 0, 3999);
+    BOOST_TEST(std::string(static_cast<const char*>(bulk.buffer), seq_end) == "1999");
+
+    // nothing new, and the duplicates already held aren't fetched again
+    responses = std::queue<DBMsg>();
+    db_dispatch(dbRefresh, dups_qid, Static::empty_cs);
+    Sleep(1000);
+    bulk.start_frame();
+    bulk.get_db_responses(responses);
+    BOOST_TEST(responses.back().row_count == 0u);
+    BOOST_TEST(bulk.get_row_count(h) == 4000u);
+}
+
+// A key with no non-null values leaves no mark to go past, so a
+// Refresh appends nothing rather than all the rows again
+BOOST_FIXTURE_TEST_CASE(RefreshNullKeys, BulkCacheFixture)
+{
+    Sleep(1000);
+    bulk.get_db_responses(responses);   // Online
+    responses.pop();
+
+    std::string nulls_qid{ "nulls" };
+    db_dispatch(dbCommand, nulls_qid, "create table nulls as select null::bigint as seq, range as n from range(3000);");
+    DBMsg query;
+    query.type = dbQuery;
+    query.qid = nulls_qid;
+    query.sql = "select * from nulls order by n;";
+    query.refresh_key = "seq";
+    bulk.db_dispatch(std::move(query));
+    db_dispatch(dbBatchRequest, nulls_qid, Static::empty_cs);
+    Sleep(1000);
+    bulk.start_frame();
+    bulk.get_db_responses(responses);
+    RSHandle h = bulk.get_handle(nulls_qid);
+    BOOST_TEST(h != 0);
+    BOOST_TEST(bulk.get_row_count(h) == 3000u);
+
+    for (uint32_t pass = 1; pass <= 2; pass++) {
+        responses = std::queue<DBMsg>();
+        db_dispatch(dbRefresh, nulls_qid, Static::empty_cs);
+        Sleep(1000);
+        bulk.start_frame();
+        bulk.get_db_responses(responses);
+        BOOST_TEST(responses.back().type == dbBatchResponse);
+        BOOST_TEST(responses.back().db_action == dbRefresh);
+        BOOST_TEST(responses.back().error == 0);
+        BOOST_TEST(responses.back().row_count == 0u);
+        BOOST_TEST(bulk.get_handle(nulls_qid) == h);
+        BOOST_TEST(bulk.get_row_count(h) == 3000u);
+    }
+}
+
+// max_rows below a chunk's 2048 rows admits max_rows rows from the
+// first chunk cut short, rather than none
+BOOST_AUTO_TEST_CASE(MaxRowsPartialChunk)
+{
+    NDConfig<nlohmann::json>::get_instance().initialize(std::string(R"({"db_config":{"max_rows":"1000"}})"));
+    BulkCache_t bulk;
+    std::queue<DBMsg> responses;
+    bulk.start_db_thread();
+    Sleep(1000);
+    bulk.get_db_responses(responses);   // Online
+    responses.pop();
+
+    std::string capped_qid{ "capped" };
+    DBMsg query;
+    query.type = dbQuery;
+    query.qid = capped_qid;
+    query.sql = "select range as x from range(5000);";
+    bulk.db_dispatch(std::move(query));
+    DBMsg batch;
+    batch.type = dbBatchRequest;
+    batch.qid = capped_qid;
+    bulk.db_dispatch(std::move(batch));
+    Sleep(1000);
+    bulk.start_frame();
+    bulk.get_db_responses(responses);
+    BOOST_TEST(responses.back().type == dbBatchResponse);
+    BOOST_TEST(responses.back().truncated);
+    BOOST_TEST(responses.back().row_count == 1000u);
+    RSHandle h = bulk.get_handle(capped_qid);
+    BOOST_TEST(h != 0);
+    BOOST_TEST(bulk.get_row_count(h) == 1000u);
+    double min{ 0.0 }, max{ 0.0 };
+    BOOST_TEST(bulk.get_min_max(h, "x", min, max));
+    BOOST_TEST(max == 999.0);
+    uint32_t col_count{ 0 }, row_count{ 0 };
+    BOOST_TEST(bulk.get_meta_data(h, col_count, row_count));
+    const char* end = bulk.get_datum(h, 0, 999);
+    BOOST_TEST(std::string(static_cast<const char*>(bulk.buffer), end) == "999");
+    bulk.set_done(true);
+    NDConfig<nlohmann::json>::get_instance().initialize(std::string("{}"));
+}
+
+// get_datum stand in: "r.c" text, zero terminated for odd columns
+struct FakeBulk {
+    char        string_buffer[32];
+    char*       buffer{ string_buffer };
+    uint32_t    datum_count{ 0 };
+
+    const char* get_datum(RSHandle, uint32_t colm_index, uint32_t row_index) {
+        datum_count++;
+        int len = snprintf(string_buffer, sizeof(string_buffer), "%u.%u", row_index, colm_index);
+        return colm_index % 2 ? nullptr : string_buffer + len;
+    }
+};
+
+BOOST_AUTO_TEST_CASE(CellCacheWindow)
+{
+    FakeBulk bulk;
+    CellCache cells;
+    cells.reset(1, 0, 4, 1000);
+    BOOST_TEST(!cells.covers(0, 30));
+    cells.fill(bulk, 100, 130);
+    BOOST_TEST(cells.first_row == 100 - CellCache::prefetch_rows);
+    BOOST_TEST(cells.end_row == 130 + CellCache::prefetch_rows);
+    BOOST_TEST(bulk.datum_count == (cells.end_row - cells.first_row) * 4);
+    const char* end{ nullptr };
+    const char* begin = cells.cell(101, 3, end);
+    BOOST_TEST(std::string(begin, end) == "101.3");
+    begin = cells.cell(129, 0, end);
+    BOOST_TEST(std::string(begin, end) == "129.0");
+    // scrolling within the prefetch margin formats nothing
+    BOOST_TEST(cells.covers(110, 140));
+    BOOST_TEST(cells.fill_count == 1);
+    // a new result epoch drops the window
+    BOOST_TEST(cells.matches(1, 0, 4, 1000));
+    BOOST_TEST(!cells.matches(1, 1, 4, 1000));
+    cells.reset(1, 1, 4, 1000);
+    BOOST_TEST(!cells.covers(110, 140));
+    // clamped at both ends of the result set
+    cells.fill(bulk, 980, 1000);
+    BOOST_TEST(cells.end_row == 1000);
+    cells.fill(bulk, 0, 10);
+    BOOST_TEST(cells.first_row == 0);
+    // appended rows in an unchanged order keep the window
+    BOOST_TEST(cells.grows(1, 1, 4, 1200));
+    BOOST_TEST(!cells.grows(1, 1, 4, 1200, 1));
+    cells.row_count = 1200;
+    BOOST_TEST(cells.covers(0, 10));
+    BOOST_TEST(cells.fill_count == 3);
+}
+
+// Columns for TableSort: col 0 int32 with nulls in two chunks, col 1
+// VARCHAR as duckdb_string_t, col 2 a 2M row double for the timing
+struct FakeSortBulk {
+    ChunkIndex                  cinx;
+    StringVec                   col_names{ "num", "str", "big" };
+    std::vector<int32_t>        nums0{ 3, 1, 2, 1 };
+    std::vector<int32_t>        nums1{ 0, 9, 1 };
+    uint64_t                    nums1_validity{ 0b101 };    // row 5 null
+    std::vector<char>           strs;
+    std::vector<double>         big;
+
+    FakeSortBulk() {
+        cinx.add_chunk(4);
+        cinx.add_chunk(3);
+        const char* words[] = { "pear", "apple", "pear", "a much longer banana", "apple", "fig", "apple" };
+        strs.resize(7 * 16);
+        for (uint32_t row = 0; row < 7; row++) {
+            uint32_t len = static_cast<uint32_t>(strlen(words[row]));
+            char* str = &strs[row * 16];
+            memcpy(str, &len, sizeof(uint32_t));
+            if (len <= 12)
+                memcpy(str + 4, words[row], len);
+            else
+                memcpy(str + 8, &words[row], sizeof(const char*));
+        }
+    }
+
+    StringVec& get_col_names(RSHandle) { return col_names; }
+
+    bool init_series(RSHandle, const char* col_name, SeriesColumn& series) {
+        series.clear();
+        series.cinx = &cinx;
+        if (!strcmp(col_name, "num")) {
+            series.type = stInt32;
+            series.chunks = { nums0.data(), nums1.data() };
+            series.validities = { nullptr, &nums1_validity };
+        }
+        else if (!strcmp(col_name, "str")) {
+            series.type = stString16;
+            series.chunks = { strs.data(), strs.data() + 4 * 16 };
+            series.validities = { nullptr, nullptr };
+        }
+        else {
+            return false;
+        }
+        return true;
+    }
+};
+
+template <typename DB>
+void wait_for_sort(TableSort& sort, DB& bulk) {
+    for (int tries = 0; tries < 1000 && sort.job; tries++) {
+        Sleep(1);
+        sort.update(bulk);
+    }
+}
+
+// Multi column, stable, null last sorts, and their cache
+BOOST_AUTO_TEST_CASE(TableSortPermutation)
+{
+    FakeSortBulk bulk;
+    TableSort sort;
+    sort.reset(1, 0, 7);
+    sort.update(bulk);
+    BOOST_TEST(sort.permutation() == nullptr);
+    // num asc, nulls last, ties in row order
+    sort.specs = { SortColumnSpec{ 0, false } };
+    sort.update(bulk);
+    wait_for_sort(sort, bulk);
+    std::vector<uint32_t> expected{ 4, 1, 3, 6, 2, 0, 5 };
+    const uint32_t* perm = sort.permutation();
+    BOOST_TEST(perm != nullptr);
+    BOOST_TEST(std::vector<uint32_t>(perm, perm + 7) == expected, boost::test_tools::per_element());
+    // num desc, nulls still last
+    sort.specs = { SortColumnSpec{ 0, true } };
+    sort.update(bulk);
+    wait_for_sort(sort, bulk);
+    perm = sort.permutation();
+    expected = { 0, 2, 1, 3, 6, 4, 5 };
+    BOOST_TEST(std::vector<uint32_t>(perm, perm + 7) == expected, boost::test_tools::per_element());
+    // str asc, then num desc: apples 1,4,6 by num 1,0,1
+    sort.specs = { SortColumnSpec{ 1, false }, SortColumnSpec{ 0, true } };
+    sort.update(bulk);
+    wait_for_sort(sort, bulk);
+    perm = sort.permutation();
+    expected = { 3, 1, 6, 4, 5, 0, 2 };
+    BOOST_TEST(std::vector<uint32_t>(perm, perm + 7) == expected, boost::test_tools::per_element());
+    // back to an earlier spec comes from the cache
+    uint32_t sorts = sort.sort_count;
+    uint32_t order = sort.order;
+    sort.specs = { SortColumnSpec{ 0, false } };
+    sort.update(bulk);
+    BOOST_TEST(sort.sort_count == sorts);
+    BOOST_TEST(sort.order != order);
+    BOOST_TEST(sort.permutation()[0] == 4u);
+    // unsorted, then a new result epoch drops the cache
+    sort.specs.clear();
+    sort.update(bulk);
+    BOOST_TEST(sort.permutation() == nullptr);
+    BOOST_TEST(!sort.matches(1, 1, 7));
+    sort.reset(1, 1, 7);
+    BOOST_TEST(sort.perms.empty());
+}
+
+// Rows appended to the same handle and epoch, as by a Refresh, are
+// merged into the applied perm rather than sorting every row again
+BOOST_AUTO_TEST_CASE(TableSortExtend)
+{
+    FakeSortBulk bulk;
+    TableSort sort;
+    sort.reset(1, 0, 4);
+    sort.specs = { SortColumnSpec{ 0, false } };
+    sort.update(bulk);
+    wait_for_sort(sort, bulk);
+    std::vector<uint32_t> expected{ 1, 3, 2, 0 };
+    BOOST_TEST(std::vector<uint32_t>(sort.permutation(), sort.permutation() + 4) == expected,
+        boost::test_tools::per_element());
+    BOOST_TEST(sort.grows(1, 0, 7));
+    BOOST_TEST(!sort.grows(1, 1, 7));
+    uint32_t order = sort.order;
+    sort.extend(bulk, 7);
+    BOOST_TEST(sort.matches(1, 0, 7));
+    BOOST_TEST(sort.order != order);
+    // until the merge lands, the new rows follow the sorted ones
+    BOOST_TEST(sort.job != nullptr);
+    expected = { 1, 3, 2, 0, 4, 5, 6 };
+    BOOST_TEST(std::vector<uint32_t>(sort.permutation(), sort.permutation() + 7) == expected,
+        boost::test_tools::per_element());
+    order = sort.order;
+    wait_for_sort(sort, bulk);
+    BOOST_TEST(sort.order != order);
+    expected = { 4, 1, 3, 6, 2, 0, 5 };
+    BOOST_TEST(std::vector<uint32_t>(sort.permutation(), sort.permutation() + 7) == expected,
+        boost::test_tools::per_element());
+    // unsorted, growth keeps no perm
+    sort.specs.clear();
+    sort.reset(1, 0, 4);
+    sort.extend(bulk, 7);
+    BOOST_TEST(sort.permutation() == nullptr);
+    BOOST_TEST(!sort.job);
+}
+
+// A merge of appended rows into a sorted base orders ties as a stable
+// sort of all the rows would
+BOOST_AUTO_TEST_CASE(TableSortMergeBase)
+{
+    const uint32_t rows{ 20000 };
+    const uint32_t base_rows{ 15000 };
+    std::vector<double> nums(rows);
+    uint64_t seed{ 88172645463325252ull };
+    for (uint32_t row = 0; row < rows; row++) {
+        seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+        nums[row] = row % 37 == 0 ? std::nan("") : static_cast<double>(seed % 500);
+    }
+    auto make_job = [&nums](uint32_t row_count) {
+        std::shared_ptr<SortJob> job{ std::make_shared<SortJob>() };
+        job->row_count = row_count;
+        job->keys.emplace_back();
+        job->keys.back().descending = true;
+        job->keys.back().nums.assign(nums.begin(), nums.begin() + row_count);
+        return job;
+    };
+    std::shared_ptr<SortJob> full{ make_job(rows) };
+    full->run();
+    std::shared_ptr<SortJob> base{ make_job(base_rows) };
+    base->run();
+    std::shared_ptr<SortJob> merged{ make_job(rows) };
+    merged->base = base->perm;
+    merged->run();
+    BOOST_TEST(merged->done);
+    BOOST_TEST(merged->base.empty());
+    BOOST_TEST(merged->perm == full->perm, boost::test_tools::per_element());
+}
+
+// 2M doubles with nulls, off the GUI thread. Timing is printed, not checked.
+BOOST_AUTO_TEST_CASE(TableSortLarge)
+{
+    const uint32_t rows{ 2000000 };
+    SortJob job;
+    job.row_count = rows;
+    job.keys.emplace_back();
+    SortKeys& keys{ job.keys.back() };
+    keys.nums.resize(rows);
+    uint64_t seed{ 88172645463325252ull };
+    for (uint32_t row = 0; row < rows; row++) {
+        seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+        keys.nums[row] = row % 100 == 0 ? std::nan("") : static_cast<double>(seed % 100000);
+    }
+    std::vector<double> nums(keys.nums);
+    boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+    job.run();
+    boost::chrono::milliseconds elapsed = boost::chrono::duration_cast<boost::chrono::milliseconds>(
+        boost::chrono::steady_clock::now() - start);
+    std::cout << "TableSortLarge: " << rows << " rows in " << elapsed.count() << "ms" << std::endl;
+    BOOST_TEST(job.done);
+    uint32_t bad{ 0 };
+    for (uint32_t inx = 1; inx < rows; inx++) {
+        double prev = nums[job.perm[inx - 1]];
+        double cur = nums[job.perm[inx]];
+        if (std::isnan(prev))
+            bad += std::isnan(cur) ? 0 : 1;
+        else if (!std::isnan(cur))
+            bad += prev < cur || (prev == cur && job.perm[inx - 1] < job.perm[inx]) ? 0 : 1;
+    }
+    BOOST_TEST(bad == 0);
+}
+
+// encode_chunk over real DuckDB chunks of 2048, 2048 and 904 rows, with
+// dict_max 100: venue is coded throughout, id is never coded, and grow
+// is coded in its first chunk, then fills and stays strings. get_datum,
+// the zone maps and a sort read each through the handle.
+BOOST_AUTO_TEST_CASE(DictCodedResult)
+{
+    NDConfig<nlohmann::json>::get_instance().initialize(std::string(R"({"db_config":{"dict_max":"100"}})"));
+    BulkCache_t bulk;
+    std::queue<DBMsg> responses;
+    bulk.start_db_thread();
+    Sleep(1000);
+    bulk.get_db_responses(responses);   // Online
+    responses.pop();
+
+    std::string coded_qid{ "coded" };
+    DBMsg query;
+    query.type = dbQuery;
+    query.qid = coded_qid;
+    query.sql = "select range as n, "
+        "case when range % 7 = 0 then null else ['XEUR', 'CHIX', 'BATS-EUROPE-DARK'][range % 3 + 1] end as venue, "
+        "'order-' || range as id, "
+        "case when range < 2048 then 'g' || (range % 10) when range % 13 = 0 then null else 'grown-' || range end as grow, "
+        "case when range % 11 = 0 then null else range * 0.5 end as px "
+        "from range(5000) order by n;";
+    bulk.db_dispatch(std::move(query));
+    DBMsg batch;
+    batch.type = dbBatchRequest;
+    batch.qid = coded_qid;
+    bulk.db_dispatch(std::move(batch));
+    Sleep(1000);
+    bulk.start_frame();
+    bulk.get_db_responses(responses);
+    BOOST_TEST(responses.back().type == dbBatchResponse);
+    BOOST_TEST(responses.back().error == 0);
+    RSHandle h = bulk.get_handle(coded_qid);
+    BOOST_TEST_REQUIRE(h != 0);
+    BOOST_TEST_REQUIRE(bulk.get_row_count(h) == 5000u);
+
+    // text of a cell, whether get_datum zero terminated it or not
+    auto datum = [&bulk, h](uint32_t col_inx, uint32_t row) {
+        const char* end = bulk.get_datum(h, col_inx, row);
+        const char* text = bulk.buffer;
+        return end ? std::string(text, end) : std::string(text);
+    };
+    auto is_null = [&bulk, h](uint32_t col_inx, uint32_t row) {
+        bulk.get_datum(h, col_inx, row);
+        return bulk.buffer == Static::null_cs;
+    };
+    BOOST_TEST(is_null(1, 0));
+    BOOST_TEST(datum(1, 1) == "CHIX");
+    BOOST_TEST(datum(1, 2) == "BATS-EUROPE-DARK");
+    BOOST_TEST(datum(1, 4999) == "CHIX");
+    BOOST_TEST(datum(2, 0) == "order-0");
+    BOOST_TEST(datum(2, 4999) == "order-4999");
+    BOOST_TEST(datum(3, 5) == "g5");
+    BOOST_TEST(datum(3, 2047) == "g7");
+    BOOST_TEST(datum(3, 2050) == "grown-2050");
+    BOOST_TEST(is_null(3, 2054));
+    BOOST_TEST(datum(3, 4999) == "grown-4999");
+    BOOST_TEST(datum(0, 4097) == "4097");
+    BOOST_TEST(is_null(4, 2057));
+
+    // venue is coded in every chunk, grow only in its first
+    SeriesColumn col;
+    BOOST_TEST(bulk.init_series(h, "venue", col));
+    BOOST_TEST(col.all_coded());
+    BOOST_TEST(bulk.init_series(h, "grow", col));
+    BOOST_TEST(!col.all_coded());
+    uint32_t len{ 0 };
+    BOOST_TEST(std::string(col.str_at(9, len), len) == "g9");
+    BOOST_TEST(std::string(col.str_at(4999, len), len) == "grown-4999");
+    BOOST_TEST(bulk.init_series(h, "id", col));
+    BOOST_TEST(!col.all_coded());
+
+    // zones were taken before coding: strings have no limits, and the
+    // columns copied into coded chunks keep their values and nulls
+    double min{ 0.0 }, max{ 0.0 };
+    BOOST_TEST(!bulk.get_min_max(h, "venue", min, max));
+    BOOST_TEST(!bulk.get_min_max(h, "grow", min, max));
+    BOOST_TEST(bulk.get_min_max(h, "px", min, max));
+    BOOST_TEST(min == 0.5);
+    BOOST_TEST(max == 2499.5);
+    BOOST_TEST(bulk.get_min_max(h, "px", 100, 3000, min, max));
+    BOOST_TEST(min == 50.0);
+    BOOST_TEST(max == 1549.5);
+    BOOST_TEST(bulk.get_min_max(h, "n", 2000, 100, min, max));
+    BOOST_TEST(min == 2000.0);
+    BOOST_TEST(max == 2099.0);
+
+    // sorted through the handle: ascending, ties in row order, nulls last
+    auto check_sort = [&](uint32_t col_inx, uint32_t null_count) {
+        TableSort sort;
+        sort.reset(h, bulk.get_result_epoch(), 5000);
+        sort.specs = { SortColumnSpec{ static_cast<int32_t>(col_inx), false } };
+        sort.update(bulk);
+        wait_for_sort(sort, bulk);
+        const uint32_t* perm = sort.permutation();
+        BOOST_TEST_REQUIRE(perm != nullptr);
+        uint32_t bad{ 0 };
+        uint32_t valid_rows{ 5000 - null_count };
+        std::string prev{ datum(col_inx, perm[0]) };
+        for (uint32_t inx = 1; inx < 5000; inx++) {
+            if (inx >= valid_rows) {
+                bad += is_null(col_inx, perm[inx]) ? 0 : 1;
+                continue;
+            }
+            std::string cur{ datum(col_inx, perm[inx]) };
+            bad += prev < cur || (prev == cur && perm[inx - 1] < perm[inx]) ? 0 : 1;
+            prev = cur;
+        }
+        BOOST_TEST(bad == 0u);
+    };
+    check_sort(1, 715);     // ranks of a coded column
+    check_sort(3, 227);     // strings, coded and not
+    check_sort(2, 0);
+    bulk.set_done(true);
+    NDConfig<nlohmann::json>::get_instance().initialize(std::string("{}"));
+}
+
+// What ScanCache keys on: the file arguments of the scan functions, and
+// the tables the SQL creates
+BOOST_AUTO_TEST_CASE(ScanCacheParse)
+{
+    std::string scan_sql{ "BEGIN; DROP TABLE IF EXISTS depth; CREATE TABLE depth as select * from "
+        "read_parquet(['https://localhost/api/parquet/a.parquet', 'it''s.parquet']); COMMIT;" };
+    StringVec sources = scan_sources(scan_sql);
+    BOOST_TEST(sources.size() == 2);
+    BOOST_TEST(sources[0] == "'https://localhost/api/parquet/a.parquet'");
+    BOOST_TEST(sources[1] == "'it''s.parquet'");
+    // options aren't sources, and read_csv doesn't match inside read_csv_auto
+    sources = scan_sources("select * from READ_CSV_AUTO('a.csv') union all select * from read_csv('b.csv', delim=',')");
+    BOOST_TEST(sources.size() == 2);
+    BOOST_TEST(sources[0] == "'a.csv'");
+    BOOST_TEST(sources[1] == "'b.csv'");
+    BOOST_TEST(scan_sources("select * from depth").empty());
+    StringVec tables = created_tables(scan_sql);
+    BOOST_TEST(tables.size() == 1);
+    BOOST_TEST(tables[0] == "depth");
+    tables = created_tables("create or replace table main.\"Two\"(a int); create temp table t as select 1;"
+        "CREATE TABLE IF NOT EXISTS three AS SELECT 1");
+    BOOST_TEST(tables.size() == 2);
+    BOOST_TEST(tables[0] == "Two");
+    BOOST_TEST(tables[1] == "three");
+    // a list of files splits into a select per file, keeping the options
+    ScanSplit split;
+    BOOST_TEST(split_scan(scan_sql, split));
+    BOOST_TEST(split.part_selects.size() == 2);
+    BOOST_TEST(split.part_selects[0] == "SELECT * FROM read_parquet('https://localhost/api/parquet/a.parquet')");
+    BOOST_TEST(split.part_selects[1] == "SELECT * FROM read_parquet('it''s.parquet')");
+    BOOST_TEST(split.prefix == "BEGIN; DROP TABLE IF EXISTS depth; CREATE TABLE depth as select * from ");
+    BOOST_TEST(split.suffix == "; COMMIT;");
+    BOOST_TEST(!split.by_name);
+    BOOST_TEST(split_scan("select * from read_csv(['a.csv', 'b.csv'], delim=',', union_by_name = true) t", split));
+    BOOST_TEST(split.part_selects[1] == "SELECT * FROM read_csv('b.csv', delim=',', union_by_name = true)");
+    BOOST_TEST(split.suffix == " t");
+    BOOST_TEST(split.by_name);
+    // one file, two scan calls, or a list that isn't all literals
+    BOOST_TEST(!split_scan("select * from read_parquet(['a.parquet'])", split));
+    BOOST_TEST(!split_scan("select * from read_parquet(['a.parquet', 'b.parquet']) union all "
+        "select * from read_parquet('c.parquet')", split));
+    BOOST_TEST(!split_scan("select * from read_parquet(['a.parquet', $1])", split));
+}
+
+// A scan against an on disk database is a hit until its source file or
+// its table changes
+BOOST_AUTO_TEST_CASE(ScanCacheReuse)
+{
+    const char* db_file{ "scan_cache_test.duckdb" };
+    remove(db_file);
+    remove("scan_cache_test.duckdb.wal");
+    duckdb_database db;
+    BOOST_TEST_REQUIRE(duckdb_open(db_file, &db) == DuckDBSuccess);
+    ScanCache scan_cache;
+    BOOST_TEST(scan_cache.init(db));
+    duckdb_connection conn;
+    BOOST_TEST_REQUIRE(duckdb_connect(db, &conn) == DuckDBSuccess);
+    std::string copy_sql{ "COPY (SELECT range AS a FROM range(10)) TO 'scan_cache_test.parquet' (FORMAT parquet);" };
+    BOOST_TEST(duckdb_query(conn, copy_sql.c_str(), nullptr) == DuckDBSuccess);
+    std::string scan_sql{ "BEGIN; DROP TABLE IF EXISTS sc_test; CREATE TABLE sc_test AS "
+        "SELECT * FROM read_parquet(['scan_cache_test.parquet']); COMMIT;" };
+    std::string fingerprint = scan_cache.fingerprint(conn, scan_sql);
+    BOOST_TEST(!fingerprint.empty());
+    BOOST_TEST(!scan_cache.hit(conn, scan_sql, fingerprint));
+    BOOST_TEST(duckdb_query(conn, scan_sql.c_str(), nullptr) == DuckDBSuccess);
+    scan_cache.store(conn, scan_sql, fingerprint);
+    BOOST_TEST(scan_cache.hit(conn, scan_sql, fingerprint));
+    // a rewritten source has a new size
+    copy_sql = "COPY (SELECT range AS a FROM range(1000)) TO 'scan_cache_test.parquet' (FORMAT parquet);";
+    BOOST_TEST(duckdb_query(conn, copy_sql.c_str(), nullptr) == DuckDBSuccess);
+    BOOST_TEST(!scan_cache.hit(conn, scan_sql, scan_cache.fingerprint(conn, scan_sql)));
+    // a dropped table is a miss whatever the fingerprint
+    BOOST_TEST(duckdb_query(conn, "DROP TABLE sc_test;", nullptr) == DuckDBSuccess);
+    BOOST_TEST(!scan_cache.hit(conn, scan_sql, fingerprint));
+    // no tables created or no sources found: not cached
+    BOOST_TEST(scan_cache.fingerprint(conn, "SELECT * FROM read_parquet('scan_cache_test.parquet');").empty());
+    BOOST_TEST(scan_cache.fingerprint(conn, "CREATE TABLE q AS SELECT * FROM read_parquet('missing.parquet');").empty());
+    duckdb_disconnect(&conn);
+    duckdb_close(&db);
+}
+
+// Multi statement SQL runs task by task, publishing progress for its
+// query_id, and an interrupt stops it between tasks
+BOOST_AUTO_TEST_CASE(QueryProgressPending)
+{
+    duckdb_database db;
+    BOOST_TEST_REQUIRE(duckdb_open(nullptr, &db) == DuckDBSuccess);
+    duckdb_connection conn;
+    BOOST_TEST_REQUIRE(duckdb_connect(db, &conn) == DuckDBSuccess);
+    BOOST_TEST(duckdb_query(conn, "SET enable_progress_bar = true; SET enable_progress_bar_print = false;", nullptr) == DuckDBSuccess);
+    QueryProgress progress;
+    boost::atomic<uint32_t> interrupt{ 0 };
+    PendingExec exec{ conn, progress, interrupt };
+    progress.begin("the_scan");
+    duckdb_result result{};
+    BOOST_TEST(execute_sql(exec, "BEGIN; DROP TABLE IF EXISTS qp_test; CREATE TABLE qp_test AS "
+        "SELECT range AS a, range % 7 AS b FROM range(2000000); COMMIT;", false, &result) == DuckDBSuccess);
+    duckdb_destroy_result(&result);
+    BOOST_TEST(execute_sql(exec, "SELECT b, sum(a) FROM qp_test GROUP BY b ORDER BY b;", false, &result) == DuckDBSuccess);
+    BOOST_TEST(duckdb_row_count(&result) == 7);
+    duckdb_destroy_result(&result);
+    double percent{ -1.0 };
+    double rows_per_sec{ -1.0 };
+    BOOST_TEST(progress.read(QueryProgress::hash("the_scan"), percent, rows_per_sec));
+    BOOST_TEST(percent >= 0.0);
+    BOOST_TEST(rows_per_sec >= 0.0);
+    BOOST_TEST(!progress.read(QueryProgress::hash("the_query"), percent, rows_per_sec));
+    // a parse error, a bind error in a later statement, and an interrupt
+    BOOST_TEST(execute_sql(exec, "SELEC 1;", false, &result) == DuckDBError);
+    duckdb_destroy_result(&result);
+    BOOST_TEST(execute_sql(exec, "SELECT 1; SELECT * FROM qp_missing;", false, &result) == DuckDBError);
+    duckdb_destroy_result(&result);
+    interrupt = 1;
+    BOOST_TEST(execute_sql(exec, "SELECT sum(a) FROM qp_test;", false, &result) == DuckDBError);
+    duckdb_destroy_result(&result);
+    progress.end();
+    BOOST_TEST(!progress.read(QueryProgress::hash("the_scan"), percent, rows_per_sec));
+    duckdb_disconnect(&conn);
+    duckdb_close(&db);
+}
+
+// get_datum's formatters: exact decimals with rounding and grouping,
+// timestamps at each unit either side of the epoch, and the cspec
+BOOST_AUTO_TEST_CASE(ColFormatterText)
+{
+    char text[STR_BUF_LEN];
+    ColFormatSpec plain;
+    ColFormatter dec3{ ColFormatter::decimal(3, plain) };
+    BOOST_TEST(std::string(text, dec3.format_decimal(int64_t(123456), text)) == "123.456");
+    BOOST_TEST(std::string(text, dec3.format_decimal(int64_t(-5), text)) == "-0.005");
+    BOOST_TEST(std::string(text, dec3.format_decimal(INT64_MIN, text)) == "-9223372036854775.808");
+    ColFormatSpec grouped_2dp{ 2, true };
+    ColFormatter dec3_2dp{ ColFormatter::decimal(3, grouped_2dp) };
+    BOOST_TEST(std::string(text, dec3_2dp.format_decimal(int64_t(1234567895), text)) == "1,234,567.90");
+    BOOST_TEST(std::string(text, dec3_2dp.format_decimal(int64_t(999995), text)) == "1,000.00");
+    BOOST_TEST(std::string(text, dec3_2dp.format_decimal(int64_t(-4), text)) == "0.00");
+    BOOST_TEST(std::string(text, dec3_2dp.format_decimal(int64_t(-5), text)) == "-0.01");
+    // HUGEINT DECIMAL(38,2)
+    ColFormatter huge{ ColFormatter::decimal(2, plain) };
+    BOOST_TEST(std::string(text, huge.format_decimal(~uint64_t(12345) + 1, int64_t(-1), text)) == "-123.45");
+    BOOST_TEST(std::string(text, huge.format_decimal(UINT64_MAX, INT64_MAX, text))
+        == "1701411834604692317316873037158841057.27");
+    ColFormatter ints{ cfkInt, ColFormatSpec{ -1, true } };
+    BOOST_TEST(std::string(text, ints.format_int(-1234567, text)) == "-1,234,567");
+    BOOST_TEST(std::string(text, ints.format_int(999, text)) == "999");
+    ColFormatter dbls{ cfkDouble, plain };
+    BOOST_TEST(std::string(text, dbls.format_double(0.1, text)) == "0.1");
+    BOOST_TEST(std::string(text, dbls.format_double(1.0 / 3, text)) == "0.3333333333333333");
+    ColFormatter dbls_2dp{ cfkDouble, grouped_2dp };
+    BOOST_TEST(std::string(text, dbls_2dp.format_double(-1234.5, text)) == "-1,234.50");
+    // timestamps: the day prefix cache must follow day changes
+    ColFormatter micros{ ColFormatter::timestamp(1000000, plain) };
+    BOOST_TEST(std::string(text, micros.format_timestamp(1220252400123456LL, text)) == "2008-09-01 07:00:00.123456");
+    BOOST_TEST(std::string(text, micros.format_timestamp(1220252401000000LL, text)) == "2008-09-01 07:00:01.000000");
+    BOOST_TEST(std::string(text, micros.format_timestamp(-1LL, text)) == "1969-12-31 23:59:59.999999");
+    BOOST_TEST(std::string(text, micros.format_timestamp(951782400000000LL, text)) == "2000-02-29 00:00:00.000000");
+    ColFormatter secs{ ColFormatter::timestamp(1, plain) };
+    BOOST_TEST(std::string(text, secs.format_timestamp(1220252400, text)) == "2008-09-01 07:00:00");
+    ColFormatSpec time_ms{ 3, false, false, true };
+    ColFormatter nanos{ ColFormatter::timestamp(1000000000, time_ms) };
+    BOOST_TEST(std::string(text, nanos.format_timestamp(1220252400123456789LL, text)) == "07:00:00.123");
+    ColFormatSpec date_only{ -1, false, true, false };
+    ColFormatter millis{ ColFormatter::timestamp(1000, date_only) };
+    BOOST_TEST(std::string(text, millis.format_timestamp(1220252400123LL, text)) == "2008-09-01");
+    ColFormatter dates{ cfkDate, plain };
+    BOOST_TEST(std::string(text, dates.format_date(-1, text)) == "1969-12-31");
+    // cspec: named columns win over *
+    std::vector<ColFormatSpec> specs{ parse_col_formats("*:';Price:'.2;Time:T", { "Price", "Time", "Qty" }) };
+    BOOST_TEST(specs[0].precision == 2);
+    BOOST_TEST(specs[0].thousands);
+    BOOST_TEST(specs[1].time_only);
+    BOOST_TEST(!specs[1].thousands);
+    BOOST_TEST(specs[2].thousands);
+    BOOST_TEST(specs[2].precision == -1);
+    // the old DECIMAL path, per cell, against a compiled formatter
+    const uint32_t cells{ 1000000 };
+    char format_buffer[16];
+    double sink{ 0.0 };
+    boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+    for (uint32_t cell = 0; cell < cells; cell++) {
+        double divisor = pow(10, 3);
+        sprintf(format_buffer, "%%.%df", 3);
+        sprintf(text, format_buffer, static_cast<double>(cell) / divisor);
+        sink += text[0];
+    }
+    boost::chrono::duration<double> old_secs = boost::chrono::steady_clock::now() - start;
+    start = boost::chrono::steady_clock::now();
+    for (uint32_t cell = 0; cell < cells; cell++) {
+        dec3.format_decimal(static_cast<int64_t>(cell), text);
+        sink += text[0];
+    }
+    boost::chrono::duration<double> new_secs = boost::chrono::steady_clock::now() - start;
+    std::cout << "ColFormatterText: DECIMAL sprintf(" << old_secs.count() << "s) formatter("
+        << new_secs.count() << "s) for " << cells << " cells" << std::endl;
+    BOOST_TEST(sink > 0.0);
+}
+
+BOOST_AUTO_TEST_CASE(DBMessageJson)
+{
+    // the duck_module.js boundary: requests out, results in
+    DBMsg db_request;
+    db_request.type = dbBatchRequest;
+    db_request.qid = "depth_select";
+    db_request.serial = 3;
+    db_request.max_rows = 1000;
+    nlohmann::json js_request = db_message_to_json(db_request);
+    BOOST_TEST(JAsString(js_request, Static::nd_type_cs) == Static::batch_request_cs);
+    BOOST_TEST(JAsInt(js_request, Static::serial_cs) == 3);
+    BOOST_TEST(JAsInt(js_request, Static::max_rows_cs) == 1000);
+    BOOST_TEST(!JContains(js_request, Static::sql_cs));
+    BOOST_TEST(!JContains(js_request, Static::timeout_ms_cs));
+
+    DBMsg prepared_request;
+    prepared_request.type = dbQuery;
+    prepared_request.qid = "depth_select";
+    prepared_request.sql = "select * from depth where Instrument=$1 and Date>=$2 and Bid>$3;";
+    prepared_request.prepared = true;
+    prepared_request.params.push_back(DBParam{ cdStr, 0, 0.0, false, "FGBMU8" });
+    prepared_request.params.push_back(DBParam{ cdStr, 0, 0.0, false, "2008-09-01" });
+    prepared_request.params.push_back(DBParam{});    // NULL
+    nlohmann::json js_prepared = db_message_to_json(prepared_request);
+    BOOST_TEST(JAsBool(js_prepared, Static::prepared_cs));
+    BOOST_TEST(JSize(js_prepared[Static::params_cs]) == 3);
+    BOOST_TEST(js_prepared[Static::params_cs][0] == "FGBMU8");
+    BOOST_TEST(js_prepared[Static::params_cs][2].is_null());
+
+    nlohmann::json js_result = JParse<nlohmann::json>(
+        R"({"nd_type":"BatchResponse","query_id":"depth_select","serial":3,"chunk":4096,)"
+        R"("chunk_count":2,"done":true,"row_count":4000,"truncated":true})");
+    DBMsg db_result{ db_message_from_json(js_result) };
+    BOOST_TEST(db_result.type == dbBatchResponse);
+    BOOST_TEST(db_result.qid == "depth_select");
+    BOOST_TEST(db_result.serial == 3);
+    BOOST_TEST(db_result.chunk == 4096);
+    BOOST_TEST(db_result.chunk_count == 2);
+    BOOST_TEST(db_result.row_count == 4000);
+    BOOST_TEST(db_result.done);
+    BOOST_TEST(db_result.truncated);
+    BOOST_TEST(db_result.error == 0);
+
+    DBMsg cancelled{ db_message_from_json(JParse<nlohmann::json>(
+        R"({"nd_type":"Cancelled","query_id":"depth_select","db_action":"Query","error":1})")) };
+    BOOST_TEST(cancelled.type == dbCancelled);
+    BOOST_TEST(cancelled.db_action == dbQuery);
+    BOOST_TEST(cancelled.error == 1);
+}
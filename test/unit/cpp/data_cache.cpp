@@ -43,6 +43,27 @@ static const char* min_menu_pop_layout_cs{
     R"( }] )"
 };
 
+// a prepared Query bound to a Combo's selection and a date
+static const char* prepared_action_data_cs{
+    R"( { )"
+    R"(   "instruments":["FGBMU8", "FGBMZ8"], )"
+    R"(   "selected_instrument":0, )"
+    R"(   "start_date":[2008, 9, 1], )"
+    R"(   "depth_sql":"select * from depth where Instrument=$1 and Date>=$2;", )"
+    R"(   "actions":{ )"
+    R"(     "DuckDB.Online":[ )"
+    R"(       {"db_action":"Query", "query_id":"the_depth_query", "sql_cname":"depth_sql", )"
+    R"(        "params":[{"cname":"instruments", "cindex":"selected_instrument"}, {"cname":"start_date"}]}, )"
+    R"(       {"db_action":"BatchRequest", "query_id":"the_depth_query"} )"
+    R"(     ], )"
+    R"(     "DuckDB.CommandResult":[ )"
+    R"(       {"db_action":"Query", "query_id":"the_bad_query", "sql_cname":"depth_sql", )"
+    R"(        "params":[{"cname":"no_such_address"}]} )"
+    R"(     ] )"
+    R"(   } )"
+    R"( } )"
+};
+
 template <typename JSON>
 struct TestDLC : public DataLayCache<JSON> {
     void on_init() {
@@ -501,3 +522,29 @@ BOOST_FIXTURE_TEST_CASE(ExfServerLayout, DataCacheFixture)
     assert_cache_state();
 }
 
+
+BOOST_FIXTURE_TEST_CASE(PreparedActionParams, DataCacheFixture)
+{
+    auto data = JParse<nlohmann::json>(prepared_action_data_cs);
+    auto layout = JParse<nlohmann::json>(Static::empty_list_cs);
+
+    dc.on_json(data, layout, [&]() { dc.on_init(); });
+    dc.report_actions();
+    BOOST_TEST(dc.action_map_size() == 2);
+    // the_bad_query is dropped for its unknown param address
+    BOOST_TEST(dc.error_count() == 1);
+    // instruments, selected_instrument and start_date
+    BOOST_TEST(dc.bound_action_map_size() == 3);
+    const char* bound_addrs[3] = { "instruments", "selected_instrument", "start_date" };
+    for (const char* addr : bound_addrs) {
+        const std::vector<BoundAction>* bound_vec = dc.get_bound_actions(dc.get_addr_inx(addr)());
+        BOOST_TEST_REQUIRE(bound_vec != nullptr);
+        BOOST_TEST(bound_vec->size() == 1);
+        const NDAction& action{ (*bound_vec)[0].sequence->at((*bound_vec)[0].inx) };
+        BOOST_TEST(action.db_action == dbQuery);
+        BOOST_TEST(action.params.size() == 2);
+        BOOST_TEST(action.params[0].cindex.is_valid());
+        BOOST_TEST(!action.params[1].cindex.is_valid());
+    }
+    BOOST_TEST(dc.get_bound_actions(dc.get_addr_inx("depth_sql")()) == nullptr);
+}
@@ -25,6 +25,19 @@ extern "C" {
         std::cout << std::endl;
     }
 
+    // v2 chunks carry values only, so we keep the last schema
+    // batch_materializer sent to walk them
+    static StringVec schema_names;
+    static IntVec schema_types;
+
+    void on_schema_cpp(const char* qid, const char* schema) {
+        const static char* method = "on_schema_cpp";
+        emscripten::val jschema = emscripten::val::global("JSON").call<emscripten::val>("parse", std::string(schema));
+        schema_names = emscripten::vecFromJSArray<std::string>(jschema["names"]);
+        schema_types = emscripten::vecFromJSArray<int>(jschema["types"]);
+        printf("%s: qid: %s, schema: %s\n", method, qid, schema);
+    }
+
     int get_chunk_cpp(const char* qid, int size) {
         const static char* method = "get_chunk_cpp";
         // batch_materializer calls us to get a handle on WASM memory
@@ -40,67 +53,37 @@ extern "C" {
     void on_chunk_cpp(int* chunk) {
         const static char* method = "on_chunk_cpp";
         uint32_t* chunk_ptr = reinterpret_cast<uint32_t*>(chunk);
-        printf("%s: METADATA\n", method);
-        // First 3 words are done, col_count, row_count
-        int bptr = 0;
-        int done = chunk_ptr[bptr++];
-        int col_count = chunk_ptr[bptr++];
-        int row_count = chunk_ptr[bptr++];
-        printf("%s: done: %d, col_count: %d, row_count: %d\n", method, done, col_count, row_count);
-        // next col_count words are the types
-        printf("%s: types:", method);
-        for (int i = 0; i < col_count; i++) {
-            WasmDuckType tipe{ static_cast<int32_t>(chunk_ptr[bptr++]) };
-            const char* dt = WasmDuckTypeToString(tipe);
-            printf("%d/%s", tipe, dt);
-            printf_comma(i, col_count);
-        }
-        // next col_count words are the col addrs
+        // v2: row count, then values and validity offsets per column
+        int col_count = static_cast<int>(schema_types.size());
+        int row_count = wasm_chunk_rows(chunk_ptr);
+        printf("%s: col_count: %d, row_count: %d\n", method, col_count, row_count);
         printf("%s: caddr:", method);
         for (int i = 0; i < col_count; i++) {
-            uint32_t* col_addr = reinterpret_cast<uint32_t*>(chunk_ptr[bptr++]);
-            printf("%d/%d", i, col_addr);
+            printf("%d/%d/%d", i, chunk_ptr[1 + i * 2], chunk_ptr[2 + i * 2]);
             printf_comma(i, col_count);
         }
-        // next col_count zero terminated ASCII strings
-        std::vector<std::string> col_names;
-        printf("%s: names:", method);
-        for (int i = 0; i < col_count; i++) {
-            std::string name;
-            while (chunk[bptr] != 0) {
-                name.push_back(chunk[bptr]);
-                bptr++;
-            }
-            printf("%s", name.c_str());
-            printf_comma(i, col_count);
-            bptr++;
-            col_names.push_back(name);
-        }
-        // And now the columns themselves. Each one has
-        // a type(32),row_count(32) preamble. We check the
-        // lo bit of bptr first to see if it's "odd" ie on
-        // a 4 byte boundary.
-        printf("%s: COLUMNS bptr(%d)\n", method, bptr);
+        // And now the columns themselves, each on an 8 byte boundary
         char cbuf[128];
         for (int i = 0; i < col_count; i++) {
-            // mv bptr fwd to next 8 byte boundary
-            if (bptr & 1) {
-                bptr++;
-                printf("%s: incremented bptr to %d\n", method, bptr);
-            }
-            else {
-                printf("%s:             bptr on %d\n", method, bptr);
+            int32_t tipe = schema_types[i];
+            int bptr = chunk_ptr[1 + i * 2];
+            if (bptr & 1)
+                printf("%s: col(%d) bptr(%d) not 8 byte aligned\n", method, i, bptr);
+            printf("%s type(%d) rows(%d)\n", schema_names[i].c_str(), tipe, row_count);
+            int stride = WasmDuckTypeToSize(static_cast<WasmDuckType>(tipe)) / 4;    // 1 for 4 bytes, 2 for 8 bytes
+            if (tipe == wdtUtf8) {
+                // offsets, then the heap they index
+                const int32_t* offsets = reinterpret_cast<const int32_t*>(chunk_ptr + bptr);
+                const char* heap = wasm_utf8_heap(chunk_ptr + bptr, row_count);
+                for (int row : { 0, 1, row_count - 2, row_count - 1 }) {
+                    printf("[%d]=%.*s\n", row, offsets[row + 1] - offsets[row], heap + offsets[row]);
+                }
+                continue;
             }
-            int32_t tipe = chunk_ptr[bptr++];
-            uint32_t stored_sz = chunk_ptr[bptr++];
-            const std::string& name(col_names[i]);
-            printf("%s type(%d) sz(%d) rows(%d)\n", name.c_str(), tipe, stored_sz, row_count);
-            int stride = stored_sz / 4;    // 1 for 4 bytes, 2 for 8 bytes
             sprintf_value(cbuf, chunk_ptr, bptr, tipe, 0);
             sprintf_value(cbuf, chunk_ptr, bptr+stride, tipe, 1);
             sprintf_value(cbuf, chunk_ptr, bptr+(stride*(row_count-2)), tipe, row_count-2);
             sprintf_value(cbuf, chunk_ptr, bptr+(stride*(row_count-1)), tipe, row_count-1);
-            bptr += stride * row_count;
         }
     }
 };
\ No newline at end of file
@@ -0,0 +1,269 @@
+#define BOOST_TEST_MODULE SIMD_Kernels_Tests
+#include <boost/test/unit_test.hpp>
+#include <boost/chrono.hpp>
+#include <cmath>
+#include <random>
+#include <vector>
+#include "zone_map.hpp"
+
+// The simd_kernels.hpp stats and widening kernels against the scalar
+// loops zone_scan and next_range used to have. The results must match
+// exactly, bar sum, whose vector adds are reordered. Run a Release build
+// for the elements/sec figures; they are printed, not checked.
+
+using Clock = boost::chrono::steady_clock;
+
+static constexpr uint32_t ROWS = 2048;          // CHUNK_SIZE
+static constexpr uint32_t BENCH_PASSES = 2000;
+
+// zone_scan before simd_kernels.hpp
+template <typename T>
+void old_zone_scan(ColumnZone& zone, const T* data, const uint64_t* validity,
+                    uint32_t begin, uint32_t end, double divisor = 1.0) {
+    zone.numeric = true;
+    zone.row_count += end - begin;
+    double prev = std::numeric_limits<double>::lowest();
+    for (uint32_t inx = begin; inx < end; inx++) {
+        if (!zone_row_is_valid(validity, inx)) {
+            zone.null_count++;
+            continue;
+        }
+        double val = static_cast<double>(data[inx]) / divisor;
+        if (val < prev)
+            zone.sorted = false;
+        prev = val;
+        if (val < zone.min) zone.min = val;
+        if (val > zone.max) zone.max = val;
+    }
+}
+
+static std::vector<uint64_t> make_validity(std::mt19937& gen, uint32_t null_pct) {
+    std::vector<uint64_t> validity(ROWS / 64, ~0ull);
+    std::uniform_int_distribution<uint32_t> pct(0, 99);
+    for (uint32_t row = 0; row < ROWS; row++) {
+        if (pct(gen) < null_pct)
+            validity[row >> 6] &= ~(1ull << (row & 63));
+    }
+    return validity;
+}
+
+template <typename T>
+void check_zone(const T* data, const uint64_t* validity, uint32_t begin, uint32_t end, double divisor = 1.0) {
+    ColumnZone old_zone;
+    ColumnZone new_zone;
+    old_zone_scan(old_zone, data, validity, begin, end, divisor);
+    zone_scan(new_zone, data, validity, begin, end, divisor);
+    BOOST_TEST(old_zone.row_count == new_zone.row_count);
+    BOOST_TEST(old_zone.null_count == new_zone.null_count);
+    BOOST_TEST(old_zone.sorted == new_zone.sorted);
+    BOOST_TEST(old_zone.has_values() == new_zone.has_values());
+    if (old_zone.has_values()) {
+        BOOST_TEST(old_zone.min == new_zone.min);
+        BOOST_TEST(old_zone.max == new_zone.max);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(StatsMatchScalar)
+{
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<double> dbl_dist(-1e6, 1e6);
+    std::uniform_int_distribution<int32_t> int_dist(-1000000, 1000000);
+    std::uniform_int_distribution<int64_t> i64_dist(std::numeric_limits<int64_t>::min(),
+                                                    std::numeric_limits<int64_t>::max());
+    std::vector<double> dbls(ROWS);
+    std::vector<int32_t> ints(ROWS);
+    std::vector<int64_t> i64s(ROWS);
+    for (uint32_t row = 0; row < ROWS; row++) {
+        dbls[row] = dbl_dist(gen);
+        ints[row] = int_dist(gen);
+        i64s[row] = i64_dist(gen);
+    }
+    // NaNs are skipped by min,max in both
+    dbls[7] = std::nan("");
+    dbls[1500] = std::nan("");
+    for (uint32_t null_pct : { 0u, 1u, 50u, 100u }) {
+        std::vector<uint64_t> validity = make_validity(gen, null_pct);
+        // odd slices exercise the scalar heads and tails
+        for (auto slice : { std::make_pair(0u, ROWS), std::make_pair(3u, 1001u), std::make_pair(64u, 67u),
+                            std::make_pair(100u, 100u), std::make_pair(1u, ROWS - 1) }) {
+            check_zone(dbls.data(), validity.data(), slice.first, slice.second);
+            check_zone(ints.data(), validity.data(), slice.first, slice.second);
+            check_zone(ints.data(), validity.data(), slice.first, slice.second, 100.0);
+            check_zone(i64s.data(), validity.data(), slice.first, slice.second);
+            check_zone(dbls.data(), nullptr, slice.first, slice.second);
+            check_zone(i64s.data(), nullptr, slice.first, slice.second, 1e6);
+            BOOST_TEST(simd_count_valid(validity.data(), slice.first, slice.second)
+                == slice.second - slice.first - [&]() {
+                    uint32_t nulls{ 0 };
+                    for (uint32_t row = slice.first; row < slice.second; row++)
+                        nulls += zone_row_is_valid(validity.data(), row) ? 0 : 1;
+                    return nulls; }());
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(SortedAcrossLanes)
+{
+    std::vector<int64_t> ts(ROWS);
+    for (uint32_t row = 0; row < ROWS; row++)
+        ts[row] = 1700000000000000LL + row * 1000LL;
+    ColumnZone zone;
+    zone_scan(zone, ts.data(), nullptr, 0, ROWS);
+    BOOST_TEST(zone.sorted);
+    BOOST_TEST(zone.min == 1700000000000000.0);
+    // one step back at each lane position, and across the vector boundary
+    for (uint32_t row : { 4u, 5u, 6u, 7u, 8u, ROWS - 1 }) {
+        std::vector<int64_t> unsorted(ts);
+        unsorted[row] = unsorted[row - 1] - 1;
+        ColumnZone uzone;
+        zone_scan(uzone, unsorted.data(), nullptr, 0, ROWS);
+        BOOST_TEST(!uzone.sorted, "row " << row);
+    }
+    // a null between two rows that are out of order hides nothing
+    std::vector<uint64_t> validity(ROWS / 64, ~0ull);
+    std::vector<int64_t> gap(ts);
+    gap[100] = 0;
+    gap[101] = gap[99] - 1;
+    validity[100 >> 6] &= ~(1ull << (100 & 63));
+    ColumnZone gzone;
+    zone_scan(gzone, gap.data(), validity.data(), 0, ROWS);
+    BOOST_TEST(!gzone.sorted);
+    BOOST_TEST(gzone.null_count == 1);
+}
+
+BOOST_AUTO_TEST_CASE(WidenMatchesCast)
+{
+    std::mt19937 gen(7);
+    std::uniform_int_distribution<int32_t> int_dist(std::numeric_limits<int32_t>::min(),
+                                                    std::numeric_limits<int32_t>::max());
+    std::uniform_int_distribution<int64_t> i64_dist(std::numeric_limits<int64_t>::min(),
+                                                    std::numeric_limits<int64_t>::max());
+    std::vector<int32_t> ints(ROWS + 3);
+    std::vector<int64_t> i64s(ROWS + 3);
+    for (uint32_t row = 0; row < ROWS + 3; row++) {
+        ints[row] = int_dist(gen);
+        i64s[row] = i64_dist(gen);
+    }
+    i64s[0] = std::numeric_limits<int64_t>::min();
+    i64s[1] = std::numeric_limits<int64_t>::max();
+    i64s[2] = -1;
+    i64s[3] = (1LL << 53) + 1;     // rounds
+    std::vector<double> out(ROWS + 3);
+    simd_widen(ints.data(), out.data(), ROWS + 3);
+    uint32_t bad{ 0 };
+    for (uint32_t row = 0; row < ROWS + 3; row++)
+        bad += out[row] == static_cast<double>(ints[row]) ? 0 : 1;
+    BOOST_TEST(bad == 0);
+    simd_widen(i64s.data(), out.data(), ROWS + 3);
+    for (uint32_t row = 0; row < ROWS + 3; row++)
+        bad += out[row] == static_cast<double>(i64s[row]) ? 0 : 1;
+    BOOST_TEST(bad == 0);
+    simd_widen(i64s.data(), out.data(), ROWS + 3, 1e6);
+    for (uint32_t row = 0; row < ROWS + 3; row++)
+        bad += out[row] == static_cast<double>(i64s[row]) / 1e6 ? 0 : 1;
+    BOOST_TEST(bad == 0);
+}
+
+// Nulls become NaN across word boundaries, from a mid word begin, and
+// an all valid slice is handed back untouched
+BOOST_AUTO_TEST_CASE(NanNullsMatchValidity)
+{
+    std::mt19937 gen(11);
+    std::vector<uint64_t> validity{ make_validity(gen, 10) };
+    std::vector<double> data(ROWS);
+    for (uint32_t row = 0; row < ROWS; row++)
+        data[row] = row;
+    std::vector<double> buf(ROWS);
+    for (uint32_t begin : { 0u, 5u, 63u, 64u, 1000u }) {
+        uint32_t n = std::min(700u, ROWS - begin);
+        double* out = simd_nan_nulls(data.data() + begin, validity.data(), begin, n, buf.data());
+        BOOST_TEST(out == buf.data());
+        uint32_t bad{ 0 };
+        for (uint32_t inx = 0; inx < n; inx++) {
+            bool valid = zone_row_is_valid(validity.data(), begin + inx);
+            bad += valid == !std::isnan(out[inx]) && (!valid || out[inx] == begin + inx) ? 0 : 1;
+        }
+        BOOST_TEST(bad == 0);
+    }
+    // the source is never written
+    uint32_t written{ 0 };
+    for (uint32_t row = 0; row < ROWS; row++)
+        written += data[row] == row ? 0 : 1;
+    BOOST_TEST(written == 0);
+    std::vector<uint64_t> all_valid(ROWS / 64, ~0ull);
+    BOOST_TEST(simd_nan_nulls(data.data(), all_valid.data(), 0, ROWS, buf.data()) == data.data());
+    BOOST_TEST(simd_nan_nulls(data.data(), nullptr, 0, ROWS, buf.data()) == data.data());
+}
+
+template <typename FUNC>
+double elements_per_sec(FUNC func) {
+    Clock::time_point start = Clock::now();
+    for (uint32_t pass = 0; pass < BENCH_PASSES; pass++)
+        func();
+    boost::chrono::duration<double> secs = Clock::now() - start;
+    return static_cast<double>(ROWS) * BENCH_PASSES / secs.count();
+}
+
+template <typename T>
+void bench_stats(const char* label, const std::vector<T>& data, const uint64_t* validity) {
+    double sink{ 0.0 };
+    double old_eps = elements_per_sec([&]() {
+        ColumnZone zone;
+        old_zone_scan(zone, data.data(), validity, 0, ROWS);
+        sink += zone.max;
+    });
+    double new_eps = elements_per_sec([&]() {
+        ColumnZone zone;
+        zone_scan(zone, data.data(), validity, 0, ROWS);
+        sink += zone.max;
+    });
+    std::cout << label << ": scalar(" << old_eps / 1e6 << "M/s) simd(" << new_eps / 1e6
+        << "M/s) x" << new_eps / old_eps << (sink == 0.0 ? " " : "") << std::endl;
+}
+
+BOOST_AUTO_TEST_CASE(Benchmark)
+{
+    std::mt19937 gen(1);
+    std::vector<double> dbls(ROWS);
+    std::vector<int32_t> ints(ROWS);
+    std::vector<int64_t> i64s(ROWS);
+    for (uint32_t row = 0; row < ROWS; row++) {
+        dbls[row] = std::uniform_real_distribution<double>(0, 1000)(gen);
+        ints[row] = static_cast<int32_t>(row);
+        i64s[row] = 1700000000000000LL + row * 1000LL;
+    }
+    std::vector<uint64_t> sparse_nulls = make_validity(gen, 1);
+#ifdef ND_SIMD_AVX2
+    std::cout << "avx2: " << simd_has_avx2() << std::endl;
+#endif
+    bench_stats("min,max double", dbls, nullptr);
+    bench_stats("min,max double 1% null", dbls, sparse_nulls.data());
+    bench_stats("min,max int32", ints, nullptr);
+    bench_stats("min,max timestamp", i64s, nullptr);
+
+    static double dbl_buf[ROWS];
+    double sink{ 0.0 };
+    double old_eps = elements_per_sec([&]() {
+        for (uint32_t i = 0; i < ROWS; i++)
+            dbl_buf[i] = static_cast<double>(ints[i]);
+        sink += dbl_buf[ROWS - 1];
+    });
+    double new_eps = elements_per_sec([&]() {
+        simd_widen(ints.data(), dbl_buf, ROWS);
+        sink += dbl_buf[ROWS - 1];
+    });
+    std::cout << "widen int32: scalar(" << old_eps / 1e6 << "M/s) simd(" << new_eps / 1e6
+        << "M/s) x" << new_eps / old_eps << std::endl;
+    old_eps = elements_per_sec([&]() {
+        for (uint32_t i = 0; i < ROWS; i++)
+            dbl_buf[i] = static_cast<double>(i64s[i]);
+        sink += dbl_buf[ROWS - 1];
+    });
+    new_eps = elements_per_sec([&]() {
+        simd_widen(i64s.data(), dbl_buf, ROWS);
+        sink += dbl_buf[ROWS - 1];
+    });
+    std::cout << "widen timestamp: scalar(" << old_eps / 1e6 << "M/s) simd(" << new_eps / 1e6
+        << "M/s) x" << new_eps / old_eps << std::endl;
+    BOOST_TEST(sink > 0.0);
+}
@@ -0,0 +1,259 @@
+#define BOOST_TEST_MODULE SPSC_Tests
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <queue>
+#include <vector>
+#include "spsc_ring.hpp"
+
+// Handoff latency and render thread jitter for the GUI<->DB queues:
+// the mutex, std::queue and condition_variable scheme BBDuckDBCache
+// used to have, against SPSCRing plus Doorbell. Run a Release build;
+// the timings are printed, and only the message counts are checked.
+
+using Clock = boost::chrono::steady_clock;
+using Nanos = boost::chrono::nanoseconds;
+
+static constexpr uint32_t MSG_COUNT = 20000;
+static constexpr uint32_t FRAME_COUNT = 2000;
+
+struct Stats {
+    std::vector<int64_t> samples;
+
+    void add(Nanos ns) { samples.push_back(ns.count()); }
+
+    int64_t percentile(double p) {
+        if (samples.empty())
+            return 0;
+        std::sort(samples.begin(), samples.end());
+        size_t inx = static_cast<size_t>(p * (samples.size() - 1));
+        return samples[inx];
+    }
+
+    void report(const char* label) {
+        std::cout << label << ": n(" << samples.size() << ") p50(" << percentile(0.5)
+            << "ns) p99(" << percentile(0.99) << "ns) max(" << percentile(1.0) << "ns)" << std::endl;
+    }
+};
+
+// The old scheme: GUI pushes under a mutex and notifies, the DB
+// thread waits on the condition, and vice versa for results
+struct LockedQueue {
+    std::queue<Clock::time_point>   queue;
+    boost::mutex                    mutex;
+    boost::condition_variable       cond;
+
+    void push(Clock::time_point t) {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            queue.push(t);
+        }
+        cond.notify_one();
+    }
+
+    bool wait_pop(Clock::time_point& t) {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (!cond.wait_for(lock, boost::chrono::milliseconds(100), [this]() { return !queue.empty(); }))
+            return false;
+        t = queue.front();
+        queue.pop();
+        return true;
+    }
+
+    // like get_db_responses: lock and swap on every frame
+    size_t drain(std::queue<Clock::time_point>& out) {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        queue.swap(out);
+        return out.size();
+    }
+};
+
+BOOST_AUTO_TEST_CASE(RingOrderAndCapacity)
+{
+    SPSCRing<uint32_t, 8> ring;
+    uint32_t val{ 0 };
+    BOOST_TEST(ring.empty());
+    BOOST_TEST(!ring.try_pop(val));
+    for (uint32_t i = 0; i < 8; i++) {
+        BOOST_TEST(ring.try_push(i));
+    }
+    BOOST_TEST(!ring.try_push(99u));   // full
+    BOOST_TEST(ring.size() == 8);
+    for (uint32_t i = 0; i < 8; i++) {
+        BOOST_TEST(ring.try_pop(val));
+        BOOST_TEST(val == i);
+    }
+    BOOST_TEST(ring.empty());
+    // wrap around
+    for (uint32_t i = 0; i < 20; i++) {
+        BOOST_TEST(ring.try_push(i));
+        BOOST_TEST(ring.try_pop(val));
+        BOOST_TEST(val == i);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(RingCrossThread)
+{
+    SPSCRing<uint32_t, 64> ring;
+    Doorbell bell;
+    uint64_t sum{ 0 };
+    uint32_t next{ 0 };
+    bool in_order{ true };
+    boost::thread consumer([&]() {
+        uint32_t val{ 0 };
+        while (next < MSG_COUNT) {
+            uint32_t key = bell.key();
+            if (!ring.try_pop(val)) {
+                bell.wait_for(key, boost::chrono::milliseconds(100));
+                continue;
+            }
+            in_order = in_order && val == next;
+            sum += val;
+            next++;
+        }
+    });
+    for (uint32_t i = 0; i < MSG_COUNT; i++) {
+        while (!ring.try_push(i)) {
+            boost::this_thread::yield();
+        }
+        bell.ring();
+    }
+    consumer.join();
+    BOOST_TEST(in_order);
+    BOOST_TEST(sum == static_cast<uint64_t>(MSG_COUNT) * (MSG_COUNT - 1) / 2);
+}
+
+// WordRing's producer is materialize.js, which only knows the word
+// layout, so push as it does: slot, then tail, by word index
+BOOST_AUTO_TEST_CASE(WordRingLayout)
+{
+    using Ring = WordRing<4>;
+    Ring ring;
+    uint32_t* words = reinterpret_cast<uint32_t*>(&ring);
+    BOOST_TEST(words[Ring::capacity_word] == 4u);
+    uint32_t val{ 0 };
+    BOOST_TEST(!ring.try_pop(val));
+    for (uint32_t i = 0; i < 10; i++) {
+        uint32_t tail = words[Ring::tail_word];
+        BOOST_TEST(tail - words[Ring::head_word] < 4u);
+        words[Ring::slots_word + (tail & 3)] = 1000 + i;
+        words[Ring::tail_word] = tail + 1;
+        BOOST_TEST(ring.try_pop(val));
+        BOOST_TEST(val == 1000 + i);
+        BOOST_TEST(words[Ring::head_word] == i + 1);
+    }
+    for (uint32_t i = 0; i < 4; i++) {
+        BOOST_TEST(ring.try_push(i));
+    }
+    BOOST_TEST(!ring.try_push(99u));   // full
+    BOOST_TEST(ring.try_pop(val));
+    BOOST_TEST(val == 0u);
+}
+
+// GUI -> DB handoff: time from push to the DB thread waking with it.
+// Messages are spaced out so the consumer is usually asleep, which is
+// the common case for db_loop.
+BOOST_AUTO_TEST_CASE(HandoffLatency)
+{
+    const uint32_t count{ 2000 };
+    Stats locked_stats;
+    {
+        LockedQueue lq;
+        boost::thread consumer([&]() {
+            Clock::time_point t;
+            for (uint32_t i = 0; i < count; i++) {
+                if (lq.wait_pop(t))
+                    locked_stats.add(Clock::now() - t);
+            }
+        });
+        for (uint32_t i = 0; i < count; i++) {
+            lq.push(Clock::now());
+            boost::this_thread::sleep_for(boost::chrono::microseconds(50));
+        }
+        consumer.join();
+    }
+    Stats ring_stats;
+    {
+        SPSCRing<Clock::time_point, 256> ring;
+        Doorbell bell;
+        boost::thread consumer([&]() {
+            Clock::time_point t;
+            uint32_t received{ 0 };
+            while (received < count) {
+                uint32_t key = bell.key();
+                if (!ring.try_pop(t)) {
+                    if (!bell.wait_for(key, boost::chrono::milliseconds(100)) && ring.empty())
+                        break;
+                    continue;
+                }
+                ring_stats.add(Clock::now() - t);
+                received++;
+            }
+        });
+        for (uint32_t i = 0; i < count; i++) {
+            while (!ring.try_push(Clock::now())) {
+                boost::this_thread::yield();
+            }
+            bell.ring();
+            boost::this_thread::sleep_for(boost::chrono::microseconds(50));
+        }
+        consumer.join();
+    }
+    locked_stats.report("handoff mutex+condvar");
+    ring_stats.report("handoff spsc+doorbell");
+    BOOST_TEST(locked_stats.samples.size() == count);
+    BOOST_TEST(ring_stats.samples.size() == count);
+}
+
+// DB -> GUI: a producer streams results flat out while the render
+// thread drains once per simulated frame. We time the drain call,
+// which is what a frame pays, so its spread is the jitter.
+BOOST_AUTO_TEST_CASE(FrameJitter)
+{
+    Stats locked_stats;
+    uint64_t locked_received{ 0 };
+    {
+        LockedQueue lq;
+        boost::atomic<bool> stop{ false };
+        boost::thread producer([&]() {
+            while (!stop)
+                lq.push(Clock::now());
+        });
+        std::queue<Clock::time_point> out;
+        for (uint32_t frame = 0; frame < FRAME_COUNT; frame++) {
+            Clock::time_point start = Clock::now();
+            locked_received += lq.drain(out);
+            locked_stats.add(Clock::now() - start);
+            out = std::queue<Clock::time_point>();
+            boost::this_thread::sleep_for(boost::chrono::microseconds(200));
+        }
+        stop = true;
+        producer.join();
+    }
+    Stats ring_stats;
+    uint64_t ring_received{ 0 };
+    {
+        SPSCRing<Clock::time_point, 1024> ring;
+        boost::atomic<bool> stop{ false };
+        boost::thread producer([&]() {
+            while (!stop) {
+                if (!ring.try_push(Clock::now()))
+                    boost::this_thread::yield();
+            }
+        });
+        Clock::time_point t;
+        for (uint32_t frame = 0; frame < FRAME_COUNT; frame++) {
+            Clock::time_point start = Clock::now();
+            while (ring.try_pop(t))
+                ring_received++;
+            ring_stats.add(Clock::now() - start);
+            boost::this_thread::sleep_for(boost::chrono::microseconds(200));
+        }
+        stop = true;
+        producer.join();
+    }
+    locked_stats.report("frame drain mutex+condvar");
+    ring_stats.report("frame drain spsc");
+    std::cout << "received: mutex+condvar(" << locked_received << ") spsc(" << ring_received << ")" << std::endl;
+    BOOST_TEST(locked_stats.samples.size() == FRAME_COUNT);
+    BOOST_TEST(ring_stats.samples.size() == FRAME_COUNT);
+}
@@ -0,0 +1,128 @@
+// materialize_worker.js under node worker_threads: a shared WebAssembly
+// Memory stands in for the WASM heap, with a WordRing laid out as
+// spsc_ring.hpp does, so no browser or C++ build is needed.
+import { Worker } from "node:worker_threads";
+import {
+  ChunkQueueWords,
+  ChunkType,
+  chunk_layout,
+  column_buffers,
+} from "../../../src/web/materialize.js";
+
+const QUEUE_ADDR = 64;
+const QUEUE_CAPACITY = 4;
+const CHUNK_ADDR = 4096;
+
+function new_heap() {
+  let memory = new WebAssembly.Memory({ initial: 1, maximum: 16, shared: true });
+  let queue = new Int32Array(memory.buffer, QUEUE_ADDR, ChunkQueueWords.slots + QUEUE_CAPACITY);
+  queue[ChunkQueueWords.capacity] = QUEUE_CAPACITY;
+  return { memory, queue };
+}
+
+function start_worker(heap) {
+  let worker = new Worker(new URL("../../../src/web/materialize_worker.js", import.meta.url));
+  worker.postMessage({ nd_type: "Init", memory: heap.memory, chunk_queue: QUEUE_ADDR });
+  return worker;
+}
+
+function materialize(worker, job) {
+  return new Promise((resolve) => {
+    worker.once("message", resolve);
+    worker.postMessage(job, column_buffers(job.columns));
+  });
+}
+
+// As column_parts makes them from Arrow Data. Row 1 of dbl is null.
+function make_columns() {
+  let utf8 = new TextEncoder().encode("alphabetagamma");
+  return [
+    { type_id: ChunkType.Int, offset: 0, null_count: 0, values: new Int32Array([7, -8, 9]) },
+    {
+      type_id: ChunkType.Float,
+      offset: 0,
+      null_count: 1,
+      values: new Float64Array([1.5, 0, 3.5]),
+      null_bitmap: new Uint8Array([0b101]),
+    },
+    {
+      type_id: ChunkType.Utf8,
+      offset: 0,
+      null_count: 0,
+      values: utf8,
+      value_offsets: new Int32Array([0, 5, 9, 14]),
+    },
+    { type_id: ChunkType.Date, date_unit: 0, offset: 0, null_count: 0, values: new Int32Array([0, 1, 2]) },
+    { type_id: ChunkType.Timestamp, offset: 0, null_count: 0, values: new BigInt64Array([1n, 2n, 3n]) },
+    // an ENUM: Uint8 indices widen to int32 codes
+    { type_id: ChunkType.Dict, offset: 0, null_count: 0, values: new Uint8Array([2, 0, 2]) },
+  ];
+}
+
+describe("materialize_worker", () => {
+  it("fills the chunk in the shared heap and queues its address", async () => {
+    let heap = new_heap();
+    let worker = start_worker(heap);
+    let columns = make_columns();
+    let layout = chunk_layout(columns, 3);
+    let done = await materialize(worker, {
+      nd_type: "Materialize",
+      job_id: 1,
+      buffer_offset: CHUNK_ADDR,
+      row_count: 3,
+      layout: layout,
+      columns: columns,
+    });
+    await worker.terminate();
+    expect(done.job_id).toBe(1);
+    expect(done.buffer_offset).toBe(CHUNK_ADDR);
+    expect(done.error).toBeUndefined();
+    // transferred, not copied
+    expect(columns[0].values.length).toBe(0);
+
+    let words = new Uint32Array(heap.memory.buffer, CHUNK_ADDR, layout.words);
+    let col = (ic) => CHUNK_ADDR + words[1 + ic * 2] * 4;
+    expect(words[0]).toBe(3);
+    expect([...new Int32Array(heap.memory.buffer, col(0), 3)]).toEqual([7, -8, 9]);
+    expect(new Float64Array(heap.memory.buffer, col(1), 3)[2]).toBe(3.5);
+    // only dbl has a bitmap, 8 byte aligned, with row 1 null
+    expect(words[2]).toBe(0);
+    expect(words[4] % 2).toBe(0);
+    expect(new Uint8Array(heap.memory.buffer, CHUNK_ADDR + words[4] * 4, 8)[0]).toBe(0b101);
+    let offsets = new Int32Array(heap.memory.buffer, col(2), 4);
+    let strs = new TextDecoder().decode(new Uint8Array(heap.memory.buffer, col(2) + 16, offsets[3]));
+    expect(strs.slice(offsets[1], offsets[2])).toBe("beta");
+    expect([...new Float64Array(heap.memory.buffer, col(3), 3)]).toEqual([0, 86400000, 172800000]);
+    expect([...new BigInt64Array(heap.memory.buffer, col(4), 3)]).toEqual([1n, 2n, 3n]);
+    expect([...new Int32Array(heap.memory.buffer, col(5), 3)]).toEqual([2, 0, 2]);
+
+    expect(Atomics.load(heap.queue, ChunkQueueWords.tail)).toBe(1);
+    expect(heap.queue[ChunkQueueWords.slots]).toBe(CHUNK_ADDR);
+  });
+
+  it("waits for the render thread when the chunk queue is full", async () => {
+    let heap = new_heap();
+    let worker = start_worker(heap);
+    let chunks = [];
+    for (let job_id = 1; job_id <= QUEUE_CAPACITY + 2; job_id++) {
+      let columns = [{ type_id: ChunkType.Int, offset: 0, null_count: 0, values: new Int32Array([job_id]) }];
+      let buffer_offset = CHUNK_ADDR * job_id;
+      chunks.push(buffer_offset);
+      let job = { nd_type: "Materialize", job_id, buffer_offset, row_count: 1, layout: chunk_layout(columns, 1), columns };
+      worker.postMessage(job, column_buffers(columns));
+    }
+    // drain as WordRing::try_pop does, a frame at a time
+    let popped = [];
+    while (popped.length < chunks.length) {
+      await new Promise((resolve) => setTimeout(resolve, 5));
+      let head = Atomics.load(heap.queue, ChunkQueueWords.head);
+      let tail = Atomics.load(heap.queue, ChunkQueueWords.tail);
+      expect(tail - head).toBeLessThanOrEqual(QUEUE_CAPACITY);
+      for (; head != tail; head++)
+        popped.push(heap.queue[ChunkQueueWords.slots + (head & (QUEUE_CAPACITY - 1))]);
+      Atomics.store(heap.queue, ChunkQueueWords.head, head);
+    }
+    await worker.terminate();
+    expect(popped).toEqual(chunks);
+  });
+});
@@ -0,0 +1,44 @@
+// watermark.js: the marks duck_module.js keeps for Refresh, from columns
+// as column_parts makes them, and the SQL that fetches past them
+import { ChunkType } from "../../../src/web/materialize.js";
+import {
+  TimeUnit,
+  column_max,
+  later_mark,
+  mark_literal,
+  refresh_sql,
+} from "../../../src/web/watermark.js";
+
+describe("watermark", () => {
+  it("takes the max of a batch's valid rows", () => {
+    // a sliced batch: rows 1..4 of the buffers, row 3 null
+    let col = {
+      type_id: ChunkType.Float,
+      offset: 1,
+      null_count: 1,
+      values: new Float64Array([99, 3, 7, 42, 5]),
+      null_bitmap: new Uint8Array([0b10111]),
+    };
+    expect(column_max(col, 4)).toBe(7);
+    let ts = { type_id: ChunkType.Timestamp, offset: 0, null_count: 0, values: new BigInt64Array([5n, 9n, 2n]) };
+    expect(column_max(ts, 3)).toBe(9n);
+    let nulls = { ...col, offset: 3, null_bitmap: new Uint8Array([0]) };
+    expect(column_max(nulls, 2)).toBeNull();
+    expect(column_max({ type_id: ChunkType.Utf8, offset: 0, values: new Uint8Array(4) }, 1)).toBeNull();
+    expect(later_mark(null, 7)).toBe(7);
+    expect(later_mark(9n, 5n)).toBe(9n);
+  });
+
+  it("writes marks as literals of the key's type", () => {
+    expect(mark_literal(ChunkType.Float, 0, 2999)).toBe("2999");
+    expect(mark_literal(ChunkType.Date, 0, 19000)).toBe("DATE '1970-01-01' + 19000");
+    expect(mark_literal(ChunkType.Timestamp, TimeUnit.Millisecond, 1700000000123n)).toBe(
+      "make_timestamp(1700000000123000)",
+    );
+    expect(mark_literal(ChunkType.Timestamp, TimeUnit.Nanosecond, 1n)).toBeNull();
+    expect(mark_literal(ChunkType.Dict, 0, 1)).toBeNull();
+    expect(refresh_sql("select * from ticks order by seq; \n", 'seq"no', "2999")).toBe(
+      'select * from (select * from ticks order by seq) where "seq""no" > 2999',
+    );
+  });
+});